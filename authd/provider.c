@@ -89,7 +89,7 @@ set_provider_done(struct auth_client *auth, uint32_t provider)
 void
 init_providers(void)
 {
-	auth_clients = rb_dictionary_create("pending auth clients", rb_uint32cmp);
+	auth_clients = rb_dictionary_create_hashed("pending auth clients", rb_uint32cmp, rb_dictionary_uint32_hash);
 	timeout_ev = rb_event_addish("provider_timeout_event", provider_timeout_event, NULL, 1);
 
 	/* FIXME must be started before rdns/ident to receive completion notification from them */
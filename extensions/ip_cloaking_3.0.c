@@ -67,6 +67,7 @@ distribute_hostchange(struct Client *client_p, char *newhost)
 		SetDynSpoof(client_p);
 	else
 		ClearDynSpoof(client_p);
+	invalidate_client_matchset(client_p);
 }
 
 #define Nval 0x8c3a48ac
@@ -229,4 +230,5 @@ check_new_user(void *vdata)
 		if (irccmp(source_p->host, source_p->orighost))
 			SetDynSpoof(source_p);
 	}
+	invalidate_client_matchset(source_p);
 }
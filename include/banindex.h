@@ -0,0 +1,32 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  banindex.h: Compiled ban, quiet and exception lists of a channel.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#ifndef INCLUDED_banindex_h
+#define INCLUDED_banindex_h
+
+struct Ban;
+struct Channel;
+struct Client;
+struct matchset;
+
+struct Ban *banindex_find(struct Channel *chptr, rb_dlink_list *list,
+			  struct Client *who, const struct matchset *ms, long mode_type);
+void banindex_free(struct Channel *chptr);
+
+#endif
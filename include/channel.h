@@ -77,6 +77,10 @@ struct Channel
 	time_t channelts;
 	char *chname;
 
+	struct ChannelBanIndex *ban_index;	/* see banindex.c */
+	rb_dlink_node refresh_node;	/* in the ban refresh queue */
+	rb_dlink_node *refresh_next;	/* next local member to refresh */
+
 	struct Client *last_checked_client;
 	time_t last_checked_ts;
 	unsigned int last_checked_type;
@@ -96,6 +100,16 @@ struct membership
 	time_t bants;
 };
 
+/* the members of a channel at some point, for replies that are sent
+ * bit by bit (see safelist.c)
+ */
+struct MemberSnapshot
+{
+	char chname[CHANNELLEN + 1];
+	char *ids;		/* IDLEN bytes each */
+	size_t count, pos;
+};
+
 #define BANLEN 195
 struct Ban
 {
@@ -230,6 +244,7 @@ extern void add_user_to_channel(struct Channel *, struct Client *, int flags);
 extern void remove_user_from_channel(struct membership *);
 extern void remove_user_from_channels(struct Client *);
 extern void invalidate_bancache_user(struct Client *);
+extern void invalidate_bancache_channel(struct Channel *);
 
 extern void free_channel_list(rb_dlink_list *);
 
@@ -237,6 +252,12 @@ extern bool check_channel_name(const char *name);
 
 extern void channel_member_names(struct Channel *chptr, struct Client *,
 				 int show_eon);
+extern void stream_channel_member_names(struct Channel *chptr, struct Client *);
+
+extern void snapshot_channel_members(struct MemberSnapshot *snap, struct Channel *chptr,
+				     rb_dlink_node *ptr);
+extern struct membership *next_snapshot_member(struct MemberSnapshot *snap);
+extern void free_member_snapshot(struct MemberSnapshot *snap);
 
 extern void del_invite(struct Channel *chptr, struct Client *who);
 
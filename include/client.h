@@ -61,6 +61,9 @@ struct Server;
 struct LocalUser;
 struct PreClient;
 struct ListClient;
+struct ServerBurst;
+struct UserIndexEntry;
+struct matchset;
 struct scache_entry;
 struct ws_ctl;
 
@@ -78,6 +81,7 @@ struct User
 
 	char *opername; /* name of operator{} block being used or tried (challenge) */
 	struct PrivilegeSet *privset;
+	struct UserIndexEntry *index_entry;	/* see userindex.c */
 
 	char suser[NICKLEN+1];
 };
@@ -124,6 +128,7 @@ struct Client
 	unsigned short status;	/* Client type */
 	unsigned char handler;	/* Handler index */
 	unsigned long serial;	/* used to enforce 1 send per nick */
+	uint64_t list_order;	/* position on global_client_list, see userindex.c */
 
 	/* client->name is the unique name for a client nick or host */
 	char name[NAMELEN + 1];
@@ -190,6 +195,7 @@ struct LocalUser
 	/* Send and receive linebuf queues .. */
 	buf_head_t buf_sendq;
 	buf_head_t buf_recvq;
+	rb_dlink_node dirty_node;	/* node for the deferred flush list */
 
 	/*
 	 * we want to use unsigned int here so the sizes have a better chance of
@@ -267,10 +273,13 @@ struct LocalUser
 	time_t ratelimit;
 	unsigned int join_who_credits;
 
-	struct ListClient *safelist_data;
+	rb_dlink_list safelist_jobs;	/* replies still being sent, see safelist.c */
+	struct ServerBurst *burst;	/* netburst still being generated for this link */
+	struct ClientIndexEntry *index_entry;	/* see clientindex.c */
 
 	char *mangledhost; /* non-NULL if host mangling module loaded and
 			      applicable to this client */
+	struct matchset *matchset;	/* cached ban masks, see client_matchset() */
 
 	struct _ssl_ctl *ssl_ctl;		/* which ssl daemon we're associate with */
 	struct _ssl_ctl *z_ctl;			/* second ctl for ssl+zlib */
@@ -325,6 +334,22 @@ struct ListClient
 	int operspy;
 };
 
+struct ServerBurst
+{
+	char (*uids)[IDLEN];	/* users present when the link was established */
+	size_t nuids, upos;
+	char **chnames;		/* likewise for channels */
+	size_t nchans, cpos;
+	buf_head_t holdq;	/* live traffic queued behind the burst */
+	struct timeval start;
+	unsigned long lines;
+	unsigned long long bytes;
+	struct ev_entry *ev;
+	bool direct;		/* let sends bypass holdq (burst hooks) */
+	bool replying;		/* likewise, while parsing a line from the link */
+	bool running;
+};
+
 /*
  * status macros.
  */
@@ -437,6 +462,8 @@ struct ListClient
 #define LFLAGS_CORK		0x00000004
 #define LFLAGS_SCTP		0x00000008
 #define LFLAGS_INSECURE	0x00000010	/* for marking SSL clients as insecure before registration */
+#define LFLAGS_SENDQ_DIRTY	0x00000020	/* sendq is waiting for the deferred flush pass */
+#define LFLAGS_SSL_HANDSHAKE	0x00000040	/* ssld is still doing the TLS handshake */
 
 /* umodes, settable flags */
 /* lots of this moved to snomask -- jilles */
@@ -513,6 +540,14 @@ struct ListClient
 #define SetInsecure(x)		((x)->localClient->localflags |= LFLAGS_INSECURE)
 #define ClearInsecure(x)	((x)->localClient->localflags &= ~LFLAGS_INSECURE)
 
+#define IsSendqDirty(x)		((x)->localClient->localflags & LFLAGS_SENDQ_DIRTY)
+#define SetSendqDirty(x)	((x)->localClient->localflags |= LFLAGS_SENDQ_DIRTY)
+#define ClearSendqDirty(x)	((x)->localClient->localflags &= ~LFLAGS_SENDQ_DIRTY)
+
+#define IsSSLHandshake(x)	((x)->localClient->localflags & LFLAGS_SSL_HANDSHAKE)
+#define SetSSLHandshake(x)	((x)->localClient->localflags |= LFLAGS_SSL_HANDSHAKE)
+#define ClearSSLHandshake(x)	((x)->localClient->localflags &= ~LFLAGS_SSL_HANDSHAKE)
+
 /* oper flags */
 #define MyOper(x)               (MyConnect(x) && IsOper(x))
 
@@ -582,6 +617,7 @@ extern void check_banned_lines(void);
 extern void check_klines(void);
 extern void check_one_kline(struct ConfItem *kline);
 extern void check_dlines(void);
+extern void check_one_dline(struct ConfItem *dline);
 extern void check_xlines(void);
 extern void resv_nick_fnc(const char *mask, const char *reason, int temp_time);
 
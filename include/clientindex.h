@@ -0,0 +1,30 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  clientindex.h: Index of local clients by address and hostname.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#ifndef INCLUDED_clientindex_h
+#define INCLUDED_clientindex_h
+
+struct Client;
+
+void init_client_index(void);
+void client_index_add(struct Client *client_p);
+void client_index_del(struct Client *client_p);
+bool client_index_find(const char *mask, rb_dlink_list *list);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ *  charybdis: an advanced ircd.
+ *  cmdhash.h: The perfect hash for the core command verbs.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef INCLUDED_cmdhash_h
+#define INCLUDED_cmdhash_h
+
+/*
+ * parse() finds the verbs below through a perfect hash of their first
+ * two and last characters and their length, see ircd/parse.c.
+ *
+ * CMD_FAST_MULT is generated: after changing CMD_FAST_VERBS, run
+ * tools/mkcmdhash, which checks the current multiplier and searches for
+ * a new one if two verbs share a slot.
+ */
+#define CMD_FAST_BITS	7
+#define CMD_FAST_MULT	0x0a436681U
+
+#define CMD_FAST_VERBS \
+	"PRIVMSG", "NOTICE", "PING", "PONG", "JOIN", "PART", "MODE", "WHO", \
+	"WHOIS", "NICK", "QUIT", "TOPIC", "AWAY", "CAP", "USER", "KICK", \
+	"INVITE", "NAMES", "ISON", "USERHOST", "MONITOR", "AUTHENTICATE", \
+	"LIST", "SJOIN", "TMODE", "UID", "EUID", "BMASK", "ENCAP", "SID", \
+	"SQUIT", "KILL", "SAVE", "TB", "ETB", "CHGHOST", "MLOCK", "SERVER", \
+	"PASS", "CAPAB", "SVINFO", "ERROR"
+
+static inline unsigned int
+cmd_fast_hash_mult(const char *cmd, size_t len, uint32_t mult)
+{
+	const unsigned char *s = (const unsigned char *)cmd;
+	uint32_t key;
+
+	/* & 0xdf folds ASCII case, which is all rb_strcasecmp() cares about */
+	key = (s[0] & 0xdf) | (s[1] & 0xdf) << 8 | (s[len - 1] & 0xdf) << 16 | (uint32_t)len << 24;
+	return (key * mult) >> (32 - CMD_FAST_BITS);
+}
+
+#endif /* INCLUDED_cmdhash_h */
@@ -69,6 +69,7 @@ extern uint32_t fnv_hash_upper(const unsigned char *s, int bits);
 extern uint32_t fnv_hash(const unsigned char *s, int bits);
 extern uint32_t fnv_hash_len(const unsigned char *s, int bits, int len);
 extern uint32_t fnv_hash_upper_len(const unsigned char *s, int bits, int len);
+extern uint32_t irccase_hash(const void *key);
 
 extern void init_hash(void);
 
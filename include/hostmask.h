@@ -35,6 +35,7 @@ enum
 
 int parse_netmask(const char *, struct rb_sockaddr_storage *, int *);
 int parse_netmask_strict(const char *, struct rb_sockaddr_storage *, int *);
+const char *get_mask_anchor(const char *);
 struct ConfItem *find_conf_by_address(const char *host, const char *sockhost,
 				      const char *orighost, struct sockaddr *,
 				      int, int, const char *, const char *);
@@ -61,11 +62,10 @@ void report_auth(struct Client *);
 int match_ipv6(struct sockaddr *, struct sockaddr *, int);
 int match_ipv4(struct sockaddr *, struct sockaddr *, int);
 
-/* Hashtable stuff... */
-#define ATABLE_SIZE 0x1000 /* 2^12 */
-#define ATABLE_BITS (32-12)
+struct HostNode;
 
-extern struct AddressRec *atable[ATABLE_SIZE];
+/* all address records, for reporting them */
+extern rb_dlink_list address_conf_list;
 
 struct AddressRec
 {
@@ -99,8 +99,14 @@ struct AddressRec
 	const char *auth_user;
 	struct ConfItem *aconf;
 
-	/* The next record in this hash bucket. */
+	/* The next record in this patricia or hostname trie node. */
 	struct AddressRec *next;
+	/* The patricia node holding IP masks. */
+	rb_patricia_node_t *pnode;
+	/* The trie node holding hostname masks. */
+	struct HostNode *hnode;
+	/* Node in address_conf_list. */
+	rb_dlink_node lnode;
 };
 
 
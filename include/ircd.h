@@ -75,6 +75,7 @@ extern bool opers_see_all_users; /* sno_farconnect.so loaded, operspy without
 
 extern struct Client me;
 extern rb_dlink_list global_client_list;
+extern uint64_t global_client_order;
 extern struct Client *local[];
 extern struct Counter Count;
 extern int default_server_capabs;
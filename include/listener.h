@@ -40,6 +40,9 @@ struct Listener
 	int defer_accept;	/* use TCP_DEFER_ACCEPT */
 	bool sctp;		/* use SCTP */
 	int wsock;		/* wsock listener */
+	uint32_t id;		/* names it to wsockd */
+	uint64_t ws_deflate_plain;	/* permessage-deflate bytes before compression */
+	uint64_t ws_deflate_wire;	/* and after */
 	struct rb_sockaddr_storage addr[2];
 	char vhost[(HOSTLEN * 2) + 1];	/* virtual name of listener */
 };
@@ -51,5 +54,6 @@ extern void close_listeners(void);
 extern const char *get_listener_name(const struct Listener *listener);
 extern void show_ports(struct Client *client);
 extern void free_listener(struct Listener *);
+extern struct Listener *find_listener_id(uint32_t id);
 
 #endif /* INCLUDED_listener_h */
@@ -0,0 +1,36 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  maskset.h: Match a string against many wildcard masks at once.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#ifndef INCLUDED_maskset_h
+#define INCLUDED_maskset_h
+
+/* mask syntax */
+#define MASKSET_MATCH		0	/* match(): '*' and '?' */
+#define MASKSET_MATCH_ESC	1	/* match_esc(): also '@', '#' and '\' */
+
+struct MaskSet;
+
+struct MaskSet *maskset_create(int syntax);
+void maskset_destroy(struct MaskSet *set);
+void maskset_clear(struct MaskSet *set);
+void maskset_add(struct MaskSet *set, const char *mask, void *data);
+void *maskset_find(struct MaskSet *set, const char *name);
+int maskset_size(const struct MaskSet *set);
+
+#endif
@@ -43,6 +43,23 @@ extern int match_esc(const char *mask, const char *name);
 extern int match_cidr(const char *mask, const char *name);
 extern int match_ips(const char *mask, const char *name);
 
+/*
+ * match_compile - compile a mask to match many names against
+ * match_compiled - returns 1 if the compiled mask matches name, 0 otherwise
+ * match_free - frees a compiled mask, NULL is ignored
+ *
+ * match(), mask_match() and match_esc() compile their mask on every call.
+ */
+#define MATCH_GLOB	0	/* match() */
+#define MATCH_MASK	1	/* mask_match() */
+#define MATCH_ESC	2	/* match_esc() */
+
+struct match_pattern;
+
+extern struct match_pattern *match_compile(const char *mask, int syntax);
+extern int match_compiled(const struct match_pattern *pat, const char *name);
+extern void match_free(struct match_pattern *pat);
+
 /*
  * comp_with_mask - compares to IP address
  */
@@ -67,6 +84,8 @@ struct matchset {
 struct Client;
 
 void matchset_for_client(struct Client *who, struct matchset *m);
+const struct matchset *client_matchset(struct Client *who);
+void invalidate_client_matchset(struct Client *who);
 bool client_matches_mask(struct Client *who, const char *mask);
 bool matches_mask(const struct matchset *m, const char *mask);
 
@@ -28,5 +28,6 @@
 extern PF read_packet;
 extern EVH flood_recalc;
 extern void flood_endgrace(struct Client *);
+extern void parse_client_queued(struct Client *);
 
 #endif /* INCLUDED_packet_h */
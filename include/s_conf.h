@@ -245,6 +245,7 @@ struct config_file_entry
 
 	int hide_opers_in_whois;
 	int hide_opers;
+	int deferred_flush;
 
 	char *drain_reason;
 };
@@ -275,6 +276,7 @@ struct config_channel_entry
 	int displayed_usercount;
 	int strip_topic_colors;
 	int opmod_send_statusmsg;
+	int ban_refresh;
 };
 
 struct config_server_hide
@@ -300,8 +302,13 @@ struct server_info
 	char *ssl_cert;
 	char *ssl_dh_params;
 	char *ssl_cipher_list;
+	int ssl_ktls;
 	int ssld_count;
 	int wsockd_count;
+	int wsock_deflate;
+	int wsock_deflate_context_takeover;
+	int wsock_deflate_memory;
+	int wsock_pack_lines;
 };
 
 struct admin_info
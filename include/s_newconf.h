@@ -57,6 +57,8 @@ extern struct _rb_patricia_tree_t *tgchange_tree;
 extern void init_s_newconf(void);
 extern void clear_s_newconf(void);
 extern void clear_s_newconf_bans(void);
+extern void xline_conf_changed(void);
+extern void resv_conf_changed(void);
 
 typedef struct
 {
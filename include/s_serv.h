@@ -141,6 +141,8 @@ extern void try_connections(void *unused);
 
 extern int check_server(const char *name, struct Client *server);
 extern int server_estab(struct Client *client_p);
+extern void burst_continue(struct Client *client_p);
+extern void burst_abort(struct Client *client_p);
 
 extern int serv_connect(struct server_conf *, struct Client *);
 
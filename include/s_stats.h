@@ -66,6 +66,17 @@ struct ServerStatistics
 	unsigned int is_sbad;	/* failed sasl authentications */
 	unsigned int is_tgch;	/* messages blocked due to target change */
 	unsigned int is_rl;     /* commands blocked due to ratelimit */
+	unsigned long long int is_sqw;	/* sendq write calls */
+	unsigned long long int is_sqwb;	/* bytes written by sendq write calls */
+	unsigned long long int is_sqdf;	/* sends deferred to the flush pass */
+	unsigned long long int is_sqco;	/* deferred sends merged into an already pending flush */
+	unsigned long long int is_bst;	/* netbursts sent */
+	unsigned long long int is_bstl;	/* lines sent in netbursts */
+	unsigned long long int is_bstb;	/* bytes sent in netbursts */
+	unsigned long long int is_bstt;	/* msec spent sending netbursts */
+	unsigned long long int is_bch;	/* cached channel ban results used */
+	unsigned long long int is_bcm;	/* channel bans rechecked on send */
+	unsigned long long int is_bcr;	/* channel bans rechecked in the background */
 };
 
 extern struct ServerStatistics ServerStats;
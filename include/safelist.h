@@ -0,0 +1,42 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  safelist.h: Replies generated as the client's sendq drains.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#ifndef INCLUDED_safelist_h
+#define INCLUDED_safelist_h
+
+struct Client;
+
+/* sends more of the reply, returns true once all of it has been sent */
+typedef bool (*safelist_step_cb)(struct Client *client_p, void *data);
+/* sends the end of the reply unless aborted, and frees data */
+typedef void (*safelist_done_cb)(struct Client *client_p, void *data, bool aborted);
+
+extern bool safelist_sendq_exceeded(struct Client *client_p);
+extern bool safelist_busy(struct Client *client_p);
+extern bool safelist_holds_input(struct Client *client_p);
+extern bool safelist_pending(struct Client *client_p, safelist_step_cb step);
+
+extern void safelist_start(struct Client *client_p, safelist_step_cb step,
+		safelist_done_cb done, void *data, bool hold_input);
+extern void safelist_cancel(struct Client *client_p, safelist_step_cb step);
+extern void safelist_cancel_all(safelist_step_cb step);
+extern void safelist_continue(struct Client *client_p);
+extern void safelist_abort(struct Client *client_p);
+
+#endif
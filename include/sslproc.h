@@ -34,13 +34,14 @@ enum ssld_status {
 void init_ssld(void);
 void restart_ssld(void);
 int start_ssldaemon(int count);
-ssl_ctl_t *start_ssld_accept(rb_fde_t *sslF, rb_fde_t *plainF, uint32_t id);
+ssl_ctl_t *start_ssld_accept(rb_fde_t *sslF, rb_fde_t *plainF, uint32_t id, bool handoff);
 ssl_ctl_t *start_ssld_connect(rb_fde_t *sslF, rb_fde_t *plainF, uint32_t id);
 void start_zlib_session(void *data);
 void ssld_update_config(void);
+void ssld_handshake_done(struct Client *client_p);
 void ssld_decrement_clicount(ssl_ctl_t *ctl);
 int get_ssld_count(void);
-void ssld_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum ssld_status status, const char *version), void *data);
+void ssld_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, int handshakes, unsigned long handshakes_total, unsigned long resumed_total, enum ssld_status status, const char *version), void *data);
 
 #endif
 
@@ -0,0 +1,38 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  userindex.h: Trigram index of users for mask searches.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#ifndef INCLUDED_userindex_h
+#define INCLUDED_userindex_h
+
+struct Client;
+
+/* a mask a user has to match, syntax is MATCH_GLOB or MATCH_ESC */
+struct UserIndexMask
+{
+	const char *mask;
+	int syntax;
+};
+
+void init_user_index(void);
+void user_index_add(struct Client *client_p);
+void user_index_del(struct Client *client_p);
+void user_index_update(struct Client *client_p);
+bool user_index_find(const struct UserIndexMask *masks, int nmasks, rb_dlink_list *list);
+
+#endif
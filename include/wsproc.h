@@ -35,7 +35,8 @@ enum wsockd_status {
 void init_wsockd(void);
 void restart_wsockd(void);
 int start_wsockd(int count);
-ws_ctl_t *start_wsockd_accept(rb_fde_t *wsF, rb_fde_t *plainF, uint32_t id);
+ws_ctl_t *start_wsockd_accept(rb_fde_t *wsF, rb_fde_t *plainF, uint32_t id, uint32_t listener_id);
+void wsockd_update_config(void);
 void wsockd_decrement_clicount(ws_ctl_t *ctl);
 int get_wsockd_count(void);
 void wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status), void *data);
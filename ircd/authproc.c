@@ -117,7 +117,7 @@ start_authd(void)
 	}
 
 	if(cid_clients == NULL)
-		cid_clients = rb_dictionary_create("authd cid to uid mapping", rb_uint32cmp);
+		cid_clients = rb_dictionary_create_hashed("authd cid to uid mapping", rb_uint32cmp, rb_dictionary_uint32_hash);
 
 	if(timeout_ev == NULL)
 		timeout_ev = rb_event_addish("timeout_dead_authd_clients", timeout_dead_authd_clients, NULL, 1);
@@ -493,6 +493,7 @@ authd_read_client(struct Client *client_p)
 	 * Above comment was originally in s_auth.c, but moved here with below code.
 	 * --Elizafox
 	 */
+	client_p->list_order = ++global_client_order;
 	rb_dlinkAddTail(client_p, &client_p->node, &global_client_list);
 	read_packet(client_p->localClient->F, client_p);
 }
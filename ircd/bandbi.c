@@ -356,7 +356,10 @@ bandb_handle_finish(void)
 
 		case CONF_XLINE:
 			if(bandb_check_xline(aconf))
+			{
 				rb_dlinkAddAlloc(aconf, &xline_conf_list);
+				xline_conf_changed();
+			}
 			else
 				free_conf(aconf);
 
@@ -372,7 +375,10 @@ bandb_handle_finish(void)
 
 		case CONF_RESV_NICK:
 			if(bandb_check_resv_nick(aconf))
+			{
 				rb_dlinkAddAlloc(aconf, &resv_conf_list);
+				resv_conf_changed();
+			}
 			else
 				free_conf(aconf);
 
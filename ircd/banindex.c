@@ -0,0 +1,435 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  banindex.c: Compiled ban, quiet and exception lists of a channel.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "channel.h"
+#include "client.h"
+#include "hash.h"
+#include "match.h"
+#include "maskset.h"
+#include "banindex.h"
+#include "s_assert.h"
+
+/* banindex_find() answers the question the loops in is_banned_list()
+ * used to: which is the first entry of a ban, quiet or exception list
+ * that matches a client, by matches_mask() or match_extban().
+ *
+ * Each list of a channel is compiled, on first use after it changed,
+ * into
+ *  - a hash of the masks whose host part has no wildcards, keyed on
+ *    that host part ("*!*@host.example.com"),
+ *  - a patricia tree per address family of the CIDR masks, as
+ *    match_cidr() reads them ("*!*@192.0.2.0/24"),
+ *  - a mask set of the remaining masks,
+ *  - the extbans, parsed into their type, inversion and argument.
+ * Every structure hands out positions in the list, and the candidates
+ * are still checked with match(), match_cidr() and the extban function;
+ * the lowest position that matches wins, as it did when the list was
+ * walked.  Extbans are only tried while they come before the best match
+ * found so far.
+ *
+ * A compiled list is stale once chptr->bants moves on, see
+ * invalidate_bancache_channel().
+ */
+
+/* shorter lists are just walked */
+#define BANINDEX_MIN	8
+
+#define BANLIST_BAN	0
+#define BANLIST_EXCEPT	1
+#define BANLIST_QUIET	2
+
+struct BanExtban
+{
+	int pos;
+	unsigned char type;
+	bool invert;
+	int arg;		/* offset of the argument in banstr, -1 if none */
+};
+
+struct BanList
+{
+	int nbans;
+	struct Ban **bans;	/* in list order */
+
+	int hashmask;
+	int *hash_head;		/* position + 1 */
+	int *hash_next;
+
+	rb_patricia_tree_t *cidr[2];	/* IPv4, IPv6; node->data is position + 1 */
+	int *cidr_next;
+
+	struct MaskSet *wild;	/* data is position + 1 */
+
+	struct BanExtban *extbans;	/* in list order */
+	int nextbans;
+};
+
+struct ChannelBanIndex
+{
+	time_t bants;
+	struct BanList *lists[3];
+};
+
+static uint32_t
+host_hash(const char *s)
+{
+	uint32_t h = FNV1_32_INIT;
+
+	for(; *s != '\0'; s++)
+	{
+		h ^= irctolower(*s);
+		h += (h<<1) + (h<<4) + (h<<7) + (h << 8) + (h << 24);
+	}
+	return h;
+}
+
+static void
+free_ban_list(struct BanList *bl)
+{
+	int i;
+
+	if(bl == NULL)
+		return;
+
+	for(i = 0; i < 2; i++)
+		if(bl->cidr[i] != NULL)
+			rb_destroy_patricia(bl->cidr[i], NULL);
+
+	maskset_destroy(bl->wild);
+	rb_free(bl->bans);
+	rb_free(bl->hash_head);
+	rb_free(bl->hash_next);
+	rb_free(bl->cidr_next);
+	rb_free(bl->extbans);
+	rb_free(bl);
+}
+
+/* the host part of a mask, if match() can only match it literally */
+static const char *
+literal_host(const char *mask)
+{
+	const char *host = strrchr(mask, '@');
+
+	if(host == NULL || strpbrk(host, "*?") != NULL)
+		return NULL;
+	return host + 1;
+}
+
+/* reads a mask the way match_cidr() does; returns 0 for IPv4, 1 for
+ * IPv6 and -1 if match_cidr() would never match it */
+static int
+parse_cidr(const char *mask, struct rb_sockaddr_storage *addr, int *bits)
+{
+	char ipmask[BUFSIZE];
+	const char *host;
+	char *len;
+	void *ipptr;
+	int aftype;
+
+	host = strrchr(mask, '@');
+	if(host == NULL)
+		return -1;
+	rb_strlcpy(ipmask, host + 1, sizeof(ipmask));
+
+	len = strrchr(ipmask, '/');
+	if(len == NULL)
+		return -1;
+	*len++ = '\0';
+
+	*bits = atoi(len);
+	if(*bits <= 0)
+		return -1;
+
+	memset(addr, 0, sizeof(*addr));
+	if(strchr(ipmask, ':'))
+	{
+		if(*bits > 128)
+			return -1;
+		aftype = AF_INET6;
+		ipptr = &((struct sockaddr_in6 *)addr)->sin6_addr;
+	}
+	else
+	{
+		if(*bits > 32)
+			return -1;
+		aftype = AF_INET;
+		ipptr = &((struct sockaddr_in *)addr)->sin_addr;
+	}
+
+	if(rb_inet_pton(aftype, ipmask, ipptr) <= 0)
+		return -1;
+
+	SET_SS_FAMILY(addr, aftype);
+	return aftype == AF_INET6;
+}
+
+static struct BanList *
+compile_ban_list(rb_dlink_list *list)
+{
+	struct BanList *bl = rb_malloc(sizeof(struct BanList));
+	struct rb_sockaddr_storage addr;
+	struct BanExtban *ext;
+	rb_patricia_node_t *pnode;
+	rb_dlink_node *ptr;
+	struct Ban *banptr;
+	const char *host, *p;
+	int i, fam, bits, size, h;
+
+	bl->nbans = rb_dlink_list_length(list);
+	bl->bans = rb_malloc(bl->nbans * sizeof(struct Ban *));
+
+	for(size = 16; size < bl->nbans * 2; size *= 2)
+		;
+	bl->hashmask = size - 1;
+	bl->hash_head = rb_malloc(size * sizeof(int));
+	bl->hash_next = rb_malloc(bl->nbans * sizeof(int));
+	bl->cidr_next = rb_malloc(bl->nbans * sizeof(int));
+	bl->extbans = rb_malloc(bl->nbans * sizeof(struct BanExtban));
+	bl->wild = maskset_create(MASKSET_MATCH);
+
+	i = 0;
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		banptr = ptr->data;
+		bl->bans[i] = banptr;
+
+		if((host = literal_host(banptr->banstr)) != NULL)
+		{
+			h = host_hash(host) & bl->hashmask;
+			bl->hash_next[i] = bl->hash_head[h];
+			bl->hash_head[h] = i + 1;
+
+			if((fam = parse_cidr(banptr->banstr, &addr, &bits)) >= 0)
+			{
+				if(bl->cidr[fam] == NULL)
+					bl->cidr[fam] = rb_new_patricia(fam ? 128 : 32);
+
+				pnode = make_and_lookup_ip(bl->cidr[fam], (struct sockaddr *)&addr, bits);
+				if(pnode != NULL)
+				{
+					bl->cidr_next[i] = (int)(intptr_t)pnode->data;
+					pnode->data = (void *)(intptr_t)(i + 1);
+				}
+			}
+		}
+		else if(strpbrk(banptr->banstr, "*?") != NULL)
+			maskset_add(bl->wild, banptr->banstr, (void *)(intptr_t)(i + 1));
+
+		/* anything else has no wildcards and no '@', so it matches
+		 * no nick!user@host */
+
+		/* the same parse as match_extban() */
+		if(*banptr->banstr == '$')
+		{
+			ext = &bl->extbans[bl->nextbans++];
+			ext->pos = i;
+
+			p = banptr->banstr + 1;
+			if(*p == '~')
+			{
+				ext->invert = true;
+				p++;
+			}
+			ext->type = irctolower(*p);
+			ext->arg = -1;
+			if(*p != '\0' && p[1] == ':')
+				ext->arg = p + 2 - banptr->banstr;
+		}
+
+		i++;
+	}
+
+	return bl;
+}
+
+static int
+find_in_list(struct BanList *bl, struct Channel *chptr, struct Client *who,
+	     const struct matchset *ms, long mode_type)
+{
+	rb_patricia_node_t *pnodes[RB_PATRICIA_MAXBITS + 1];
+	struct rb_sockaddr_storage addr;
+	struct BanExtban *ext;
+	const char *name, *host;
+	ExtbanFunc f;
+	void *data;
+	int best = bl->nbans;
+	int i, j, n, pos, fam, result;
+
+	for(i = 0; i < ARRAY_SIZE(ms->host) + ARRAY_SIZE(ms->ip); i++)
+	{
+		name = i < ARRAY_SIZE(ms->host) ? ms->host[i] : ms->ip[i - ARRAY_SIZE(ms->host)];
+		if(name[0] == '\0')
+			continue;
+
+		host = strrchr(name, '@');
+		if(host != NULL)
+		{
+			for(pos = bl->hash_head[host_hash(host + 1) & bl->hashmask]; pos != 0;
+					pos = bl->hash_next[pos - 1])
+				if(pos - 1 < best && match(bl->bans[pos - 1]->banstr, name))
+					best = pos - 1;
+		}
+
+		data = maskset_find(bl->wild, name);
+		if(data != NULL && (int)(intptr_t)data - 1 < best)
+			best = (int)(intptr_t)data - 1;
+
+		/* matches_mask() only tries match_cidr() on the addresses */
+		if(i < ARRAY_SIZE(ms->host) || host == NULL)
+			continue;
+
+		memset(&addr, 0, sizeof(addr));
+		if(strchr(host + 1, ':'))
+		{
+			fam = 1;
+			if(rb_inet_pton(AF_INET6, host + 1, &((struct sockaddr_in6 *)&addr)->sin6_addr) <= 0)
+				continue;
+			SET_SS_FAMILY(&addr, AF_INET6);
+		}
+		else
+		{
+			fam = 0;
+			if(rb_inet_pton(AF_INET, host + 1, &((struct sockaddr_in *)&addr)->sin_addr) <= 0)
+				continue;
+			SET_SS_FAMILY(&addr, AF_INET);
+		}
+
+		if(bl->cidr[fam] == NULL)
+			continue;
+
+		n = rb_match_ip_all(bl->cidr[fam], (struct sockaddr *)&addr, pnodes);
+		for(j = 0; j < n; j++)
+			for(pos = (int)(intptr_t)pnodes[j]->data; pos != 0; pos = bl->cidr_next[pos - 1])
+				if(pos - 1 < best && match_cidr(bl->bans[pos - 1]->banstr, name))
+					best = pos - 1;
+	}
+
+	for(i = 0; i < bl->nextbans && bl->extbans[i].pos < best; i++)
+	{
+		ext = &bl->extbans[i];
+
+		/* looked up every time, extban modules come and go */
+		f = extban_table[ext->type];
+		if(f == NULL)
+			continue;
+
+		result = f(ext->arg < 0 ? NULL : bl->bans[ext->pos]->banstr + ext->arg,
+				who, chptr, mode_type);
+		if(ext->invert ? result == EXTBAN_NOMATCH : result == EXTBAN_MATCH)
+		{
+			best = ext->pos;
+			break;
+		}
+	}
+
+	return best;
+}
+
+/* struct Ban *banindex_find(struct Channel *, rb_dlink_list *, struct Client *,
+ *                           const struct matchset *, long)
+ * Input: A channel, its banlist, quietlist or exceptlist, a local client
+ *        and its matchset, the mode type to pass to extbans.
+ * Output: The first entry of the list that matches the client, NULL if
+ *         none does.
+ * Side-effects: The list is compiled if it changed since the last lookup.
+ */
+struct Ban *
+banindex_find(struct Channel *chptr, rb_dlink_list *list,
+	      struct Client *who, const struct matchset *ms, long mode_type)
+{
+	struct ChannelBanIndex *index;
+	struct BanList *bl;
+	struct Ban *banptr;
+	rb_dlink_node *ptr;
+	int which, i, pos;
+
+	if(list == &chptr->banlist)
+		which = BANLIST_BAN;
+	else if(list == &chptr->exceptlist)
+		which = BANLIST_EXCEPT;
+	else if(list == &chptr->quietlist)
+		which = BANLIST_QUIET;
+	else
+		which = -1;
+
+	if(which < 0 || rb_dlink_list_length(list) < BANINDEX_MIN)
+	{
+		RB_DLINK_FOREACH(ptr, list->head)
+		{
+			banptr = ptr->data;
+			if(matches_mask(ms, banptr->banstr))
+				return banptr;
+			if(match_extban(banptr->banstr, who, chptr, mode_type))
+				return banptr;
+		}
+		return NULL;
+	}
+
+	index = chptr->ban_index;
+	if(index == NULL)
+		index = chptr->ban_index = rb_malloc(sizeof(struct ChannelBanIndex));
+
+	if(index->bants != chptr->bants)
+	{
+		for(i = 0; i < 3; i++)
+		{
+			free_ban_list(index->lists[i]);
+			index->lists[i] = NULL;
+		}
+		index->bants = chptr->bants;
+	}
+
+	bl = index->lists[which];
+
+	/* every change to the list should have moved chptr->bants on */
+	if(bl != NULL && bl->nbans != (int)rb_dlink_list_length(list))
+	{
+		s_assert(0);
+		free_ban_list(bl);
+		bl = NULL;
+	}
+
+	if(bl == NULL)
+		bl = index->lists[which] = compile_ban_list(list);
+
+	pos = find_in_list(bl, chptr, who, ms, mode_type);
+	return pos < bl->nbans ? bl->bans[pos] : NULL;
+}
+
+/* void banindex_free(struct Channel *)
+ * Input: A channel.
+ * Output: None.
+ * Side-effects: The compiled lists of the channel are freed.
+ */
+void
+banindex_free(struct Channel *chptr)
+{
+	struct ChannelBanIndex *index = chptr->ban_index;
+	int i;
+
+	if(index == NULL)
+		return;
+
+	for(i = 0; i < 3; i++)
+		free_ban_list(index->lists[i]);
+	rb_free(index);
+	chptr->ban_index = NULL;
+}
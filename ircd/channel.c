@@ -24,6 +24,7 @@
 
 #include "stdinc.h"
 #include "channel.h"
+#include "banindex.h"
 #include "chmode.h"
 #include "client.h"
 #include "hash.h"
@@ -37,7 +38,9 @@
 #include "whowas.h"
 #include "s_conf.h"		/* ConfigFileEntry, ConfigChannel */
 #include "s_newconf.h"
+#include "s_stats.h"
 #include "logger.h"
+#include "safelist.h"
 #include "s_assert.h"
 
 struct config_channel_entry ConfigChannel;
@@ -261,7 +264,11 @@ remove_user_from_channel(struct membership *msptr)
 	rb_dlinkDelete(&msptr->channode, &chptr->members);
 
 	if(client_p->servptr == &me)
+	{
+		if(chptr->refresh_next == &msptr->locchannode)
+			chptr->refresh_next = chptr->refresh_next->next;
 		rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
+	}
 
 	if(!(chptr->mode.mode & MODE_PERMANENT) && rb_dlink_list_length(&chptr->members) <= 0)
 		destroy_channel(chptr);
@@ -296,7 +303,11 @@ remove_user_from_channels(struct Client *client_p)
 		rb_dlinkDelete(&msptr->channode, &chptr->members);
 
 		if(client_p->servptr == &me)
+		{
+			if(chptr->refresh_next == &msptr->locchannode)
+				chptr->refresh_next = chptr->refresh_next->next;
 			rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
+		}
 
 		if(!(chptr->mode.mode & MODE_PERMANENT) && rb_dlink_list_length(&chptr->members) <= 0)
 			destroy_channel(chptr);
@@ -332,6 +343,100 @@ invalidate_bancache_user(struct Client *client_p)
 	}
 }
 
+/* With channel::ban_refresh, a channel whose lists changed is queued,
+ * and every BAN_REFRESH_INTERVAL msec up to BAN_REFRESH_SLICE local
+ * members with a stale cached ban status are rechecked, so that work is
+ * not all done on the send path right after the change.
+ * chptr->refresh_next is the next member due, removing that member
+ * moves it along.
+ */
+#define BAN_REFRESH_SLICE	250
+#define BAN_REFRESH_INTERVAL	20
+
+static rb_dlink_list ban_refresh_list;
+static struct ev_entry *ban_refresh_ev;
+
+static void
+dequeue_ban_refresh(struct Channel *chptr)
+{
+	if(chptr->refresh_node.data == NULL)
+		return;
+
+	rb_dlinkDelete(&chptr->refresh_node, &ban_refresh_list);
+	chptr->refresh_node.data = NULL;
+	chptr->refresh_next = NULL;
+}
+
+static void
+refresh_bans_step(void *unused)
+{
+	struct Channel *chptr;
+	struct membership *msptr;
+	int n = 0;
+
+	ban_refresh_ev = NULL;
+
+	while(ban_refresh_list.head != NULL && n < BAN_REFRESH_SLICE)
+	{
+		chptr = ban_refresh_list.head->data;
+		if(chptr->refresh_next == NULL)
+		{
+			dequeue_ban_refresh(chptr);
+			continue;
+		}
+
+		msptr = chptr->refresh_next->data;
+		chptr->refresh_next = chptr->refresh_next->next;
+
+		/* it spoke in the meantime */
+		if(msptr->bants == chptr->bants)
+			continue;
+
+		/* as can_send() would */
+		if(is_banned(chptr, msptr->client_p, msptr, NULL, NULL) != CHFL_BAN)
+			is_quieted(chptr, msptr->client_p, msptr, NULL);
+
+		ServerStats.is_bcr++;
+		n++;
+	}
+
+	if(ban_refresh_list.head != NULL)
+		ban_refresh_ev = rb_event_addonce_msec("refresh_bans", refresh_bans_step, NULL,
+				BAN_REFRESH_INTERVAL);
+}
+
+/* invalidate_bancache_channel()
+ *
+ * input	- channel whose ban, quiet or exception list changed
+ * output	-
+ * side effects - the cached ban status of every member and the compiled
+ *                lists of the channel are invalidated, local members
+ *                may be queued for a recheck
+ */
+void
+invalidate_bancache_channel(struct Channel *chptr)
+{
+	/* bants must change even if the lists changed before within
+	 * this second */
+	if(rb_current_time() > chptr->bants)
+		chptr->bants = rb_current_time();
+	else
+		chptr->bants++;
+
+	if(!ConfigChannel.ban_refresh || chptr->locmembers.head == NULL)
+		return;
+
+	if(chptr->refresh_node.data == NULL)
+		rb_dlinkAddTail(chptr, &chptr->refresh_node, &ban_refresh_list);
+	chptr->refresh_next = chptr->locmembers.head;
+
+	/* the first pass waits a little, an op often sets several bans
+	 * in a row */
+	if(ban_refresh_ev == NULL)
+		ban_refresh_ev = rb_event_addonce_msec("refresh_bans", refresh_bans_step, NULL,
+				BAN_REFRESH_INTERVAL);
+}
+
 /* check_channel_name()
  *
  * input	- channel name
@@ -398,6 +503,8 @@ destroy_channel(struct Channel *chptr)
 	free_channel_list(&chptr->exceptlist);
 	free_channel_list(&chptr->invexlist);
 	free_channel_list(&chptr->quietlist);
+	banindex_free(chptr);
+	dequeue_ban_refresh(chptr);
 
 	/* Free the topic */
 	free_topic(chptr);
@@ -423,6 +530,47 @@ channel_pub_or_secret(struct Channel *chptr)
 	return ("*");
 }
 
+/* names_add_member()
+ *
+ * input	- client being listed to, RPL_NAMREPLY line being built,
+ *		  length of its prefix and of the line, member to add
+ * output	-
+ * side effects - the line is sent first if the member doesnt fit
+ */
+static void
+names_add_member(struct Client *client_p, char *lbuf, int mlen, int *cur_len,
+		struct membership *msptr, int stack)
+{
+	struct Client *target_p = msptr->client_p;
+
+	if (IsCapable(client_p, CLICAP_USERHOST_IN_NAMES))
+	{
+		/* space, possible "@+" prefix */
+		if (*cur_len + strlen(target_p->name) + strlen(target_p->username) + strlen(target_p->host) + 5 >= BUFSIZE - 5)
+		{
+			lbuf[*cur_len - 1] = '\0';
+			sendto_one(client_p, "%s", lbuf);
+			*cur_len = mlen;
+		}
+
+		*cur_len += sprintf(lbuf + *cur_len, "%s%s!%s@%s ", find_channel_status(msptr, stack),
+				  target_p->name, target_p->username, target_p->host);
+	}
+	else
+	{
+		/* space, possible "@+" prefix */
+		if(*cur_len + strlen(target_p->name) + 3 >= BUFSIZE - 3)
+		{
+			lbuf[*cur_len - 1] = '\0';
+			sendto_one(client_p, "%s", lbuf);
+			*cur_len = mlen;
+		}
+
+		*cur_len += sprintf(lbuf + *cur_len, "%s%s ", find_channel_status(msptr, stack),
+				  target_p->name);
+	}
+}
+
 /* channel_member_names()
  *
  * input	- channel to list, client to list to, show endofnames
@@ -433,12 +581,9 @@ void
 channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eon)
 {
 	struct membership *msptr;
-	struct Client *target_p;
 	rb_dlink_node *ptr;
 	char lbuf[BUFSIZE];
-	char *t;
 	int mlen;
-	int tlen;
 	int cur_len;
 	int is_member;
 	int stack = IsCapable(client_p, CLICAP_MULTI_PREFIX);
@@ -451,47 +596,14 @@ channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eo
 					    me.name, client_p->name,
 					    channel_pub_or_secret(chptr), chptr->chname);
 
-		t = lbuf + cur_len;
-
 		RB_DLINK_FOREACH(ptr, chptr->members.head)
 		{
 			msptr = ptr->data;
-			target_p = msptr->client_p;
 
-			if(IsInvisible(target_p) && !is_member)
+			if(IsInvisible(msptr->client_p) && !is_member)
 				continue;
 
-			if (IsCapable(client_p, CLICAP_USERHOST_IN_NAMES))
-			{
-				/* space, possible "@+" prefix */
-				if (cur_len + strlen(target_p->name) + strlen(target_p->username) + strlen(target_p->host) + 5 >= BUFSIZE - 5)
-				{
-					*(t - 1) = '\0';
-					sendto_one(client_p, "%s", lbuf);
-					cur_len = mlen;
-					t = lbuf + mlen;
-				}
-
-				tlen = sprintf(t, "%s%s!%s@%s ", find_channel_status(msptr, stack),
-						  target_p->name, target_p->username, target_p->host);
-			}
-			else
-			{
-				/* space, possible "@+" prefix */
-				if(cur_len + strlen(target_p->name) + 3 >= BUFSIZE - 3)
-				{
-					*(t - 1) = '\0';
-					sendto_one(client_p, "%s", lbuf);
-					cur_len = mlen;
-					t = lbuf + mlen;
-				}
-
-				tlen = sprintf(t, "%s%s ", find_channel_status(msptr, stack),
-						  target_p->name);
-			}
-
-			cur_len += tlen;
-			t += tlen;
+			names_add_member(client_p, lbuf, mlen, &cur_len, msptr, stack);
 		}
 
 		/* The old behaviour here was to always output our buffer,
@@ -503,7 +615,7 @@ channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eo
 		 */
 		if(cur_len != mlen)
 		{
-			*(t - 1) = '\0';
+			lbuf[cur_len - 1] = '\0';
 			sendto_one(client_p, "%s", lbuf);
 		}
 	}
@@ -513,6 +625,176 @@ channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eo
 			   me.name, client_p->name, chptr->chname);
 }
 
+struct names_stream
+{
+	struct MemberSnapshot snap;
+	char lbuf[BUFSIZE];
+	int mlen;
+	int cur_len;
+	int is_member;
+	int stack;
+};
+
+static bool
+names_stream_step(struct Client *client_p, void *data)
+{
+	struct names_stream *ns = data;
+	struct membership *msptr;
+
+	while(!safelist_sendq_exceeded(client_p))
+	{
+		if((msptr = next_snapshot_member(&ns->snap)) == NULL)
+			return true;
+
+		if(IsInvisible(msptr->client_p) && !ns->is_member)
+			continue;
+
+		names_add_member(client_p, ns->lbuf, ns->mlen, &ns->cur_len, msptr, ns->stack);
+	}
+
+	return false;
+}
+
+static void
+names_stream_done(struct Client *client_p, void *data, bool aborted)
+{
+	struct names_stream *ns = data;
+
+	if(!aborted)
+	{
+		if(ns->cur_len != ns->mlen)
+		{
+			ns->lbuf[ns->cur_len - 1] = '\0';
+			sendto_one(client_p, "%s", ns->lbuf);
+		}
+
+		sendto_one(client_p, form_str(RPL_ENDOFNAMES),
+			   me.name, client_p->name, ns->snap.chname);
+	}
+
+	free_member_snapshot(&ns->snap);
+	rb_free(ns);
+}
+
+/* stream_channel_member_names()
+ *
+ * input	- channel to list, local client to list to
+ * output	-
+ * side effects - client is given list of users on channel and
+ *		  endofnames, whatever doesnt fit in half its sendq is
+ *		  sent as that drains
+ */
+void
+stream_channel_member_names(struct Channel *chptr, struct Client *client_p)
+{
+	struct names_stream *ns;
+	rb_dlink_node *ptr;
+
+	if(!ShowChannel(client_p, chptr))
+	{
+		sendto_one(client_p, form_str(RPL_ENDOFNAMES),
+			   me.name, client_p->name, chptr->chname);
+		return;
+	}
+
+	ns = rb_malloc(sizeof(struct names_stream));
+	ns->is_member = IsMember(client_p, chptr);
+	ns->stack = IsCapable(client_p, CLICAP_MULTI_PREFIX);
+	ns->cur_len = ns->mlen = sprintf(ns->lbuf, form_str(RPL_NAMREPLY),
+				    me.name, client_p->name,
+				    channel_pub_or_secret(chptr), chptr->chname);
+
+	/* send what fits straight from the member list, unless another
+	 * reply is still going
+	 */
+	ptr = chptr->members.head;
+	if(!safelist_busy(client_p))
+	{
+		for(; ptr != NULL; ptr = ptr->next)
+		{
+			struct membership *msptr = ptr->data;
+
+			if(safelist_sendq_exceeded(client_p))
+				break;
+
+			if(IsInvisible(msptr->client_p) && !ns->is_member)
+				continue;
+
+			names_add_member(client_p, ns->lbuf, ns->mlen, &ns->cur_len, msptr, ns->stack);
+		}
+	}
+
+	snapshot_channel_members(&ns->snap, chptr, ptr);
+	safelist_start(client_p, names_stream_step, names_stream_done, ns, true);
+}
+
+/* snapshot_channel_members()
+ *
+ * input	- snapshot to fill in, channel, first member to take
+ * output	-
+ * side effects - the ids of the members from ptr on are copied
+ */
+void
+snapshot_channel_members(struct MemberSnapshot *snap, struct Channel *chptr, rb_dlink_node *ptr)
+{
+	struct membership *msptr;
+	rb_dlink_node *p;
+	size_t n = 0;
+
+	for(p = ptr; p != NULL; p = p->next)
+		n++;
+
+	rb_strlcpy(snap->chname, chptr->chname, sizeof snap->chname);
+	snap->ids = n ? rb_malloc(n * IDLEN) : NULL;
+	snap->count = n;
+	snap->pos = 0;
+
+	for(n = 0, p = ptr; p != NULL; p = p->next, n++)
+	{
+		msptr = p->data;
+		rb_strlcpy(snap->ids + n * IDLEN, use_id(msptr->client_p), IDLEN);
+	}
+}
+
+/* next_snapshot_member()
+ *
+ * input	- snapshot
+ * output	- the membership of the next member in the snapshot that
+ *		  is still on the channel, NULL at the end or if the
+ *		  channel is gone
+ * side effects -
+ */
+struct membership *
+next_snapshot_member(struct MemberSnapshot *snap)
+{
+	struct Channel *chptr;
+	struct Client *target_p;
+	struct membership *msptr;
+
+	if(snap->pos >= snap->count || (chptr = find_channel(snap->chname)) == NULL)
+		return NULL;
+
+	while(snap->pos < snap->count)
+	{
+		target_p = find_id(snap->ids + snap->pos++ * IDLEN);
+		if(target_p == NULL || !IsPerson(target_p))
+			continue;
+
+		if((msptr = find_channel_membership(chptr, target_p)) != NULL)
+			return msptr;
+	}
+
+	return NULL;
+}
+
+void
+free_member_snapshot(struct MemberSnapshot *snap)
+{
+	rb_free(snap->ids);
+	snap->ids = NULL;
+	snap->count = snap->pos = 0;
+}
+
 /* del_invite()
  *
  * input	- channel to remove invite from, client to remove
@@ -539,8 +821,6 @@ is_banned_list(struct Channel *chptr, rb_dlink_list *list,
 	       struct Client *who, struct membership *msptr,
 	       const struct matchset *ms, const char **forward)
 {
-	struct matchset ms_;
-	rb_dlink_node *ptr;
 	struct Ban *actualBan = NULL;
 	struct Ban *actualExcept = NULL;
 
@@ -548,40 +828,25 @@ is_banned_list(struct Channel *chptr, rb_dlink_list *list,
 		return 0;
 
 	if (ms == NULL)
-	{
-		matchset_for_client(who, &ms_);
-		ms = &ms_;
-	}
+		ms = client_matchset(who);
 
-	RB_DLINK_FOREACH(ptr, list->head)
-	{
-		actualBan = ptr->data;
-		if (matches_mask(ms, actualBan->banstr))
-			break;
-		if (match_extban(actualBan->banstr, who, chptr, CHFL_BAN))
-			break;
-		actualBan = NULL;
-	}
+	actualBan = banindex_find(chptr, list, who, ms, CHFL_BAN);
 
 	if ((actualBan != NULL) && ConfigChannel.use_except)
 	{
-		RB_DLINK_FOREACH(ptr, chptr->exceptlist.head)
-		{
-			actualExcept = ptr->data;
+		actualExcept = banindex_find(chptr, &chptr->exceptlist, who, ms, CHFL_BAN);
 
-			/* theyre exempted.. */
-			if (matches_mask(ms, actualExcept->banstr) ||
-					match_extban(actualExcept->banstr, who, chptr, CHFL_BAN))
+		/* theyre exempted.. */
+		if (actualExcept != NULL)
+		{
+			/* cache the fact theyre not banned */
+			if(msptr != NULL)
 			{
-				/* cache the fact theyre not banned */
-				if(msptr != NULL)
-				{
-					msptr->bants = chptr->bants;
-					msptr->flags &= ~CHFL_BANNED;
-				}
-
-				return CHFL_EXCEPTION;
+				msptr->bants = chptr->bants;
+				msptr->flags &= ~CHFL_BANNED;
 			}
+
+			return CHFL_EXCEPTION;
 		}
 	}
 
@@ -679,7 +944,7 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 	rb_dlink_node *invite = NULL;
 	rb_dlink_node *ptr;
 	struct Ban *invex = NULL;
-	struct matchset ms;
+	const struct matchset *ms;
 	int i = 0;
 	hook_data_channel moduledata;
 
@@ -689,9 +954,9 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 	moduledata.chptr = chptr;
 	moduledata.approved = 0;
 
-	matchset_for_client(source_p, &ms);
+	ms = client_matchset(source_p);
 
-	if((is_banned(chptr, source_p, NULL, &ms, forward)) == CHFL_BAN)
+	if((is_banned(chptr, source_p, NULL, ms, forward)) == CHFL_BAN)
 	{
 		moduledata.approved = ERR_BANNEDFROMCHAN;
 		goto finish_join_check;
@@ -721,7 +986,7 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 			RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
 			{
 				invex = ptr->data;
-				if (matches_mask(&ms, invex->banstr) ||
+				if (matches_mask(ms, invex->banstr) ||
 						match_extban(invex->banstr, source_p, chptr, CHFL_INVEX))
 					break;
 			}
@@ -810,12 +1075,17 @@ can_send(struct Channel *chptr, struct Client *source_p, struct membership *mspt
 		/* cached can_send */
 		if(msptr->bants == chptr->bants)
 		{
+			ServerStats.is_bch++;
 			if(can_send_banned(msptr))
 				moduledata.approved = CAN_SEND_NO;
 		}
-		else if(is_banned(chptr, source_p, msptr, NULL, NULL) == CHFL_BAN
-			|| is_quieted(chptr, source_p, msptr, NULL) == CHFL_BAN)
-			moduledata.approved = CAN_SEND_NO;
+		else
+		{
+			ServerStats.is_bcm++;
+			if(is_banned(chptr, source_p, msptr, NULL, NULL) == CHFL_BAN
+				|| is_quieted(chptr, source_p, msptr, NULL) == CHFL_BAN)
+				moduledata.approved = CAN_SEND_NO;
+		}
 	}
 
 	if(is_chanop_voiced(msptr))
@@ -898,12 +1168,12 @@ find_bannickchange_channel(struct Client *client_p)
 	struct Channel *chptr;
 	struct membership *msptr;
 	rb_dlink_node *ptr;
-	struct matchset ms;
+	const struct matchset *ms;
 
 	if (!MyClient(client_p))
 		return NULL;
 
-	matchset_for_client(client_p, &ms);
+	ms = client_matchset(client_p);
 
 	RB_DLINK_FOREACH(ptr, client_p->user->channel.head)
 	{
@@ -914,12 +1184,17 @@ find_bannickchange_channel(struct Client *client_p)
 		/* cached can_send */
 		if (msptr->bants == chptr->bants)
 		{
+			ServerStats.is_bch++;
 			if (can_send_banned(msptr))
 				return chptr;
 		}
-		else if (is_banned(chptr, client_p, msptr, &ms, NULL) == CHFL_BAN
-			|| is_quieted(chptr, client_p, msptr, &ms) == CHFL_BAN)
-			return chptr;
+		else
+		{
+			ServerStats.is_bcm++;
+			if (is_banned(chptr, client_p, msptr, ms, NULL) == CHFL_BAN
+				|| is_quieted(chptr, client_p, msptr, ms) == CHFL_BAN)
+				return chptr;
+		}
 	}
 	return NULL;
 }
@@ -43,6 +43,9 @@
 #include "s_user.h"
 #include "hash.h"
 #include "hostmask.h"
+#include "clientindex.h"
+#include "userindex.h"
+#include "safelist.h"
 #include "listener.h"
 #include "hook.h"
 #include "msg.h"
@@ -120,7 +123,7 @@ init_client(void)
 	rb_event_addish("exit_aborted_clients", exit_aborted_clients, NULL, 1);
 	rb_event_add("flood_recalc", flood_recalc, NULL, 1);
 
-	nd_dict = rb_dictionary_create("nickdelay", irccmp);
+	nd_dict = rb_dictionary_create_hashed("nickdelay", irccmp, irccase_hash);
 }
 
 /*
@@ -285,6 +288,9 @@ free_local_client(struct Client *client_p)
 	}
 
 	client_release_connids(client_p);
+	burst_abort(client_p);
+	safelist_abort(client_p);
+	send_queued_forget(client_p);
 	if(client_p->localClient->F != NULL)
 	{
 		rb_close(client_p->localClient->F);
@@ -301,9 +307,13 @@ free_local_client(struct Client *client_p)
 	rb_free(client_p->localClient->challenge);
 	rb_free(client_p->localClient->fullcaps);
 	rb_free(client_p->localClient->mangledhost);
+	rb_free(client_p->localClient->matchset);
 
 	if (IsSSL(client_p))
+	{
+		ssld_handshake_done(client_p);
 		ssld_decrement_clicount(client_p->localClient->ssl_ctl);
+	}
 
 	rb_free(client_p->localClient->cipher_string);
 
@@ -508,6 +518,52 @@ notify_banned_client(struct Client *client_p, struct ConfItem *aconf, int ban)
 			 ConfigFileEntry.kline_reason);
 }
 
+/* A full check of every client against the ban lists, as after a
+ * rehash, looks at BAN_CHECK_SLICE clients at a time, every
+ * BAN_CHECK_INTERVAL msec, so a large server does not stall and client
+ * i/o gets a turn in between.  ban_check_next is the next client due,
+ * exit_local_client() moves it along if that client goes away.
+ * Clients registering meanwhile were checked against the current bans
+ * already.
+ */
+#define BAN_CHECK_SLICE	1000
+#define BAN_CHECK_INTERVAL	2
+
+static rb_dlink_node *ban_check_next;
+static struct ev_entry *ban_check_ev;
+
+static bool check_dline_client(struct Client *client_p);
+static bool check_kline_client(struct Client *client_p);
+static bool check_xline_client(struct Client *client_p);
+static void check_dlines_unknown(void);
+
+static void
+check_banned_step(void *unused)
+{
+	struct Client *client_p;
+	int n = 0;
+
+	ban_check_ev = NULL;
+
+	while(ban_check_next != NULL && n++ < BAN_CHECK_SLICE)
+	{
+		client_p = ban_check_next->data;
+		ban_check_next = ban_check_next->next;
+
+		if(IsMe(client_p))
+			continue;
+
+		if(check_dline_client(client_p) || check_kline_client(client_p))
+			continue;
+
+		check_xline_client(client_p);
+	}
+
+	if(ban_check_next != NULL)
+		ban_check_ev = rb_event_addonce_msec("check_banned_lines", check_banned_step, NULL,
+						     BAN_CHECK_INTERVAL);
+}
+
 /*
  * check_banned_lines
  * inputs	- NONE
@@ -518,9 +574,45 @@ notify_banned_client(struct Client *client_p, struct ConfItem *aconf, int ban)
 void
 check_banned_lines(void)
 {
-	check_dlines();
-	check_klines();
-	check_xlines();
+	check_dlines_unknown();
+
+	if(ban_check_ev != NULL)
+	{
+		rb_event_delete(ban_check_ev);
+		ban_check_ev = NULL;
+	}
+
+	ban_check_next = lclient_list.head;
+	check_banned_step(NULL);
+}
+
+/* returns true if the client was exited */
+static bool
+check_kline_client(struct Client *client_p)
+{
+	struct ConfItem *aconf;
+
+	if(!IsPerson(client_p))
+		return false;
+
+	if((aconf = find_kline(client_p)) == NULL)
+		return false;
+
+	if(IsExemptKline(client_p))
+	{
+		sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				     "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
+				     get_client_name(client_p, HIDE_IP),
+				     aconf->user, aconf->host);
+		return false;
+	}
+
+	sendto_realops_snomask(SNO_GENERAL, L_ALL,
+			     "KLINE active for %s",
+			     get_client_name(client_p, HIDE_IP));
+
+	notify_banned_client(client_p, aconf, K_LINED);
+	return true;
 }
 
 /* check_klines
@@ -532,39 +624,78 @@ check_banned_lines(void)
 void
 check_klines(void)
 {
-	struct Client *client_p;
-	struct ConfItem *aconf;
 	rb_dlink_node *ptr;
 	rb_dlink_node *next_ptr;
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
 	{
-		client_p = ptr->data;
+		struct Client *client_p = ptr->data;
 
-		if(IsMe(client_p) || !IsPerson(client_p))
+		if(IsMe(client_p))
 			continue;
 
-		if((aconf = find_kline(client_p)) != NULL)
-		{
-			if(IsExemptKline(client_p))
-			{
-				sendto_realops_snomask(SNO_GENERAL, L_ALL,
-						     "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
-						     get_client_name(client_p, HIDE_IP),
-						     aconf->user, aconf->host);
-				continue;
-			}
+		check_kline_client(client_p);
+	}
+}
 
-			sendto_realops_snomask(SNO_GENERAL, L_ALL,
-					     "KLINE active for %s",
-					     get_client_name(client_p, HIDE_IP));
+static void
+check_one_kline_client(struct ConfItem *kline, int masktype,
+		struct rb_sockaddr_storage *sockaddr, int bits, struct Client *client_p)
+{
+	struct sockaddr_in ip4;
+	int matched = 0;
 
-			notify_banned_client(client_p, aconf, K_LINED);
-			continue;
-		}
+	if(IsMe(client_p) || !IsPerson(client_p) || IsAnyDead(client_p))
+		return;
+
+	if(!match(kline->user, client_p->username))
+		return;
+
+	/* match one kline */
+	switch (masktype) {
+	case HM_IPV4:
+	case HM_IPV6:
+		if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
+				IsConfKlineSpoof(client_p->localClient->att_conf))
+			return;
+		if (client_p->localClient->ip.ss_family == AF_INET6 && sockaddr->ss_family == AF_INET &&
+				rb_ipv4_from_ipv6((struct sockaddr_in6 *)&client_p->localClient->ip, &ip4)
+					&& comp_with_mask_sock((struct sockaddr *)&ip4, (struct sockaddr *)sockaddr, bits))
+			matched = 1;
+		else if (client_p->localClient->ip.ss_family == sockaddr->ss_family &&
+				comp_with_mask_sock((struct sockaddr *)&client_p->localClient->ip,
+					(struct sockaddr *)sockaddr, bits))
+			matched = 1;
+		break;
+	case HM_HOST:
+		if (match(kline->host, client_p->orighost))
+			matched = 1;
+		if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
+				IsConfKlineSpoof(client_p->localClient->att_conf))
+			return;
+		if (match(kline->host, client_p->sockhost))
+			matched = 1;
+		break;
+	}
+
+	if (!matched)
+		return;
+
+	if(IsExemptKline(client_p))
+	{
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+					 "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
+					 get_client_name(client_p, HIDE_IP),
+					 kline->user, kline->host);
+		return;
 	}
-}
 
+	sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				 "KLINE active for %s",
+				 get_client_name(client_p, HIDE_IP));
+
+	notify_banned_client(client_p, kline, K_LINED);
+}
 
 /* check_one_kline()
  *
@@ -572,81 +703,79 @@ check_klines(void)
  *
  * inputs       - pointer to kline to check
  * outputs      -
- * side effects - all clients will be checked against given kline
+ * side effects - all clients the kline may match will be checked against it
  */
 void
 check_one_kline(struct ConfItem *kline)
 {
-	struct Client *client_p;
+	rb_dlink_list candidates = { NULL, NULL, 0 };
 	rb_dlink_node *ptr;
 	rb_dlink_node *next_ptr;
 	int masktype;
 	int bits;
 	struct rb_sockaddr_storage sockaddr;
-	struct sockaddr_in ip4;
 
 	masktype = parse_netmask(kline->host, (struct sockaddr_storage *)&sockaddr, &bits);
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
+	if(!client_index_find(kline->host, &candidates))
 	{
-		int matched = 0;
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
+			check_one_kline_client(kline, masktype, &sockaddr, bits, ptr->data);
+		return;
+	}
 
-		client_p = ptr->data;
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, candidates.head)
+	{
+		struct Client *client_p = ptr->data;
 
-		if(IsMe(client_p) || !IsPerson(client_p))
-			continue;
+		rb_dlinkDestroy(ptr, &candidates);
+		check_one_kline_client(kline, masktype, &sockaddr, bits, client_p);
+	}
+}
 
-		if(!match(kline->user, client_p->username))
-			continue;
+/* returns true if the client was exited */
+static bool
+check_dline_client(struct Client *client_p)
+{
+	struct ConfItem *aconf;
 
-		/* match one kline */
-		switch (masktype) {
-		case HM_IPV4:
-		case HM_IPV6:
-			if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
-					IsConfKlineSpoof(client_p->localClient->att_conf))
-				continue;
-			if (client_p->localClient->ip.ss_family == AF_INET6 && sockaddr.ss_family == AF_INET &&
-					rb_ipv4_from_ipv6((struct sockaddr_in6 *)&client_p->localClient->ip, &ip4)
-						&& comp_with_mask_sock((struct sockaddr *)&ip4, (struct sockaddr *)&sockaddr, bits))
-				matched = 1;
-			else if (client_p->localClient->ip.ss_family == sockaddr.ss_family &&
-					comp_with_mask_sock((struct sockaddr *)&client_p->localClient->ip,
-						(struct sockaddr *)&sockaddr, bits))
-				matched = 1;
-			break;
-		case HM_HOST:
-			if (match(kline->host, client_p->orighost))
-				matched = 1;
-			if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
-					IsConfKlineSpoof(client_p->localClient->att_conf))
-				continue;
-			if (match(kline->host, client_p->sockhost))
-				matched = 1;
-			break;
-		}
+	if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) == NULL)
+		return false;
 
-		if (!matched)
-			continue;
+	if(aconf->status & CONF_EXEMPTDLINE)
+		return false;
 
-		if(IsExemptKline(client_p))
-		{
-			sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-						 "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
-						 get_client_name(client_p, HIDE_IP),
-						 kline->user, kline->host);
-			continue;
-		}
+	sendto_realops_snomask(SNO_GENERAL, L_ALL,
+			     "DLINE active for %s",
+			     get_client_name(client_p, HIDE_IP));
 
-		sendto_realops_snomask(SNO_GENERAL, L_ALL,
-					 "KLINE active for %s",
-					 get_client_name(client_p, HIDE_IP));
+	notify_banned_client(client_p, aconf, D_LINED);
+	return true;
+}
+
+/* dlines need to be checked against unknowns too */
+static void
+check_dlines_unknown(void)
+{
+	struct Client *client_p;
+	struct ConfItem *aconf;
+	rb_dlink_node *ptr;
+	rb_dlink_node *next_ptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, unknown_list.head)
+	{
+		client_p = ptr->data;
+
+		if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) != NULL)
+		{
+			if(aconf->status & CONF_EXEMPTDLINE)
+				continue;
 
-		notify_banned_client(client_p, kline, K_LINED);
+			notify_banned_client(client_p, aconf, D_LINED);
+		}
 	}
 }
 
-
 /* check_dlines()
  *
  * inputs       -
@@ -657,7 +786,6 @@ void
 check_dlines(void)
 {
 	struct Client *client_p;
-	struct ConfItem *aconf;
 	rb_dlink_node *ptr;
 	rb_dlink_node *next_ptr;
 
@@ -668,33 +796,69 @@ check_dlines(void)
 		if(IsMe(client_p))
 			continue;
 
-		if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) != NULL)
-		{
-			if(aconf->status & CONF_EXEMPTDLINE)
-				continue;
+		check_dline_client(client_p);
+	}
 
-			sendto_realops_snomask(SNO_GENERAL, L_ALL,
-					     "DLINE active for %s",
-					     get_client_name(client_p, HIDE_IP));
+	check_dlines_unknown();
+}
 
-			notify_banned_client(client_p, aconf, D_LINED);
-			continue;
-		}
+/* check_one_dline()
+ *
+ * inputs       - pointer to dline just added
+ * outputs      -
+ * side effects - all clients inside the dline will be checked for dlines
+ */
+void
+check_one_dline(struct ConfItem *dline)
+{
+	rb_dlink_list candidates = { NULL, NULL, 0 };
+	rb_dlink_node *ptr;
+	rb_dlink_node *next_ptr;
+
+	if(!client_index_find(dline->host, &candidates))
+	{
+		check_dlines();
+		return;
 	}
 
-	/* dlines need to be checked against unknowns too */
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, unknown_list.head)
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, candidates.head)
 	{
-		client_p = ptr->data;
+		struct Client *client_p = ptr->data;
 
-		if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip, GET_SS_FAMILY(&client_p->localClient->ip))) != NULL)
-		{
-			if(aconf->status & CONF_EXEMPTDLINE)
-				continue;
+		rb_dlinkDestroy(ptr, &candidates);
+		if(!IsAnyDead(client_p))
+			check_dline_client(client_p);
+	}
 
-			notify_banned_client(client_p, aconf, D_LINED);
-		}
+	check_dlines_unknown();
+}
+
+/* returns true if the client was exited */
+static bool
+check_xline_client(struct Client *client_p)
+{
+	struct ConfItem *aconf;
+
+	if(!IsPerson(client_p))
+		return false;
+
+	if((aconf = find_xline(client_p->info, 1)) == NULL)
+		return false;
+
+	if(IsExemptKline(client_p))
+	{
+		sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				     "XLINE over-ruled for %s, client is kline_exempt [%s]",
+				     get_client_name(client_p, HIDE_IP),
+				     aconf->host);
+		return false;
 	}
+
+	sendto_realops_snomask(SNO_GENERAL, L_ALL, "XLINE active for %s",
+			     get_client_name(client_p, HIDE_IP));
+
+	(void) exit_client(client_p, client_p, &me, "Bad user info");
+	return true;
 }
 
 /* check_xlines
@@ -706,35 +870,17 @@ check_dlines(void)
 void
 check_xlines(void)
 {
-	struct Client *client_p;
-	struct ConfItem *aconf;
 	rb_dlink_node *ptr;
 	rb_dlink_node *next_ptr;
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
 	{
-		client_p = ptr->data;
+		struct Client *client_p = ptr->data;
 
-		if(IsMe(client_p) || !IsPerson(client_p))
+		if(IsMe(client_p))
 			continue;
 
-		if((aconf = find_xline(client_p->info, 1)) != NULL)
-		{
-			if(IsExemptKline(client_p))
-			{
-				sendto_realops_snomask(SNO_GENERAL, L_ALL,
-						     "XLINE over-ruled for %s, client is kline_exempt [%s]",
-						     get_client_name(client_p, HIDE_IP),
-						     aconf->host);
-				continue;
-			}
-
-			sendto_realops_snomask(SNO_GENERAL, L_ALL, "XLINE active for %s",
-					     get_client_name(client_p, HIDE_IP));
-
-			(void) exit_client(client_p, client_p, &me, "Bad user info");
-			continue;
-		}
+		check_xline_client(client_p);
 	}
 }
 
@@ -810,6 +956,8 @@ resv_nick_fnc(const char *mask, const char *reason, int temp_time)
 			del_from_client_hash(client_p->name, client_p);
 			rb_strlcpy(client_p->name, nick, sizeof(client_p->name));
 			add_to_client_hash(nick, client_p);
+			invalidate_client_matchset(client_p);
+			user_index_update(client_p);
 
 			monitor_signon(client_p);
 
@@ -896,6 +1044,8 @@ remove_client_from_list(struct Client *client_p)
 	if(client_p == NULL)
 		return;
 
+	user_index_del(client_p);
+
 	/* A client made with make_client()
 	 * is on the unknown_list until removed.
 	 * If it =does= happen to exit before its removed from that list
@@ -1611,6 +1761,9 @@ exit_local_client(struct Client *client_p, struct Client *source_p, struct Clien
 	clear_monitor(source_p);
 
 	s_assert(IsPerson(source_p));
+	if(ban_check_next == &source_p->localClient->tnode)
+		ban_check_next = ban_check_next->next;
+	client_index_del(source_p);
 	rb_dlinkDelete(&source_p->localClient->tnode, &lclient_list);
 	rb_dlinkDelete(&source_p->lnode, &me.serv->users);
 
@@ -2090,6 +2243,12 @@ close_connection(struct Client *client_p)
 
 	client_release_connids(client_p);
 
+	/* drop whatever was left of a netburst */
+	burst_abort(client_p);
+	safelist_abort(client_p);
+
+	send_queued_forget(client_p);
+
 	if(client_p->localClient->F != NULL)
 	{
 		/* attempt to flush any pending dbufs. Evil, but .. -- adrian */
@@ -0,0 +1,254 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  clientindex.c: Index of local clients by address and hostname.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "client.h"
+#include "clientindex.h"
+#include "hash.h"
+#include "hostmask.h"
+#include "match.h"
+#include "s_assert.h"
+
+/* Registered local clients are indexed on their IP address, one
+ * patricia tree per family, and on every label aligned suffix of their
+ * orighost and sockhost ("foo.example.com", "example.com", "com").  A
+ * new ban then only looks at the clients inside its CIDR, or under the
+ * literal suffix its hostname mask is anchored on (see
+ * get_mask_anchor()), instead of at every client on the server.
+ *
+ * IPv6 clients with an embedded IPv4 address (6to4, Teredo) are in the
+ * IPv4 tree as well, IPv4 K-lines apply to them.
+ */
+struct HostBucket
+{
+	rb_dlink_list clients;
+	char suffix[];
+};
+
+struct ClientIndexEntry
+{
+	rb_patricia_node_t *pnode[2];	/* IPv4, IPv6 */
+	rb_dlink_node ipnode[2];
+	int nsuffix;
+	struct
+	{
+		struct HostBucket *bucket;
+		rb_dlink_node node;
+	} suffix[];
+};
+
+static rb_patricia_tree_t *client_tree[2];
+static rb_dictionary *host_buckets;
+
+void
+init_client_index(void)
+{
+	client_tree[0] = rb_new_patricia(32);
+	client_tree[1] = rb_new_patricia(128);
+	host_buckets = rb_dictionary_create_hashed("client host suffixes", irccmp, irccase_hash);
+}
+
+static int
+count_labels(const char *host)
+{
+	int n = 1;
+
+	for(; *host != '\0'; host++)
+		if(*host == '.')
+			n++;
+	return n;
+}
+
+static void
+index_ip(struct ClientIndexEntry *entry, int i, struct sockaddr *addr, struct Client *client_p)
+{
+	rb_patricia_node_t *pnode;
+
+	pnode = make_and_lookup_ip(client_tree[i], addr, i == 0 ? 32 : 128);
+	if(pnode == NULL)
+		return;
+
+	if(pnode->data == NULL)
+		pnode->data = rb_malloc(sizeof(rb_dlink_list));
+
+	rb_dlinkAdd(client_p, &entry->ipnode[i], pnode->data);
+	entry->pnode[i] = pnode;
+}
+
+static void
+index_host(struct ClientIndexEntry *entry, const char *host, struct Client *client_p)
+{
+	struct HostBucket *bucket;
+	const char *p;
+	int i;
+
+	for(p = host; p != NULL && *p != '\0'; p = strchr(p, '.'))
+	{
+		if(*p == '.')
+			p++;
+
+		bucket = rb_dictionary_retrieve(host_buckets, p);
+		if(bucket == NULL)
+		{
+			bucket = rb_malloc(sizeof(struct HostBucket) + strlen(p) + 1);
+			strcpy(bucket->suffix, p);
+			rb_dictionary_add(host_buckets, bucket->suffix, bucket);
+		}
+		else
+		{
+			/* orighost and sockhost are often the same */
+			for(i = 0; i < entry->nsuffix; i++)
+				if(entry->suffix[i].bucket == bucket)
+					break;
+			if(i < entry->nsuffix)
+				continue;
+		}
+
+		rb_dlinkAdd(client_p, &entry->suffix[entry->nsuffix].node, &bucket->clients);
+		entry->suffix[entry->nsuffix++].bucket = bucket;
+	}
+}
+
+/* void client_index_add(struct Client *)
+ * Input: A local client that just registered.
+ * Output: None.
+ * Side-effects: The client is indexed on its IP, orighost and sockhost.
+ */
+void
+client_index_add(struct Client *client_p)
+{
+	struct LocalUser *lp = client_p->localClient;
+	struct ClientIndexEntry *entry;
+	struct sockaddr_in ip4;
+	int n;
+
+	s_assert(lp->index_entry == NULL);
+	if(lp->index_entry != NULL)
+		return;
+
+	n = count_labels(client_p->orighost) + count_labels(client_p->sockhost);
+	entry = rb_malloc(sizeof(struct ClientIndexEntry) + n * sizeof(entry->suffix[0]));
+
+	if(GET_SS_FAMILY(&lp->ip) == AF_INET6)
+	{
+		index_ip(entry, 1, (struct sockaddr *)&lp->ip, client_p);
+		if(rb_ipv4_from_ipv6((struct sockaddr_in6 *)&lp->ip, &ip4))
+			index_ip(entry, 0, (struct sockaddr *)&ip4, client_p);
+	}
+	else if(GET_SS_FAMILY(&lp->ip) == AF_INET)
+		index_ip(entry, 0, (struct sockaddr *)&lp->ip, client_p);
+
+	index_host(entry, client_p->orighost, client_p);
+	index_host(entry, client_p->sockhost, client_p);
+
+	lp->index_entry = entry;
+}
+
+/* void client_index_del(struct Client *)
+ * Input: A local client.
+ * Output: None.
+ * Side-effects: The client is removed from the index, if it was in it.
+ */
+void
+client_index_del(struct Client *client_p)
+{
+	struct ClientIndexEntry *entry = client_p->localClient->index_entry;
+	struct HostBucket *bucket;
+	rb_dlink_list *list;
+	int i;
+
+	if(entry == NULL)
+		return;
+
+	for(i = 0; i < 2; i++)
+	{
+		if(entry->pnode[i] == NULL)
+			continue;
+
+		list = entry->pnode[i]->data;
+		rb_dlinkDelete(&entry->ipnode[i], list);
+		if(list->head == NULL)
+		{
+			rb_free(list);
+			rb_patricia_remove(client_tree[i], entry->pnode[i]);
+		}
+	}
+
+	for(i = 0; i < entry->nsuffix; i++)
+	{
+		bucket = entry->suffix[i].bucket;
+		rb_dlinkDelete(&entry->suffix[i].node, &bucket->clients);
+		if(bucket->clients.head == NULL)
+		{
+			rb_dictionary_delete(host_buckets, bucket->suffix);
+			rb_free(bucket);
+		}
+	}
+
+	rb_free(entry);
+	client_p->localClient->index_entry = NULL;
+}
+
+/* bool client_index_find(const char *, rb_dlink_list *)
+ * Input: The host part of a K-line or D-line, a list to fill in.
+ * Output: true if every indexed client the mask can match has been
+ *         added to list (along with some it may not match), false if
+ *         the mask has no literal part to look up and all clients must
+ *         be checked.
+ * Side-effects: list nodes are allocated, free them with rb_dlinkDestroy().
+ */
+bool
+client_index_find(const char *mask, rb_dlink_list *list)
+{
+	struct rb_sockaddr_storage addr;
+	struct HostBucket *bucket;
+	rb_patricia_node_t *top, *pnode;
+	rb_dlink_node *ptr;
+	const char *anchor;
+	int masktype, bits;
+
+	masktype = parse_netmask(mask, &addr, &bits);
+	if(masktype == HM_IPV4 || masktype == HM_IPV6)
+	{
+		top = rb_match_ip_within(client_tree[masktype == HM_IPV6], (struct sockaddr *)&addr, bits);
+		if(top == NULL)
+			return true;
+
+		RB_PATRICIA_WALK(top, pnode)
+		{
+			RB_DLINK_FOREACH(ptr, ((rb_dlink_list *)pnode->data)->head)
+				rb_dlinkAddAlloc(ptr->data, list);
+		}
+		RB_PATRICIA_WALK_END;
+		return true;
+	}
+
+	anchor = get_mask_anchor(mask);
+	if(*anchor == '\0')
+		return false;
+
+	bucket = rb_dictionary_retrieve(host_buckets, anchor);
+	if(bucket != NULL)
+	{
+		RB_DLINK_FOREACH(ptr, bucket->clients.head)
+			rb_dlinkAddAlloc(ptr->data, list);
+	}
+	return true;
+}
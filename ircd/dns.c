@@ -306,8 +306,8 @@ stats_results_callback(int resc, const char *resv[], int status, void *data)
 void
 init_dns(void)
 {
-	query_dict = rb_dictionary_create("dns queries", rb_uint32cmp);
-	stat_dict = rb_dictionary_create("dns stat queries", rb_uint32cmp);
+	query_dict = rb_dictionary_create_hashed("dns queries", rb_uint32cmp, rb_dictionary_uint32_hash);
+	stat_dict = rb_dictionary_create_hashed("dns stat queries", rb_uint32cmp, rb_dictionary_uint32_hash);
 	(void)get_nameservers(stats_results_callback, NULL);
 }
 
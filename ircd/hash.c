@@ -58,7 +58,7 @@ rb_radixtree *hostname_tree = NULL;
 void
 init_hash(void)
 {
-	client_connid_tree = rb_dictionary_create("client connid", rb_uint32cmp);
+	client_connid_tree = rb_dictionary_create_hashed("client connid", rb_uint32cmp, rb_dictionary_uint32_hash);
 	client_id_tree = rb_radixtree_create("client id", NULL);
 	client_name_tree = rb_radixtree_create("client name", irccasecanon);
 
@@ -83,6 +83,13 @@ fnv_hash_upper(const unsigned char *s, int bits)
 	return h;
 }
 
+/* rb_dictionary hash callback matching irccmp() */
+uint32_t
+irccase_hash(const void *key)
+{
+	return fnv_hash_upper((const unsigned char *)key, 32);
+}
+
 uint32_t
 fnv_hash(const unsigned char *s, int bits)
 {
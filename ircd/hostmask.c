@@ -28,12 +28,11 @@
 #include "s_conf.h"
 #include "s_newconf.h"
 #include "hostmask.h"
+#include "hash.h"
 #include "numeric.h"
 #include "send.h"
 #include "match.h"
-
-static unsigned long hash_ipv6(struct sockaddr *, int);
-static unsigned long hash_ipv4(struct sockaddr *, int);
+#include "s_assert.h"
 
 
 static int
@@ -126,98 +125,254 @@ int parse_netmask_strict(const char *mask, struct rb_sockaddr_storage *addr, int
 	return _parse_netmask(mask, addr, blen, true);
 }
 
-/* Hashtable stuff...now external as its used in m_stats.c */
-struct AddressRec *atable[ATABLE_SIZE];
+/* IP masks are kept in a patricia tree per conf type and address family
+ * so a lookup visits exactly the prefixes covering the address.
+ *
+ * Hostname masks are kept in a trie of reversed labels, again one per
+ * conf type: a mask hangs off the node for the literal labels right of
+ * its last wildcard ("*.example.com" off com -> example), so a lookup
+ * only looks at masks anchored on a suffix of the hostname. Masks with
+ * no literal suffix at all ("*", "foo.*") live on the root node and are
+ * tried against every host, and the sockhost.
+ */
+#define ATREE_OTHER	4
+static rb_patricia_tree_t *atree4[ATREE_OTHER + 1];
+static rb_patricia_tree_t *atree6[ATREE_OTHER + 1];
 
-void
-init_host_hash(void)
+struct HostNode
 {
-	memset(&atable, 0, sizeof(atable));
-}
+	struct HostNode *parent;
+	const char *label;		/* not terminated, see len */
+	size_t len;
+	unsigned int children;
+	struct AddressRec *recs;	/* masks anchored here, by precedence */
+};
 
-/* unsigned long hash_ipv4(struct rb_sockaddr_storage*)
- * Input: An IP address.
- * Output: A hash value of the IP address.
- * Side effects: None
- */
-static unsigned long
-hash_ipv4(struct sockaddr *saddr, int bits)
-{
-	struct sockaddr_in *addr = (struct sockaddr_in *)(void *)saddr;
+static struct HostNode host_root[ATREE_OTHER + 1];
+
+/* children of every node, keyed on (parent, label) */
+static rb_dictionary *host_nodes;
+
+/* every address record, in the order they were added */
+rb_dlink_list address_conf_list;
 
-	if(bits != 0)
+static int
+host_node_cmp(const void *a, const void *b)
+{
+	const struct HostNode *x = a, *y = b;
+	size_t i;
+	int c;
+
+	if(x->parent != y->parent)
+		return (uintptr_t)x->parent < (uintptr_t)y->parent ? -1 : 1;
+	if(x->len != y->len)
+		return x->len < y->len ? -1 : 1;
+	for(i = 0; i < x->len; i++)
 	{
-		unsigned long av = ntohl(addr->sin_addr.s_addr) & ~((1 << (32 - bits)) - 1);
-		return (av ^ (av >> 12) ^ (av >> 24)) & (ATABLE_SIZE - 1);
+		c = irctoupper(x->label[i]) - irctoupper(y->label[i]);
+		if(c != 0)
+			return c;
 	}
-
 	return 0;
 }
 
-/* unsigned long hash_ipv6(struct rb_sockaddr_storage*)
- * Input: An IP address.
- * Output: A hash value of the IP address.
- * Side effects: None
- */
-static unsigned long
-hash_ipv6(struct sockaddr *saddr, int bits)
+static uint32_t
+host_node_hash(const void *key)
+{
+	const struct HostNode *node = key;
+	uintptr_t p = (uintptr_t)node->parent;
+
+	return fnv_hash_upper_len((const unsigned char *)node->label, 32, node->len) ^
+		(uint32_t)((p >> 4) * 0x9e3779b1U);
+}
+
+void
+init_host_hash(void)
 {
-	struct sockaddr_in6 *addr = (struct sockaddr_in6 *)(void *)saddr;
-	unsigned long v = 0, n;
-	for (n = 0; n < 16; n++)
+	int i;
+
+	for(i = 0; i <= ATREE_OTHER; i++)
 	{
-		if(bits >= 8)
-		{
-			v ^= addr->sin6_addr.s6_addr[n];
-			bits -= 8;
-		}
-		else if(bits)
-		{
-			v ^= addr->sin6_addr.s6_addr[n] & ~((1 << (8 - bits)) - 1);
-			return v & (ATABLE_SIZE - 1);
-		}
-		else
-			return v & (ATABLE_SIZE - 1);
+		atree4[i] = rb_new_patricia(32);
+		atree6[i] = rb_new_patricia(128);
 	}
-	return v & (ATABLE_SIZE - 1);
+
+	host_nodes = rb_dictionary_create_hashed("hostmask labels", host_node_cmp, host_node_hash);
 }
 
-/* int hash_text(const char *start)
- * Input: The start of the text to hash.
- * Output: The hash of the string between 1 and (TH_MAX-1)
- * Side-effects: None.
- */
 static int
-hash_text(const char *start)
+get_slot(int type)
 {
-	const char *p = start;
-	unsigned long h = 0;
-
-	while(*p)
+	switch(type & ~0x1)
 	{
-		h = (h << 4) - (h + (unsigned char) irctolower(*p++));
+	case CONF_CLIENT:
+		return 0;
+	case CONF_KILL:
+		return 1;
+	case CONF_DLINE:
+		return 2;
+	case CONF_EXEMPTDLINE:
+		return 3;
+	default:
+		return ATREE_OTHER;
 	}
+}
+
+static rb_patricia_tree_t *
+get_atree(int masktype, int type)
+{
+	int slot = get_slot(type);
 
-	return (h & (ATABLE_SIZE - 1));
+	return masktype == HM_IPV6 ? atree6[slot] : atree4[slot];
 }
 
-/* unsigned long get_hash_mask(const char *)
- * Input: The text to hash.
- * Output: The hash of the string right of the first '.' past the last
- *         wildcard in the string.
+/* const char *get_mask_anchor(const char *)
+ * Input: A hostname mask.
+ * Output: The part of the mask right of the first '.' past the last
+ *         wildcard, or the whole mask if there is none.
  * Side-effects: None.
  */
-static unsigned long
-get_mask_hash(const char *text)
+const char *
+get_mask_anchor(const char *text)
 {
 	const char *hp = "", *p;
 
 	for (p = text + strlen(text) - 1; p >= text; p--)
 		if(*p == '*' || *p == '?')
-			return hash_text(hp);
+			return hp;
 		else if(*p == '.')
 			hp = p + 1;
-	return hash_text(text);
+	return text;
+}
+
+static struct HostNode *
+host_node_child(struct HostNode *parent, const char *label, size_t len)
+{
+	struct HostNode key;
+
+	key.parent = parent;
+	key.label = label;
+	key.len = len;
+	return rb_dictionary_retrieve(host_nodes, &key);
+}
+
+/* struct HostNode *get_host_node(const char *, int, bool)
+ * Input: A hostname mask, its conf type, whether to create missing nodes.
+ * Output: The trie node the mask is anchored on, NULL if it does not
+ *         exist and create is false.
+ * Side-effects: None
+ */
+static struct HostNode *
+get_host_node(const char *mask, int type, bool create)
+{
+	struct HostNode *node = &host_root[get_slot(type)], *child;
+	const char *anchor = get_mask_anchor(mask);
+	const char *end, *label;
+	char *copy;
+
+	if(*anchor == '\0')
+		return node;
+
+	end = anchor + strlen(anchor);
+	while(end >= anchor)
+	{
+		for(label = end; label > anchor && label[-1] != '.'; label--)
+			;
+
+		child = host_node_child(node, label, end - label);
+		if(child == NULL)
+		{
+			if(!create)
+				return NULL;
+
+			child = rb_malloc(sizeof(struct HostNode) + (end - label) + 1);
+			copy = (char *)(child + 1);
+			memcpy(copy, label, end - label);
+			child->label = copy;
+			child->len = end - label;
+			child->parent = node;
+			node->children++;
+			rb_dictionary_add(host_nodes, child, child);
+		}
+		node = child;
+		end = label - 1;
+	}
+
+	return node;
+}
+
+/* drop nodes that no longer hold masks or lead to any */
+static void
+prune_host_node(struct HostNode *node)
+{
+	struct HostNode *parent;
+
+	while(node->parent != NULL && node->recs == NULL && node->children == 0)
+	{
+		parent = node->parent;
+		rb_dictionary_delete(host_nodes, node);
+		rb_free(node);
+		parent->children--;
+		node = parent;
+	}
+}
+
+static inline bool
+arec_matches_user(struct AddressRec *arec, int type, const char *username, const char *auth_user)
+{
+	return arec->type == (type & ~0x1) &&
+		(type & 0x1 || match(arec->username, username)) &&
+		(type != CONF_CLIENT || !arec->auth_user ||
+		(auth_user && match(arec->auth_user, auth_user)));
+}
+
+/* void find_host_conf(const char *, const char *, ...)
+ * Input: A hostname, optionally the IP address as text, the lookup
+ *        parameters of find_conf_by_address(), the best match so far.
+ * Output: None
+ * Side-effects: *hprecv and *hprec are updated with any better match.
+ */
+static void
+find_host_conf(const char *host, const char *sockhost, int type,
+		const char *username, const char *auth_user,
+		unsigned long *hprecv, struct ConfItem **hprec)
+{
+	struct HostNode *root = &host_root[get_slot(type)], *node = root;
+	struct AddressRec *arec;
+	const char *end, *label;
+
+	end = host + strlen(host);
+	while(end >= host)
+	{
+		for(label = end; label > host && label[-1] != '.'; label--)
+			;
+
+		node = host_node_child(node, label, end - label);
+		if(node == NULL)
+			break;
+
+		/* each node is sorted by precedence, the first match wins */
+		for (arec = node->recs; arec && arec->precedence > *hprecv; arec = arec->next)
+			if(match(arec->Mask.hostname, host) &&
+			   arec_matches_user(arec, type, username, auth_user))
+			{
+				*hprecv = arec->precedence;
+				*hprec = arec->aconf;
+				break;
+			}
+
+		end = label - 1;
+	}
+
+	for (arec = root->recs; arec && arec->precedence > *hprecv; arec = arec->next)
+		if((match(arec->Mask.hostname, host) ||
+		    (sockhost && match(arec->Mask.hostname, sockhost))) &&
+		   arec_matches_user(arec, type, username, auth_user))
+		{
+			*hprecv = arec->precedence;
+			*hprec = arec->aconf;
+			break;
+		}
 }
 
 /* struct ConfItem* find_conf_by_address(const char*, struct rb_sockaddr_storage*,
@@ -242,7 +397,8 @@ find_conf_by_address(const char *name, const char *sockhost,
 	struct AddressRec *arec;
 	struct sockaddr_in ip4;
 	struct sockaddr *pip4 = NULL;
-	int b;
+	rb_patricia_node_t *pnodes[RB_PATRICIA_MAXBITS + 1];
+	int i, n;
 
 	if(username == NULL)
 		username = "";
@@ -257,128 +413,43 @@ find_conf_by_address(const char *name, const char *sockhost,
 			if (type == CONF_KILL && rb_ipv4_from_ipv6((struct sockaddr_in6 *)addr, &ip4))
 				pip4 = (struct sockaddr *)&ip4;
 
-			for (b = 128; b >= 0; b -= 16)
+			n = rb_match_ip_all(get_atree(HM_IPV6, type), addr, pnodes);
+			for (i = 0; i < n; i++)
 			{
-				for (arec = atable[hash_ipv6(addr, b)]; arec; arec = arec->next)
-					if(arec->type == (type & ~0x1) &&
-					   arec->masktype == HM_IPV6 &&
-					   comp_with_mask_sock(addr, (struct sockaddr *)&arec->Mask.ipa.addr,
-						arec->Mask.ipa.bits) &&
-						(type & 0x1 || match(arec-> username, username)) &&
-						(type != CONF_CLIENT || !arec->auth_user ||
-						(auth_user && match(arec->auth_user, auth_user))) &&
-						arec->precedence > hprecv)
+				/* each node is sorted by precedence, the first match wins */
+				for (arec = pnodes[i]->data; arec && arec->precedence > hprecv; arec = arec->next)
+					if(arec_matches_user(arec, type, username, auth_user))
 					{
 						hprecv = arec->precedence;
 						hprec = arec->aconf;
+						break;
 					}
 			}
 		}
 
 		if (pip4 != NULL)
 		{
-			for (b = 32; b >= 0; b -= 8)
+			n = rb_match_ip_all(get_atree(HM_IPV4, type), pip4, pnodes);
+			for (i = 0; i < n; i++)
 			{
-				for (arec = atable[hash_ipv4(pip4, b)]; arec; arec = arec->next)
-					if(arec->type == (type & ~0x1) &&
-					   arec->masktype == HM_IPV4 &&
-					   comp_with_mask_sock(pip4, (struct sockaddr *)&arec->Mask.ipa.addr,
-							       arec->Mask.ipa.bits) &&
-						(type & 0x1 || match(arec->username, username)) &&
-						(type != CONF_CLIENT || !arec->auth_user ||
-						(auth_user && match(arec->auth_user, auth_user))) &&
-						arec->precedence > hprecv)
+				/* each node is sorted by precedence, the first match wins */
+				for (arec = pnodes[i]->data; arec && arec->precedence > hprecv; arec = arec->next)
+					if(arec_matches_user(arec, type, username, auth_user))
 					{
 						hprecv = arec->precedence;
 						hprec = arec->aconf;
+						break;
 					}
 			}
 		}
 	}
 
 	if(orighost != NULL)
-	{
-		const char *p;
-
-		for (p = orighost; p != NULL;)
-		{
-			for (arec = atable[hash_text(p)]; arec; arec = arec->next)
-
-				if((arec->type == (type & ~0x1)) &&
-				   (arec->masktype == HM_HOST) &&
-				   arec->precedence > hprecv &&
-				   match(arec->Mask.hostname, orighost) &&
-				   (type != CONF_CLIENT || !arec->auth_user ||
-				   (auth_user && match(arec->auth_user, auth_user))) &&
-				   (type & 0x1 || match(arec->username, username)))
-				{
-					hprecv = arec->precedence;
-					hprec = arec->aconf;
-				}
-			p = strchr(p, '.');
-			if(p != NULL)
-				p++;
-			else
-				break;
-		}
-		for (arec = atable[0]; arec; arec = arec->next)
-		{
-			if(arec->type == (type & ~0x1) &&
-			   arec->masktype == HM_HOST &&
-			   arec->precedence > hprecv &&
-			   (match(arec->Mask.hostname, orighost) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
-			    (type != CONF_CLIENT || !arec->auth_user ||
-			    (auth_user && match(arec->auth_user, auth_user))) &&
-			   (type & 0x1 || match(arec->username, username)))
-			{
-				hprecv = arec->precedence;
-				hprec = arec->aconf;
-			}
-		}
-	}
+		find_host_conf(orighost, sockhost, type, username, auth_user, &hprecv, &hprec);
 
 	if(name != NULL)
-	{
-		const char *p;
-		/* And yes - we have to check p after strchr and p after increment for
-		 * NULL -kre */
-		for (p = name; p != NULL;)
-		{
-			for (arec = atable[hash_text(p)]; arec; arec = arec->next)
-				if((arec->type == (type & ~0x1)) &&
-				   (arec->masktype == HM_HOST) &&
-				   arec->precedence > hprecv &&
-				   match(arec->Mask.hostname, name) &&
-				   (type != CONF_CLIENT || !arec->auth_user ||
-				   (auth_user && match(arec->auth_user, auth_user))) &&
-				   (type & 0x1 || match(arec->username, username)))
-				{
-					hprecv = arec->precedence;
-					hprec = arec->aconf;
-				}
-			p = strchr(p, '.');
-			if(p != NULL)
-				p++;
-			else
-				break;
-		}
-		for (arec = atable[0]; arec; arec = arec->next)
-		{
-			if(arec->type == (type & ~0x1) &&
-			   arec->masktype == HM_HOST &&
-			   arec->precedence > hprecv &&
-			   (match(arec->Mask.hostname, name) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
-			    (type != CONF_CLIENT || !arec->auth_user ||
-			    (auth_user && match(arec->auth_user, auth_user))) &&
-			   (type & 0x1 || match(arec->username, username)))
-			{
-				hprecv = arec->precedence;
-				hprec = arec->aconf;
-			}
-		}
-	}
+		find_host_conf(name, sockhost, type, username, auth_user, &hprecv, &hprec);
+
 	return hprec;
 }
 
@@ -487,28 +558,26 @@ struct ConfItem *
 find_exact_conf_by_address(const char *address, int type, const char *username)
 {
 	int masktype, bits;
-	unsigned long hv;
 	struct AddressRec *arec;
 	struct rb_sockaddr_storage addr;
+	rb_patricia_node_t *pnode;
+	struct HostNode *hnode;
 
 	if(address == NULL)
 		address = "/NOMATCH!/";
 	masktype = parse_netmask(address, &addr, &bits);
-	if(masktype == HM_IPV6)
-	{
-		/* We have to do this, since we do not re-hash for every bit -A1kmm. */
-		hv = hash_ipv6((struct sockaddr *)&addr, bits - bits % 16);
-	}
-	else if(masktype == HM_IPV4)
+	if(masktype == HM_IPV6 || masktype == HM_IPV4)
 	{
-		/* We have to do this, since we do not re-hash for every bit -A1kmm. */
-		hv = hash_ipv4((struct sockaddr *)&addr, bits - bits % 8);
+		pnode = rb_match_ip_exact(get_atree(masktype, type), (struct sockaddr *)&addr, bits);
+		arec = pnode != NULL ? pnode->data : NULL;
 	}
 	else
 	{
-		hv = get_mask_hash(address);
+		hnode = get_host_node(address, type, false);
+		arec = hnode != NULL ? hnode->recs : NULL;
 	}
-	for (arec = atable[hv]; arec; arec = arec->next)
+
+	for (; arec; arec = arec->next)
 	{
 		if (arec->type == type &&
 				arec->masktype == masktype &&
@@ -521,8 +590,7 @@ find_exact_conf_by_address(const char *address, int type, const char *username)
 			}
 			else
 			{
-				if (arec->Mask.ipa.bits == bits &&
-					comp_with_mask_sock((struct sockaddr *)&arec->Mask.ipa.addr, (struct sockaddr *)&addr, bits))
+				if (arec->Mask.ipa.bits == bits)
 					return arec->aconf;
 			}
 		}
@@ -534,47 +602,100 @@ find_exact_conf_by_address(const char *address, int type, const char *username)
  *         struct ConfItem *aconf)
  * Input:
  * Output: None
- * Side-effects: Adds this entry to the hash table.
+ * Side-effects: Adds this entry to the hash table or the patricia tree.
  */
 void
 add_conf_by_address(const char *address, int type, const char *username, const char *auth_user, struct ConfItem *aconf)
 {
 	static unsigned long prec_value = 0xFFFFFFFF;
 	int bits;
-	unsigned long hv;
-	struct AddressRec *arec;
+	struct AddressRec *arec, *tail;
+	rb_patricia_node_t *pnode;
+	struct HostNode *hnode;
 
 	if(address == NULL)
 		address = "/NOMATCH!/";
 	arec = rb_malloc(sizeof(struct AddressRec));
 	arec->masktype = parse_netmask(address, &arec->Mask.ipa.addr, &bits);
-	if(arec->masktype == HM_IPV6)
-	{
-		arec->Mask.ipa.bits = bits;
-		/* We have to do this, since we do not re-hash for every bit -A1kmm. */
-		bits -= bits % 16;
-		arec->next = atable[(hv = hash_ipv6((struct sockaddr *)&arec->Mask.ipa.addr, bits))];
-		atable[hv] = arec;
-	}
-	else if(arec->masktype == HM_IPV4)
+	if(arec->masktype == HM_IPV6 || arec->masktype == HM_IPV4)
 	{
 		arec->Mask.ipa.bits = bits;
-		/* We have to do this, since we do not re-hash for every bit -A1kmm. */
-		bits -= bits % 8;
-		arec->next = atable[(hv = hash_ipv4((struct sockaddr *)&arec->Mask.ipa.addr, bits))];
-		atable[hv] = arec;
+		pnode = make_and_lookup_ip(get_atree(arec->masktype, type),
+				(struct sockaddr *)&arec->Mask.ipa.addr, bits);
+		arec->pnode = pnode;
+
+		/* precedence only goes down, appending keeps the node sorted */
+		if(pnode->data == NULL)
+			pnode->data = arec;
+		else
+		{
+			for (tail = pnode->data; tail->next; tail = tail->next)
+				;
+			tail->next = arec;
+		}
 	}
 	else
 	{
 		arec->Mask.hostname = address;
-		arec->next = atable[(hv = get_mask_hash(address))];
-		atable[hv] = arec;
+		hnode = get_host_node(address, type, true);
+		arec->hnode = hnode;
+
+		if(hnode->recs == NULL)
+			hnode->recs = arec;
+		else
+		{
+			for (tail = hnode->recs; tail->next; tail = tail->next)
+				;
+			tail->next = arec;
+		}
 	}
 	arec->username = username;
 	arec->auth_user = auth_user;
 	arec->aconf = aconf;
 	arec->precedence = prec_value--;
 	arec->type = type;
+	rb_dlinkAddTail(arec, &arec->lnode, &address_conf_list);
+}
+
+/* void unlink_address_rec(struct AddressRec *)
+ * Input: An address record.
+ * Output: None
+ * Side effects: Removes the record from the hash table or patricia tree
+ *               and from address_conf_list.
+ */
+static void
+unlink_address_rec(struct AddressRec *arec)
+{
+	struct AddressRec *prev = NULL, *cur;
+
+	if(arec->masktype == HM_HOST)
+		cur = arec->hnode->recs;
+	else
+		cur = arec->pnode->data;
+
+	for (; cur != NULL && cur != arec; cur = cur->next)
+		prev = cur;
+
+	s_assert(cur == arec);
+	if(cur == NULL)
+		return;
+
+	if(prev != NULL)
+		prev->next = arec->next;
+	else if(arec->masktype == HM_HOST)
+	{
+		arec->hnode->recs = arec->next;
+		prune_host_node(arec->hnode);
+	}
+	else if(arec->next != NULL)
+		arec->pnode->data = arec->next;
+	else
+	{
+		arec->pnode->data = NULL;
+		rb_patricia_remove(get_atree(arec->masktype, arec->type), arec->pnode);
+	}
+
+	rb_dlinkDelete(&arec->lnode, &address_conf_list);
 }
 
 /* void delete_one_address(const char*, struct ConfItem*)
@@ -586,41 +707,42 @@ add_conf_by_address(const char *address, int type, const char *username, const c
 void
 delete_one_address_conf(const char *address, struct ConfItem *aconf)
 {
-	int masktype, bits;
-	unsigned long hv;
-	struct AddressRec *arec, *arecl = NULL;
+	int masktype, bits, i;
+	struct AddressRec *arec = NULL;
 	struct rb_sockaddr_storage addr;
+	rb_patricia_node_t *pnode;
+	struct HostNode *hnode;
+	static const int types[] = { CONF_CLIENT, CONF_KILL, CONF_DLINE, CONF_EXEMPTDLINE, 0 };
+
 	masktype = parse_netmask(address, &addr, &bits);
-	if(masktype == HM_IPV6)
-	{
-		/* We have to do this, since we do not re-hash for every bit -A1kmm. */
-		bits -= bits % 16;
-		hv = hash_ipv6((struct sockaddr *)&addr, bits);
-	}
-	else if(masktype == HM_IPV4)
-	{
-		/* We have to do this, since we do not re-hash for every bit -A1kmm. */
-		bits -= bits % 8;
-		hv = hash_ipv4((struct sockaddr *)&addr, bits);
-	}
-	else
-		hv = get_mask_hash(address);
-	for (arec = atable[hv]; arec; arec = arec->next)
+
+	/* we dont know which tree it went into, the type is not passed */
+	for (i = 0; arec == NULL && i < (int)(sizeof(types) / sizeof(types[0])); i++)
 	{
-		if(arec->aconf == aconf)
+		if(masktype == HM_IPV6 || masktype == HM_IPV4)
 		{
-			if(arecl)
-				arecl->next = arec->next;
-			else
-				atable[hv] = arec->next;
-			aconf->status |= CONF_ILLEGAL;
-			if(!aconf->clients)
-				free_conf(aconf);
-			rb_free(arec);
-			return;
+			pnode = rb_match_ip_exact(get_atree(masktype, types[i]), (struct sockaddr *)&addr, bits);
+			arec = pnode != NULL ? pnode->data : NULL;
 		}
-		arecl = arec;
+		else
+		{
+			hnode = get_host_node(address, types[i], false);
+			arec = hnode != NULL ? hnode->recs : NULL;
+		}
+
+		for (; arec; arec = arec->next)
+			if(arec->aconf == aconf)
+				break;
 	}
+
+	if(arec == NULL)
+		return;
+
+	unlink_address_rec(arec);
+	aconf->status |= CONF_ILLEGAL;
+	if(!aconf->clients)
+		free_conf(aconf);
+	rb_free(arec);
 }
 
 /* void clear_out_address_conf(void)
@@ -633,66 +755,48 @@ delete_one_address_conf(const char *address, struct ConfItem *aconf)
 void
 clear_out_address_conf(void)
 {
-	int i;
-	struct AddressRec **store_next;
-	struct AddressRec *arec, *arecn;
+	rb_dlink_node *ptr, *next_ptr;
+	struct AddressRec *arec;
 
-	for (i = 0; i < ATABLE_SIZE; i++)
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, address_conf_list.head)
 	{
-		store_next = &atable[i];
-		for (arec = atable[i]; arec; arec = arecn)
-		{
-			arecn = arec->next;
-			/* We keep the temporary K-lines and destroy the
-			 * permanent ones, just to be confusing :) -A1kmm */
-			if(arec->aconf->flags & CONF_FLAGS_TEMPORARY ||
-			   (arec->type != CONF_CLIENT && arec->type != CONF_EXEMPTDLINE))
-			{
-				*store_next = arec;
-				store_next = &arec->next;
-			}
-			else
-			{
-				arec->aconf->status |= CONF_ILLEGAL;
-				if(!arec->aconf->clients)
-					free_conf(arec->aconf);
-				rb_free(arec);
-			}
-		}
-		*store_next = NULL;
+		arec = ptr->data;
+
+		/* We keep the temporary K-lines and destroy the
+		 * permanent ones, just to be confusing :) -A1kmm */
+		if(arec->aconf->flags & CONF_FLAGS_TEMPORARY ||
+		   (arec->type != CONF_CLIENT && arec->type != CONF_EXEMPTDLINE))
+			continue;
+
+		unlink_address_rec(arec);
+		arec->aconf->status |= CONF_ILLEGAL;
+		if(!arec->aconf->clients)
+			free_conf(arec->aconf);
+		rb_free(arec);
 	}
 }
 
 void
 clear_out_address_conf_bans(void)
 {
-	int i;
-	struct AddressRec **store_next;
-	struct AddressRec *arec, *arecn;
+	rb_dlink_node *ptr, *next_ptr;
+	struct AddressRec *arec;
 
-	for (i = 0; i < ATABLE_SIZE; i++)
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, address_conf_list.head)
 	{
-		store_next = &atable[i];
-		for (arec = atable[i]; arec; arec = arecn)
-		{
-			arecn = arec->next;
-			/* We keep the temporary K-lines and destroy the
-			 * permanent ones, just to be confusing :) -A1kmm */
-			if(arec->aconf->flags & CONF_FLAGS_TEMPORARY ||
-			   (arec->type == CONF_CLIENT || arec->type == CONF_EXEMPTDLINE))
-			{
-				*store_next = arec;
-				store_next = &arec->next;
-			}
-			else
-			{
-				arec->aconf->status |= CONF_ILLEGAL;
-				if(!arec->aconf->clients)
-					free_conf(arec->aconf);
-				rb_free(arec);
-			}
-		}
-		*store_next = NULL;
+		arec = ptr->data;
+
+		/* We keep the temporary K-lines and destroy the
+		 * permanent ones, just to be confusing :) -A1kmm */
+		if(arec->aconf->flags & CONF_FLAGS_TEMPORARY ||
+		   (arec->type == CONF_CLIENT || arec->type == CONF_EXEMPTDLINE))
+			continue;
+
+		unlink_address_rec(arec);
+		arec->aconf->status |= CONF_ILLEGAL;
+		if(!arec->aconf->clients)
+			free_conf(arec->aconf);
+		rb_free(arec);
 	}
 }
 
@@ -745,28 +849,31 @@ report_auth(struct Client *client_p)
 	const char *pass;
 	struct AddressRec *arec;
 	struct ConfItem *aconf;
-	int i, port;
+	rb_dlink_node *ptr;
+	int port;
 
-	for (i = 0; i < ATABLE_SIZE; i++)
-		for (arec = atable[i]; arec; arec = arec->next)
-			if(arec->type == CONF_CLIENT)
-			{
-				aconf = arec->aconf;
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
+	{
+		arec = ptr->data;
 
-				if(!IsOperGeneral(client_p) && IsConfDoSpoofIp(aconf))
-					continue;
+		if(arec->type != CONF_CLIENT)
+			continue;
 
-				get_printable_conf(aconf, &name, &host, &pass, &user, &port,
-						   &classname);
+		aconf = arec->aconf;
 
-				if(!EmptyString(aconf->spasswd))
-					pass = aconf->spasswd;
+		if(!IsOperGeneral(client_p) && IsConfDoSpoofIp(aconf))
+			continue;
 
-				sendto_one_numeric(client_p, RPL_STATSILINE,
-						   form_str(RPL_STATSILINE),
-						   name, pass, show_iline_prefix(client_p, aconf, user),
-						   show_ip_conf(aconf, client_p) ? host : "255.255.255.255",
-						   port, classname);
-			}
-}
+		get_printable_conf(aconf, &name, &host, &pass, &user, &port,
+				   &classname);
+
+		if(!EmptyString(aconf->spasswd))
+			pass = aconf->spasswd;
 
+		sendto_one_numeric(client_p, RPL_STATSILINE,
+				   form_str(RPL_STATSILINE),
+				   name, pass, show_iline_prefix(client_p, aconf, user),
+				   show_ip_conf(aconf, client_p) ? host : "255.255.255.255",
+				   port, classname);
+	}
+}
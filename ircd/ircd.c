@@ -36,6 +36,8 @@
 #include "ircd_signal.h"
 #include "msg.h"		/* msgtab */
 #include "hostmask.h"
+#include "clientindex.h"
+#include "userindex.h"
 #include "numeric.h"
 #include "parse.h"
 #include "restart.h"
@@ -87,6 +89,7 @@ struct Client me;		/* That's me */
 struct LocalUser meLocalUser;	/* That's also part of me */
 
 rb_dlink_list global_client_list;
+uint64_t global_client_order;	/* last Client.list_order handed out */
 
 /* unknown/client pointer lists */
 rb_dlink_list unknown_list;        /* unknown clients ON this server only */
@@ -738,6 +741,7 @@ charybdis_main(int argc, char * const argv[])
 	/* Init the event subsystem */
 	rb_lib_init(ircd_log_cb, ircd_restart_cb, ircd_die_cb, !server_state_foreground, maxconnections, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
 	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+	rb_set_select_hook(flush_dirty_sendqs);
 
 	rb_init_prng(NULL, RB_PRNG_DEFAULT);
 
@@ -753,6 +757,8 @@ charybdis_main(int argc, char * const argv[])
 	init_hash();
 	clear_scache_hash_table();	/* server cache name table */
 	init_host_hash();
+	init_client_index();
+	init_user_index();
 	clear_hash_parse();
 	init_client();
 	init_hook();
@@ -51,8 +51,10 @@ static SSL_OPEN_CB accept_sslcallback;
 static struct Listener *
 make_listener(struct rb_sockaddr_storage *addr)
 {
+	static uint32_t listener_id;
 	struct Listener *listener = (struct Listener *) rb_malloc(sizeof(struct Listener));
 	s_assert(0 != listener);
+	listener->id = ++listener_id;
 	listener->name = me.name;
 	listener->F = NULL;
 
@@ -61,6 +63,23 @@ make_listener(struct rb_sockaddr_storage *addr)
 	return listener;
 }
 
+/*
+ * find_listener_id - the listener wsockd knows by id, if it is still around
+ */
+struct Listener *
+find_listener_id(uint32_t id)
+{
+	struct Listener *listener;
+
+	for (listener = ListenerPollList; listener; listener = listener->next)
+	{
+		if (listener->id == id)
+			return listener;
+	}
+
+	return NULL;
+}
+
 void
 free_listener(struct Listener *listener)
 {
@@ -123,16 +142,28 @@ void
 show_ports(struct Client *source_p)
 {
 	struct Listener *listener = 0;
+	char flags[BUFSIZE];
 
 	for (listener = ListenerPollList; listener; listener = listener->next)
 	{
+		rb_strlcpy(flags, listener->ssl ? " ssl" : "", sizeof(flags));
+		if (listener->wsock)
+			rb_strlcat(flags, " wsock", sizeof(flags));
+
+		/* compressed websocket traffic, in bytes before and after */
+		if (listener->ws_deflate_plain > 0)
+			snprintf(flags + strlen(flags), sizeof(flags) - strlen(flags),
+				" deflate %llu/%llu",
+				(unsigned long long) listener->ws_deflate_plain,
+				(unsigned long long) listener->ws_deflate_wire);
+
 		sendto_one_numeric(source_p, RPL_STATSPLINE,
 			   form_str(RPL_STATSPLINE), 'P',
 			   get_listener_port(listener),
 			   IsOperAdmin(source_p) ? listener->name : me.name,
 			   listener->ref_count, (listener->active) ? "active" : "disabled",
 			   listener->sctp ? " sctp" : " tcp",
-			   listener->ssl ? " ssl" : "");
+			   flags);
 	}
 }
 
@@ -529,7 +560,8 @@ add_connection(struct Listener *listener, rb_fde_t *F, struct sockaddr *sai, str
 		}
 		new_client->localClient->ssl_callback = accept_sslcallback;
 		defer = true;
-		new_client->localClient->ssl_ctl = start_ssld_accept(F, xF[1], connid_get(new_client));        /* this will close F for us */
+		/* a websocket connection has to stay behind ssld, wsockd reads its plaintext */
+		new_client->localClient->ssl_ctl = start_ssld_accept(F, xF[1], connid_get(new_client), !listener->wsock);        /* this will close F for us */
 		if(new_client->localClient->ssl_ctl == NULL)
 		{
 			SetIOError(new_client);
@@ -550,7 +582,7 @@ add_connection(struct Listener *listener, rb_fde_t *F, struct sockaddr *sai, str
 			exit_client(new_client, new_client, new_client, "Fatal Error");
 			return;
 		}
-		new_client->localClient->ws_ctl = start_wsockd_accept(F, xF[1], connid_get(new_client));        /* this will close F for us */
+		new_client->localClient->ws_ctl = start_wsockd_accept(F, xF[1], connid_get(new_client), listener->id);        /* this will close F for us */
 		if(new_client->localClient->ws_ctl == NULL)
 		{
 			SetIOError(new_client);
@@ -0,0 +1,504 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  maskset.c: Match a string against many wildcard masks at once.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "match.h"
+#include "maskset.h"
+#include "s_assert.h"
+
+/* A mask set answers "which is the first of these masks that matches
+ * this string", as a loop calling match() on each mask would, without
+ * looking at every mask.
+ *
+ * The runs of literal characters between the wildcards of a mask must
+ * all appear in any string it matches.  Those runs (the longest few,
+ * if there are many) go into an Aho-Corasick automaton, so one pass
+ * over the string finds every run it contains.  The masks that had all
+ * of their runs found, and the masks with none at all, are then tried
+ * in the order they were added until one matches, each compiled once
+ * with match_compile() when it is added.
+ *
+ * The automaton is built on the first lookup after the set changes.
+ */
+
+#define MAX_KEYLEN	16
+#define MAX_KEYS	4
+
+struct MaskEntry
+{
+	char *mask;
+	struct match_pattern *pat;
+	void *data;
+	int nkeys;
+};
+
+struct MaskKey
+{
+	char key[MAX_KEYLEN + 1];	/* folded */
+	int entry;
+};
+
+struct MaskState
+{
+	int fail;
+	int dict;		/* nearest state on the fail chain ending a key */
+	int members;		/* entries with a key ending here, in MaskSet.members */
+	int nmembers;
+	int edge;		/* first edge in MaskSet.edges */
+	int nedge;
+};
+
+struct MaskEdge
+{
+	unsigned char c;
+	int next;
+};
+
+struct MaskSet
+{
+	int syntax;
+	bool compiled;
+
+	struct MaskEntry *entries;
+	int nentries;
+	int maxentries;
+
+	struct MaskState *states;
+	int nstates;
+	struct MaskEdge *edges;
+	int *members;
+	int root[256];		/* transitions out of the root state */
+	int *always;		/* entries with no key, ascending */
+	int nalways;
+
+	/* lookup scratch */
+	uint32_t stamp;
+	uint32_t *seen;		/* per state */
+	uint32_t *hit_stamp;	/* per entry */
+	int *hits;
+	int *cand;
+};
+
+struct MaskSet *
+maskset_create(int syntax)
+{
+	struct MaskSet *set = rb_malloc(sizeof(struct MaskSet));
+
+	set->syntax = syntax;
+	return set;
+}
+
+static void
+maskset_uncompile(struct MaskSet *set)
+{
+	rb_free(set->states);
+	rb_free(set->edges);
+	rb_free(set->members);
+	rb_free(set->always);
+	rb_free(set->seen);
+	rb_free(set->hit_stamp);
+	rb_free(set->hits);
+	rb_free(set->cand);
+	set->states = NULL;
+	set->edges = NULL;
+	set->members = NULL;
+	set->always = NULL;
+	set->seen = set->hit_stamp = NULL;
+	set->hits = set->cand = NULL;
+	set->nstates = set->nalways = 0;
+	set->compiled = false;
+}
+
+void
+maskset_clear(struct MaskSet *set)
+{
+	int i;
+
+	for(i = 0; i < set->nentries; i++)
+	{
+		rb_free(set->entries[i].mask);
+		match_free(set->entries[i].pat);
+	}
+	set->nentries = 0;
+	maskset_uncompile(set);
+}
+
+void
+maskset_destroy(struct MaskSet *set)
+{
+	if(set == NULL)
+		return;
+
+	maskset_clear(set);
+	rb_free(set->entries);
+	rb_free(set);
+}
+
+int
+maskset_size(const struct MaskSet *set)
+{
+	return set->nentries;
+}
+
+static void
+add_key(struct MaskKey *keys, int *nkeys, const char *run, int len, int entry)
+{
+	int i, shortest = 0;
+
+	for(i = 0; i < *nkeys; i++)
+	{
+		if(!strncmp(keys[i].key, run, len) && keys[i].key[len] == '\0')
+			return;
+		if(strlen(keys[i].key) < strlen(keys[shortest].key))
+			shortest = i;
+	}
+
+	if(*nkeys == MAX_KEYS)
+	{
+		if(strlen(keys[shortest].key) >= (size_t)len)
+			return;
+		i = shortest;
+	}
+	else
+		i = (*nkeys)++;
+
+	memcpy(keys[i].key, run, len);
+	keys[i].key[len] = '\0';
+	keys[i].entry = entry;
+}
+
+/* the runs of characters a string has to contain to match mask */
+static int
+find_keys(const char *mask, int syntax, struct MaskKey *keys, int entry)
+{
+	const unsigned char *p = (const unsigned char *)mask;
+	char run[MAX_KEYLEN + 1];
+	int len = 0, nkeys = 0;
+	unsigned char c;
+
+	while(1)
+	{
+		c = *p++;
+
+		if(c == '*' || c == '?' || c == '\0' ||
+		   (syntax == MASKSET_MATCH_ESC && (c == '@' || c == '#')))
+		{
+			if(len > 0)
+				add_key(keys, &nkeys, run, len, entry);
+			len = 0;
+
+			if(c == '\0')
+				return nkeys;
+			continue;
+		}
+
+		if(syntax == MASKSET_MATCH_ESC && c == '\\')
+		{
+			c = *p++;
+			if(c == '\0')
+			{
+				/* not a valid mask, let match_esc() decide
+				 * what it does */
+				return 0;
+			}
+			if(c == 's')
+				c = ' ';
+		}
+
+		/* a longer run contains this prefix as well */
+		if(len < MAX_KEYLEN)
+			run[len++] = irctolower(c);
+	}
+}
+
+void
+maskset_add(struct MaskSet *set, const char *mask, void *data)
+{
+	struct MaskEntry *entry;
+
+	if(set->nentries == set->maxentries)
+	{
+		set->maxentries = set->maxentries ? set->maxentries * 2 : 16;
+		set->entries = rb_realloc(set->entries, set->maxentries * sizeof(struct MaskEntry));
+	}
+
+	entry = &set->entries[set->nentries++];
+	entry->mask = rb_strdup(mask);
+	entry->pat = match_compile(mask, set->syntax == MASKSET_MATCH_ESC ? MATCH_ESC : MATCH_GLOB);
+	entry->data = data;
+	entry->nkeys = 0;
+
+	maskset_uncompile(set);
+}
+
+static inline int
+maskset_goto(const struct MaskSet *set, int state, unsigned char c)
+{
+	const struct MaskState *st;
+	int lo, hi, mid;
+
+	if(state == 0)
+		return set->root[c];
+
+	st = &set->states[state];
+	lo = st->edge;
+	hi = st->edge + st->nedge - 1;
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if(set->edges[mid].c == c)
+			return set->edges[mid].next;
+		if(set->edges[mid].c < c)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -1;
+}
+
+static int
+cmp_key(const void *a, const void *b)
+{
+	const struct MaskKey *x = a, *y = b;
+	int c = strcmp(x->key, y->key);
+
+	if(c != 0)
+		return c;
+	return x->entry < y->entry ? -1 : x->entry > y->entry;
+}
+
+static void
+maskset_compile(struct MaskSet *set)
+{
+	struct MaskKey *keys, *key, *prev = NULL;
+	int *child, *sibling, *last_child, *queue, *label;
+	int path[MAX_KEYLEN + 1];
+	int i, j, nkeys = 0, depth, lcp, maxstates, state, s, f, next, qhead, qtail, nedges = 0;
+
+	maskset_uncompile(set);
+
+	keys = rb_malloc((set->nentries * MAX_KEYS + 1) * sizeof(struct MaskKey));
+	set->always = rb_malloc((set->nentries + 1) * sizeof(int));
+	for(i = 0; i < set->nentries; i++)
+	{
+		set->entries[i].nkeys = find_keys(set->entries[i].mask, set->syntax, &keys[nkeys], i);
+		nkeys += set->entries[i].nkeys;
+		if(set->entries[i].nkeys == 0)
+			set->always[set->nalways++] = i;
+	}
+
+	/* insert the keys in sorted order, so each one shares its path
+	 * with the one before for as long as they agree */
+	qsort(keys, nkeys, sizeof(struct MaskKey), cmp_key);
+
+	/* the trie has at most one state per key character, plus the root */
+	maxstates = 1;
+	for(i = 0; i < nkeys; i++)
+		maxstates += strlen(keys[i].key);
+
+	set->states = rb_malloc(maxstates * sizeof(struct MaskState));
+	set->members = rb_malloc((nkeys + 1) * sizeof(int));
+	child = rb_malloc(maxstates * sizeof(int));
+	sibling = rb_malloc(maxstates * sizeof(int));
+	last_child = rb_malloc(maxstates * sizeof(int));
+	label = rb_malloc(maxstates * sizeof(int));
+
+	set->nstates = 1;
+	child[0] = sibling[0] = last_child[0] = -1;
+	path[0] = 0;
+
+	for(i = 0; i < nkeys; i++)
+	{
+		key = &keys[i];
+
+		lcp = 0;
+		if(prev != NULL)
+			while(key->key[lcp] != '\0' && key->key[lcp] == prev->key[lcp])
+				lcp++;
+
+		for(depth = lcp; key->key[depth] != '\0'; depth++)
+		{
+			s = set->nstates++;
+			set->states[s].nmembers = 0;
+			child[s] = sibling[s] = last_child[s] = -1;
+			label[s] = (unsigned char)key->key[depth];
+
+			state = path[depth];
+			if(last_child[state] == -1)
+				child[state] = s;
+			else
+				sibling[last_child[state]] = s;
+			last_child[state] = s;
+			path[depth + 1] = s;
+		}
+
+		/* keys are sorted by entry too, so the members of a state
+		 * are contiguous and ascending */
+		s = path[depth];
+		if(set->states[s].nmembers == 0)
+			set->states[s].members = i;
+		set->members[i] = key->entry;
+		set->states[s].nmembers++;
+
+		prev = key;
+	}
+	set->states[0].nmembers = 0;
+
+	/* lay the edges out breadth first, computing failure links as we go */
+	set->edges = rb_malloc(set->nstates * sizeof(struct MaskEdge));
+	queue = rb_malloc(set->nstates * sizeof(int));
+	qhead = qtail = 0;
+	queue[qtail++] = 0;
+
+	for(j = 0; j < 256; j++)
+		set->root[j] = 0;
+
+	while(qhead < qtail)
+	{
+		state = queue[qhead++];
+		set->states[state].edge = nedges;
+		set->states[state].nedge = 0;
+
+		for(s = child[state]; s != -1; s = sibling[s])
+		{
+			set->edges[nedges].c = label[s];
+			set->edges[nedges].next = s;
+			nedges++;
+			set->states[state].nedge++;
+
+			if(state == 0)
+			{
+				set->root[label[s]] = s;
+				f = 0;
+			}
+			else
+			{
+				f = set->states[state].fail;
+				while((next = maskset_goto(set, f, label[s])) == -1)
+					f = set->states[f].fail;
+				f = next;
+			}
+			set->states[s].fail = f;
+			set->states[s].dict = set->states[f].nmembers ? f : set->states[f].dict;
+
+			queue[qtail++] = s;
+		}
+	}
+	set->states[0].fail = 0;
+	set->states[0].dict = 0;
+
+	set->seen = rb_malloc(set->nstates * sizeof(uint32_t));
+	set->hit_stamp = rb_malloc((set->nentries + 1) * sizeof(uint32_t));
+	set->hits = rb_malloc((set->nentries + 1) * sizeof(int));
+	set->cand = rb_malloc((set->nentries + 1) * sizeof(int));
+	set->stamp = 0;
+	set->compiled = true;
+
+	rb_free(keys);
+	rb_free(queue);
+	rb_free(child);
+	rb_free(sibling);
+	rb_free(last_child);
+	rb_free(label);
+}
+
+static int
+cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* void *maskset_find(struct MaskSet *, const char *)
+ * Input: A mask set, a string.
+ * Output: The data of the first mask added to the set that matches the
+ *         string, NULL if none does.
+ * Side-effects: The set is compiled if it changed since the last lookup.
+ */
+void *
+maskset_find(struct MaskSet *set, const char *name)
+{
+	const struct MaskState *st;
+	const unsigned char *p;
+	int state, s, e, k, next, ncand = 0, i, j;
+
+	if(set->nentries == 0)
+		return NULL;
+
+	if(!set->compiled)
+		maskset_compile(set);
+
+	if(++set->stamp == 0)
+	{
+		memset(set->seen, 0, set->nstates * sizeof(uint32_t));
+		memset(set->hit_stamp, 0, set->nentries * sizeof(uint32_t));
+		set->stamp = 1;
+	}
+
+	state = 0;
+	for(p = (const unsigned char *)name; *p != '\0'; p++)
+	{
+		unsigned char c = irctolower(*p);
+
+		while((next = maskset_goto(set, state, c)) == -1)
+			state = set->states[state].fail;
+		state = next;
+
+		s = set->states[state].nmembers ? state : set->states[state].dict;
+		for(; s != 0; s = set->states[s].dict)
+		{
+			/* everything further down the chain was seen too */
+			if(set->seen[s] == set->stamp)
+				break;
+			set->seen[s] = set->stamp;
+
+			st = &set->states[s];
+			for(k = st->members; k < st->members + st->nmembers; k++)
+			{
+				e = set->members[k];
+				if(set->hit_stamp[e] != set->stamp)
+				{
+					set->hit_stamp[e] = set->stamp;
+					set->hits[e] = 0;
+				}
+				if(++set->hits[e] == set->entries[e].nkeys)
+					set->cand[ncand++] = e;
+			}
+		}
+	}
+
+	if(ncand > 1)
+		qsort(set->cand, ncand, sizeof(int), cmp_int);
+
+	/* try the candidates and the keyless masks in the order added */
+	for(i = 0, j = 0; i < ncand || j < set->nalways;)
+	{
+		if(j == set->nalways || (i < ncand && set->cand[i] < set->always[j]))
+			e = set->cand[i++];
+		else
+			e = set->always[j++];
+
+		if(match_compiled(set->entries[e].pat, name))
+			return set->entries[e].data;
+	}
+
+	return NULL;
+}
@@ -24,17 +24,412 @@
 #include "match.h"
 #include "s_assert.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
- * Compare if a given string (name) matches the given
- * mask (which can contain wild cards: '*' - match any
- * number of chars, '?' - match any single character.
+ * Compiled masks.
  *
- * return  1, if match
- *         0, if no match
+ * A mask is split on its '*'s into segments, each a run of single
+ * character tests: a literal, '?', and for match_esc() '@' and '#'.  A
+ * name matches if the first segment matches at its start (unless the
+ * mask starts with a '*'), the last one at its end (unless the mask ends
+ * with a '*'), and the others in order in between without overlapping.
+ * Taking the leftmost place each of those matches never loses a match,
+ * so there is no backtracking.
  *
- *  Originally by Douglas A Lewis (dalewis@acsu.buffalo.edu)
- *  Rewritten by Timothy Vogelsang (netski), net@astrolink.org
+ * A segment is looked for by scanning for its first literal, in either
+ * case, and only trying the places where that is found.
  */
+#define MATCH_OP_LIT	0
+#define MATCH_OP_ANY	1	/* '?' */
+#define MATCH_OP_NOSTAR	2	/* '?' in mask_match() */
+#define MATCH_OP_LETTER	3	/* '@' in match_esc() */
+#define MATCH_OP_DIGIT	4	/* '#' in match_esc() */
+
+/* masks up to this long are compiled on the stack by match() */
+#define MATCH_STACK_LEN	128
+
+struct match_op
+{
+	unsigned char op;
+	unsigned char c;	/* MATCH_OP_LIT, folded */
+};
+
+struct match_seg
+{
+	int start;		/* first op */
+	int len;
+	int lit;		/* offset of the first literal, -1 if none */
+	unsigned char c1, c2;	/* that literal in both cases */
+};
+
+struct match_pattern
+{
+	bool invalid;
+	bool lead_star;
+	bool trail_star;
+	int nseg;
+	int minlen;
+	struct match_seg *seg;
+	struct match_op *op;
+};
+
+/* the other char that folds to c, or c if there is none */
+static inline unsigned char
+other_case(unsigned char c)
+{
+	return irctolower(irctoupper(c)) == c ? irctoupper(c) : c;
+}
+
+/* a mask of len chars has at most len ops and len / 2 + 1 segments */
+static void
+compile_pattern(struct match_pattern *pat, const char *mask, int syntax)
+{
+	const unsigned char *m = (const unsigned char *)mask;
+	struct match_seg *seg = NULL;
+	struct match_op *op = pat->op;
+	int nseg = 0, seglen = 0;
+	bool trail_star = false;
+	unsigned char c, op_type;
+
+	pat->invalid = false;
+	pat->lead_star = *m == '*';
+
+	while((c = *m++) != '\0')
+	{
+		if(c == '*')
+		{
+			if(seg != NULL)
+				seg->len = seglen;
+			seg = NULL;
+			trail_star = true;
+			continue;
+		}
+		trail_star = false;
+
+		if(seg == NULL)
+		{
+			seg = &pat->seg[nseg++];
+			seg->start = op - pat->op;
+			seg->lit = -1;
+			seglen = 0;
+		}
+
+		if(c == '?')
+			op_type = syntax == MATCH_MASK ? MATCH_OP_NOSTAR : MATCH_OP_ANY;
+		else if(syntax == MATCH_ESC && c == '@')
+			op_type = MATCH_OP_LETTER;
+		else if(syntax == MATCH_ESC && c == '#')
+			op_type = MATCH_OP_DIGIT;
+		else
+		{
+			if(syntax == MATCH_ESC && c == '\\')
+			{
+				c = *m++;
+				/* nothing to escape, match nothing */
+				if(c == '\0')
+				{
+					pat->invalid = true;
+					return;
+				}
+				if(c == 's')
+					c = ' ';
+			}
+
+			op_type = MATCH_OP_LIT;
+			c = irctolower(c);
+			if(seg->lit < 0)
+			{
+				seg->lit = seglen;
+				seg->c1 = c;
+				seg->c2 = other_case(c);
+			}
+		}
+
+		op->op = op_type;
+		op->c = c;
+		op++;
+		seglen++;
+	}
+
+	if(seg != NULL)
+		seg->len = seglen;
+	pat->trail_star = trail_star;
+	pat->nseg = nseg;
+	pat->minlen = op - pat->op;
+}
+
+/* struct match_pattern *match_compile(const char *, int)
+ * Input: A mask, its syntax (MATCH_GLOB, MATCH_MASK or MATCH_ESC).
+ * Output: The mask compiled for match_compiled().
+ * Side-effects: None, free it with match_free().
+ */
+struct match_pattern *
+match_compile(const char *mask, int syntax)
+{
+	struct match_pattern *pat;
+	size_t len = strlen(mask);
+
+	pat = rb_malloc(sizeof(struct match_pattern) +
+			(len / 2 + 1) * sizeof(struct match_seg) +
+			len * sizeof(struct match_op));
+	pat->seg = (struct match_seg *)(pat + 1);
+	pat->op = (struct match_op *)(pat->seg + len / 2 + 1);
+	compile_pattern(pat, mask, syntax);
+	return pat;
+}
+
+void
+match_free(struct match_pattern *pat)
+{
+	rb_free(pat);
+}
+
+/* the first of c1 or c2 in s[0..len), or NULL */
+static const unsigned char *
+find_either(const unsigned char *s, size_t len, unsigned char c1, unsigned char c2)
+{
+	if(c1 == c2)
+		return memchr(s, c1, len);
+
+#if defined(__SSE2__)
+	{
+		const __m128i v1 = _mm_set1_epi8(c1);
+		const __m128i v2 = _mm_set1_epi8(c2);
+
+		for(; len >= 16; s += 16, len -= 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)s);
+			int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, v1), _mm_cmpeq_epi8(v, v2)));
+
+			if(mask != 0)
+				return s + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	for(; len > 0; s++, len--)
+	{
+		if(*s == c1 || *s == c2)
+			return s;
+	}
+	return NULL;
+}
+
+static inline bool
+match_seg_at(const struct match_pattern *pat, const struct match_seg *seg, const unsigned char *s)
+{
+	const struct match_op *op = &pat->op[seg->start];
+	int i;
+
+	for(i = 0; i < seg->len; i++, op++)
+	{
+		switch(op->op)
+		{
+		case MATCH_OP_LIT:
+			if(irctolower(s[i]) != op->c)
+				return false;
+			break;
+		case MATCH_OP_NOSTAR:
+			if(s[i] == '*')
+				return false;
+			break;
+		case MATCH_OP_LETTER:
+			if(!IsLetter(s[i]))
+				return false;
+			break;
+		case MATCH_OP_DIGIT:
+			if(!IsDigit(s[i]))
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+/* the leftmost place in s[0..end) seg matches, or NULL */
+static const unsigned char *
+match_seg_find(const struct match_pattern *pat, const struct match_seg *seg,
+		const unsigned char *s, const unsigned char *end)
+{
+	const unsigned char *p;
+
+	while(end - s >= seg->len)
+	{
+		if(seg->lit >= 0)
+		{
+			p = find_either(s + seg->lit, end - s - seg->len + 1, seg->c1, seg->c2);
+			if(p == NULL)
+				return NULL;
+			s = p - seg->lit;
+		}
+
+		if(match_seg_at(pat, seg, s))
+			return s;
+		s++;
+	}
+	return NULL;
+}
+
+/* int match_compiled(const struct match_pattern *, const char *)
+ * Input: A compiled mask, a string.
+ * Output: 1 if the mask matches the string, 0 otherwise.
+ * Side-effects: None.
+ */
+int
+match_compiled(const struct match_pattern *pat, const char *name)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	const unsigned char *end = s + strlen(name);
+	const struct match_seg *seg, *last;
+
+	if(pat->invalid || end - s < pat->minlen)
+		return 0;
+	if(pat->nseg == 0)
+		return pat->lead_star || s == end;
+
+	seg = pat->seg;
+	last = pat->seg + pat->nseg - 1;
+
+	if(!pat->lead_star)
+	{
+		if(seg == last && !pat->trail_star && end - s != seg->len)
+			return 0;
+		if(!match_seg_at(pat, seg, s))
+			return 0;
+		s += seg->len;
+		seg++;
+	}
+
+	if(!pat->trail_star && seg <= last)
+	{
+		if(end - s < last->len || !match_seg_at(pat, last, end - last->len))
+			return 0;
+		end -= last->len;
+		last--;
+	}
+
+	for(; seg <= last; seg++)
+	{
+		s = match_seg_find(pat, seg, s, end);
+		if(s == NULL)
+			return 0;
+		s += seg->len;
+	}
+	return 1;
+}
+
+static inline bool
+match_glob_char(unsigned char m, unsigned char n, int syntax)
+{
+	if(m == '?')
+		return syntax != MATCH_MASK || n != '*';
+	return irctolower(m) == irctolower(n);
+}
+
+/* match_compiled() for a mask without escapes, working off the mask
+ * itself so a single match() doesn't pay for compiling it first */
+static int
+match_glob(const unsigned char *m, const unsigned char *n, int syntax)
+{
+	const unsigned char *mend = m + strlen((const char *)m);
+	const unsigned char *nend = n + strlen((const char *)n);
+	const unsigned char *star, *p;
+	ptrdiff_t len, lit, i;
+	unsigned char c1 = 0, c2 = 0;
+
+	/* whatever follows the last '*' is anchored at the end */
+	for(; mend > m && mend[-1] != '*'; mend--, nend--)
+	{
+		if(nend == n || !match_glob_char(mend[-1], nend[-1], syntax))
+			return 0;
+	}
+
+	for(;;)
+	{
+		while(m < mend && *m == '*')
+			m++;
+		if(m == mend)
+			return 1;
+
+		star = memchr(m, '*', mend - m);
+		len = star - m;
+		for(lit = 0; lit < len && m[lit] == '?'; lit++)
+			;
+		if(lit < len)
+		{
+			c1 = irctolower(m[lit]);
+			c2 = other_case(c1);
+		}
+
+		for(;; n++)
+		{
+			if(nend - n < len)
+				return 0;
+			if(lit < len)
+			{
+				p = find_either(n + lit, nend - n - len + 1, c1, c2);
+				if(p == NULL)
+					return 0;
+				n = p - lit;
+			}
+
+			for(i = 0; i < len && match_glob_char(m[i], n[i], syntax); i++)
+				;
+			if(i == len)
+				break;
+		}
+
+		n += len;
+		m = star;
+	}
+}
+
+/* a single match, without compiling the mask if that can be helped */
+static int
+match_once(const char *mask, const char *name, int syntax)
+{
+	struct match_op op[MATCH_STACK_LEN];
+	struct match_seg seg[MATCH_STACK_LEN / 2 + 1];
+	struct match_pattern pat, *heap_pat;
+	const unsigned char *m = (const unsigned char *)mask;
+	const unsigned char *n = (const unsigned char *)name;
+	int ret;
+
+	/* most masks that fail do so on their leading literals */
+	for(;; m++, n++)
+	{
+		if(*m == '\0')
+			return *n == '\0';
+		if(*m == '*' || (syntax == MATCH_ESC && (*m == '\\' || *m == '@' || *m == '#')))
+			break;
+		if(*m == '?')
+		{
+			if(*n == '\0' || (syntax == MATCH_MASK && *n == '*'))
+				return 0;
+		}
+		else if(irctolower(*m) != irctolower(*n))
+			return 0;
+	}
+
+	if(syntax != MATCH_ESC)
+		return match_glob(m, n, syntax);
+
+	if(strlen((const char *)m) > MATCH_STACK_LEN)
+	{
+		heap_pat = match_compile((const char *)m, syntax);
+		ret = match_compiled(heap_pat, (const char *)n);
+		match_free(heap_pat);
+		return ret;
+	}
+
+	pat.op = op;
+	pat.seg = seg;
+	compile_pattern(&pat, (const char *)m, syntax);
+	return match_compiled(&pat, (const char *)n);
+}
 
 /** Check a string against a mask.
  * This test checks using traditional IRC wildcards only: '*' means
@@ -47,61 +442,10 @@
  */
 int match(const char *mask, const char *name)
 {
-	const char *m = mask, *n = name;
-	const char *m_tmp = mask, *n_tmp = name;
-	int star_p;
-
 	s_assert(mask != NULL);
 	s_assert(name != NULL);
 
-	for (;;)
-	{
-		switch (*m)
-		{
-		  case '\0':
-			  if (!*n)
-				  return 1;
-		  backtrack:
-			  if (m_tmp == mask)
-				  return 0;
-			  m = m_tmp;
-			  n = ++n_tmp;
-			  break;
-		  case '*':
-		  case '?':
-			  for (star_p = 0;; m++)
-			  {
-				  if (*m == '*')
-					  star_p = 1;
-				  else if (*m == '?')
-				  {
-					  if (!*n++)
-						  goto backtrack;
-				  }
-				  else
-					  break;
-			  }
-			  if (star_p)
-			  {
-				  if (!*m)
-					  return 1;
-				  else
-				  {
-					  m_tmp = m;
-					  for (n_tmp = n; *n && irctolower(*n) != irctolower(*m); n++);
-				  }
-			  }
-			  /* and fall through */
-		  default:
-			  if (!*n)
-				  return (*m != '\0' ? 0 : 1);
-			  if (irctolower(*m) != irctolower(*n))
-				  goto backtrack;
-			  m++;
-			  n++;
-			  break;
-		}
-	}
+	return match_once(mask, name, MATCH_GLOB);
 }
 
 /** Check a mask against a mask.
@@ -117,68 +461,12 @@ int match(const char *mask, const char *name)
  */
 int mask_match(const char *mask, const char *name)
 {
-	const char *m = mask, *n = name;
-	const char *m_tmp = mask, *n_tmp = name;
-	int star_p;
-
 	s_assert(mask != NULL);
 	s_assert(name != NULL);
 
-	for (;;)
-	{
-		switch (*m)
-		{
-		  case '\0':
-			  if (!*n)
-				  return 1;
-		  backtrack:
-			  if (m_tmp == mask)
-				  return 0;
-			  m = m_tmp;
-			  n = ++n_tmp;
-			  break;
-		  case '*':
-		  case '?':
-			  for (star_p = 0;; m++)
-			  {
-				  if (*m == '*')
-					  star_p = 1;
-				  else if (*m == '?')
-				  {
-					  /* changed for mask_match() */
-					  if (*n == '*' || !*n)
-						  goto backtrack;
-					  n++;
-				  }
-				  else
-					  break;
-			  }
-			  if (star_p)
-			  {
-				  if (!*m)
-					  return 1;
-				  else
-				  {
-					  m_tmp = m;
-					  for (n_tmp = n; *n && irctolower(*n) != irctolower(*m); n++);
-				  }
-			  }
-			  /* and fall through */
-		  default:
-			  if (!*n)
-				  return (*m != '\0' ? 0 : 1);
-			  if (irctolower(*m) != irctolower(*n))
-				  goto backtrack;
-			  m++;
-			  n++;
-			  break;
-		}
-	}
+	return match_once(mask, name, MATCH_MASK);
 }
 
-
-#define MATCH_MAX_CALLS 512	/* ACK! This dies when it's less that this
-				   and we have long lines to parse */
 /** Check a string against a mask.
  * This test checks using extended wildcards: '*' means match zero
  * or more characters of any type; '?' means match exactly one
@@ -196,116 +484,13 @@ int mask_match(const char *mask, const char *name)
 int
 match_esc(const char *mask, const char *name)
 {
-	const unsigned char *m = (const unsigned char *)mask;
-	const unsigned char *n = (const unsigned char *)name;
-	const unsigned char *ma = (const unsigned char *)mask;
-	const unsigned char *na = (const unsigned char *)name;
-	int wild = 0;
-	int calls = 0;
-	int quote = 0;
-	int match1 = 0;
-
 	s_assert(mask != NULL);
 	s_assert(name != NULL);
 
 	if(!mask || !name)
 		return 0;
 
-	/* if the mask is "*", it matches everything */
-	if((*m == '*') && (*(m + 1) == '\0'))
-		return 1;
-
-	while(calls++ < MATCH_MAX_CALLS)
-	{
-		if(quote)
-			quote++;
-		if(quote == 3)
-			quote = 0;
-		if(*m == '\\' && !quote)
-		{
-			m++;
-			quote = 1;
-			continue;
-		}
-		if(!quote && *m == '*')
-		{
-			/*
-			 * XXX - shouldn't need to spin here, the mask should have been
-			 * collapsed before match is called
-			 */
-			while(*m == '*')
-				m++;
-
-			wild = 1;
-			ma = m;
-			na = n;
-
-			if(*m == '\\')
-			{
-				m++;
-				/* This means it is an invalid mask -A1kmm. */
-				if(!*m)
-					return 0;
-				quote++;
-				continue;
-			}
-		}
-
-		if(!*m)
-		{
-			if(!*n)
-				return 1;
-			if(quote)
-				return 0;
-			for(m--; (m > (const unsigned char *)mask) && (*m == '?'); m--)
-				;
-
-			if(*m == '*' && (m > (const unsigned char *)mask))
-				return 1;
-			if(!wild)
-				return 0;
-			m = ma;
-			n = ++na;
-		}
-		else if(!*n)
-		{
-			/*
-			 * XXX - shouldn't need to spin here, the mask should have been
-			 * collapsed before match is called
-			 */
-			if(quote)
-				return 0;
-			while(*m == '*')
-				m++;
-			return (*m == 0);
-		}
-
-		if(quote)
-			match1 = *m == 's' ? *n == ' ' : irctolower(*m) == irctolower(*n);
-		else if(*m == '?')
-			match1 = 1;
-		else if(*m == '@')
-			match1 = IsLetter(*n);
-		else if(*m == '#')
-			match1 = IsDigit(*n);
-		else
-			match1 = irctolower(*m) == irctolower(*n);
-		if(match1)
-		{
-			if(*m)
-				m++;
-			if(*n)
-				n++;
-		}
-		else
-		{
-			if(!wild)
-				return 0;
-			m = ma;
-			n = ++na;
-		}
-	}
-	return 0;
+	return match_once(mask, name, MATCH_ESC);
 }
 
 int comp_with_mask(void *addr, void *dest, unsigned int mask)
@@ -617,9 +802,10 @@ void matchset_for_client(struct Client *who, struct matchset *m)
 	if (!IsIPSpoof(who) && GET_SS_FAMILY(&who->localClient->ip) == AF_INET6 &&
 			rb_ipv4_from_ipv6((const struct sockaddr_in6 *)&who->localClient->ip, &ip4))
 	{
-		int n = sprintf(m->ip[ipn++], "%s!%s@", who->name, who->username);
+		int n = sprintf(m->ip[ipn], "%s!%s@", who->name, who->username);
 		rb_inet_ntop_sock((struct sockaddr *)&ip4,
 				m->ip[ipn] + n, sizeof m->ip[ipn] - n);
+		ipn++;
 	}
 
 	for (int i = hostn; i < ARRAY_SIZE(m->host); i++)
@@ -632,11 +818,37 @@ void matchset_for_client(struct Client *who, struct matchset *m)
 	}
 }
 
+/*
+ * client_matchset - return the matchset of a local client, built on first
+ * use after it was invalidated.  It must be invalidated whenever anything
+ * matchset_for_client() reads changes: nick, username, host, orighost,
+ * mangledhost or the spoof flags.  A built matchset always has host[0] set,
+ * so an empty host[0] marks a stale one.
+ */
+const struct matchset *client_matchset(struct Client *who)
+{
+	struct LocalUser *lclient = who->localClient;
+
+	if (lclient->matchset == NULL)
+		lclient->matchset = rb_malloc(sizeof(struct matchset));
+
+	if (lclient->matchset->host[0][0] == '\0')
+		matchset_for_client(who, lclient->matchset);
+
+	return lclient->matchset;
+}
+
+void invalidate_client_matchset(struct Client *who)
+{
+	if (!MyConnect(who) || who->localClient->matchset == NULL)
+		return;
+
+	who->localClient->matchset->host[0][0] = '\0';
+}
+
 bool client_matches_mask(struct Client *who, const char *mask)
 {
-	static struct matchset ms;
-	matchset_for_client(who, &ms);
-	return matches_mask(&ms, mask);
+	return matches_mask(client_matchset(who), mask);
 }
 
 bool matches_mask(const struct matchset *m, const char *mask)
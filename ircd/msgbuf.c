@@ -134,16 +134,19 @@ msgbuf_parse(struct MsgBuf *msgbuf, char *line)
 		}
 	}
 
-	/* truncate message if it's too long */
-	if (strlen(ch) > DATALEN) {
+	/* truncate message if it's too long; the line is measured once and
+	 * everything below stays within [ch, endp) */
+	char *endp = ch + strlen(ch);
+	if (endp - ch > DATALEN) {
 		ch[DATALEN] = '\0';
+		endp = &ch[DATALEN];
 	}
 
 	if (*ch == ':') {
 		ch++;
 		msgbuf->origin = ch;
 
-		char *end = strchr(ch, ' ');
+		char *end = memchr(ch, ' ', endp - ch);
 		if (end == NULL)
 			return 4;
 
@@ -154,7 +157,7 @@ msgbuf_parse(struct MsgBuf *msgbuf, char *line)
 	if (*ch == '\0')
 		return 2;
 
-	msgbuf->endp = &ch[strlen(ch)];
+	msgbuf->endp = endp;
 	msgbuf->n_para = rb_string_to_array(ch, (char **)msgbuf->para, MAXPARA);
 	if (msgbuf->n_para == 0)
 		return 3;
@@ -234,7 +237,7 @@ msgbuf_unparse_tags(char *buf, size_t buflen, const struct MsgBuf *msgbuf, unsig
 
 		if (output + len > end)
 			break;
-		strcat(output, msgbuf->tags[i].key);
+		memcpy(output, msgbuf->tags[i].key, len);
 		output += len;
 
 		if (msgbuf->tags[i].value != NULL) {
@@ -434,6 +437,12 @@ msgbuf_cache_initf(struct MsgBuf_cache *cache, const struct MsgBuf *msgbuf, cons
 	va_end(va);
 }
 
+/*
+ * get the serialised line for a client with the given caps.  Only the caps
+ * that select one of the tags matter, so every client that would see the
+ * same tags shares one buf_head_t and the recipients' sendqs just take a
+ * reference to its lines.
+ */
 buf_head_t*
 msgbuf_cache_get(struct MsgBuf_cache *cache, unsigned int caps)
 {
@@ -442,6 +451,8 @@ msgbuf_cache_get(struct MsgBuf_cache *cache, unsigned int caps)
 	struct MsgBuf_cache_entry *result = NULL;
 	int n = 0;
 
+	caps &= cache->overall_capmask;
+
 	while (entry != NULL) {
 		if (entry->caps == caps) {
 			/* Cache hit */
@@ -2627,7 +2627,12 @@ static struct ConfEntry conf_serverinfo_table[] =
 	{ "ssl_cert",           CF_QSTRING, NULL, 0, &ServerInfo.ssl_cert },
 	{ "ssl_dh_params",      CF_QSTRING, NULL, 0, &ServerInfo.ssl_dh_params },
 	{ "ssl_cipher_list",	CF_QSTRING, NULL, 0, &ServerInfo.ssl_cipher_list },
+	{ "ssl_ktls",		CF_YESNO,   NULL, 0, &ServerInfo.ssl_ktls },
 	{ "ssld_count",		CF_INT,	    NULL, 0, &ServerInfo.ssld_count },
+	{ "wsock_deflate",	CF_YESNO,   NULL, 0, &ServerInfo.wsock_deflate },
+	{ "wsock_deflate_context_takeover", CF_YESNO, NULL, 0, &ServerInfo.wsock_deflate_context_takeover },
+	{ "wsock_deflate_memory", CF_INT,   NULL, 0, &ServerInfo.wsock_deflate_memory },
+	{ "wsock_pack_lines",	CF_YESNO,   NULL, 0, &ServerInfo.wsock_pack_lines },
 
 	{ "default_max_clients",CF_INT,     NULL, 0, &ServerInfo.default_max_clients },
 
@@ -2810,6 +2815,7 @@ static struct ConfEntry conf_general_table[] =
 	{ "certfp_method",	CF_STRING, conf_set_general_certfp_method, 0, NULL },
 	{ "drain_reason",	CF_QSTRING, NULL, BUFSIZE, &ConfigFileEntry.drain_reason	},
 	{ "tls_ciphers_oper_only",	CF_YESNO, NULL, 0, &ConfigFileEntry.tls_ciphers_oper_only	},
+	{ "deferred_flush",	CF_YESNO, NULL, 0, &ConfigFileEntry.deferred_flush	},
 	{ "\0", 		0, 	  NULL, 0, NULL }
 };
 
@@ -2839,6 +2845,7 @@ static struct ConfEntry conf_channel_table[] =
 	{ "displayed_usercount",	CF_INT, NULL, 0, &ConfigChannel.displayed_usercount	},
 	{ "strip_topic_colors",	CF_YESNO, NULL, 0, &ConfigChannel.strip_topic_colors	},
 	{ "opmod_send_statusmsg", CF_YESNO, NULL, 0, &ConfigChannel.opmod_send_statusmsg	},
+	{ "ban_refresh",	CF_YESNO, NULL, 0, &ConfigChannel.ban_refresh		},
 	{ "\0", 		0, 	  NULL, 0, NULL }
 };
 
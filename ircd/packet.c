@@ -33,6 +33,7 @@
 #include "send.h"
 #include "s_assert.h"
 #include "s_newconf.h"
+#include "safelist.h"
 
 static char readBuf[READBUF_SIZE];
 static void client_dopacket(struct Client *client_p, char *buffer, size_t length);
@@ -40,7 +41,7 @@ static void client_dopacket(struct Client *client_p, char *buffer, size_t length
 /*
  * parse_client_queued - parse client queued messages
  */
-static void
+void
 parse_client_queued(struct Client *client_p)
 {
 	int dolen = 0;
@@ -92,7 +93,8 @@ parse_client_queued(struct Client *client_p)
 
 	if(IsAnyServer(client_p) || IsExemptFlood(client_p))
 	{
-		while (!IsAnyDead(client_p) && (dolen = rb_linebuf_get(&client_p->localClient->buf_recvq,
+		while (!IsAnyDead(client_p) && !safelist_holds_input(client_p) &&
+				(dolen = rb_linebuf_get(&client_p->localClient->buf_recvq,
 					   readBuf, READBUF_SIZE, LINEBUF_COMPLETE,
 					   LINEBUF_PARSED)) > 0)
 		{
@@ -134,6 +136,10 @@ parse_client_queued(struct Client *client_p)
 			if(client_p->localClient->sent_parsed >= allow_read)
 				break;
 
+			/* a reply is still being sent, the next one waits for it */
+			if(safelist_holds_input(client_p))
+				break;
+
 			/* post_registration_delay hack. Don't process any messages from a new client for $n seconds,
 			 * to allow network bots to do their thing before channels can be joined.
 			 */
@@ -357,5 +363,15 @@ client_dopacket(struct Client *client_p, char *buffer, size_t length)
 		me.localClient->receiveB &= 0x03ff;
 	}
 
+	/* replies to a server we are still bursting to, such as PONG or
+	 * the KILL/SAVE for a nick collision, dont wait behind the burst.
+	 * the burst may be finished or aborted while the line is handled.
+	 */
+	if(client_p->localClient->burst != NULL)
+		client_p->localClient->burst->replying = true;
+
 	parse(client_p, buffer, buffer + length);
+
+	if(client_p->localClient->burst != NULL)
+		client_p->localClient->burst->replying = false;
 }
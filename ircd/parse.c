@@ -40,10 +40,68 @@
 #include "s_serv.h"
 #include "packet.h"
 #include "s_assert.h"
+#include "cmdhash.h"
 
 rb_dictionary *cmd_dict = NULL;
 rb_dictionary *alias_dict = NULL;
 
+/*
+ * Fast path for the verbs that make up nearly all traffic.  Each core
+ * verb owns a slot of the perfect hash in cmdhash.h; the slot caches
+ * the struct Message once a module registers it.  Everything else is
+ * looked up in cmd_dict.  clear_hash_parse() checks on startup that no
+ * two verbs share a slot.
+ */
+static const char *core_cmds[] = { CMD_FAST_VERBS };
+
+struct cmd_fast_slot
+{
+	const char *name;
+	size_t len;
+	struct Message *msg;
+};
+
+static struct cmd_fast_slot cmd_fast[1 << CMD_FAST_BITS];
+
+static inline unsigned int
+cmd_fast_hash(const char *cmd, size_t len)
+{
+	return cmd_fast_hash_mult(cmd, len, CMD_FAST_MULT);
+}
+
+/* returns the core verb slot for cmd, or NULL if cmd is not a core verb */
+static inline struct cmd_fast_slot *
+cmd_fast_find(const char *cmd, size_t len)
+{
+	struct cmd_fast_slot *slot;
+
+	if(len == 0)
+		return NULL;
+
+	slot = &cmd_fast[cmd_fast_hash(cmd, len)];
+	if(slot->len != len || rb_strcasecmp(slot->name, cmd))
+		return NULL;
+
+	return slot;
+}
+
+/* find_command()
+ *
+ * inputs	- command name
+ * output	- struct Message for the command, or NULL
+ * side effects - none
+ */
+struct Message *
+find_command(const char *cmd)
+{
+	struct cmd_fast_slot *slot = cmd_fast_find(cmd, strlen(cmd));
+
+	if(slot != NULL)
+		return slot->msg;
+
+	return rb_dictionary_retrieve(cmd_dict, cmd);
+}
+
 static void cancel_clients(struct Client *, struct Client *);
 static void remove_unknown(struct Client *, const char *, char *);
 
@@ -131,7 +189,7 @@ parse(struct Client *client_p, char *pbuffer, char *bufend)
 	}
 	else
 	{
-		mptr = rb_dictionary_retrieve(cmd_dict, msgbuf.cmd);
+		mptr = find_command(msgbuf.cmd);
 
 		/* no command or its encap only, error */
 		if(!mptr || !mptr->cmd)
@@ -248,7 +306,7 @@ handle_encap(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *so
 	struct MessageEntry ehandler;
 	MessageHandler handler = 0;
 
-	mptr = rb_dictionary_retrieve(cmd_dict, command);
+	mptr = find_command(command);
 
 	if(mptr == NULL || mptr->cmd == NULL)
 		return;
@@ -274,7 +332,28 @@ handle_encap(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *so
 void
 clear_hash_parse()
 {
-	cmd_dict = rb_dictionary_create("command", rb_strcasecmp);
+	struct cmd_fast_slot *slot;
+	size_t i, len;
+
+	cmd_dict = rb_dictionary_create_hashed("command", rb_strcasecmp, rb_dictionary_strcase_hash);
+
+	for(i = 0; i < ARRAY_SIZE(core_cmds); i++)
+	{
+		len = strlen(core_cmds[i]);
+		slot = &cmd_fast[cmd_fast_hash(core_cmds[i], len)];
+
+		/* a collision only costs speed, the verb still goes via cmd_dict */
+		if(slot->name != NULL)
+		{
+			ilog(L_MAIN, "Command fast path: %s collides with %s",
+			     core_cmds[i], slot->name);
+			s_assert(0);
+			continue;
+		}
+
+		slot->name = core_cmds[i];
+		slot->len = len;
+	}
 }
 
 /* mod_add_cmd
@@ -289,6 +368,8 @@ clear_hash_parse()
 void
 mod_add_cmd(struct Message *msg)
 {
+	struct cmd_fast_slot *slot;
+
 	s_assert(msg != NULL);
 	if(msg == NULL)
 		return;
@@ -304,6 +385,9 @@ mod_add_cmd(struct Message *msg)
 	msg->bytes = 0;
 
 	rb_dictionary_add(cmd_dict, msg->cmd, msg);
+
+	if((slot = cmd_fast_find(msg->cmd, strlen(msg->cmd))) != NULL)
+		slot->msg = msg;
 }
 
 /* mod_del_cmd
@@ -315,10 +399,15 @@ mod_add_cmd(struct Message *msg)
 void
 mod_del_cmd(struct Message *msg)
 {
+	struct cmd_fast_slot *slot;
+
 	s_assert(msg != NULL);
 	if(msg == NULL)
 		return;
 
+	if((slot = cmd_fast_find(msg->cmd, strlen(msg->cmd))) != NULL && slot->msg == msg)
+		slot->msg = NULL;
+
 	if (rb_dictionary_delete(cmd_dict, msg->cmd) == NULL) {
 		ilog(L_MAIN, "Delete command: %s not found", msg->cmd);
 		s_assert(0);
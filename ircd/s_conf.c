@@ -806,6 +806,7 @@ set_default_conf(void)
 	ConfigChannel.disable_local_channels = false;
 	ConfigChannel.displayed_usercount = 3;
 	ConfigChannel.opmod_send_statusmsg = false;
+	ConfigChannel.ban_refresh = false;
 
 	ConfigChannel.autochanmodes = MODE_TOPICLIMIT | MODE_NOPRIVMSGS;
 
@@ -838,6 +839,7 @@ set_default_conf(void)
 	ConfigFileEntry.certfp_method = RB_SSL_CERTFP_METH_CERT_SHA1;
 	ConfigFileEntry.hide_opers_in_whois = 0;
 	ConfigFileEntry.hide_opers = 0;
+	ConfigFileEntry.deferred_flush = 0;
 
 	if (!alias_dict)
 		alias_dict = rb_dictionary_create("alias", rb_strcasecmp);
@@ -880,6 +882,14 @@ validate_conf(void)
 	if(ServerInfo.network_name == NULL)
 		ServerInfo.network_name = rb_strdup(NETWORK_NAME_DEFAULT);
 
+	/* one per cpu */
+	if(ServerInfo.ssld_count == 0)
+	{
+#ifdef _SC_NPROCESSORS_ONLN
+		ServerInfo.ssld_count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	}
+
 	if(ServerInfo.ssld_count < 1)
 		ServerInfo.ssld_count = 1;
 
@@ -908,6 +918,10 @@ validate_conf(void)
 		start_wsockd(start);
 	}
 
+	if(ServerInfo.wsock_deflate_memory < 0)
+		ServerInfo.wsock_deflate_memory = 0;
+	wsockd_update_config();
+
 	/* General conf */
 	if (ConfigFileEntry.default_operstring == NULL)
 		ConfigFileEntry.default_operstring = rb_strdup("is an IRC operator");
@@ -1129,9 +1143,11 @@ deactivate_conf(struct ConfItem *aconf, rb_dlink_node *ptr, time_t now)
 			break;
 		case CONF_XLINE:
 			rb_dlinkFindDestroy(aconf, &xline_conf_list);
+			xline_conf_changed();
 			break;
 		case CONF_RESV_NICK:
 			rb_dlinkFindDestroy(aconf, &resv_conf_list);
+			resv_conf_changed();
 			break;
 		case CONF_RESV_CHANNEL:
 			del_from_resv_hash(aconf->host, aconf);
@@ -1506,6 +1522,11 @@ clear_out_old_conf(void)
 	ServerInfo.network_name = NULL;
 
 	ServerInfo.ssld_count = 1;
+	ServerInfo.ssl_ktls = 0;
+	ServerInfo.wsock_deflate = 0;
+	ServerInfo.wsock_deflate_context_takeover = 1;
+	ServerInfo.wsock_deflate_memory = 64 * 1024;
+	ServerInfo.wsock_pack_lines = 0;
 
 	/* clean out AdminInfo */
 	rb_free(AdminInfo.name);
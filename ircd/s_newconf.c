@@ -38,6 +38,7 @@
 #include "s_serv.h"
 #include "send.h"
 #include "hostmask.h"
+#include "maskset.h"
 #include "newconf.h"
 #include "hash.h"
 #include "rb_dictionary.h"
@@ -58,6 +59,20 @@ rb_dlink_list tgchange_list;
 
 rb_patricia_tree_t *tgchange_tree;
 
+/* xline_conf_list and resv_conf_list, as mask sets for find_xline()
+ * and find_nick_resv().  Anything changing those lists must call
+ * xline_conf_changed() or resv_conf_changed() so they are rebuilt.
+ */
+struct conf_maskset
+{
+	struct MaskSet *set;
+	rb_dlink_list *list;
+	bool stale;
+};
+
+static struct conf_maskset xline_masks = { NULL, &xline_conf_list, true };
+static struct conf_maskset resv_masks = { NULL, &resv_conf_list, true };
+
 static rb_bh *nd_heap = NULL;
 
 static void expire_temp_rxlines(void *unused);
@@ -150,6 +165,8 @@ clear_s_newconf_bans(void)
 		rb_dlinkDestroy(ptr, &resv_conf_list);
 	}
 
+	xline_conf_changed();
+	resv_conf_changed();
 	clear_resv_hash();
 }
 
@@ -569,25 +586,52 @@ disable_server_conf_autoconn(const char *name)
 	}
 }
 
-struct ConfItem *
-find_xline(const char *gecos, int counter)
+void
+xline_conf_changed(void)
+{
+	xline_masks.stale = true;
+}
+
+void
+resv_conf_changed(void)
+{
+	resv_masks.stale = true;
+}
+
+static struct MaskSet *
+get_conf_maskset(struct conf_maskset *cm)
 {
 	struct ConfItem *aconf;
 	rb_dlink_node *ptr;
 
-	RB_DLINK_FOREACH(ptr, xline_conf_list.head)
-	{
-		aconf = ptr->data;
+	if(cm->set == NULL)
+		cm->set = maskset_create(MASKSET_MATCH_ESC);
 
-		if(match_esc(aconf->host, gecos))
+	/* the length check is only a safety net for a missed call */
+	if(cm->stale || (unsigned long)maskset_size(cm->set) != rb_dlink_list_length(cm->list))
+	{
+		maskset_clear(cm->set);
+		RB_DLINK_FOREACH(ptr, cm->list->head)
 		{
-			if(counter)
-				aconf->port++;
-			return aconf;
+			aconf = ptr->data;
+			maskset_add(cm->set, aconf->host, aconf);
 		}
+		cm->stale = false;
 	}
 
-	return NULL;
+	return cm->set;
+}
+
+struct ConfItem *
+find_xline(const char *gecos, int counter)
+{
+	struct ConfItem *aconf;
+
+	aconf = maskset_find(get_conf_maskset(&xline_masks), gecos);
+	if(aconf != NULL && counter)
+		aconf->port++;
+
+	return aconf;
 }
 
 struct ConfItem *
@@ -611,20 +655,12 @@ struct ConfItem *
 find_nick_resv(const char *name)
 {
 	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
 
-	RB_DLINK_FOREACH(ptr, resv_conf_list.head)
-	{
-		aconf = ptr->data;
+	aconf = maskset_find(get_conf_maskset(&resv_masks), name);
+	if(aconf != NULL)
+		aconf->port++;
 
-		if(match_esc(aconf->host, name))
-		{
-			aconf->port++;
-			return aconf;
-		}
-	}
-
-	return NULL;
+	return aconf;
 }
 
 struct ConfItem *
@@ -783,6 +819,7 @@ expire_temp_rxlines(void *unused)
 						aconf->host);
 			free_conf(aconf);
 			rb_dlinkDestroy(ptr, &resv_conf_list);
+			resv_conf_changed();
 		}
 	}
 
@@ -800,6 +837,7 @@ expire_temp_rxlines(void *unused)
 						aconf->host);
 			free_conf(aconf);
 			rb_dlinkDestroy(ptr, &xline_conf_list);
+			xline_conf_changed();
 		}
 	}
 }
@@ -430,7 +430,7 @@ check_server(const char *name, struct Client *client_p)
 		return error;
 	}
 
-	if(ServerConfSSL(server_p) && client_p->localClient->ssl_ctl == NULL)
+	if(ServerConfSSL(server_p) && !IsSSL(client_p))
 	{
 		return -5;
 	}
@@ -529,6 +529,109 @@ burst_ban(struct Client *client_p)
 	}
 }
 
+/*
+ * The netburst is not written out in one go: the users and channels that
+ * exist when the link is established are snapshotted, and the lines for
+ * them are generated a few at a time whenever the sendq to the new server
+ * runs low. Traffic relayed to the link in the meantime is held back in
+ * holdq and released after the burst, so the remote side still sees all
+ * state before the changes to it. Entities that disappear before their
+ * turn are skipped; those that changed are sent as they are now, which
+ * makes the held changes no-ops under TS6 rules.
+ *
+ * Direct replies to the remote's own lines (PONG, the KILL or SAVE for a
+ * nick collision, errors) are not held, see client_dopacket(), as the
+ * remote would otherwise act on its side of a collision for the rest of
+ * our burst. Such a reply can get ahead of a held change to something
+ * already bursted, e.g. a SAVE ahead of a held NICK of the same user; the
+ * remote then resolves the later line against the saved nick as usual.
+ */
+
+/* refill the sendq once it drops below this */
+#define BURST_LOWAT	(64 * 1024)
+/* most we generate in one go before yielding to the event loop */
+#define BURST_SLICE	(256 * 1024)
+/* msec until the next slice, other clients are served in between */
+#define BURST_INTERVAL	2
+
+/* burst lines are assembled with memcpy instead of going through
+ * the printf machinery of sendto_one(); they are clipped to DATALEN
+ * just like sendto_one() would
+ */
+struct burst_line
+{
+	char *p;
+	char buf[DATALEN + 1];
+};
+
+static inline void
+bl_init(struct burst_line *bl)
+{
+	bl->p = bl->buf;
+}
+
+static inline void
+bl_mem(struct burst_line *bl, const char *s, size_t len)
+{
+	size_t room = bl->buf + DATALEN - bl->p;
+
+	if(len > room)
+		len = room;
+	memcpy(bl->p, s, len);
+	bl->p += len;
+}
+
+static inline void
+bl_str(struct burst_line *bl, const char *s)
+{
+	bl_mem(bl, s, strlen(s));
+}
+
+static inline void
+bl_chr(struct burst_line *bl, char c)
+{
+	if(bl->p < bl->buf + DATALEN)
+		*bl->p++ = c;
+}
+
+static void
+bl_long(struct burst_line *bl, long v)
+{
+	char tmp[24];
+	char *t = tmp + sizeof(tmp);
+	unsigned long u = v < 0 ? -(unsigned long)v : (unsigned long)v;
+
+	do
+	{
+		*--t = '0' + u % 10;
+		u /= 10;
+	} while(u);
+
+	if(v < 0)
+		*--t = '-';
+
+	bl_mem(bl, t, tmp + sizeof(tmp) - t);
+}
+
+/* ":<source> <command>" */
+static inline void
+bl_start(struct burst_line *bl, const char *source, const char *command)
+{
+	bl_init(bl);
+	bl_chr(bl, ':');
+	bl_str(bl, source);
+	bl_chr(bl, ' ');
+	bl_str(bl, command);
+}
+
+static void
+bl_send(struct Client *client_p, struct burst_line *bl)
+{
+	rb_linebuf_putbuf(&client_p->localClient->buf_sendq, bl->buf, bl->p - bl->buf);
+	client_p->localClient->sendM += 1;
+	me.localClient->sendM += 1;
+}
+
 /* burst_modes_TS6()
  *
  * input	- client to burst to, channel name, list to burst, mode flag
@@ -539,22 +642,30 @@ static void
 burst_modes_TS6(struct Client *client_p, struct Channel *chptr,
 		rb_dlink_list *list, char flag)
 {
+	struct burst_line bl;
 	rb_dlink_node *ptr;
 	struct Ban *banptr;
-	char *t;
+	size_t blen, flen;
 	int tlen;
 	int mlen;
 	int cur_len;
 
-	cur_len = mlen = sprintf(buf, ":%s BMASK %ld %s %c :",
-				    me.id, (long) chptr->channelts, chptr->chname, flag);
-	t = buf + mlen;
+	bl_start(&bl, me.id, "BMASK ");
+	bl_long(&bl, (long) chptr->channelts);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, chptr->chname);
+	bl_chr(&bl, ' ');
+	bl_chr(&bl, flag);
+	bl_mem(&bl, " :", 2);
+	cur_len = mlen = bl.p - bl.buf;
 
 	RB_DLINK_FOREACH(ptr, list->head)
 	{
 		banptr = ptr->data;
 
-		tlen = strlen(banptr->banstr) + (banptr->forward ? strlen(banptr->forward) + 1 : 0) + 1;
+		blen = strlen(banptr->banstr);
+		flen = banptr->forward ? strlen(banptr->forward) : 0;
+		tlen = blen + (banptr->forward ? flen + 1 : 0) + 1;
 
 		/* uh oh */
 		if(cur_len + tlen > BUFSIZE - 3)
@@ -567,195 +678,476 @@ burst_modes_TS6(struct Client *client_p, struct Channel *chptr,
 			}
 
 			/* chop off trailing space and send.. */
-			*(t-1) = '\0';
-			sendto_one(client_p, "%s", buf);
+			bl.p--;
+			bl_send(client_p, &bl);
 			cur_len = mlen;
-			t = buf + mlen;
+			bl.p = bl.buf + mlen;
 		}
 
+		bl_mem(&bl, banptr->banstr, blen);
 		if (banptr->forward)
-			sprintf(t, "%s$%s ", banptr->banstr, banptr->forward);
-		else
-			sprintf(t, "%s ", banptr->banstr);
-		t += tlen;
+		{
+			bl_chr(&bl, '$');
+			bl_mem(&bl, banptr->forward, flen);
+		}
+		bl_chr(&bl, ' ');
 		cur_len += tlen;
 	}
 
 	/* cant ever exit the loop above without having modified buf,
 	 * chop off trailing space and send.
 	 */
-	*(t-1) = '\0';
-	sendto_one(client_p, "%s", buf);
+	bl.p--;
+	bl_send(client_p, &bl);
 }
 
 /*
- * burst_TS6
+ * burst_client
  *
- * inputs	- client (server) to send nick towards
- * 		- client to send nick for
+ * inputs	- server to burst to, client to burst
  * output	- NONE
- * side effects	- NICK message is sent towards given client_p
+ * side effects	- UID/EUID and associated state for target_p is queued
  */
 static void
-burst_TS6(struct Client *client_p)
+burst_client(struct Client *client_p, struct ServerBurst *burst, struct Client *target_p)
 {
-	char ubuf[BUFSIZE];
-	struct Client *target_p;
-	struct Channel *chptr;
-	struct membership *msptr;
+	struct burst_line bl;
 	hook_data_client hclientinfo;
+	char ubuf[BUFSIZE];
+	bool euid = IsCapable(client_p, CAP_EUID);
+
+	send_umode(NULL, target_p, 0, ubuf);
+	if(!*ubuf)
+	{
+		ubuf[0] = '+';
+		ubuf[1] = '\0';
+	}
+
+	bl_start(&bl, target_p->servptr->id, euid ? "EUID " : "UID ");
+	bl_str(&bl, target_p->name);
+	bl_chr(&bl, ' ');
+	bl_long(&bl, target_p->hopcount + 1);
+	bl_chr(&bl, ' ');
+	bl_long(&bl, (long) target_p->tsinfo);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, ubuf);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, target_p->username);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, target_p->host);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, IsIPSpoof(target_p) ? "0" : target_p->sockhost);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, target_p->id);
+	if(euid)
+	{
+		bl_chr(&bl, ' ');
+		bl_str(&bl, IsDynSpoof(target_p) ? target_p->orighost : "*");
+		bl_chr(&bl, ' ');
+		bl_str(&bl, EmptyString(target_p->user->suser) ? "*" : target_p->user->suser);
+	}
+	bl_mem(&bl, " :", 2);
+	bl_str(&bl, target_p->info);
+	bl_send(client_p, &bl);
+
+	if(!EmptyString(target_p->certfp))
+	{
+		bl_start(&bl, use_id(target_p), "ENCAP * CERTFP :");
+		bl_str(&bl, target_p->certfp);
+		bl_send(client_p, &bl);
+	}
+
+	if(!euid)
+	{
+		if(IsDynSpoof(target_p))
+		{
+			bl_start(&bl, use_id(target_p), "ENCAP * REALHOST ");
+			bl_str(&bl, target_p->orighost);
+			bl_send(client_p, &bl);
+		}
+		if(!EmptyString(target_p->user->suser))
+		{
+			bl_start(&bl, use_id(target_p), "ENCAP * LOGIN ");
+			bl_str(&bl, target_p->user->suser);
+			bl_send(client_p, &bl);
+		}
+	}
+
+	if(ConfigFileEntry.burst_away && !EmptyString(target_p->user->away))
+	{
+		bl_start(&bl, use_id(target_p), "AWAY :");
+		bl_str(&bl, target_p->user->away);
+		bl_send(client_p, &bl);
+	}
+
+	if(IsOper(target_p) && target_p->user && target_p->user->opername && target_p->user->privset)
+	{
+		bl_start(&bl, use_id(target_p), "OPER ");
+		bl_str(&bl, target_p->user->opername);
+		bl_chr(&bl, ' ');
+		bl_str(&bl, target_p->user->privset->name);
+		bl_send(client_p, &bl);
+	}
+
+	hclientinfo.client = client_p;
+	hclientinfo.target = target_p;
+	burst->direct = true;
+	call_hook(h_burst_client, &hclientinfo);
+	burst->direct = false;
+}
+
+/*
+ * burst_channel
+ *
+ * inputs	- server to burst to, channel to burst
+ * output	- NONE
+ * side effects	- SJOIN, ban lists, topic and mlock for chptr are queued
+ */
+static void
+burst_channel(struct Client *client_p, struct ServerBurst *burst, struct Channel *chptr)
+{
+	struct burst_line bl;
 	hook_data_channel hchaninfo;
-	rb_dlink_node *ptr;
+	struct membership *msptr;
 	rb_dlink_node *uptr;
-	char *t;
+	const char *id;
+	size_t idlen;
 	int tlen, mlen;
-	int cur_len = 0;
+	int cur_len;
 
-	hclientinfo.client = hchaninfo.client = client_p;
+	bl_start(&bl, me.id, "SJOIN ");
+	bl_long(&bl, (long) chptr->channelts);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, chptr->chname);
+	bl_chr(&bl, ' ');
+	bl_str(&bl, channel_modes(chptr, client_p));
+	bl_mem(&bl, " :", 2);
+	cur_len = mlen = bl.p - bl.buf;
 
-	RB_DLINK_FOREACH(ptr, global_client_list.head)
+	RB_DLINK_FOREACH(uptr, chptr->members.head)
 	{
-		target_p = ptr->data;
+		msptr = uptr->data;
 
-		if(!IsPerson(target_p))
-			continue;
-
-		if(MyClient(target_p->from) && target_p->localClient->att_sconf != NULL && ServerConfNoExport(target_p->localClient->att_sconf))
-			continue;
+		id = use_id(msptr->client_p);
+		idlen = strlen(id);
+		tlen = idlen + 1;
+		if(is_chanop(msptr))
+			tlen++;
+		if(is_voiced(msptr))
+			tlen++;
 
-		send_umode(NULL, target_p, 0, ubuf);
-		if(!*ubuf)
+		if(cur_len + tlen >= BUFSIZE - 3)
 		{
-			ubuf[0] = '+';
-			ubuf[1] = '\0';
+			bl.p--;
+			bl_send(client_p, &bl);
+			cur_len = mlen;
+			bl.p = bl.buf + mlen;
 		}
 
-		if(IsCapable(client_p, CAP_EUID))
-			sendto_one(client_p, ":%s EUID %s %d %ld %s %s %s %s %s %s %s :%s",
-				   target_p->servptr->id, target_p->name,
-				   target_p->hopcount + 1,
-				   (long) target_p->tsinfo, ubuf,
-				   target_p->username, target_p->host,
-				   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
-				   target_p->id,
-				   IsDynSpoof(target_p) ? target_p->orighost : "*",
-				   EmptyString(target_p->user->suser) ? "*" : target_p->user->suser,
-				   target_p->info);
-		else
-			sendto_one(client_p, ":%s UID %s %d %ld %s %s %s %s %s :%s",
-				   target_p->servptr->id, target_p->name,
-				   target_p->hopcount + 1,
-				   (long) target_p->tsinfo, ubuf,
-				   target_p->username, target_p->host,
-				   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
-				   target_p->id, target_p->info);
+		if(is_chanop(msptr))
+			bl_chr(&bl, '@');
+		if(is_voiced(msptr))
+			bl_chr(&bl, '+');
+		bl_mem(&bl, id, idlen);
+		bl_chr(&bl, ' ');
+
+		cur_len += tlen;
+	}
+
+	if (rb_dlink_list_length(&chptr->members) > 0)
+	{
+		/* remove trailing space */
+		bl.p--;
+	}
+	bl_send(client_p, &bl);
 
-		if(!EmptyString(target_p->certfp))
-			sendto_one(client_p, ":%s ENCAP * CERTFP :%s",
-					use_id(target_p), target_p->certfp);
+	if(rb_dlink_list_length(&chptr->banlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->banlist, 'b');
 
-		if(!IsCapable(client_p, CAP_EUID))
+	if(IsCapable(client_p, CAP_EX) &&
+	   rb_dlink_list_length(&chptr->exceptlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->exceptlist, 'e');
+
+	if(IsCapable(client_p, CAP_IE) &&
+	   rb_dlink_list_length(&chptr->invexlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->invexlist, 'I');
+
+	if(rb_dlink_list_length(&chptr->quietlist) > 0)
+		burst_modes_TS6(client_p, chptr, &chptr->quietlist, 'q');
+
+	if(IsCapable(client_p, CAP_TB) && chptr->topic != NULL)
+	{
+		bl_start(&bl, me.id, "TB ");
+		bl_str(&bl, chptr->chname);
+		bl_chr(&bl, ' ');
+		bl_long(&bl, (long) chptr->topic_time);
+		bl_chr(&bl, ' ');
+		if(ConfigChannel.burst_topicwho)
 		{
-			if(IsDynSpoof(target_p))
-				sendto_one(client_p, ":%s ENCAP * REALHOST %s",
-						use_id(target_p), target_p->orighost);
-			if(!EmptyString(target_p->user->suser))
-				sendto_one(client_p, ":%s ENCAP * LOGIN %s",
-						use_id(target_p), target_p->user->suser);
+			bl_str(&bl, chptr->topic_info);
+			bl_chr(&bl, ' ');
 		}
+		bl_chr(&bl, ':');
+		bl_str(&bl, chptr->topic);
+		bl_send(client_p, &bl);
+	}
 
-		if(ConfigFileEntry.burst_away && !EmptyString(target_p->user->away))
-			sendto_one(client_p, ":%s AWAY :%s",
-				   use_id(target_p),
-				   target_p->user->away);
+	if(IsCapable(client_p, CAP_MLOCK))
+	{
+		bl_start(&bl, me.id, "MLOCK ");
+		bl_long(&bl, (long) chptr->channelts);
+		bl_chr(&bl, ' ');
+		bl_str(&bl, chptr->chname);
+		bl_mem(&bl, " :", 2);
+		if(!EmptyString(chptr->mode_lock))
+			bl_str(&bl, chptr->mode_lock);
+		bl_send(client_p, &bl);
+	}
 
-		if(IsOper(target_p) && target_p->user && target_p->user->opername && target_p->user->privset)
-			sendto_one(client_p, ":%s OPER %s %s",
-					use_id(target_p),
-					target_p->user->opername,
-					target_p->user->privset->name);
+	hchaninfo.client = client_p;
+	hchaninfo.chptr = chptr;
+	burst->direct = true;
+	call_hook(h_burst_channel, &hchaninfo);
+	burst->direct = false;
+}
 
-		hclientinfo.target = target_p;
-		call_hook(h_burst_client, &hclientinfo);
-	}
+/*
+ * burst_step
+ *
+ * inputs	- server being bursted, its burst state
+ * output	- false once there is nothing left to send
+ * side effects	- the next user or channel in the snapshot is queued
+ */
+static bool
+burst_step(struct Client *client_p, struct ServerBurst *burst)
+{
+	struct Client *target_p;
+	struct Channel *chptr;
 
-	RB_DLINK_FOREACH(ptr, global_channel_list.head)
+	while(burst->upos < burst->nuids)
 	{
-		chptr = ptr->data;
+		target_p = find_id(burst->uids[burst->upos++]);
+		if(target_p == NULL || !IsPerson(target_p))
+			continue;
 
-		if(*chptr->chname != '#')
+		if(MyClient(target_p->from) && target_p->localClient->att_sconf != NULL && ServerConfNoExport(target_p->localClient->att_sconf))
 			continue;
 
-		cur_len = mlen = sprintf(buf, ":%s SJOIN %ld %s %s :", me.id,
-				(long) chptr->channelts, chptr->chname,
-				channel_modes(chptr, client_p));
+		burst_client(client_p, burst, target_p);
+		return true;
+	}
 
-		t = buf + mlen;
+	while(burst->cpos < burst->nchans)
+	{
+		chptr = find_channel(burst->chnames[burst->cpos]);
+		rb_free(burst->chnames[burst->cpos]);
+		burst->chnames[burst->cpos++] = NULL;
+		if(chptr == NULL)
+			continue;
 
-		RB_DLINK_FOREACH(uptr, chptr->members.head)
-		{
-			msptr = uptr->data;
+		burst_channel(client_p, burst, chptr);
+		return true;
+	}
 
-			tlen = strlen(use_id(msptr->client_p)) + 1;
-			if(is_chanop(msptr))
-				tlen++;
-			if(is_voiced(msptr))
-				tlen++;
+	return false;
+}
 
-			if(cur_len + tlen >= BUFSIZE - 3)
-			{
-				*(t-1) = '\0';
-				sendto_one(client_p, "%s", buf);
-				cur_len = mlen;
-				t = buf + mlen;
-			}
+static void
+burst_free(struct ServerBurst *burst)
+{
+	size_t i;
+
+	if(burst->ev != NULL)
+		rb_event_delete(burst->ev);
+
+	for(i = burst->cpos; i < burst->nchans; i++)
+		rb_free(burst->chnames[i]);
+
+	rb_linebuf_donebuf(&burst->holdq);
+	rb_free(burst->chnames);
+	rb_free(burst->uids);
+	rb_free(burst);
+}
+
+/*
+ * burst_finish
+ *
+ * inputs	- server that has been bursted
+ * output	- NONE
+ * side effects	- end of burst is sent, held traffic is released and
+ *		  the burst state freed
+ */
+static void
+burst_finish(struct Client *client_p, struct ServerBurst *burst)
+{
+	hook_data_client hclientinfo;
+	const struct timeval *now;
+	unsigned long long msec;
+
+	burst->direct = true;
+	hclientinfo.client = client_p;
+	hclientinfo.target = NULL;
+	call_hook(h_burst_finished, &hclientinfo);
+
+	/* Always send a PING after connect burst is done */
+	sendto_one(client_p, "PING :%s", get_id(&me, client_p));
+
+	if(IsAnyDead(client_p))
+		return;
+
+	rb_set_time();
+	now = rb_current_time_tv();
+	msec = (now->tv_sec - burst->start.tv_sec) * 1000ULL +
+		(now->tv_usec - burst->start.tv_usec) / 1000;
+
+	ServerStats.is_bst++;
+	ServerStats.is_bstl += burst->lines;
+	ServerStats.is_bstb += burst->bytes;
+	ServerStats.is_bstt += msec;
+
+	sendto_realops_snomask(SNO_GENERAL, L_ALL,
+			"Burst to %s sent: %lu lines, %llu bytes in %llu.%03llu seconds",
+			client_p->name, burst->lines, burst->bytes,
+			msec / 1000, msec % 1000);
+
+	client_p->localClient->burst = NULL;
+	rb_linebuf_attach(&client_p->localClient->buf_sendq, &burst->holdq);
+	burst_free(burst);
+
+	send_queued(client_p);
+}
+
+static void
+burst_event(void *data)
+{
+	struct Client *client_p = data;
+
+	client_p->localClient->burst->ev = NULL;
+	burst_continue(client_p);
+}
+
+/*
+ * burst_continue
+ *
+ * inputs	- server being bursted
+ * output	- NONE
+ * side effects	- generates burst lines until the sendq fills up or a
+ *		  slice is used up, finishing the burst if it is done
+ */
+void
+burst_continue(struct Client *client_p)
+{
+	struct ServerBurst *burst = client_p->localClient->burst;
+	buf_head_t *sendq = &client_p->localClient->buf_sendq;
+	unsigned long long produced = 0;
+	unsigned int len;
+	int lines;
+	bool done = false;
+
+	if(burst == NULL || burst->running || burst->ev != NULL)
+		return;
 
-			sprintf(t, "%s%s ", find_channel_status(msptr, 1),
-				   use_id(msptr->client_p));
+	burst->running = true;
+	while(!IsAnyDead(client_p))
+	{
+		if(rb_linebuf_len(sendq) >= BURST_LOWAT)
+		{
+			/* wait for the write event if it doesnt drain */
+			send_queued(client_p);
+			if(rb_linebuf_len(sendq) >= BURST_LOWAT)
+				break;
+		}
 
-			cur_len += tlen;
-			t += tlen;
+		if(produced >= BURST_SLICE)
+		{
+			burst->ev = rb_event_addonce_msec("burst_continue", burst_event, client_p,
+					BURST_INTERVAL);
+			send_queued(client_p);
+			break;
 		}
 
-		if (rb_dlink_list_length(&chptr->members) > 0)
+		len = rb_linebuf_len(sendq);
+		lines = rb_linebuf_numlines(sendq);
+		if(!burst_step(client_p, burst))
 		{
-			/* remove trailing space */
-			*(t-1) = '\0';
+			done = true;
+			break;
 		}
-		sendto_one(client_p, "%s", buf);
+		burst->bytes += rb_linebuf_len(sendq) - len;
+		burst->lines += rb_linebuf_numlines(sendq) - lines;
+		produced += rb_linebuf_len(sendq) - len;
+	}
+	burst->running = false;
 
-		if(rb_dlink_list_length(&chptr->banlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->banlist, 'b');
+	if(done)
+		burst_finish(client_p, burst);
+}
 
-		if(IsCapable(client_p, CAP_EX) &&
-		   rb_dlink_list_length(&chptr->exceptlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->exceptlist, 'e');
+/*
+ * burst_abort
+ *
+ * inputs	- server link going away
+ * output	- NONE
+ * side effects	- any unfinished burst state is freed
+ */
+void
+burst_abort(struct Client *client_p)
+{
+	struct ServerBurst *burst = client_p->localClient->burst;
 
-		if(IsCapable(client_p, CAP_IE) &&
-		   rb_dlink_list_length(&chptr->invexlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->invexlist, 'I');
+	if(burst == NULL)
+		return;
 
-		if(rb_dlink_list_length(&chptr->quietlist) > 0)
-			burst_modes_TS6(client_p, chptr, &chptr->quietlist, 'q');
+	client_p->localClient->burst = NULL;
+	burst_free(burst);
+}
 
-		if(IsCapable(client_p, CAP_TB) && chptr->topic != NULL)
-			sendto_one(client_p, ":%s TB %s %ld %s%s:%s",
-				   me.id, chptr->chname, (long) chptr->topic_time,
-				   ConfigChannel.burst_topicwho ? chptr->topic_info : "",
-				   ConfigChannel.burst_topicwho ? " " : "",
-				   chptr->topic);
+/*
+ * burst_TS6
+ *
+ * inputs	- client (server) to burst to
+ * output	- NONE
+ * side effects	- current users and channels are snapshotted and the
+ *		  netburst to client_p is started
+ */
+static void
+burst_TS6(struct Client *client_p)
+{
+	struct ServerBurst *burst;
+	struct Client *target_p;
+	struct Channel *chptr;
+	rb_dlink_node *ptr;
+
+	burst = rb_malloc(sizeof(struct ServerBurst));
+	burst->uids = rb_malloc(sizeof(*burst->uids) * (rb_dlink_list_length(&global_client_list) + 1));
+	burst->chnames = rb_malloc(sizeof(char *) * (rb_dlink_list_length(&global_channel_list) + 1));
+
+	RB_DLINK_FOREACH(ptr, global_client_list.head)
+	{
+		target_p = ptr->data;
 
-		if(IsCapable(client_p, CAP_MLOCK))
-			sendto_one(client_p, ":%s MLOCK %ld %s :%s",
-				   me.id, (long) chptr->channelts, chptr->chname,
-				   EmptyString(chptr->mode_lock) ? "" : chptr->mode_lock);
+		if(!IsPerson(target_p))
+			continue;
 
-		hchaninfo.chptr = chptr;
-		call_hook(h_burst_channel, &hchaninfo);
+		rb_strlcpy(burst->uids[burst->nuids++], target_p->id, IDLEN);
 	}
 
-	hclientinfo.target = NULL;
-	call_hook(h_burst_finished, &hclientinfo);
+	RB_DLINK_FOREACH(ptr, global_channel_list.head)
+	{
+		chptr = ptr->data;
+
+		if(*chptr->chname != '#')
+			continue;
+
+		burst->chnames[burst->nchans++] = rb_strdup(chptr->chname);
+	}
+
+	rb_linebuf_newbuf(&burst->holdq);
+	rb_set_time();
+	burst->start = *rb_current_time_tv();
+
+	client_p->localClient->burst = burst;
+	burst_continue(client_p);
 }
 
 /*
@@ -998,11 +1390,11 @@ server_estab(struct Client *client_p)
 	if(IsCapable(client_p, CAP_BAN))
 		burst_ban(client_p);
 
+	/* the rest of the burst, and the PING that ends it,
+	 * are sent as the sendq drains
+	 */
 	burst_TS6(client_p);
 
-	/* Always send a PING after connect burst is done */
-	sendto_one(client_p, "PING :%s", get_id(&me, client_p));
-
 	free_pre_client(client_p);
 
 	send_pop_queue(client_p);
@@ -44,6 +44,8 @@
 #include "whowas.h"
 #include "packet.h"
 #include "reject.h"
+#include "clientindex.h"
+#include "userindex.h"
 #include "cache.h"
 #include "hook.h"
 #include "monitor.h"
@@ -643,6 +645,8 @@ register_local_user(struct Client *client_p, struct Client *source_p)
 	s_assert(!IsClient(source_p));
 	rb_dlinkMoveNode(&source_p->localClient->tnode, &unknown_list, &lclient_list);
 	SetClient(source_p);
+	client_index_add(source_p);
+	user_index_add(source_p);
 
 	source_p->servptr = &me;
 	rb_dlinkAdd(source_p, &source_p->lnode, &source_p->servptr->serv->users);
@@ -1638,6 +1642,9 @@ change_nick_user_host(struct Client *target_p,	const char *nick, const char *use
 	rb_strlcpy(target_p->name, nick, NICKLEN);
 	add_to_client_hash(target_p->name, target_p);
 
+	invalidate_client_matchset(target_p);
+	user_index_update(target_p);
+
 	if(changed)
 	{
 		monitor_signon(target_p);
@@ -0,0 +1,248 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  safelist.c: Replies generated as the client's sendq drains.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "client.h"
+#include "ircd.h"
+#include "class.h"
+#include "packet.h"
+#include "safelist.h"
+#include "send.h"
+#include "s_assert.h"
+
+/* A reply that may not fit in a client's sendq (LIST, WHO or NAMES on
+ * a big channel) is queued as a job.  The job's step callback generates
+ * lines until half of the sendq is in use and is called again from the
+ * write event once the client has read some of it, so a reply never
+ * takes more than that and the client can't be killed by its own
+ * request.  Each client's jobs run one after another in the order they
+ * were started.
+ *
+ * A job may hold the client's input as well: no further commands are
+ * parsed until it is done, so the replies to them come after it, as
+ * they would have if it had been sent in one go.
+ */
+struct SafelistJob
+{
+	rb_dlink_node node;
+	safelist_step_cb step;
+	safelist_done_cb done;
+	void *data;
+	bool hold_input;
+};
+
+/*
+ * safelist_sendq_exceeded()
+ *
+ * inputs       - pointer to client that needs checking
+ * outputs      - true if a client has exceeded the reserved
+ *                sendq limit, false if not
+ * side effects - the sendq may be written
+ *
+ * When safelisting, we only use half of the SendQ at any
+ * given time.
+ */
+bool
+safelist_sendq_exceeded(struct Client *client_p)
+{
+	buf_head_t *sendq = &client_p->localClient->buf_sendq;
+
+	if(rb_linebuf_len(sendq) <= get_sendq(client_p) / 2)
+		return false;
+
+	/* a deferred flush may not have got to it yet */
+	send_queued(client_p);
+	return rb_linebuf_len(sendq) > get_sendq(client_p) / 2;
+}
+
+bool
+safelist_busy(struct Client *client_p)
+{
+	return MyConnect(client_p) && client_p->localClient->safelist_jobs.head != NULL;
+}
+
+bool
+safelist_holds_input(struct Client *client_p)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, client_p->localClient->safelist_jobs.head)
+	{
+		struct SafelistJob *job = ptr->data;
+
+		if(job->hold_input)
+			return true;
+	}
+
+	return false;
+}
+
+bool
+safelist_pending(struct Client *client_p, safelist_step_cb step)
+{
+	rb_dlink_node *ptr;
+
+	if(!MyConnect(client_p))
+		return false;
+
+	RB_DLINK_FOREACH(ptr, client_p->localClient->safelist_jobs.head)
+	{
+		struct SafelistJob *job = ptr->data;
+
+		if(job->step == step)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+free_job(struct Client *client_p, struct SafelistJob *job, bool aborted)
+{
+	rb_dlinkDelete(&job->node, &client_p->localClient->safelist_jobs);
+	job->done(client_p, job->data, aborted);
+	rb_free(job);
+}
+
+static void
+run_jobs(struct Client *client_p)
+{
+	rb_dlink_node *ptr;
+	struct SafelistJob *job;
+
+	while(!IsAnyDead(client_p) && (ptr = client_p->localClient->safelist_jobs.head) != NULL)
+	{
+		job = ptr->data;
+		if(!job->step(client_p, job->data))
+			return;
+
+		free_job(client_p, job, false);
+	}
+}
+
+/*
+ * safelist_start()
+ *
+ * inputs       - local client, callbacks generating the reply and its
+ *                end, their data, whether to hold the client's input
+ * outputs      - none
+ * side effects - the reply is sent as far as the sendq allows, after
+ *                any replies that are still in progress
+ */
+void
+safelist_start(struct Client *client_p, safelist_step_cb step,
+		safelist_done_cb done, void *data, bool hold_input)
+{
+	struct SafelistJob *job;
+
+	s_assert(MyConnect(client_p));
+
+	job = rb_malloc(sizeof(struct SafelistJob));
+	job->step = step;
+	job->done = done;
+	job->data = data;
+	job->hold_input = hold_input;
+	rb_dlinkAddTail(job, &job->node, &client_p->localClient->safelist_jobs);
+
+	if(rb_dlink_list_length(&client_p->localClient->safelist_jobs) == 1)
+		run_jobs(client_p);
+}
+
+/*
+ * safelist_cancel()
+ *
+ * inputs       - local client, step callback of the jobs to cancel
+ * outputs      - none
+ * side effects - the matching replies are ended where they are
+ */
+void
+safelist_cancel(struct Client *client_p, safelist_step_cb step)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	if(!MyConnect(client_p))
+		return;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, client_p->localClient->safelist_jobs.head)
+	{
+		struct SafelistJob *job = ptr->data;
+
+		if(job->step == step)
+			free_job(client_p, job, false);
+	}
+
+	run_jobs(client_p);
+}
+
+/*
+ * safelist_cancel_all()
+ *
+ * inputs       - step callback of a module that is going away
+ * outputs      - none
+ * side effects - its replies are ended for every client
+ */
+void
+safelist_cancel_all(safelist_step_cb step)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
+		safelist_cancel(ptr->data, step);
+}
+
+/*
+ * safelist_continue()
+ *
+ * inputs       - local client whose sendq was written
+ * outputs      - none
+ * side effects - more of the replies in progress are sent, and the
+ *                client's commands are parsed again if they were held
+ *                and are no longer
+ */
+void
+safelist_continue(struct Client *client_p)
+{
+	bool held;
+
+	if(!safelist_busy(client_p))
+		return;
+
+	held = safelist_holds_input(client_p);
+	run_jobs(client_p);
+
+	if(held && !IsAnyDead(client_p) && !safelist_holds_input(client_p))
+		parse_client_queued(client_p);
+}
+
+/*
+ * safelist_abort()
+ *
+ * inputs       - local client that is going away
+ * outputs      - none
+ * side effects - its replies are dropped
+ */
+void
+safelist_abort(struct Client *client_p)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, client_p->localClient->safelist_jobs.head)
+		free_job(client_p, ptr->data, true);
+}
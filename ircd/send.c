@@ -34,10 +34,12 @@
 #include "s_serv.h"
 #include "s_conf.h"
 #include "s_newconf.h"
+#include "s_stats.h"
 #include "logger.h"
 #include "hook.h"
 #include "monitor.h"
 #include "msgbuf.h"
+#include "safelist.h"
 
 /* send the message to the link the target is attached to */
 #define send_linebuf(a,b) _send_linebuf((a->from ? a->from : a) ,b)
@@ -48,6 +50,9 @@ static void send_queued_write(rb_fde_t *F, void *data);
 
 unsigned long current_serial = 0L;
 
+/* local clients with data queued for the deferred flush pass */
+static rb_dlink_list dirty_sendq_list;
+
 struct Client *remote_rehash_oper_p;
 
 /* send_linebuf()
@@ -65,28 +70,43 @@ _send_linebuf(struct Client *to, buf_head_t *linebuf)
 		return 0;
 	}
 
+	struct ServerBurst *burst;
+	unsigned int queued;
+
 	if(!MyConnect(to) || IsIOError(to))
 		return 0;
 
-	if(rb_linebuf_len(&to->localClient->buf_sendq) > get_sendq(to))
+	burst = to->localClient->burst;
+	queued = rb_linebuf_len(&to->localClient->buf_sendq);
+	if(burst != NULL)
+		queued += rb_linebuf_len(&burst->holdq);
+
+	if(queued > get_sendq(to))
 	{
 		if(IsServer(to))
 		{
 			sendto_realops_snomask(SNO_GENERAL, L_ALL,
 					     "Max SendQ limit exceeded for %s: %u > %lu",
-					     to->name,
-					     rb_linebuf_len(&to->localClient->buf_sendq),
-					     get_sendq(to));
+					     to->name, queued, get_sendq(to));
 
 			ilog(L_SERVER, "Max SendQ limit exceeded for %s: %u > %lu",
 			     log_client_name(to, SHOW_IP),
-			     rb_linebuf_len(&to->localClient->buf_sendq),
-			     get_sendq(to));
+			     queued, get_sendq(to));
 		}
 
 		dead_link(to, 1);
 		return -1;
 	}
+	else if(burst != NULL && !burst->direct && !burst->replying)
+	{
+		/* the link is still being bursted, anything that happens
+		 * meanwhile has to go out after the state it applies to
+		 */
+		rb_linebuf_attach(&burst->holdq, linebuf);
+		to->localClient->sendM += 1;
+		me.localClient->sendM += 1;
+		return 0;
+	}
 	else
 	{
 		/* just attach the linebuf to the sendq instead of
@@ -103,10 +123,76 @@ _send_linebuf(struct Client *to, buf_head_t *linebuf)
 	to->localClient->sendM += 1;
 	me.localClient->sendM += 1;
 	if(rb_linebuf_len(&to->localClient->buf_sendq) > 0)
-		send_queued(to);
+	{
+		if(ConfigFileEntry.deferred_flush)
+			send_queued_deferred(to);
+		else
+			send_queued(to);
+	}
 	return 0;
 }
 
+/* send_queued_deferred()
+ *
+ * inputs	- client with data in its sendq
+ * outputs	-
+ * side effects - client is put on the dirty list, its sendq will be
+ *		  written by flush_dirty_sendqs() at the end of this pass
+ *		  through the event loop
+ */
+void
+send_queued_deferred(struct Client *to)
+{
+	if(IsSendqDirty(to))
+	{
+		ServerStats.is_sqco++;
+		return;
+	}
+
+	ServerStats.is_sqdf++;
+	SetSendqDirty(to);
+	rb_dlinkAdd(to, &to->localClient->dirty_node, &dirty_sendq_list);
+}
+
+/* send_queued_forget()
+ *
+ * inputs	- local client that is going away
+ * outputs	-
+ * side effects - client is removed from the dirty list
+ */
+void
+send_queued_forget(struct Client *to)
+{
+	if(IsSendqDirty(to))
+	{
+		ClearSendqDirty(to);
+		rb_dlinkDelete(&to->localClient->dirty_node, &dirty_sendq_list);
+	}
+}
+
+/* flush_dirty_sendqs()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - every sendq on the dirty list is written, using as
+ *		  many lines per writev() as the sendq holds
+ */
+void
+flush_dirty_sendqs(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+	struct Client *to;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, dirty_sendq_list.head)
+	{
+		to = ptr->data;
+
+		ClearSendqDirty(to);
+		rb_dlinkDelete(ptr, &dirty_sendq_list);
+		send_queued(to);
+	}
+}
+
 /* send_linebuf_remote()
  *
  * inputs	- client to attach to, sender, linebuf
@@ -154,6 +240,9 @@ send_queued(struct Client *to)
 			/* We have some data written .. update counters */
 			ClearFlush(to);
 
+			ServerStats.is_sqw++;
+			ServerStats.is_sqwb += retlen;
+
 			to->localClient->sendB += retlen;
 			me.localClient->sendB += retlen;
 			if(to->localClient->sendB > 1023)
@@ -183,6 +272,10 @@ send_queued(struct Client *to)
 	}
 	else
 		ClearFlush(to);
+
+	/* the sendq drained, generate more of the netburst */
+	if(to->localClient->burst != NULL)
+		burst_continue(to);
 }
 
 void
@@ -208,6 +301,9 @@ send_queued_write(rb_fde_t *F, void *data)
 	struct Client *to = data;
 	ClearFlush(to);
 	send_queued(to);
+
+	/* the sendq drained, send more of any long reply */
+	safelist_continue(to);
 }
 
 /*
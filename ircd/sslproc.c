@@ -60,6 +60,9 @@ struct _ssl_ctl
 {
 	rb_dlink_node node;
 	int cli_count;
+	int handshakes;			/* connections still in the TLS handshake */
+	unsigned long handshakes_total;
+	unsigned long resumed_total;	/* handshakes that resumed a session */
 	rb_fde_t *F;
 	rb_fde_t *P;
 	pid_t pid;
@@ -73,6 +76,8 @@ struct _ssl_ctl
 static void ssld_update_config_one(ssl_ctl_t *ctl);
 static void send_new_ssl_certs_one(ssl_ctl_t * ctl);
 static void send_certfp_method(ssl_ctl_t *ctl);
+static void send_ktls_mode(ssl_ctl_t *ctl);
+static void send_ticket_keys(ssl_ctl_t *ctl);
 
 
 static rb_dlink_list ssl_daemons;
@@ -399,6 +404,62 @@ ssl_process_open_fd(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
 	if(client_p == NULL || client_p->localClient == NULL)
 		return;
 
+	if(ctl_buf->buflen > 5 && ctl_buf->buf[5])
+		ctl->resumed_total++;
+
+	ssld_handshake_done(client_p);
+
+	if(client_p->localClient->ssl_callback)
+	{
+		SSL_OPEN_CB *hdl = client_p->localClient->ssl_callback;
+
+		client_p->localClient->ssl_callback = NULL;
+
+		hdl(client_p, RB_OK);
+	}
+}
+
+/*
+ * ssld has finished the handshake of an accepted connection and put the
+ * session into kernel TLS, so it sends us the socket itself. From now on we
+ * read and write the plaintext on it directly and ssld is out of the loop.
+ */
+static void
+ssl_process_handoff(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
+{
+	struct Client *client_p;
+	rb_fde_t *F = ctl_buf->F[0];
+	uint32_t fd;
+
+	if(F == NULL)
+		return;
+
+	if(ctl_buf->buflen < 5)
+	{
+		rb_close(F);
+		return;		/* bogus message..drop it.. XXX should warn here */
+	}
+
+	fd = buf_to_uint32(&ctl_buf->buf[1]);
+	client_p = find_cli_connid_hash(fd);
+	if(client_p == NULL || client_p->localClient == NULL || IsAnyDead(client_p))
+	{
+		rb_close(F);
+		return;
+	}
+
+	/* nothing has been read from or written to our end of the socketpair
+	 * yet, the client is only read once the connection is open */
+	rb_close(client_p->localClient->F);
+	client_p->localClient->F = F;
+
+	if(ctl_buf->buflen > 5 && ctl_buf->buf[5])
+		ctl->resumed_total++;
+
+	ssld_handshake_done(client_p);
+	ssld_decrement_clicount(client_p->localClient->ssl_ctl);
+	client_p->localClient->ssl_ctl = NULL;
+
 	if(client_p->localClient->ssl_callback)
 	{
 		SSL_OPEN_CB *hdl = client_p->localClient->ssl_callback;
@@ -425,6 +486,8 @@ ssl_process_dead_fd(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
 	if(client_p == NULL || client_p->localClient == NULL)
 		return;
 
+	ssld_handshake_done(client_p);
+
 	if(IsAnyServer(client_p))
 	{
 		sendto_realops_snomask(SNO_GENERAL, is_remote_connect(client_p) && !IsServer(client_p) ? L_NETWIDE : L_ALL, "ssld error for %s: %s", client_p->name, reason);
@@ -561,6 +624,9 @@ ssl_process_cmd_recv(ssl_ctl_t * ctl)
 		case 'D':
 			ssl_process_dead_fd(ctl, ctl_buf);
 			break;
+		case 'H':
+			ssl_process_handoff(ctl, ctl_buf);
+			break;
 		case 'C':
 			ssl_process_cipher_string(ctl, ctl_buf);
 			break;
@@ -637,6 +703,11 @@ ssl_read_ctl(rb_fde_t * F, void *data)
 	rb_setselect(ctl->F, RB_SELECT_READ, ssl_read_ctl, ctl);
 }
 
+/*
+ * A new connection goes to the ssld with the fewest handshakes in progress,
+ * as handshakes are what a burst of connections (after a netsplit, say)
+ * costs, rather than to the one with the fewest connections.
+ */
 static ssl_ctl_t *
 which_ssld(void)
 {
@@ -655,12 +726,42 @@ which_ssld(void)
 			lowest = ctl;
 			continue;
 		}
-		if(ctl->cli_count < lowest->cli_count)
+		if(ctl->handshakes < lowest->handshakes ||
+		   (ctl->handshakes == lowest->handshakes && ctl->cli_count < lowest->cli_count))
 			lowest = ctl;
 	}
 	return (lowest);
 }
 
+static void
+ssld_handshake_start(ssl_ctl_t *ctl, uint32_t id)
+{
+	struct Client *client_p = find_cli_connid_hash(id);
+
+	if(client_p == NULL)
+		return;
+
+	SetSSLHandshake(client_p);
+	ctl->handshakes++;
+	ctl->handshakes_total++;
+}
+
+/*
+ * ssld_handshake_done - the TLS handshake of client_p has finished,
+ * failed, or the client went away; it no longer counts towards its
+ * ssld's load.
+ */
+void
+ssld_handshake_done(struct Client *client_p)
+{
+	if(!IsSSLHandshake(client_p))
+		return;
+
+	ClearSSLHandshake(client_p);
+	if(client_p->localClient->ssl_ctl != NULL)
+		client_p->localClient->ssl_ctl->handshakes--;
+}
+
 static void
 ssl_write_ctl(rb_fde_t * F, void *data)
 {
@@ -773,10 +874,79 @@ send_certfp_method(ssl_ctl_t *ctl)
 	ssl_cmd_write_queue(ctl, NULL, 0, buf, sizeof(buf));
 }
 
+static void
+send_ktls_mode(ssl_ctl_t *ctl)
+{
+	char buf[2];
+
+	buf[0] = 'T';
+	buf[1] = ServerInfo.ssl_ktls ? 1 : 0;
+	ssl_cmd_write_queue(ctl, NULL, 0, buf, sizeof(buf));
+}
+
+/*
+ * Session tickets are encrypted with keys we make and give to every ssld,
+ * so a client can resume its session whichever ssld it lands on next time.
+ * The newest key encrypts new tickets, the one before it is still accepted
+ * until the next rotation.
+ */
+static uint8_t ticket_keys[RB_SSL_TICKET_KEYS_MAX][RB_SSL_TICKET_KEY_LEN];
+static int ticket_key_count;
+
+static void
+send_ticket_keys(ssl_ctl_t *ctl)
+{
+	char buf[2 + sizeof(ticket_keys)];
+
+	buf[0] = 'R';
+	buf[1] = ticket_key_count;
+	memcpy(&buf[2], ticket_keys, ticket_key_count * RB_SSL_TICKET_KEY_LEN);
+	ssl_cmd_write_queue(ctl, NULL, 0, buf, 2 + ticket_key_count * RB_SSL_TICKET_KEY_LEN);
+}
+
+static bool
+new_ticket_key(void)
+{
+	uint8_t key[RB_SSL_TICKET_KEY_LEN];
+
+	if(!rb_get_random(key, sizeof(key)))
+		return false;
+
+	memmove(ticket_keys[1], ticket_keys[0], (RB_SSL_TICKET_KEYS_MAX - 1) * RB_SSL_TICKET_KEY_LEN);
+	memcpy(ticket_keys[0], key, sizeof(key));
+	if(ticket_key_count < RB_SSL_TICKET_KEYS_MAX)
+		ticket_key_count++;
+
+	return true;
+}
+
+static void
+rotate_ticket_keys(void *unused)
+{
+	rb_dlink_node *ptr;
+
+	if(!new_ticket_key())
+		return;
+
+	RB_DLINK_FOREACH(ptr, ssl_daemons.head)
+	{
+		ssl_ctl_t *ctl = ptr->data;
+
+		if (ctl->dead || ctl->shutdown)
+			continue;
+
+		send_ticket_keys(ctl);
+	}
+}
+
 static void
 ssld_update_config_one(ssl_ctl_t *ctl)
 {
 	send_certfp_method(ctl);
+	send_ktls_mode(ctl);
+	if(ticket_key_count == 0)
+		new_ticket_key();
+	send_ticket_keys(ctl);
 	send_new_ssl_certs_one(ctl);
 }
 
@@ -796,21 +966,28 @@ ssld_update_config(void)
 	}
 }
 
+/*
+ * handoff says whether the socket may come back to us after the handshake
+ * (see ssl_process_handoff), ssld only does that with ssl_ktls enabled and
+ * when the kernel took over both directions of the session.
+ */
 ssl_ctl_t *
-start_ssld_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
+start_ssld_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id, bool handoff)
 {
 	rb_fde_t *F[2];
 	ssl_ctl_t *ctl;
-	char buf[5];
+	char buf[6];
 	F[0] = sslF;
 	F[1] = plainF;
 
 	buf[0] = 'A';
 	uint32_to_buf(&buf[1], id);
+	buf[5] = handoff && ServerInfo.ssl_ktls ? 1 : 0;
 	ctl = which_ssld();
 	if(!ctl)
 		return NULL;
 	ctl->cli_count++;
+	ssld_handshake_start(ctl, id);
 	ssl_cmd_write_queue(ctl, F, 2, buf, sizeof(buf));
 	return ctl;
 }
@@ -831,6 +1008,7 @@ start_ssld_connect(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	if(!ctl)
 		return NULL;
 	ctl->cli_count++;
+	ssld_handshake_start(ctl, id);
 	ssl_cmd_write_queue(ctl, F, 2, buf, sizeof(buf));
 	return ctl;
 }
@@ -995,7 +1173,7 @@ get_ssld_count(void)
 }
 
 void
-ssld_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum ssld_status status, const char *version), void *data)
+ssld_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, int handshakes, unsigned long handshakes_total, unsigned long resumed_total, enum ssld_status status, const char *version), void *data)
 {
 	rb_dlink_node *ptr, *next;
 	ssl_ctl_t *ctl;
@@ -1003,6 +1181,7 @@ ssld_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum ssld_s
 	{
 		ctl = ptr->data;
 		func(data, ctl->pid, ctl->cli_count,
+			ctl->handshakes, ctl->handshakes_total, ctl->resumed_total,
 			ctl->dead ? SSLD_DEAD :
 				(ctl->shutdown ? SSLD_SHUTDOWN : SSLD_ACTIVE),
 			ctl->version);
@@ -1014,4 +1193,5 @@ init_ssld(void)
 {
 	rb_event_addish("collect_zipstats", collect_zipstats, NULL, ZIPSTATS_TIME);
 	rb_event_addish("cleanup_dead_ssld", cleanup_dead_ssl, NULL, 60);
+	rb_event_add("rotate_ticket_keys", rotate_ticket_keys, NULL, RB_SSL_TICKET_LIFETIME / 2);
 }
@@ -0,0 +1,374 @@
+/*
+ *  charybdis: an advanced internet relay chat daemon (ircd).
+ *  userindex.c: Trigram index of users for mask searches.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "client.h"
+#include "ircd.h"
+#include "match.h"
+#include "userindex.h"
+#include "s_assert.h"
+
+/* Every user on the network is indexed on the trigrams (case folded
+ * three character substrings) of its nick, username, host, orighost,
+ * sockhost and gecos.  A string matching a mask contains each run of
+ * literal characters between the mask's wildcards, so a user can only
+ * match a mask with a run of three or more characters if it is listed
+ * under every trigram of that run.  A lookup returns the users under
+ * the least common of those trigrams, and the caller checks each of
+ * them as it would have on a walk of global_client_list.
+ *
+ * Trigrams are hashed into USERINDEX_BUCKETS buckets, two trigrams in
+ * the same bucket only make its list longer.  A bucket is an array of
+ * slots, and an entry keeps its position in each of its buckets, so a
+ * user is removed by moving the last slot of the bucket into its place.
+ */
+
+#define USERINDEX_BITS		16
+#define USERINDEX_BUCKETS	(1 << USERINDEX_BITS)
+#define MAX_GRAMS		(NICKLEN + USERLEN + 2 * HOSTLEN + HOSTIPLEN + REALLEN)
+
+struct UserBucket
+{
+	uint32_t *slots;
+	uint32_t len;
+	uint32_t max;
+};
+
+struct UserIndexEntry
+{
+	struct Client *client_p;
+	uint32_t slot;
+	int ngrams;
+	uint32_t *pos;		/* position in the bucket */
+	uint16_t *bucket;	/* ascending */
+};
+
+static struct UserBucket *buckets;
+
+static struct UserIndexEntry **slot_table;
+static uint32_t nslots, maxslots;
+static uint32_t *free_slots;
+static uint32_t nfree, maxfree;
+
+void
+init_user_index(void)
+{
+	buckets = rb_malloc(USERINDEX_BUCKETS * sizeof(struct UserBucket));
+}
+
+static inline unsigned int
+gram_hash(unsigned char a, unsigned char b, unsigned char c)
+{
+	uint32_t g = (uint32_t)irctolower(a) << 16 | (uint32_t)irctolower(b) << 8 | irctolower(c);
+
+	return (g * 2654435761U) >> (32 - USERINDEX_BITS);
+}
+
+static int
+add_grams(uint16_t *grams, int n, const char *s)
+{
+	const unsigned char *p = (const unsigned char *)s;
+
+	if(p[0] == '\0' || p[1] == '\0')
+		return n;
+
+	for(; p[2] != '\0'; p++)
+		grams[n++] = gram_hash(p[0], p[1], p[2]);
+	return n;
+}
+
+static int
+cmp_gram(const void *a, const void *b)
+{
+	return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+static uint32_t
+alloc_slot(struct UserIndexEntry *entry)
+{
+	uint32_t slot;
+
+	if(nfree > 0)
+		slot = free_slots[--nfree];
+	else
+	{
+		if(nslots == maxslots)
+		{
+			maxslots = maxslots ? maxslots * 2 : 1024;
+			slot_table = rb_realloc(slot_table, maxslots * sizeof(*slot_table));
+		}
+		slot = nslots++;
+	}
+
+	slot_table[slot] = entry;
+	return slot;
+}
+
+static void
+release_slot(uint32_t slot)
+{
+	slot_table[slot] = NULL;
+
+	if(nfree == maxfree)
+	{
+		maxfree = maxfree ? maxfree * 2 : 1024;
+		free_slots = rb_realloc(free_slots, maxfree * sizeof(*free_slots));
+	}
+	free_slots[nfree++] = slot;
+}
+
+/* void user_index_add(struct Client *)
+ * Input: A user that was just introduced or registered.
+ * Output: None.
+ * Side-effects: The user is indexed on the trigrams of its names.
+ */
+void
+user_index_add(struct Client *client_p)
+{
+	struct UserIndexEntry *entry;
+	struct UserBucket *b;
+	uint16_t grams[MAX_GRAMS];
+	int i, n = 0;
+
+	s_assert(client_p->user != NULL && client_p->user->index_entry == NULL);
+	if(client_p->user == NULL || client_p->user->index_entry != NULL)
+		return;
+
+	n = add_grams(grams, n, client_p->name);
+	n = add_grams(grams, n, client_p->username);
+	n = add_grams(grams, n, client_p->host);
+	if(strcmp(client_p->orighost, client_p->host))
+		n = add_grams(grams, n, client_p->orighost);
+	n = add_grams(grams, n, client_p->sockhost);
+	n = add_grams(grams, n, client_p->info);
+
+	qsort(grams, n, sizeof(grams[0]), cmp_gram);
+	if(n > 0)
+	{
+		int j = 0;
+
+		for(i = 1; i < n; i++)
+			if(grams[i] != grams[j])
+				grams[++j] = grams[i];
+		n = j + 1;
+	}
+
+	entry = rb_malloc(sizeof(struct UserIndexEntry) + n * (sizeof(uint32_t) + sizeof(uint16_t)));
+	entry->client_p = client_p;
+	entry->ngrams = n;
+	entry->pos = (uint32_t *)(entry + 1);
+	entry->bucket = (uint16_t *)(entry->pos + n);
+	entry->slot = alloc_slot(entry);
+
+	for(i = 0; i < n; i++)
+	{
+		b = &buckets[grams[i]];
+		if(b->len == b->max)
+		{
+			b->max = b->max ? b->max * 2 : 4;
+			b->slots = rb_realloc(b->slots, b->max * sizeof(uint32_t));
+		}
+
+		entry->bucket[i] = grams[i];
+		entry->pos[i] = b->len;
+		b->slots[b->len++] = entry->slot;
+	}
+
+	client_p->user->index_entry = entry;
+}
+
+static int
+find_gram(const struct UserIndexEntry *entry, uint16_t gram)
+{
+	int lo = 0, hi = entry->ngrams - 1, mid;
+
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if(entry->bucket[mid] == gram)
+			return mid;
+		if(entry->bucket[mid] < gram)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	s_assert(0);
+	return -1;
+}
+
+/* void user_index_del(struct Client *)
+ * Input: A user.
+ * Output: None.
+ * Side-effects: The user is removed from the index, if it was in it.
+ */
+void
+user_index_del(struct Client *client_p)
+{
+	struct UserIndexEntry *entry, *moved;
+	struct UserBucket *b;
+	uint32_t last;
+	int i, j;
+
+	if(client_p->user == NULL || (entry = client_p->user->index_entry) == NULL)
+		return;
+
+	for(i = 0; i < entry->ngrams; i++)
+	{
+		b = &buckets[entry->bucket[i]];
+		last = b->slots[--b->len];
+
+		if(last != entry->slot)
+		{
+			b->slots[entry->pos[i]] = last;
+			moved = slot_table[last];
+			j = find_gram(moved, entry->bucket[i]);
+			if(j >= 0)
+				moved->pos[j] = entry->pos[i];
+		}
+
+		if(b->len == 0)
+		{
+			rb_free(b->slots);
+			b->slots = NULL;
+			b->max = 0;
+		}
+		else if(b->len < b->max / 4 && b->max > 16)
+		{
+			b->max /= 2;
+			b->slots = rb_realloc(b->slots, b->max * sizeof(uint32_t));
+		}
+	}
+
+	release_slot(entry->slot);
+	rb_free(entry);
+	client_p->user->index_entry = NULL;
+}
+
+/* void user_index_update(struct Client *)
+ * Input: An indexed user whose nick, username, host, orighost, sockhost
+ *        or gecos changed.
+ * Output: None.
+ * Side-effects: The user is indexed on its new names.
+ */
+void
+user_index_update(struct Client *client_p)
+{
+	if(client_p->user == NULL || client_p->user->index_entry == NULL)
+		return;
+
+	user_index_del(client_p);
+	user_index_add(client_p);
+}
+
+/* the least common bucket under a trigram of one of the mask's runs */
+static struct UserBucket *
+find_bucket(const char *mask, int syntax, struct UserBucket *best)
+{
+	const unsigned char *p = (const unsigned char *)mask;
+	unsigned char run[3] = { 0 };
+	struct UserBucket *b;
+	int len = 0;
+	unsigned char c;
+
+	while(1)
+	{
+		c = *p++;
+
+		/* a run does not span '!' or '@' either, so that a mask for
+		 * "nick!user@host" can be looked up too */
+		if(c == '*' || c == '?' || c == '\0' || c == '!' || c == '@' ||
+		   (syntax == MATCH_ESC && c == '#'))
+		{
+			len = 0;
+			if(c == '\0')
+				return best;
+			continue;
+		}
+
+		if(syntax == MATCH_ESC && c == '\\')
+		{
+			c = *p++;
+			/* matches nothing, leave it to the caller */
+			if(c == '\0')
+				return best;
+			if(c == 's')
+				c = ' ';
+		}
+
+		run[0] = run[1];
+		run[1] = run[2];
+		run[2] = c;
+		if(++len < 3)
+			continue;
+
+		b = &buckets[gram_hash(run[0], run[1], run[2])];
+		if(best == NULL || b->len < best->len)
+			best = b;
+	}
+}
+
+static int
+cmp_order(const void *a, const void *b)
+{
+	const struct Client *ca = *(struct Client * const *)a;
+	const struct Client *cb = *(struct Client * const *)b;
+
+	return ca->list_order < cb->list_order ? -1 : ca->list_order > cb->list_order;
+}
+
+/* bool user_index_find(const struct UserIndexMask *, int, rb_dlink_list *)
+ * Input: Masks a user has to match all of, each on one of the names the
+ *        index has (a "nick!user@host" mask is fine as well), a list to
+ *        fill in.
+ * Output: true if every user that can match the masks has been added to
+ *         list (along with some that do not), in global_client_list
+ *         order, false if no mask has three literal characters in a row
+ *         to look up and all users must be checked.
+ * Side-effects: list nodes are allocated, free them with rb_dlinkDestroy().
+ */
+bool
+user_index_find(const struct UserIndexMask *masks, int nmasks, rb_dlink_list *list)
+{
+	struct UserBucket *best = NULL;
+	struct Client **found;
+	uint32_t i;
+
+	for(i = 0; i < (uint32_t)nmasks; i++)
+		if(masks[i].mask != NULL)
+			best = find_bucket(masks[i].mask, masks[i].syntax, best);
+
+	if(best == NULL)
+		return false;
+	if(best->len == 0)
+		return true;
+
+	found = rb_malloc(best->len * sizeof(struct Client *));
+	for(i = 0; i < best->len; i++)
+		found[i] = slot_table[best->slots[i]]->client_p;
+
+	qsort(found, best->len, sizeof(struct Client *), cmp_order);
+
+	for(i = 0; i < best->len; i++)
+		rb_dlinkAddTailAlloc(found[i], list);
+
+	rb_free(found);
+	return true;
+}
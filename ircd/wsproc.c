@@ -35,6 +35,7 @@
 #include "packet.h"
 
 static void ws_read_ctl(rb_fde_t * F, void *data);
+static void wsockd_update_config_one(ws_ctl_t *ctl);
 static int wsockd_count;
 
 #define MAXPASSFD 4
@@ -79,6 +80,14 @@ uint32_to_buf(char *buf, uint32_t x)
 	return;
 }
 
+static inline uint64_t
+buf_to_uint64(char *buf)
+{
+	uint64_t x;
+	memcpy(&x, buf, sizeof(x));
+	return x;
+}
+
 static ws_ctl_t *
 allocate_ws_daemon(rb_fde_t * F, rb_fde_t * P, int pid)
 {
@@ -327,6 +336,7 @@ start_wsockd(int count)
 		rb_close(F2);
 		rb_close(P1);
 		ctl = allocate_ws_daemon(F1, P2, pid);
+		wsockd_update_config_one(ctl);
 		ws_read_ctl(ctl->F, ctl);
 		ws_do_pipe(P2, ctl);
 
@@ -360,6 +370,21 @@ ws_process_dead_fd(ws_ctl_t * ctl, ws_ctl_buf_t * ctl_buf)
 	exit_client(client_p, client_p, &me, reason);
 }
 
+static void
+ws_process_deflate_stats(ws_ctl_t * ctl, ws_ctl_buf_t * ctl_buf)
+{
+	struct Listener *listener;
+
+	if(ctl_buf->buflen != 21)
+		return;
+
+	listener = find_listener_id(buf_to_uint32(&ctl_buf->buf[1]));
+	if(listener == NULL)
+		return;
+
+	listener->ws_deflate_plain += buf_to_uint64(&ctl_buf->buf[5]);
+	listener->ws_deflate_wire += buf_to_uint64(&ctl_buf->buf[13]);
+}
 
 static void
 ws_process_cmd_recv(ws_ctl_t * ctl)
@@ -378,6 +403,9 @@ ws_process_cmd_recv(ws_ctl_t * ctl)
 		case 'D':
 			ws_process_dead_fd(ctl, ctl_buf);
 			break;
+		case 'S':
+			ws_process_deflate_stats(ctl, ctl_buf);
+			break;
 		default:
 			ilog(L_MAIN, "Received invalid command from wsockd: %s", ctl_buf->buf);
 			sendto_realops_snomask(SNO_GENERAL, L_ALL, "Received invalid command from wsockd");
@@ -512,16 +540,17 @@ ws_cmd_write_queue(ws_ctl_t * ctl, rb_fde_t ** F, int count, const void *buf, si
 }
 
 ws_ctl_t *
-start_wsockd_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
+start_wsockd_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id, uint32_t listener_id)
 {
 	rb_fde_t *F[2];
 	ws_ctl_t *ctl;
-	char buf[5];
+	char buf[9];
 	F[0] = sslF;
 	F[1] = plainF;
 
 	buf[0] = 'A';
 	uint32_to_buf(&buf[1], id);
+	uint32_to_buf(&buf[5], listener_id);
 	ctl = which_wsockd();
 	if(!ctl)
 		return NULL;
@@ -530,6 +559,35 @@ start_wsockd_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	return ctl;
 }
 
+static void
+wsockd_update_config_one(ws_ctl_t *ctl)
+{
+	char buf[8];
+
+	buf[0] = 'C';
+	buf[1] = ServerInfo.wsock_deflate ? 1 : 0;
+	buf[2] = ServerInfo.wsock_deflate_context_takeover ? 1 : 0;
+	uint32_to_buf(&buf[3], ServerInfo.wsock_deflate_memory);
+	buf[7] = ServerInfo.wsock_pack_lines ? 1 : 0;
+	ws_cmd_write_queue(ctl, NULL, 0, buf, sizeof(buf));
+}
+
+void
+wsockd_update_config(void)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, wsock_daemons.head)
+	{
+		ws_ctl_t *ctl = ptr->data;
+
+		if (ctl->dead || ctl->shutdown)
+			continue;
+
+		wsockd_update_config_one(ctl);
+	}
+}
+
 void
 wsockd_decrement_clicount(ws_ctl_t * ctl)
 {
@@ -81,12 +81,22 @@ struct acceptdata
 	void *data;
 };
 
-/* Only have open flags for now, could be more later */
 #define FLAG_OPEN	0x1
 #define IsFDOpen(F)	(F->flags & FLAG_OPEN)
 #define SetFDOpen(F)	(F->flags |= FLAG_OPEN)
 #define ClearFDOpen(F)	(F->flags &= ~FLAG_OPEN)
 
+/* carries fds with SCM_RIGHTS, must only be read with recvmsg() */
+#define FLAG_FDPASS	0x2
+#define IsFDPass(F)	((F)->flags & FLAG_FDPASS)
+#define SetFDPass(F)	((F)->flags |= FLAG_FDPASS)
+
+/* a stream socket that is only ever read through rb_read(), so a backend
+ * may read ahead into its own buffers */
+#define FLAG_STREAM	0x4
+#define IsFDStream(F)	((F)->flags & FLAG_STREAM)
+#define SetFDStream(F)	((F)->flags |= FLAG_STREAM)
+
 #if !defined(SHUT_RDWR) && defined(_WIN32)
 # define SHUT_RDWR SD_BOTH
 #endif
@@ -158,10 +168,7 @@ int rb_setup_fd(rb_fde_t *F);
 void rb_connect_callback(rb_fde_t *F, int status);
 
 
-int rb_io_sched_event(struct ev_entry *ev, int when);
-void rb_io_unsched_event(struct ev_entry *ev);
-int rb_io_supports_event(void);
-void rb_io_init_event(void);
+void rb_run_select_hook(void);
 
 /* epoll versions */
 void rb_setselect_epoll(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
@@ -169,10 +176,14 @@ int rb_init_netio_epoll(void);
 int rb_select_epoll(long);
 int rb_setup_fd_epoll(rb_fde_t *F);
 
-void rb_epoll_init_event(void);
-int rb_epoll_sched_event(struct ev_entry *event, int when);
-void rb_epoll_unsched_event(struct ev_entry *event);
-int rb_epoll_supports_event(void);
+/* io_uring versions */
+void rb_setselect_iouring(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
+int rb_init_netio_iouring(void);
+int rb_select_iouring(long);
+int rb_setup_fd_iouring(rb_fde_t *F);
+ssize_t rb_read_iouring(rb_fde_t *F, void *buf, int count);
+int rb_accept_iouring(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t *addrlen);
+void rb_close_iouring(rb_fde_t *F);
 
 
 /* poll versions */
@@ -193,23 +204,12 @@ int rb_init_netio_sigio(void);
 int rb_select_sigio(long);
 int rb_setup_fd_sigio(rb_fde_t *F);
 
-void rb_sigio_init_event(void);
-int rb_sigio_sched_event(struct ev_entry *event, int when);
-void rb_sigio_unsched_event(struct ev_entry *event);
-int rb_sigio_supports_event(void);
-
-
 /* ports versions */
 void rb_setselect_ports(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
 int rb_init_netio_ports(void);
 int rb_select_ports(long);
 int rb_setup_fd_ports(rb_fde_t *F);
 
-void rb_ports_init_event(void);
-int rb_ports_sched_event(struct ev_entry *event, int when);
-void rb_ports_unsched_event(struct ev_entry *event);
-int rb_ports_supports_event(void);
-
 
 /* kqueue versions */
 void rb_setselect_kqueue(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
@@ -217,11 +217,6 @@ int rb_init_netio_kqueue(void);
 int rb_select_kqueue(long);
 int rb_setup_fd_kqueue(rb_fde_t *F);
 
-void rb_kqueue_init_event(void);
-int rb_kqueue_sched_event(struct ev_entry *event, int when);
-void rb_kqueue_unsched_event(struct ev_entry *event);
-int rb_kqueue_supports_event(void);
-
 
 /* select versions */
 void rb_setselect_select(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
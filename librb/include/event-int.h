@@ -24,15 +24,12 @@
 
 struct ev_entry
 {
-	rb_dlink_node node;
+	rb_dlink_node node;	/* rb_event_find() hash chain */
 	EVH *func;
 	void *arg;
 	char *name;
-	time_t frequency;
-	time_t when;
-	time_t next;
-	void *data;
-	void *comm_ptr;
+	long frequency;		/* msec, negative means +- 1/3 */
+	int64_t when;		/* msec since the epoch */
+	int heap_index;		/* -1 when not scheduled */
 	int dead;
 };
-void rb_event_io_register_all(void);
@@ -45,6 +45,8 @@ typedef void CNCB(rb_fde_t *, int, void *);
 typedef void DUMPCB(int, const char *desc, void *);
 /* callback for accept callbacks */
 typedef void ACCB(rb_fde_t *, int status, struct sockaddr *addr, rb_socklen_t len, void *);
+/* callback run once at the end of every pass through the event loop */
+typedef void SELECTHOOK(void);
 /* callback for pre-accept callback */
 typedef int ACPRE(rb_fde_t *, struct sockaddr *addr, rb_socklen_t len, void *);
 
@@ -117,6 +119,15 @@ void rb_note(rb_fde_t *, const char *);
 #define RB_SSL_CERTFP_LEN_SHA256	32
 #define RB_SSL_CERTFP_LEN_SHA512	64
 
+/* Session ticket keys: a 16 byte name, a 32 byte cipher key and a 32 byte
+ * MAC key, newest first.  The newest key is expected to be replaced every
+ * RB_SSL_TICKET_LIFETIME / 2 seconds, keeping the one before it, so that
+ * tickets stay valid for RB_SSL_TICKET_LIFETIME seconds.
+ */
+#define RB_SSL_TICKET_KEY_LEN		80
+#define RB_SSL_TICKET_KEYS_MAX		2
+#define RB_SSL_TICKET_LIFETIME		7200
+
 int rb_set_nb(rb_fde_t *);
 int rb_set_buffers(rb_fde_t *, int);
 
@@ -160,6 +171,7 @@ int rb_ignore_errno(int);
 void rb_setselect(rb_fde_t *, unsigned int type, PF * handler, void *client_data);
 void rb_init_netio(void);
 int rb_select(unsigned long);
+void rb_set_select_hook(SELECTHOOK *);
 int rb_fd_ssl(rb_fde_t *F);
 rb_platform_fd_t rb_get_fd(rb_fde_t *F);
 const char *rb_get_ssl_strerror(rb_fde_t *F);
@@ -199,6 +211,12 @@ rb_fde_t *rb_recv_fd(rb_fde_t *);
 
 const char *rb_ssl_get_cipher(rb_fde_t *F);
 
+void rb_ssl_set_ktls(int enable);
+int rb_ssl_ktls_detach(rb_fde_t *F);
+
+int rb_ssl_set_ticket_keys(const uint8_t *keys, int count);
+int rb_ssl_session_resumed(rb_fde_t *F);
+
 int rb_ipv4_from_ipv6(const struct sockaddr_in6 *restrict ip6, struct sockaddr_in *restrict ip4);
 
 #endif /* INCLUDED_commio_h */
@@ -34,6 +34,7 @@ typedef struct rb_dictionary_iter rb_dictionary_iter;
 struct rb_dictionary;
 
 typedef int (*DCF)(/* const void *a, const void *b */);
+typedef uint32_t (*DHF)(const void *key);
 
 struct rb_dictionary_element
 {
@@ -41,6 +42,8 @@ struct rb_dictionary_element
 	void *data;
 	const void *key;
 	int position;
+	rb_dictionary_element *hnext;
+	uint32_t hashv;
 };
 
 struct rb_dictionary_iter
@@ -59,9 +62,18 @@ struct rb_dictionary_iter
  */
 extern rb_dictionary *rb_dictionary_create(const char *name, DCF compare_cb);
 
+/*
+ * rb_dictionary_create_hashed() creates a dictionary which also keeps a hash
+ * index over its keys.  Lookups probe the hash index only and never modify
+ * the tree, while iteration stays ordered by compare_cb.  hash_cb must give
+ * equal hashes for keys that compare_cb considers equal.
+ */
+extern rb_dictionary *rb_dictionary_create_hashed(const char *name, DCF compare_cb, DHF hash_cb);
+
 /*
  * rb_dictionary_set_comparator_func() resets the comparator used for lookups and
- * insertions in the DTree structure.
+ * insertions in the DTree structure.  It must not change which keys compare
+ * equal on a hashed dictionary.
  */
 extern void rb_dictionary_set_comparator_func(rb_dictionary *dict,
 	DCF compare_cb);
@@ -154,6 +166,14 @@ extern void *rb_dictionary_delete(rb_dictionary *dtree, const void *key);
  */
 extern unsigned int rb_dictionary_size(rb_dictionary *dtree);
 
+/*
+ * hash functions for rb_dictionary_create_hashed(), matching strcmp,
+ * rb_strcasecmp and rb_uint32cmp respectively.
+ */
+extern uint32_t rb_dictionary_str_hash(const void *key);
+extern uint32_t rb_dictionary_strcase_hash(const void *key);
+extern uint32_t rb_dictionary_uint32_hash(const void *key);
+
 void rb_dictionary_stats(rb_dictionary *dict, void (*cb)(const char *line, void *privdata), void *privdata);
 void rb_dictionary_stats_walk(void (*cb)(const char *line, void *privdata), void *privdata);
 
@@ -36,6 +36,9 @@ typedef void EVH(void *);
 struct ev_entry *rb_event_add(const char *name, EVH * func, void *arg, time_t when);
 struct ev_entry *rb_event_addonce(const char *name, EVH * func, void *arg, time_t when);
 struct ev_entry *rb_event_addish(const char *name, EVH * func, void *arg, time_t delta_ish);
+struct ev_entry *rb_event_add_msec(const char *name, EVH * func, void *arg, long msec);
+struct ev_entry *rb_event_addonce_msec(const char *name, EVH * func, void *arg, long msec);
+struct ev_entry *rb_event_addish_msec(const char *name, EVH * func, void *arg, long msec);
 void rb_event_run(void);
 void rb_event_init(void);
 void rb_event_delete(struct ev_entry *);
@@ -45,5 +48,6 @@ void rb_set_back_events(time_t);
 void rb_dump_events(void (*func) (char *, void *), void *ptr);
 void rb_run_one_event(struct ev_entry *);
 time_t rb_event_next(void);
+long rb_event_next_msec(void);
 
 #endif /* INCLUDED_event_h */
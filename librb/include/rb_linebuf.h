@@ -44,13 +44,22 @@ struct _buf_head;
 #define LINEBUF_SIZE            (512 + 510)
 #define CRLF_LEN                2
 
+/*
+ * Lines are allocated from a set of size classes, so a short line does not
+ * pay for a full LINEBUF_SIZE buffer.  The last class always holds a full
+ * line and is used for anything that may still grow (partial reads).
+ */
+#define LINEBUF_CLASSES         5
+#define LINEBUF_MAXCLASS        (LINEBUF_CLASSES - 1)
+
 typedef struct _buf_line
 {
-	char buf[LINEBUF_SIZE + CRLF_LEN + 1];
 	uint8_t terminated;	/* Whether we've terminated the buffer */
 	uint8_t raw;		/* Whether this linebuf may hold 8-bit data */
+	uint8_t sizeclass;	/* Which size class this line was allocated from */
 	int len;		/* How much data we've got */
 	int refcount;		/* how many linked lists are we in? */
+	char buf[];		/* sized by sizeclass */
 } buf_line_t;
 
 typedef struct _buf_head
@@ -73,8 +82,10 @@ void rb_linebuf_donebuf(buf_head_t *);
 int rb_linebuf_parse(buf_head_t *, char *, int, int);
 int rb_linebuf_get(buf_head_t *, char *, int, int, int);
 void rb_linebuf_put(buf_head_t *, const rb_strf_t *);
+void rb_linebuf_putbuf(buf_head_t *, const char *, size_t);
 void rb_linebuf_attach(buf_head_t *, buf_head_t *);
 void rb_count_rb_linebuf_memory(size_t *, size_t *);
+void rb_count_rb_linebuf_class_memory(int, size_t *, size_t *, size_t *);
 int rb_linebuf_flush(rb_fde_t *F, buf_head_t *);
 
 
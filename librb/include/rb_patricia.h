@@ -65,12 +65,18 @@ rb_patricia_tree_t;
 rb_patricia_node_t *rb_match_ip(rb_patricia_tree_t *tree, struct sockaddr *ip);
 rb_patricia_node_t *rb_match_ip_exact(rb_patricia_tree_t *tree, struct sockaddr *ip,
 				      unsigned int len);
+int rb_match_ip_all(rb_patricia_tree_t *tree, struct sockaddr *ip, rb_patricia_node_t **nodes);
+rb_patricia_node_t *rb_match_ip_within(rb_patricia_tree_t *tree, struct sockaddr *ip,
+				       unsigned int len);
 rb_patricia_node_t *rb_match_string(rb_patricia_tree_t *tree, const char *string);
 rb_patricia_node_t *rb_match_exact_string(rb_patricia_tree_t *tree, const char *string);
 rb_patricia_node_t *rb_patricia_search_exact(rb_patricia_tree_t *patricia, rb_prefix_t *prefix);
 rb_patricia_node_t *rb_patricia_search_best(rb_patricia_tree_t *patricia, rb_prefix_t *prefix);
 rb_patricia_node_t *rb_patricia_search_best2(rb_patricia_tree_t *patricia,
 					     rb_prefix_t *prefix, int inclusive);
+int rb_patricia_search_all(rb_patricia_tree_t *patricia, rb_prefix_t *prefix,
+			   rb_patricia_node_t **nodes);
+rb_patricia_node_t *rb_patricia_search_within(rb_patricia_tree_t *patricia, rb_prefix_t *prefix);
 rb_patricia_node_t *rb_patricia_lookup(rb_patricia_tree_t *patricia, rb_prefix_t *prefix);
 
 void rb_patricia_remove(rb_patricia_tree_t *patricia, rb_patricia_node_t *node);
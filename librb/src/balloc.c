@@ -58,9 +58,18 @@
 #include <librb_config.h>
 #include <rb_lib.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
 static void _rb_bh_fail(const char *reason, const char *file, int line) __attribute__((noreturn));
 
 static uintptr_t offset_pad;
+static size_t page_size;
 
 /* status information for an allocated block in heap */
 struct rb_heap_block
@@ -79,6 +88,7 @@ struct rb_bh
 	size_t elemSize;	/* Size of each element to be stored */
 	unsigned long elemsPerBlock;	/* Number of elements per block */
 	rb_dlink_list block_list;
+	rb_dlink_list idle_list;	/* empty blocks handed back to the OS */
 	rb_dlink_list free_list;
 	char *desc;
 };
@@ -94,6 +104,106 @@ _rb_bh_fail(const char *reason, const char *file, int line)
 	abort();
 }
 
+/*
+ * static void *get_block(size_t size)
+ *
+ * Input: Size of block to allocate
+ * Output: Pointer to new block
+ * Side Effects: None
+ */
+static void *
+get_block(size_t size)
+{
+	void *ptr;
+#ifdef HAVE_MMAP
+	if((ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+		ptr = NULL;
+#else
+	ptr = malloc(size);
+#endif
+	return (ptr);
+}
+
+static void
+free_block(void *ptr, size_t size)
+{
+#ifdef HAVE_MMAP
+	munmap(ptr, size);
+#else
+	free(ptr);
+#endif
+}
+
+/*
+ * static void release_block(rb_bh *bh, rb_heap_block *b)
+ *
+ * Input: heap and an empty block that has been unlinked from bh->block_list
+ * Output: None
+ * Side Effects: the pages of the block are given back to the operating
+ *               system.  Where madvise() is available the mapping is kept
+ *               on bh->idle_list so newblock() can reuse it without another
+ *               mmap(), otherwise the block is freed outright.
+ */
+static void
+release_block(rb_bh *bh, rb_heap_block *b)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_MADVISE) && defined(MADV_DONTNEED)
+	if(madvise(b->elems, b->alloc_size, MADV_DONTNEED) == 0)
+	{
+		rb_dlinkAdd(b, &b->node, &bh->idle_list);
+		return;
+	}
+#endif
+	free_block(b->elems, b->alloc_size);
+	rb_free(b);
+}
+
+/*
+ * static int newblock(rb_bh *bh)
+ *
+ * Input: heap to add a block to
+ * Output: 0 on success, 1 on failure
+ * Side Effects: carves a new block into elements and threads all of them
+ *               onto bh->free_list.  Each element starts with a pointer back
+ *               to its block, the free list node lives in the element body.
+ */
+static int
+newblock(rb_bh *bh)
+{
+	rb_heap_block *b;
+	unsigned long i;
+	uintptr_t offset;
+	rb_dlink_node *node;
+
+	if(bh->idle_list.head != NULL)
+	{
+		b = bh->idle_list.head->data;
+		rb_dlinkDelete(&b->node, &bh->idle_list);
+	}
+	else
+	{
+		b = rb_malloc(sizeof(rb_heap_block));
+		b->alloc_size = bh->elemsPerBlock * bh->elemSize;
+		b->elems = get_block(b->alloc_size);
+		if(rb_unlikely(b->elems == NULL))
+		{
+			rb_free(b);
+			return (1);
+		}
+	}
+
+	offset = (uintptr_t)b->elems;
+	for(i = 0; i < bh->elemsPerBlock; i++, offset += bh->elemSize)
+	{
+		*((void **)offset) = b;
+		node = (void *)(offset + offset_pad);
+		rb_dlinkAdd((void *)offset, node, &bh->free_list);
+	}
+	rb_dlinkAdd(b, &b->node, &bh->block_list);
+	b->free_count = bh->elemsPerBlock;
+	return (0);
+}
+
 /*
  * void rb_init_bh(void)
  *
@@ -117,6 +227,14 @@ rb_init_bh(void)
 		offset_pad &= ~(__alignof__(long long) - 1);
 	}
 #endif
+
+#if defined(HAVE_MMAP) && defined(_SC_PAGESIZE)
+	page_size = sysconf(_SC_PAGESIZE);
+#endif
+	if(page_size == 0)
+		page_size = 4096;
+
+	rb_event_addish("rb_bh_gc", rb_bh_gc_event, NULL, 300);
 }
 
 /* ************************************************************************ */
@@ -138,6 +256,7 @@ rb_bh *
 rb_bh_create(size_t elemsize, int elemsperblock, const char *desc)
 {
 	rb_bh *bh;
+	size_t block_size;
 	lrb_assert(elemsize > 0 && elemsperblock > 0);
 	lrb_assert(elemsize >= sizeof(rb_dlink_node));
 
@@ -152,8 +271,21 @@ rb_bh_create(size_t elemsize, int elemsperblock, const char *desc)
 
 	/* Allocate our new rb_bh */
 	bh = rb_malloc(sizeof(rb_bh));
+
+	/* room for the block back pointer, rounded so the next element stays aligned */
+	elemsize += offset_pad;
+	if((elemsize % offset_pad) != 0)
+	{
+		elemsize += offset_pad;
+		elemsize &= ~(offset_pad - 1);
+	}
 	bh->elemSize = elemsize;
-	bh->elemsPerBlock = elemsperblock;
+
+	/* fill out the last page of the block rather than wasting it */
+	block_size = elemsize * elemsperblock;
+	block_size = (block_size + page_size - 1) & ~(page_size - 1);
+	bh->elemsPerBlock = block_size / elemsize;
+
 	if(desc != NULL)
 		bh->desc = rb_strdup(desc);
 
@@ -161,6 +293,14 @@ rb_bh_create(size_t elemsize, int elemsperblock, const char *desc)
 	{
 		rb_bh_fail("bh == NULL when it shouldn't be");
 	}
+
+	/* get the first block, so that we fail early if the system is out of memory */
+	if(rb_unlikely(newblock(bh)))
+	{
+		rb_lib_log("newblock() failed");
+		rb_outofmemory();	/* die.. out of memory */
+	}
+
 	rb_dlinkAdd(bh, &bh->hlist, heap_lists);
 	return (bh);
 }
@@ -180,13 +320,40 @@ rb_bh_create(size_t elemsize, int elemsperblock, const char *desc)
 void *
 rb_bh_alloc(rb_bh *bh)
 {
+	rb_dlink_node *new_node;
+	rb_heap_block *block;
+	void *ptr;
+
 	lrb_assert(bh != NULL);
 	if(rb_unlikely(bh == NULL))
 	{
 		rb_bh_fail("Cannot allocate if bh == NULL");
 	}
 
-	return (rb_malloc(bh->elemSize));
+	if(bh->free_list.head == NULL)
+	{
+		/* Allocate new block and assign */
+		/* newblock returns 1 if unsuccessful, 0 if not */
+
+		if(rb_unlikely(newblock(bh)))
+		{
+			rb_lib_log("newblock() failed");
+			rb_outofmemory();	/* Well that didn't work either...bail */
+		}
+		if(bh->free_list.head == NULL)
+		{
+			rb_lib_log("out of memory after newblock()...");
+			rb_outofmemory();
+		}
+	}
+
+	new_node = bh->free_list.head;
+	block = *((rb_heap_block **)new_node->data);
+	ptr = (void *)((uintptr_t)new_node->data + offset_pad);
+	rb_dlinkDelete(new_node, &bh->free_list);
+	block->free_count--;
+	memset(ptr, 0, bh->elemSize - offset_pad);
+	return (ptr);
 }
 
 
@@ -204,6 +371,9 @@ rb_bh_alloc(rb_bh *bh)
 int
 rb_bh_free(rb_bh *bh, void *ptr)
 {
+	rb_heap_block *block;
+	void *data;
+
 	lrb_assert(bh != NULL);
 	lrb_assert(ptr != NULL);
 
@@ -219,7 +389,18 @@ rb_bh_free(rb_bh *bh, void *ptr)
 		return (1);
 	}
 
-	rb_free(ptr);
+	data = (void *)((uintptr_t)ptr - offset_pad);
+	block = *((rb_heap_block **)data);
+
+	/* XXX */
+	if(rb_unlikely(!((uintptr_t)ptr >= (uintptr_t)block->elems &&
+			 (uintptr_t)ptr < (uintptr_t)block->elems + (uintptr_t)block->alloc_size)))
+	{
+		rb_bh_fail("rb_bh_free() bogus pointer");
+	}
+	block->free_count++;
+
+	rb_dlinkAdd(data, (rb_dlink_node *)ptr, &bh->free_list);
 	return (0);
 }
 
@@ -237,9 +418,26 @@ rb_bh_free(rb_bh *bh, void *ptr)
 int
 rb_bh_destroy(rb_bh *bh)
 {
+	rb_dlink_node *ptr, *next;
+	rb_heap_block *b;
+
 	if(bh == NULL)
 		return (1);
 
+	RB_DLINK_FOREACH_SAFE(ptr, next, bh->block_list.head)
+	{
+		b = ptr->data;
+		free_block(b->elems, b->alloc_size);
+		rb_free(b);
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, bh->idle_list.head)
+	{
+		b = ptr->data;
+		free_block(b->elems, b->alloc_size);
+		rb_free(b);
+	}
+
 	rb_dlinkDelete(&bh->hlist, heap_lists);
 	rb_free(bh->desc);
 	rb_free(bh);
@@ -247,17 +445,80 @@ rb_bh_destroy(rb_bh *bh)
 	return (0);
 }
 
+/* ************************************************************************ */
+/* FUNCTION DOCUMENTATION:                                                  */
+/*    rb_bh_gc                                                             */
+/* Description:                                                             */
+/*    Returns the memory of completely unused blocks to the system.  One    */
+/*    empty block is kept per heap so alloc/free churn around a block       */
+/*    boundary does not keep mapping and unmapping pages.                   */
+/* Parameters:                                                              */
+/*    bh (IN):  Pointer to the rb_bh to collect.                            */
+/* Returns:                                                                 */
+/*    Number of blocks released.                                            */
+/* ************************************************************************ */
+int
+rb_bh_gc(rb_bh *bh)
+{
+	rb_dlink_node *ptr, *next;
+	rb_heap_block *b;
+	uintptr_t offset;
+	unsigned long i;
+	int kept = 0, released = 0;
+
+	if(bh == NULL)
+		return 0;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, bh->block_list.head)
+	{
+		b = ptr->data;
+		if(b->free_count != bh->elemsPerBlock)
+			continue;
+
+		if(!kept)
+		{
+			kept = 1;
+			continue;
+		}
+
+		/* pull every element of this block off the free list */
+		offset = (uintptr_t)b->elems;
+		for(i = 0; i < bh->elemsPerBlock; i++, offset += bh->elemSize)
+			rb_dlinkDelete((rb_dlink_node *)(offset + offset_pad), &bh->free_list);
+
+		rb_dlinkDelete(&b->node, &bh->block_list);
+		release_block(bh, b);
+		released++;
+	}
+	return released;
+}
+
 void
-rb_bh_usage(rb_bh *bh __attribute__((unused)), size_t *bused, size_t *bfree, size_t *bmemusage, const char **desc)
+rb_bh_gc_event(void *unused __attribute__((unused)))
 {
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, heap_lists->head)
+	{
+		rb_bh_gc(ptr->data);
+	}
+}
+
+void
+rb_bh_usage(rb_bh *bh, size_t *bused, size_t *bfree, size_t *bmemusage, const char **desc)
+{
+	size_t used, freem;
+
+	freem = rb_dlink_list_length(&bh->free_list);
+	used = (rb_dlink_list_length(&bh->block_list) * bh->elemsPerBlock) - freem;
 	if(bused != NULL)
-		*bused = 0;
+		*bused = used;
 	if(bfree != NULL)
-		*bfree = 0;
+		*bfree = freem;
 	if(bmemusage != NULL)
-		*bmemusage = 0;
+		*bmemusage = used * bh->elemSize;
 	if(desc != NULL)
-		*desc = "no blockheap";
+		*desc = bh->desc;
 }
 
 void
@@ -267,7 +528,7 @@ rb_bh_usage_all(rb_bh_usage_cb *cb, void *data)
 	rb_bh *bh;
 	size_t used, freem, memusage, heapalloc;
 	static const char *unnamed = "(unnamed_heap)";
-	const char *desc = unnamed;
+	const char *desc;
 
 	if(cb == NULL)
 		return;
@@ -279,8 +540,7 @@ rb_bh_usage_all(rb_bh_usage_cb *cb, void *data)
 		used = (rb_dlink_list_length(&bh->block_list) * bh->elemsPerBlock) - freem;
 		memusage = used * bh->elemSize;
 		heapalloc = (freem + used) * bh->elemSize;
-		if(bh->desc != NULL)
-			desc = bh->desc;
+		desc = bh->desc != NULL ? bh->desc : unnamed;
 		cb(used, freem, memusage, heapalloc, desc, data);
 	}
 	return;
@@ -55,6 +55,11 @@ static rb_dlink_list closed_list;
 
 static struct ev_entry *rb_timeout_ev;
 
+/* backends that do the io themselves can take over these */
+static ssize_t (*io_read_handler) (rb_fde_t *, void *, int);
+static int (*io_accept_handler) (rb_fde_t *, struct sockaddr *, rb_socklen_t *);
+static void (*io_close_handler) (rb_fde_t *);
+
 
 static const char *rb_err_str[] = { "Comm OK", "Error during bind()",
 	"Error during DNS lookup", "connect timeout",
@@ -525,7 +530,10 @@ static void rb_accept_tryaccept(rb_fde_t *F, void *data __attribute__((unused)))
 		memset(&st, 0, sizeof(st));
 		addrlen = sizeof(st);
 
-		new_fd = accept(F->fd, (struct sockaddr *)&st, &addrlen);
+		if(io_accept_handler != NULL)
+			new_fd = io_accept_handler(F, (struct sockaddr *)&st, &addrlen);
+		else
+			new_fd = accept(F->fd, (struct sockaddr *)&st, &addrlen);
 		rb_get_errno();
 		if(new_fd < 0)
 		{
@@ -546,6 +554,9 @@ static void rb_accept_tryaccept(rb_fde_t *F, void *data __attribute__((unused)))
 			continue;
 		}
 
+		if(IsFDStream(F))
+			SetFDStream(new_F);
+
 		if(rb_unlikely(!rb_set_nb(new_F)))
 		{
 			rb_get_errno();
@@ -867,6 +878,18 @@ rb_socketpair(int family, int sock_type, int proto, rb_fde_t **F1, rb_fde_t **F2
 		return -1;
 	}
 
+	/* datagram pairs are how the helpers get their fds handed over */
+	if(sock_type == SOCK_DGRAM)
+	{
+		SetFDPass(*F1);
+		SetFDPass(*F2);
+	}
+	else if(sock_type == SOCK_STREAM)
+	{
+		SetFDStream(*F1);
+		SetFDStream(*F2);
+	}
+
 	/* Set the socket non-blocking, and other wonderful bits */
 	if(rb_unlikely(!rb_set_nb(*F1)))
 	{
@@ -1002,6 +1025,9 @@ rb_socket(int family, int sock_type, int proto, const char *note)
 	}
 #endif
 
+	if(sock_type == SOCK_STREAM && !(F->type & RB_FD_SCTP))
+		SetFDStream(F);
+
 	/* Set the socket non-blocking, and other wonderful bits */
 	if(rb_unlikely(!rb_set_nb(F)))
 	{
@@ -1150,6 +1176,8 @@ rb_close(rb_fde_t *F)
 	}
 
 	rb_setselect(F, RB_SELECT_WRITE | RB_SELECT_READ, NULL, NULL);
+	if(io_close_handler != NULL)
+		io_close_handler(F);
 	rb_settimeout(F, 0, NULL, NULL);
 	rb_free(F->accept);
 	rb_free(F->connect);
@@ -1273,7 +1301,10 @@ rb_read(rb_fde_t *F, void *buf, int count)
 #endif
 	if(F->type & RB_FD_SOCKET)
 	{
-		ret = recv(F->fd, buf, count, 0);
+		if(io_read_handler != NULL)
+			ret = io_read_handler(F, buf, count);
+		else
+			ret = recv(F->fd, buf, count, 0);
 		if(ret < 0)
 		{
 			rb_get_errno();
@@ -2057,11 +2088,8 @@ rb_inet_socketpair(int family, int type, int protocol, rb_platform_fd_t fd[2])
 
 static void (*setselect_handler) (rb_fde_t *, unsigned int, PF *, void *);
 static int (*select_handler) (long);
+static SELECTHOOK *select_hook;
 static int (*setup_fd_handler) (rb_fde_t *);
-static int (*io_sched_event) (struct ev_entry *, int);
-static void (*io_unsched_event) (struct ev_entry *);
-static int (*io_supports_event) (void);
-static void (*io_init_event) (void);
 static char iotype[25];
 
 const char *
@@ -2070,12 +2098,6 @@ rb_get_iotype(void)
 	return iotype;
 }
 
-static int
-rb_unsupported_event(void)
-{
-	return 0;
-}
-
 static int
 try_kqueue(void)
 {
@@ -2084,16 +2106,29 @@ try_kqueue(void)
 		setselect_handler = rb_setselect_kqueue;
 		select_handler = rb_select_kqueue;
 		setup_fd_handler = rb_setup_fd_kqueue;
-		io_sched_event = rb_kqueue_sched_event;
-		io_unsched_event = rb_kqueue_unsched_event;
-		io_init_event = rb_kqueue_init_event;
-		io_supports_event = rb_kqueue_supports_event;
 		rb_strlcpy(iotype, "kqueue", sizeof(iotype));
 		return 0;
 	}
 	return -1;
 }
 
+static int
+try_iouring(void)
+{
+	if(!rb_init_netio_iouring())
+	{
+		setselect_handler = rb_setselect_iouring;
+		select_handler = rb_select_iouring;
+		setup_fd_handler = rb_setup_fd_iouring;
+		io_read_handler = rb_read_iouring;
+		io_accept_handler = rb_accept_iouring;
+		io_close_handler = rb_close_iouring;
+		rb_strlcpy(iotype, "iouring", sizeof(iotype));
+		return 0;
+	}
+	return -1;
+}
+
 static int
 try_epoll(void)
 {
@@ -2102,10 +2137,6 @@ try_epoll(void)
 		setselect_handler = rb_setselect_epoll;
 		select_handler = rb_select_epoll;
 		setup_fd_handler = rb_setup_fd_epoll;
-		io_sched_event = rb_epoll_sched_event;
-		io_unsched_event = rb_epoll_unsched_event;
-		io_supports_event = rb_epoll_supports_event;
-		io_init_event = rb_epoll_init_event;
 		rb_strlcpy(iotype, "epoll", sizeof(iotype));
 		return 0;
 	}
@@ -2120,10 +2151,6 @@ try_ports(void)
 		setselect_handler = rb_setselect_ports;
 		select_handler = rb_select_ports;
 		setup_fd_handler = rb_setup_fd_ports;
-		io_sched_event = rb_ports_sched_event;
-		io_unsched_event = rb_ports_unsched_event;
-		io_init_event =  rb_ports_init_event;
-		io_supports_event = rb_ports_supports_event;
 		rb_strlcpy(iotype, "ports", sizeof(iotype));
 		return 0;
 	}
@@ -2138,10 +2165,6 @@ try_devpoll(void)
 		setselect_handler = rb_setselect_devpoll;
 		select_handler = rb_select_devpoll;
 		setup_fd_handler = rb_setup_fd_devpoll;
-		io_sched_event = NULL;
-		io_unsched_event = NULL;
-		io_init_event = NULL;
-		io_supports_event = rb_unsupported_event;
 		rb_strlcpy(iotype, "devpoll", sizeof(iotype));
 		return 0;
 	}
@@ -2156,10 +2179,6 @@ try_sigio(void)
 		setselect_handler = rb_setselect_sigio;
 		select_handler = rb_select_sigio;
 		setup_fd_handler = rb_setup_fd_sigio;
-		io_sched_event = rb_sigio_sched_event;
-		io_unsched_event = rb_sigio_unsched_event;
-		io_supports_event = rb_sigio_supports_event;
-		io_init_event = rb_sigio_init_event;
 
 		rb_strlcpy(iotype, "sigio", sizeof(iotype));
 		return 0;
@@ -2175,10 +2194,6 @@ try_poll(void)
 		setselect_handler = rb_setselect_poll;
 		select_handler = rb_select_poll;
 		setup_fd_handler = rb_setup_fd_poll;
-		io_sched_event = NULL;
-		io_unsched_event = NULL;
-		io_init_event = NULL;
-		io_supports_event = rb_unsupported_event;
 		rb_strlcpy(iotype, "poll", sizeof(iotype));
 		return 0;
 	}
@@ -2193,10 +2208,6 @@ try_win32(void)
 		setselect_handler = rb_setselect_win32;
 		select_handler = rb_select_win32;
 		setup_fd_handler = rb_setup_fd_win32;
-		io_sched_event = NULL;
-		io_unsched_event = NULL;
-		io_init_event = NULL;
-		io_supports_event = rb_unsupported_event;
 		rb_strlcpy(iotype, "win32", sizeof(iotype));
 		return 0;
 	}
@@ -2211,10 +2222,6 @@ try_select(void)
 		setselect_handler = rb_setselect_select;
 		select_handler = rb_select_select;
 		setup_fd_handler = rb_setup_fd_select;
-		io_sched_event = NULL;
-		io_unsched_event = NULL;
-		io_init_event = NULL;
-		io_supports_event = rb_unsupported_event;
 		rb_strlcpy(iotype, "select", sizeof(iotype));
 		return 0;
 	}
@@ -2222,39 +2229,6 @@ try_select(void)
 }
 
 
-int
-rb_io_sched_event(struct ev_entry *ev, int when)
-{
-	if(ev == NULL || io_supports_event == NULL || io_sched_event == NULL
-	   || !io_supports_event())
-		return 0;
-	return io_sched_event(ev, when);
-}
-
-void
-rb_io_unsched_event(struct ev_entry *ev)
-{
-	if(ev == NULL || io_supports_event == NULL || io_unsched_event == NULL
-	   || !io_supports_event())
-		return;
-	io_unsched_event(ev);
-}
-
-int
-rb_io_supports_event(void)
-{
-	if(io_supports_event == NULL)
-		return 0;
-	return io_supports_event();
-}
-
-void
-rb_io_init_event(void)
-{
-	io_init_event();
-	rb_event_io_register_all();
-}
-
 void
 rb_init_netio(void)
 {
@@ -2269,6 +2243,11 @@ rb_init_netio(void)
 			if(!try_epoll())
 				return;
 		}
+		else if(!strcmp("iouring", ioenv))
+		{
+			if(!try_iouring())
+				return;
+		}
 		else if(!strcmp("kqueue", ioenv))
 		{
 			if(!try_kqueue())
@@ -2307,6 +2286,7 @@ rb_init_netio(void)
 
 	}
 
+	/* io_uring is only used when asked for with LIBRB_USE_IOTYPE */
 	if(!try_kqueue())
 		return;
 	if(!try_epoll())
@@ -2335,10 +2315,30 @@ rb_setselect(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
 	setselect_handler(F, type, handler, client_data);
 }
 
+/*
+ * rb_set_select_hook
+ *
+ * register a function to be called after every rb_select(), once all
+ * the io callbacks for that pass have run.  Only one hook is supported.
+ */
+void
+rb_set_select_hook(SELECTHOOK *hook)
+{
+	select_hook = hook;
+}
+
+void
+rb_run_select_hook(void)
+{
+	if(select_hook != NULL)
+		select_hook();
+}
+
 int
 rb_select(unsigned long timeout)
 {
 	int ret = select_handler(timeout);
+	rb_run_select_hook();
 	free_fds();
 	return ret;
 }
@@ -2407,6 +2407,7 @@ rb_recv_fd_buf(rb_fde_t *F, void *data, size_t datasize, rb_fde_t **xF, int nfds
 	msg.msg_control = cmsg;
 	msg.msg_controllen = control_len;
 
+	SetFDPass(F);
 	if((len = recvmsg(rb_get_fd(F), &msg, 0)) <= 0)
 		return len;
 
@@ -29,6 +29,9 @@
 struct rb_dictionary
 {
 	DCF compare_cb;
+	DHF hash_cb;
+	rb_dictionary_element **buckets;	/* hash index, NULL unless hashed */
+	unsigned int bucket_mask;
 	rb_dictionary_element *root, *head, *tail;
 	unsigned int count;
 	char *id;
@@ -68,6 +71,163 @@ rb_dictionary *rb_dictionary_create(const char *name,
 	return dtree;
 }
 
+#define DICT_HASH_MIN_BUCKETS	16
+
+/*
+ * rb_dictionary_create_hashed(const char *name, DCF compare_cb, DHF hash_cb)
+ *
+ * Dictionary object factory, for dictionaries which are mostly looked up.
+ *
+ * Inputs:
+ *     - dictionary name
+ *     - function to use for comparing two entries in the dtree
+ *     - function to use for hashing a key, consistent with compare_cb
+ *
+ * Outputs:
+ *     - on success, a new dictionary object.
+ *
+ * Side Effects:
+ *     - the dictionary keeps a hash index besides the tree; lookups
+ *       go through the index and leave the tree alone.
+ */
+rb_dictionary *rb_dictionary_create_hashed(const char *name,
+	DCF compare_cb, DHF hash_cb)
+{
+	rb_dictionary *dtree = rb_dictionary_create(name, compare_cb);
+
+	lrb_assert(hash_cb != NULL);
+
+	dtree->hash_cb = hash_cb;
+	dtree->buckets = rb_malloc(DICT_HASH_MIN_BUCKETS * sizeof(rb_dictionary_element *));
+	dtree->bucket_mask = DICT_HASH_MIN_BUCKETS - 1;
+
+	return dtree;
+}
+
+/*
+ * the hash index is a power of two sized array of singly linked chains,
+ * doubled whenever the load factor would exceed one.
+ */
+static void
+rb_dictionary_hash_grow(rb_dictionary *dict)
+{
+	rb_dictionary_element **buckets, *delem, *next;
+	unsigned int i, nmask = (dict->bucket_mask << 1) | 1;
+
+	buckets = rb_malloc((nmask + 1) * sizeof(rb_dictionary_element *));
+
+	for (i = 0; i <= dict->bucket_mask; i++)
+	{
+		for (delem = dict->buckets[i]; delem != NULL; delem = next)
+		{
+			next = delem->hnext;
+			delem->hnext = buckets[delem->hashv & nmask];
+			buckets[delem->hashv & nmask] = delem;
+		}
+	}
+
+	rb_free(dict->buckets);
+	dict->buckets = buckets;
+	dict->bucket_mask = nmask;
+}
+
+static void
+rb_dictionary_hash_link(rb_dictionary *dict, rb_dictionary_element *delem)
+{
+	rb_dictionary_element **bucket;
+
+	if (dict->count > dict->bucket_mask + 1)
+		rb_dictionary_hash_grow(dict);
+
+	delem->hashv = dict->hash_cb(delem->key);
+	bucket = &dict->buckets[delem->hashv & dict->bucket_mask];
+	delem->hnext = *bucket;
+	*bucket = delem;
+}
+
+static void
+rb_dictionary_hash_unlink(rb_dictionary *dict, rb_dictionary_element *delem)
+{
+	rb_dictionary_element **pp;
+
+	for (pp = &dict->buckets[delem->hashv & dict->bucket_mask]; *pp != NULL; pp = &(*pp)->hnext)
+	{
+		if (*pp == delem)
+		{
+			*pp = delem->hnext;
+			return;
+		}
+	}
+
+	lrb_assert(0);
+}
+
+static inline rb_dictionary_element *
+rb_dictionary_hash_find(rb_dictionary *dict, const void *key)
+{
+	rb_dictionary_element *delem;
+	uint32_t hashv = dict->hash_cb(key);
+
+	for (delem = dict->buckets[hashv & dict->bucket_mask]; delem != NULL; delem = delem->hnext)
+	{
+		if (delem->hashv == hashv && !dict->compare_cb(key, delem->key))
+			return delem;
+	}
+
+	return NULL;
+}
+
+/*
+ * FNV-1a, as used by the ircd hash tables.
+ */
+#define DICT_FNV_OFFSET	2166136261U
+#define DICT_FNV_PRIME	16777619U
+
+uint32_t
+rb_dictionary_str_hash(const void *key)
+{
+	const unsigned char *s = key;
+	uint32_t h = DICT_FNV_OFFSET;
+
+	while (*s)
+	{
+		h ^= *s++;
+		h *= DICT_FNV_PRIME;
+	}
+
+	return h;
+}
+
+uint32_t
+rb_dictionary_strcase_hash(const void *key)
+{
+	const unsigned char *s = key;
+	uint32_t h = DICT_FNV_OFFSET;
+
+	while (*s)
+	{
+		h ^= tolower(*s++);
+		h *= DICT_FNV_PRIME;
+	}
+
+	return h;
+}
+
+uint32_t
+rb_dictionary_uint32_hash(const void *key)
+{
+	uint32_t h = RB_POINTER_TO_UINT(key);
+
+	/* integer finaliser from murmur3, keys are often sequential */
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+
+	return h;
+}
+
 /*
  * rb_dictionary_set_comparator_func(rb_dictionary *dict,
  *     DCF compare_cb)
@@ -288,6 +448,9 @@ rb_dictionary_link(rb_dictionary *dict,
 		delem->left = delem->right = NULL;
 		delem->next = delem->prev = NULL;
 		dict->head = dict->tail = dict->root = delem;
+
+		if (dict->buckets != NULL)
+			rb_dictionary_hash_link(dict, delem);
 	}
 	else
 	{
@@ -310,6 +473,9 @@ rb_dictionary_link(rb_dictionary *dict,
 			delem->next = dict->root;
 			dict->root->prev = delem;
 			dict->root = delem;
+
+			if (dict->buckets != NULL)
+				rb_dictionary_hash_link(dict, delem);
 		}
 		else if (ret > 0)
 		{
@@ -326,9 +492,13 @@ rb_dictionary_link(rb_dictionary *dict,
 			delem->prev = dict->root;
 			dict->root->next = delem;
 			dict->root = delem;
+
+			if (dict->buckets != NULL)
+				rb_dictionary_hash_link(dict, delem);
 		}
 		else
 		{
+			/* equal keys hash equally, so the hash chain stays valid */
 			dict->root->key = delem->key;
 			dict->root->data = delem->data;
 			dict->count--;
@@ -449,6 +619,7 @@ void rb_dictionary_destroy(rb_dictionary *dtree,
 	}
 
 	rb_dlinkDelete(&dtree->node, &dictionary_list);
+	rb_free(dtree->buckets);
 	rb_free(dtree->id);
 	rb_free(dtree);
 }
@@ -645,12 +816,15 @@ void rb_dictionary_foreach_next(rb_dictionary *dtree,
  *     - on failure, NULL
  *
  * Side Effects:
- *     - none
+ *     - the tree is retuned for key, unless the dictionary is hashed.
  */
 rb_dictionary_element *rb_dictionary_find(rb_dictionary *dict, const void *key)
 {
 	lrb_assert(dict != NULL);
 
+	if (dict->buckets != NULL)
+		return rb_dictionary_hash_find(dict, key);
+
 	/* retune for key, key will be the tree's root if it's available */
 	rb_dictionary_retune(dict, key);
 
@@ -713,11 +887,27 @@ rb_dictionary_element *rb_dictionary_add(rb_dictionary *dict, const void *key, v
  */
 void *rb_dictionary_delete(rb_dictionary *dtree, const void *key)
 {
-	rb_dictionary_element *delem = rb_dictionary_find(dtree, key);
+	rb_dictionary_element *delem;
 	void *data;
 
-	if (delem == NULL)
-		return NULL;
+	if (dtree->buckets != NULL)
+	{
+		delem = rb_dictionary_hash_find(dtree, key);
+		if (delem == NULL)
+			return NULL;
+
+		rb_dictionary_hash_unlink(dtree, delem);
+
+		/* bring it to the root so it can be unlinked */
+		rb_dictionary_retune(dtree, key);
+		lrb_assert(dtree->root == delem);
+	}
+	else
+	{
+		delem = rb_dictionary_find(dtree, key);
+		if (delem == NULL)
+			return NULL;
+	}
 
 	data = delem->data;
 
@@ -809,6 +999,7 @@ stats_recurse(rb_dictionary_element *delem, int depth, int *pmaxdepth)
 void rb_dictionary_stats(rb_dictionary *dict, void (*cb)(const char *line, void *privdata), void *privdata)
 {
 	char str[256];
+	const char *type = dict->buckets != NULL ? "DICT/HASH" : "DICT";
 	int sum, maxdepth;
 
 	lrb_assert(dict != NULL);
@@ -817,11 +1008,11 @@ void rb_dictionary_stats(rb_dictionary *dict, void (*cb)(const char *line, void
 	{
 		maxdepth = 0;
 		sum = stats_recurse(dict->root, 0, &maxdepth);
-		snprintf(str, sizeof str, "%-30s %-15s %-10u %-10d %-10d %-10d", dict->id, "DICT", dict->count, sum, sum / dict->count, maxdepth);
+		snprintf(str, sizeof str, "%-30s %-15s %-10u %-10d %-10d %-10d", dict->id, type, dict->count, sum, sum / dict->count, maxdepth);
 	}
 	else
 	{
-		snprintf(str, sizeof str, "%-30s %-15s %-10s %-10s %-10s %-10s", dict->id, "DICT", "0", "0", "0", "0");
+		snprintf(str, sizeof str, "%-30s %-15s %-10s %-10s %-10s %-10s", dict->id, type, "0", "0", "0", "0");
 	}
 
 	cb(str, privdata);
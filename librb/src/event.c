@@ -47,10 +47,119 @@
 #include <event-int.h>
 
 #define EV_NAME_LEN 33
+#define EV_HASH_SIZE 256
 static char last_event_ran[EV_NAME_LEN];
-static rb_dlink_list event_list;
 
-static time_t event_time_min = -1;
+/*
+ * Pending events live in a binary min-heap ordered on when, so the next
+ * deadline is always event_heap[0] and adding or removing an event is
+ * O(log n).  rb_event_find() goes through a small hash on func/arg.
+ */
+static struct ev_entry **event_heap;
+static int event_heap_len;
+static int event_heap_max;
+static rb_dlink_list event_hash[EV_HASH_SIZE];
+
+/* the event whose callback is running, it is freed once that returns */
+static struct ev_entry *event_running;
+
+static int64_t
+rb_event_now(void)
+{
+	const struct timeval *tv = rb_current_time_tv();
+	return (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+}
+
+static unsigned int
+rb_event_hash(EVH * func, void *arg)
+{
+	uintptr_t h = (uintptr_t)func ^ ((uintptr_t)arg >> 4);
+	h ^= h >> 8;
+	h ^= h >> 16;
+	return h % EV_HASH_SIZE;
+}
+
+static inline void
+heap_set(int idx, struct ev_entry *ev)
+{
+	event_heap[idx] = ev;
+	ev->heap_index = idx;
+}
+
+static void
+heap_sift_up(int idx)
+{
+	struct ev_entry *ev = event_heap[idx];
+
+	while(idx > 0)
+	{
+		int parent = (idx - 1) / 2;
+		if(event_heap[parent]->when <= ev->when)
+			break;
+		heap_set(idx, event_heap[parent]);
+		idx = parent;
+	}
+	heap_set(idx, ev);
+}
+
+static void
+heap_sift_down(int idx)
+{
+	struct ev_entry *ev = event_heap[idx];
+
+	while(1)
+	{
+		int child = idx * 2 + 1;
+		if(child >= event_heap_len)
+			break;
+		if(child + 1 < event_heap_len && event_heap[child + 1]->when < event_heap[child]->when)
+			child++;
+		if(ev->when <= event_heap[child]->when)
+			break;
+		heap_set(idx, event_heap[child]);
+		idx = child;
+	}
+	heap_set(idx, ev);
+}
+
+static void
+heap_insert(struct ev_entry *ev)
+{
+	if(event_heap_len == event_heap_max)
+	{
+		event_heap_max = event_heap_max ? event_heap_max * 2 : 64;
+		event_heap = rb_realloc(event_heap, sizeof(struct ev_entry *) * event_heap_max);
+	}
+	heap_set(event_heap_len++, ev);
+	heap_sift_up(ev->heap_index);
+}
+
+static void
+heap_remove(struct ev_entry *ev)
+{
+	struct ev_entry *last;
+	int idx = ev->heap_index;
+
+	if(idx < 0)
+		return;
+
+	ev->heap_index = -1;
+	if(--event_heap_len == idx)
+		return;
+
+	last = event_heap[event_heap_len];
+	heap_set(idx, last);
+	heap_sift_up(idx);
+	heap_sift_down(last->heap_index);
+}
+
+/* call after ev->when has changed */
+static void
+heap_update(struct ev_entry *ev)
+{
+	heap_sift_up(ev->heap_index);
+	heap_sift_down(ev->heap_index);
+}
 
 /*
  * struct ev_entry *
@@ -65,7 +174,7 @@ rb_event_find(EVH * func, void *arg)
 {
 	rb_dlink_node *ptr;
 	struct ev_entry *ev;
-	RB_DLINK_FOREACH(ptr, event_list.head)
+	RB_DLINK_FOREACH(ptr, event_hash[rb_event_hash(func, arg)].head)
 	{
 		ev = ptr->data;
 		if((ev->func == func) && (ev->arg == arg))
@@ -75,25 +184,35 @@ rb_event_find(EVH * func, void *arg)
 	return NULL;
 }
 
+static long
+rb_event_frequency(long frequency)
+{
+	if(frequency < 0)
+	{
+		const long two_third = (2 * labs(frequency)) / 3;
+		frequency = two_third + ((rand() % 1000) * two_third) / 1000;
+		if(frequency < 1)
+			frequency = 1;
+	}
+	return frequency;
+}
+
 static
 struct ev_entry *
-rb_event_add_common(const char *name, EVH * func, void *arg, time_t when, time_t frequency)
+rb_event_add_common(const char *name, EVH * func, void *arg, long when, long frequency)
 {
 	struct ev_entry *ev;
 	ev = rb_malloc(sizeof(struct ev_entry));
 	ev->func = func;
 	ev->name = rb_strndup(name, EV_NAME_LEN);
 	ev->arg = arg;
-	ev->when = rb_current_time() + when;
-	ev->next = when;
+	/* never due in the pass that scheduled it, see rb_event_run() */
+	ev->when = rb_event_now() + (when > 0 ? when : 1);
 	ev->frequency = frequency;
 	ev->dead = 0;
 
-	if((ev->when < event_time_min) || (event_time_min == -1))
-		event_time_min = ev->when;
-
-	rb_dlinkAdd(ev, &ev->node, &event_list);
-	rb_io_sched_event(ev, when);
+	rb_dlinkAdd(ev, &ev->node, &event_hash[rb_event_hash(func, arg)]);
+	heap_insert(ev);
 	return ev;
 }
 
@@ -115,7 +234,19 @@ rb_event_add(const char *name, EVH * func, void *arg, time_t when)
 		when = 1;
 	}
 
-	return rb_event_add_common(name, func, arg, when, when);
+	return rb_event_add_common(name, func, arg, when * 1000, when * 1000);
+}
+
+struct ev_entry *
+rb_event_add_msec(const char *name, EVH * func, void *arg, long msec)
+{
+	if (rb_unlikely(msec <= 0)) {
+		rb_lib_log("rb_event_add_msec: tried to schedule %s event with a delay of "
+			"%ld msec", name, msec);
+		msec = 1;
+	}
+
+	return rb_event_add_common(name, func, arg, msec, msec);
 }
 
 struct ev_entry *
@@ -127,7 +258,26 @@ rb_event_addonce(const char *name, EVH * func, void *arg, time_t when)
 		when = 1;
 	}
 
-	return rb_event_add_common(name, func, arg, when, 0);
+	return rb_event_add_common(name, func, arg, when * 1000, 0);
+}
+
+struct ev_entry *
+rb_event_addonce_msec(const char *name, EVH * func, void *arg, long msec)
+{
+	if (rb_unlikely(msec < 0)) {
+		rb_lib_log("rb_event_addonce_msec: tried to schedule %s event to run in "
+			"%ld msec", name, msec);
+		msec = 0;
+	}
+
+	return rb_event_add_common(name, func, arg, msec, 0);
+}
+
+static void
+rb_event_free(struct ev_entry *ev)
+{
+	rb_free(ev->name);
+	rb_free(ev);
 }
 
 /*
@@ -140,12 +290,15 @@ rb_event_addonce(const char *name, EVH * func, void *arg, time_t when)
 void
 rb_event_delete(struct ev_entry *ev)
 {
-	if(ev == NULL)
+	if(ev == NULL || ev->dead)
 		return;
 
 	ev->dead = 1;
+	heap_remove(ev);
+	rb_dlinkDelete(&ev->node, &event_hash[rb_event_hash(ev->func, ev->arg)]);
 
-	rb_io_unsched_event(ev);
+	if(ev != event_running)
+		rb_event_free(ev);
 }
 
 /*
@@ -161,17 +314,6 @@ rb_event_find_delete(EVH * func, void *arg)
 	rb_event_delete(rb_event_find(func, arg));
 }
 
-static time_t
-rb_event_frequency(time_t frequency)
-{
-	if(frequency < 0)
-	{
-		const time_t two_third = (2 * labs(frequency)) / 3;
-		frequency = two_third + ((rand() % 1000) * two_third) / 1000;
-	}
-	return frequency;
-}
-
 /*
  * struct ev_entry *
  * rb_event_addish(const char *name, EVH *func, void *arg, time_t delta_isa)
@@ -185,11 +327,21 @@ rb_event_frequency(time_t frequency)
 struct ev_entry *
 rb_event_addish(const char *name, EVH * func, void *arg, time_t delta_ish)
 {
-	delta_ish = labs(delta_ish);
-	if(delta_ish >= 3.0)
-		delta_ish = -delta_ish;
+	long msec = labs(delta_ish) * 1000;
+	if(msec >= 3000)
+		msec = -msec;
+	return rb_event_add_common(name, func, arg,
+		rb_event_frequency(msec), msec);
+}
+
+struct ev_entry *
+rb_event_addish_msec(const char *name, EVH * func, void *arg, long msec)
+{
+	msec = -labs(msec);
+	if(rb_unlikely(msec == 0))
+		msec = -1;
 	return rb_event_add_common(name, func, arg,
-		rb_event_frequency(delta_ish), delta_ish);
+		rb_event_frequency(msec), msec);
 }
 
 
@@ -197,15 +349,27 @@ void
 rb_run_one_event(struct ev_entry *ev)
 {
 	rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-	ev->func(ev->arg);
-	if(!ev->frequency)
+
+	/* reschedule first, so the callback is free to delete or update it */
+	if(ev->frequency)
 	{
-		rb_event_delete(ev);
-		return;
+		ev->when = rb_event_now() + rb_event_frequency(ev->frequency);
+		if(ev->heap_index >= 0)
+			heap_update(ev);
+		else
+			heap_insert(ev);
 	}
-	ev->when = rb_current_time() + rb_event_frequency(ev->frequency);
-	if((ev->when < event_time_min) || (event_time_min == -1))
-		event_time_min = ev->when;
+	else
+		heap_remove(ev);
+
+	event_running = ev;
+	ev->func(ev->arg);
+	event_running = NULL;
+
+	if(ev->dead)
+		rb_event_free(ev);
+	else if(!ev->frequency)
+		rb_event_delete(ev);
 }
 
 /*
@@ -214,68 +378,18 @@ rb_run_one_event(struct ev_entry *ev)
  * Input: None
  * Output: None
  * Side Effects: Runs pending events in the event list
+ *
+ * Only events that were due when the pass started run.  Anything added
+ * or rearmed from a callback is at least a msec later than now, so it
+ * waits for the next pass and the IO loop gets a turn in between.
  */
 void
 rb_event_run(void)
 {
-	rb_dlink_node *ptr, *next;
-	struct ev_entry *ev;
+	int64_t now = rb_event_now();
 
-	if(rb_io_supports_event())
-		return;
-
-	event_time_min = -1;
-	RB_DLINK_FOREACH_SAFE(ptr, next, event_list.head)
-	{
-		ev = ptr->data;
-		if (ev->dead)
-		{
-			rb_dlinkDelete(&ev->node, &event_list);
-			rb_free(ev->name);
-			rb_free(ev);
-			continue;
-		}
-		if(ev->when <= rb_current_time())
-		{
-			rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-			ev->func(ev->arg);
-
-			/* event is scheduled more than once */
-			if(ev->frequency)
-			{
-				ev->when = rb_current_time() + rb_event_frequency(ev->frequency);
-				if((ev->when < event_time_min) || (event_time_min == -1))
-					event_time_min = ev->when;
-			}
-			else
-			{
-				rb_dlinkDelete(&ev->node, &event_list);
-				rb_free(ev->name);
-				rb_free(ev);
-			}
-		}
-		else
-		{
-			if((ev->when < event_time_min) || (event_time_min == -1))
-				event_time_min = ev->when;
-		}
-	}
-}
-
-void
-rb_event_io_register_all(void)
-{
-	rb_dlink_node *ptr;
-	struct ev_entry *ev;
-
-	if(!rb_io_supports_event())
-		return;
-
-	RB_DLINK_FOREACH(ptr, event_list.head)
-	{
-		ev = ptr->data;
-		rb_io_sched_event(ev, ev->next);
-	}
+	while(event_heap_len > 0 && event_heap[0]->when <= now)
+		rb_run_one_event(event_heap[0]);
 }
 
 /*
@@ -294,10 +408,10 @@ rb_event_init(void)
 void
 rb_dump_events(void (*func) (char *, void *), void *ptr)
 {
-	int len;
+	int len, i;
 	char buf[512];
-	rb_dlink_node *dptr;
 	struct ev_entry *ev;
+	int64_t now = rb_event_now();
 	len = sizeof(buf);
 
 	snprintf(buf, len, "Last event to run: %s", last_event_ran);
@@ -306,11 +420,11 @@ rb_dump_events(void (*func) (char *, void *), void *ptr)
 	rb_strlcpy(buf, "Operation                    Next Execution", len);
 	func(buf, ptr);
 
-	RB_DLINK_FOREACH(dptr, event_list.head)
+	for(i = 0; i < event_heap_len; i++)
 	{
-		ev = dptr->data;
+		ev = event_heap[i];
 		snprintf(buf, len, "%-28s %-4ld seconds (frequency=%d)", ev->name,
-			    ev->when - (long)rb_current_time(), (int)ev->frequency);
+			    (long)((ev->when - now) / 1000), (int)(ev->frequency / 1000));
 		func(buf, ptr);
 	}
 }
@@ -324,13 +438,16 @@ rb_dump_events(void (*func) (char *, void *), void *ptr)
 void
 rb_set_back_events(time_t by)
 {
-	rb_dlink_node *ptr;
 	struct ev_entry *ev;
-	RB_DLINK_FOREACH(ptr, event_list.head)
+	int64_t msec = (int64_t)by * 1000;
+	int i;
+
+	/* moving everything back by the same amount keeps the heap ordered */
+	for(i = 0; i < event_heap_len; i++)
 	{
-		ev = ptr->data;
-		if(ev->when > by)
-			ev->when -= by;
+		ev = event_heap[i];
+		if(ev->when > msec)
+			ev->when -= msec;
 		else
 			ev->when = 0;
 	}
@@ -342,19 +459,42 @@ rb_event_update(struct ev_entry *ev, time_t freq)
 	if(ev == NULL)
 		return;
 
-	ev->frequency = freq;
+	ev->frequency = freq * 1000;
 
 	/* update when it's scheduled to run if it's higher
 	 * than the new frequency
 	 */
-	time_t next = rb_event_frequency(freq);
-	if((rb_current_time() + next) < ev->when)
-		ev->when = rb_current_time() + next;
+	int64_t next = rb_event_now() + rb_event_frequency(ev->frequency);
+	if(next < ev->when)
+	{
+		ev->when = next;
+		if(ev->heap_index >= 0)
+			heap_update(ev);
+	}
 	return;
 }
 
 time_t
 rb_event_next(void)
 {
-	return event_time_min;
+	if(event_heap_len == 0)
+		return -1;
+	return event_heap[0]->when / 1000;
+}
+
+/*
+ * long rb_event_next_msec(void)
+ *
+ * Output: msec until the next event is due, 0 if one is overdue, or -1
+ *	   if there are no events.
+ */
+long
+rb_event_next_msec(void)
+{
+	int64_t delta;
+
+	if(event_heap_len == 0)
+		return -1;
+	delta = event_heap[0]->when - rb_event_now();
+	return delta > 0 ? (long)delta : 0;
 }
@@ -67,6 +67,10 @@ static unsigned int client_cert_count;
 // Shared variables
 static gnutls_priority_t default_priority;
 
+// Session ticket key (only the newest one is used)
+static uint8_t ticket_key[RB_SSL_TICKET_KEY_LEN];
+static bool ticket_key_set = false;
+
 
 
 struct ssl_connect
@@ -172,7 +176,17 @@ rb_ssl_init_fd(rb_fde_t *const F, const rb_fd_tls_direction dir)
 		gnutls_set_default_priority(SSL_P(F));
 
 	if(dir == RB_FD_TLS_DIRECTION_IN)
+	{
 		gnutls_certificate_server_set_request(SSL_P(F), GNUTLS_CERT_REQUEST);
+
+		if(ticket_key_set)
+		{
+			/* GnuTLS derives its ticket keys from a single 64 byte master key */
+			const gnutls_datum_t key = { ticket_key, 64 };
+
+			(void) gnutls_session_ticket_enable_server(SSL_P(F), &key);
+		}
+	}
 }
 
 static void
@@ -832,6 +846,43 @@ rb_ssl_clear_handshake_count(rb_fde_t *const F)
 	F->handshake_count = 0;
 }
 
+void
+rb_ssl_set_ktls(const int enable __attribute__((unused)))
+{
+	return;
+}
+
+int
+rb_ssl_ktls_detach(rb_fde_t *const F __attribute__((unused)))
+{
+	/* not supported by this backend, the connection stays in ssld */
+	return 0;
+}
+
+int
+rb_ssl_set_ticket_keys(const uint8_t *const keys, const int count)
+{
+	if(count < 0 || count > RB_SSL_TICKET_KEYS_MAX)
+		return 0;
+
+	/* tickets under an older key can't be decrypted any more; they are
+	 * rejected and the client does a full handshake */
+	if(count > 0)
+		(void) memcpy(ticket_key, keys, sizeof ticket_key);
+
+	ticket_key_set = (count > 0);
+	return 1;
+}
+
+int
+rb_ssl_session_resumed(rb_fde_t *const F)
+{
+	if(F == NULL || F->ssl == NULL)
+		return 0;
+
+	return gnutls_session_is_resumed(SSL_P(F)) ? 1 : 0;
+}
+
 void
 rb_ssl_start_accepted(rb_fde_t *const F, ACCB *const cb, void *const data, const int timeout)
 {
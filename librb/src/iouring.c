@@ -0,0 +1,832 @@
+/*
+ *  ircd-ratbox: A slightly useful ircd.
+ *  iouring.c: Linux io_uring network routines.
+ *
+ *  Copyright (C) 2002-2005 ircd-ratbox development team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ */
+
+/*
+ * This talks to the kernel directly through io_uring_setup(2) and
+ * io_uring_enter(2) rather than depending on liburing.
+ *
+ * Interest changes made through rb_setselect() are queued as poll SQEs
+ * and handed to the kernel together with the wait in rb_select(), so a
+ * pass through the loop costs one system call no matter how many fds
+ * were rearmed.  Plain stream sockets get a recv SQE instead of a poll:
+ * the kernel picks a buffer from a ring we registered up front, and
+ * rb_read() then hands out the completed data without going back into
+ * the kernel.  Listeners get a single multishot accept which stays
+ * armed for the life of the socket.  Writes stay synchronous; the
+ * linebuf code needs to know how much was written straight away.
+ *
+ * This backend is never picked on its own, only with
+ * LIBRB_USE_IOTYPE=iouring.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <librb_config.h>
+#include <rb_lib.h>
+#include <commio-int.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_MMAP)
+#include <linux/io_uring.h>
+#endif
+
+#if defined(IORING_ACCEPT_MULTISHOT) && defined(IORING_FEAT_EXT_ARG)
+#define USING_IOURING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <signal.h>
+
+#define URING_ENTRIES	1024
+#define URING_BUF_COUNT	512	/* must be a power of two */
+#define URING_BUF_SIZE	8192
+#define URING_BUF_GROUP	0
+
+#define URING_POLL_IN	1
+#define URING_POLL_OUT	2
+#define URING_RECV	3
+#define URING_ACCEPT	4
+
+/* one of these is the user_data of every SQE we submit */
+struct uring_op
+{
+	rb_fde_t *F;		/* NULL once the fd has been closed */
+	uint8_t kind;
+};
+
+struct uring_fd
+{
+	rb_fde_t *F;
+	struct uring_op *rd;	/* outstanding poll, recv or accept */
+	struct uring_op *wr;	/* outstanding POLLOUT poll */
+	rb_dlink_node ready_node;
+
+	/* a completed recv that rb_read() hasn't consumed yet */
+	uint8_t pending;
+	uint16_t bid;
+	int res;
+	int off;
+
+	/* connections taken by the multishot accept, not yet handed out */
+	int *accq;
+	int acchead;
+	int acclen;
+	int accmax;
+};
+
+struct uring_info
+{
+	int fd;
+	unsigned int features;
+
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+	unsigned int sq_local_tail;
+	struct io_uring_sqe *sqes;
+
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_sz;
+	void *cq_ring;
+	size_t cq_ring_sz;
+
+	struct io_uring_buf_ring *br;
+	char *bufs;
+
+	struct uring_fd *fds;
+	int fds_size;
+	rb_dlink_list ready;
+};
+
+static struct uring_info *ur;
+static rb_bh *uring_op_heap;
+
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags, void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static inline struct uring_fd *
+uring_slot(rb_fde_t *F)
+{
+	if(rb_unlikely(F->fd < 0 || F->fd >= ur->fds_size))
+		return NULL;
+	return &ur->fds[F->fd];
+}
+
+static unsigned int
+uring_to_submit(void)
+{
+	return ur->sq_local_tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static struct io_uring_sqe *
+uring_get_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	while(uring_to_submit() >= ur->sq_entries)
+	{
+		/* ring is full, push what we have so far */
+		if(sys_io_uring_enter(ur->fd, uring_to_submit(), 0, 0, NULL, 0) < 0
+		   && !rb_ignore_errno(errno) && errno != EBUSY)
+		{
+			rb_lib_log("uring_get_sqe(): io_uring_enter failed: %s", strerror(errno));
+			abort();
+		}
+	}
+
+	idx = ur->sq_local_tail & *ur->sq_mask;
+	sqe = &ur->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	ur->sq_array[idx] = idx;
+	return sqe;
+}
+
+static void
+uring_commit_sqe(void)
+{
+	ur->sq_local_tail++;
+	__atomic_store_n(ur->sq_tail, ur->sq_local_tail, __ATOMIC_RELEASE);
+}
+
+static struct uring_op *
+uring_submit(rb_fde_t *F, uint8_t kind)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe();
+	struct uring_op *op = rb_bh_alloc(uring_op_heap);
+
+	op->F = F;
+	op->kind = kind;
+
+	sqe->fd = F->fd;
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+
+	switch (kind)
+	{
+	case URING_POLL_IN:
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLIN;
+		break;
+	case URING_POLL_OUT:
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLOUT;
+		break;
+	case URING_RECV:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BUF_GROUP;
+		sqe->len = URING_BUF_SIZE;
+		break;
+	case URING_ACCEPT:
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		break;
+	}
+	uring_commit_sqe();
+	return op;
+}
+
+static void
+uring_cancel(struct uring_op *op)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe();
+
+	/* the completion still arrives, and is dropped because F is gone */
+	op->F = NULL;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)(uintptr_t)op;
+	sqe->user_data = 0;
+	uring_commit_sqe();
+}
+
+static inline char *
+uring_buf(uint16_t bid)
+{
+	return ur->bufs + (size_t)bid * URING_BUF_SIZE;
+}
+
+static void
+uring_recycle_buf(uint16_t bid)
+{
+	unsigned short tail = ur->br->tail;
+	struct io_uring_buf *buf = &ur->br->bufs[tail & (URING_BUF_COUNT - 1)];
+
+	buf->addr = (uint64_t)(uintptr_t)uring_buf(bid);
+	buf->len = URING_BUF_SIZE;
+	buf->bid = bid;
+	__atomic_store_n(&ur->br->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static void
+uring_mark_ready(struct uring_fd *slot)
+{
+	if(slot->ready_node.data == NULL)
+		rb_dlinkAddTail(slot, &slot->ready_node, &ur->ready);
+}
+
+static void
+uring_unmark_ready(struct uring_fd *slot)
+{
+	if(slot->ready_node.data != NULL)
+	{
+		rb_dlinkDelete(&slot->ready_node, &ur->ready);
+		slot->ready_node.data = NULL;
+	}
+}
+
+static void
+uring_call_read(rb_fde_t *F)
+{
+	PF *hdl = F->read_handler;
+	void *data = F->read_data;
+
+	F->read_handler = NULL;
+	F->read_data = NULL;
+	if(hdl)
+		hdl(F, data);
+}
+
+static void
+uring_call_write(rb_fde_t *F)
+{
+	PF *hdl = F->write_handler;
+	void *data = F->write_data;
+
+	F->write_handler = NULL;
+	F->write_data = NULL;
+	if(hdl)
+		hdl(F, data);
+}
+
+/*
+ * Plain stream sockets are read by the kernel as soon as data arrives.
+ * Anything else only gets a poll: a datagram may be read by its owner
+ * with recvfrom() or recvmsg() (and could be cut short by our buffers),
+ * and a recv on a socket carrying fds would drop the fds that came with
+ * the message.  TLS sockets are read by the TLS library.
+ */
+static void
+uring_arm_read(rb_fde_t *F, struct uring_fd *slot)
+{
+	if(slot->rd != NULL)
+		return;
+
+	/* data or connections are already waiting, no need to ask the kernel */
+	if(slot->pending || slot->acclen > 0)
+	{
+		uring_mark_ready(slot);
+		return;
+	}
+
+	if((F->type & RB_FD_LISTEN) && F->accept != NULL)
+		slot->rd = uring_submit(F, URING_ACCEPT);
+	else if(ur->br != NULL && (F->type & RB_FD_SOCKET) && IsFDStream(F)
+		&& !(F->type & (RB_FD_SSL | RB_FD_LISTEN)) && !IsFDPass(F))
+		slot->rd = uring_submit(F, URING_RECV);
+	else
+		slot->rd = uring_submit(F, URING_POLL_IN);
+}
+
+/*
+ * rb_init_netio
+ *
+ * This is a needed exported function which will be called to initialise
+ * the network loop code.
+ */
+int
+rb_init_netio_iouring(void)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	size_t brsz;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+	fd = sys_io_uring_setup(URING_ENTRIES, &p);
+	if(fd < 0)
+		return -1;
+
+	if(!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP))
+	{
+		close(fd);
+		errno = ENOSYS;
+		return -1;
+	}
+
+	ur = rb_malloc(sizeof(struct uring_info));
+	ur->fd = fd;
+	ur->features = p.features;
+
+	ur->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ur->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(ur->cq_ring_sz > ur->sq_ring_sz)
+			ur->sq_ring_sz = ur->cq_ring_sz;
+		ur->cq_ring_sz = ur->sq_ring_sz;
+	}
+
+	ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if(ur->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		ur->cq_ring = ur->sq_ring;
+	else
+	{
+		ur->cq_ring = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if(ur->cq_ring == MAP_FAILED)
+			goto fail;
+	}
+
+	ur->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(ur->sqes == MAP_FAILED)
+		goto fail;
+
+	ur->sq_head = (unsigned int *)((char *)ur->sq_ring + p.sq_off.head);
+	ur->sq_tail = (unsigned int *)((char *)ur->sq_ring + p.sq_off.tail);
+	ur->sq_mask = (unsigned int *)((char *)ur->sq_ring + p.sq_off.ring_mask);
+	ur->sq_array = (unsigned int *)((char *)ur->sq_ring + p.sq_off.array);
+	ur->sq_entries = p.sq_entries;
+	ur->sq_local_tail = *ur->sq_tail;
+
+	ur->cq_head = (unsigned int *)((char *)ur->cq_ring + p.cq_off.head);
+	ur->cq_tail = (unsigned int *)((char *)ur->cq_ring + p.cq_off.tail);
+	ur->cq_mask = (unsigned int *)((char *)ur->cq_ring + p.cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe *)((char *)ur->cq_ring + p.cq_off.cqes);
+
+	/*
+	 * The provided buffer ring needs 5.19.  Without it everything still
+	 * works, sockets just get a poll instead of a recv.
+	 */
+	brsz = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+	ur->br = mmap(NULL, brsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ur->bufs = mmap(NULL, (size_t)URING_BUF_COUNT * URING_BUF_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ur->br != MAP_FAILED && ur->bufs != MAP_FAILED)
+	{
+		memset(&reg, 0, sizeof(reg));
+		reg.ring_addr = (uint64_t)(uintptr_t)ur->br;
+		reg.ring_entries = URING_BUF_COUNT;
+		reg.bgid = URING_BUF_GROUP;
+		if(sys_io_uring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0)
+		{
+			uint16_t i;
+
+			ur->br->tail = 0;
+			for(i = 0; i < URING_BUF_COUNT; i++)
+				uring_recycle_buf(i);
+		}
+		else
+		{
+			munmap(ur->br, brsz);
+			munmap(ur->bufs, (size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+			ur->br = NULL;
+			ur->bufs = NULL;
+		}
+	}
+	else
+	{
+		if(ur->br != MAP_FAILED)
+			munmap(ur->br, brsz);
+		if(ur->bufs != MAP_FAILED)
+			munmap(ur->bufs, (size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+		ur->br = NULL;
+		ur->bufs = NULL;
+	}
+
+	ur->fds_size = getdtablesize();
+	ur->fds = rb_malloc(sizeof(struct uring_fd) * ur->fds_size);
+	/* the block heap wants room for its free list link */
+	uring_op_heap = rb_bh_create(sizeof(struct uring_op) < sizeof(rb_dlink_node) ?
+				     sizeof(rb_dlink_node) : sizeof(struct uring_op),
+				     1024, "librb_iouring_op_heap");
+
+	rb_open(fd, RB_FD_UNKNOWN, "io_uring file descriptor");
+	return 0;
+
+fail:
+	if(ur->sq_ring != MAP_FAILED && ur->sq_ring != NULL)
+		munmap(ur->sq_ring, ur->sq_ring_sz);
+	if(ur->cq_ring != MAP_FAILED && ur->cq_ring != NULL && ur->cq_ring != ur->sq_ring)
+		munmap(ur->cq_ring, ur->cq_ring_sz);
+	close(fd);
+	rb_free(ur);
+	ur = NULL;
+	return -1;
+}
+
+int
+rb_setup_fd_iouring(rb_fde_t *F __attribute__((unused)))
+{
+	return 0;
+}
+
+/*
+ * rb_setselect
+ *
+ * This is a needed exported function which will be called to register
+ * and deregister interest in a pending IO state for a given FD.
+ *
+ * Removing interest is lazy: an outstanding poll is left to fire and is
+ * ignored if nobody wants it by then, which saves a cancel round trip
+ * for the common clear-then-rearm pattern.
+ */
+void
+rb_setselect_iouring(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
+{
+	struct uring_fd *slot;
+
+	lrb_assert(IsFDOpen(F));
+
+	if((slot = uring_slot(F)) == NULL)
+	{
+		rb_lib_log("rb_setselect_iouring(): fd %d out of range", F->fd);
+		return;
+	}
+
+	slot->F = F;
+
+	if(type & RB_SELECT_READ)
+	{
+		F->read_handler = handler;
+		F->read_data = client_data;
+		if(handler != NULL)
+			uring_arm_read(F, slot);
+	}
+
+	if(type & RB_SELECT_WRITE)
+	{
+		F->write_handler = handler;
+		F->write_data = client_data;
+		if(handler != NULL && slot->wr == NULL)
+			slot->wr = uring_submit(F, URING_POLL_OUT);
+	}
+}
+
+static void
+uring_complete(struct uring_op *op, int res, unsigned int flags)
+{
+	rb_fde_t *F = op->F;
+	struct uring_fd *slot;
+
+	if(F == NULL)
+	{
+		/* the fd went away while this was in flight */
+		if(flags & IORING_CQE_F_BUFFER)
+			uring_recycle_buf(flags >> IORING_CQE_BUFFER_SHIFT);
+		if(op->kind == URING_ACCEPT && res >= 0)
+			close(res);
+		if(op->kind != URING_ACCEPT || !(flags & IORING_CQE_F_MORE))
+			rb_bh_free(uring_op_heap, op);
+		return;
+	}
+
+	slot = uring_slot(F);
+
+	switch (op->kind)
+	{
+	case URING_POLL_IN:
+		slot->rd = NULL;
+		rb_bh_free(uring_op_heap, op);
+		uring_call_read(F);
+		break;
+
+	case URING_POLL_OUT:
+		slot->wr = NULL;
+		rb_bh_free(uring_op_heap, op);
+		uring_call_write(F);
+		break;
+
+	case URING_RECV:
+		slot->rd = NULL;
+		rb_bh_free(uring_op_heap, op);
+		if(res == -ENOBUFS)
+		{
+			/* every buffer is parked on some fd, fall back to a poll */
+			if(F->read_handler != NULL)
+				slot->rd = uring_submit(F, URING_POLL_IN);
+			break;
+		}
+		slot->pending = 1;
+		slot->res = res;
+		slot->off = 0;
+		if(flags & IORING_CQE_F_BUFFER)
+			slot->bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		uring_call_read(F);
+		break;
+
+	case URING_ACCEPT:
+		if(!(flags & IORING_CQE_F_MORE))
+		{
+			slot->rd = NULL;
+			rb_bh_free(uring_op_heap, op);
+		}
+		if(res >= 0)
+		{
+			if(slot->acclen == slot->accmax)
+			{
+				int *nq, i, nmax = slot->accmax ? slot->accmax * 2 : 16;
+
+				nq = rb_malloc(sizeof(int) * nmax);
+				for(i = 0; i < slot->acclen; i++)
+					nq[i] = slot->accq[(slot->acchead + i) % slot->accmax];
+				rb_free(slot->accq);
+				slot->accq = nq;
+				slot->accmax = nmax;
+				slot->acchead = 0;
+			}
+			slot->accq[(slot->acchead + slot->acclen) % slot->accmax] = res;
+			slot->acclen++;
+		}
+		/* on error the handler's accept() call picks the errno up */
+		uring_call_read(F);
+		break;
+	}
+}
+
+/*
+ * rb_select
+ *
+ * Called to do the new-style IO, courtesy of squid (like most of this
+ * new IO code). This routine handles the stuff we've hidden in
+ * rb_setselect and fd_table[] and calls callbacks for IO ready
+ * events.
+ */
+int
+rb_select_iouring(long delay)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int head, tail, wait_nr = 1;
+	int ret, o_errno;
+	unsigned long count;
+	rb_dlink_node *ptr;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+
+	if(rb_dlink_list_length(&ur->ready) > 0)
+		delay = 0;
+
+	if(delay == 0)
+		wait_nr = 0;
+	else if(delay > 0)
+	{
+		ts.tv_sec = delay / 1000;
+		ts.tv_nsec = (delay % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+
+	ret = sys_io_uring_enter(ur->fd, uring_to_submit(), wait_nr,
+				 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+	/* save errno as rb_set_time() will likely clobber it */
+	o_errno = errno;
+	rb_set_time();
+	errno = o_errno;
+
+	if(ret < 0 && !rb_ignore_errno(o_errno) && o_errno != ETIME && o_errno != EBUSY)
+		return RB_ERROR;
+
+	head = *ur->cq_head;
+	tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+	while(head != tail)
+	{
+		struct io_uring_cqe *cqe = &ur->cqes[head & *ur->cq_mask];
+		struct uring_op *op = (struct uring_op *)(uintptr_t)cqe->user_data;
+		int res = cqe->res;
+		unsigned int flags = cqe->flags;
+
+		head++;
+		__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+		if(op != NULL)
+			uring_complete(op, res, flags);
+
+		if(head == tail)
+			tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+	}
+
+	/*
+	 * handlers can close other fds on the ready list or put their own
+	 * back on it, so pop from the head and stop at what was there when
+	 * we started.
+	 */
+	count = rb_dlink_list_length(&ur->ready);
+	while(count-- > 0 && (ptr = ur->ready.head) != NULL)
+	{
+		struct uring_fd *slot = ptr->data;
+
+		uring_unmark_ready(slot);
+		if(slot->F != NULL && IsFDOpen(slot->F))
+			uring_call_read(slot->F);
+	}
+
+	return RB_OK;
+}
+
+/*
+ * rb_read_iouring
+ *
+ * Hands out whatever the last recv completion left for this socket.  If
+ * there's nothing parked and no recv in flight, fall back to recv(2) so
+ * callers that read until EAGAIN behave as they always have.
+ */
+ssize_t
+rb_read_iouring(rb_fde_t *F, void *buf, int count)
+{
+	struct uring_fd *slot = uring_slot(F);
+	ssize_t ret;
+
+	if(slot != NULL && slot->pending)
+	{
+		if(slot->res <= 0)
+		{
+			slot->pending = 0;
+			if(slot->res == 0)
+				return 0;
+			errno = -slot->res;
+			return -1;
+		}
+
+		ret = slot->res - slot->off;
+		if(ret > count)
+			ret = count;
+		memcpy(buf, uring_buf(slot->bid) + slot->off, ret);
+		slot->off += ret;
+		if(slot->off == slot->res)
+		{
+			slot->pending = 0;
+			uring_recycle_buf(slot->bid);
+		}
+		return ret;
+	}
+
+	/* a recv is in flight, reading around it could reorder the stream */
+	if(slot != NULL && slot->rd != NULL && slot->rd->kind == URING_RECV)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return recv(F->fd, buf, count, 0);
+}
+
+/*
+ * rb_accept_iouring
+ *
+ * Pops a connection taken by the multishot accept.  The kernel doesn't
+ * give us a peer address for those, so ask for it.
+ */
+int
+rb_accept_iouring(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t *addrlen)
+{
+	struct uring_fd *slot = uring_slot(F);
+	int fd;
+
+	while(slot != NULL && slot->acclen > 0)
+	{
+		fd = slot->accq[slot->acchead];
+		slot->acchead = (slot->acchead + 1) % slot->accmax;
+		slot->acclen--;
+
+		if(getpeername(fd, addr, addrlen) == 0)
+			return fd;
+		close(fd);
+	}
+
+	if(slot != NULL && slot->rd != NULL && slot->rd->kind == URING_ACCEPT)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return accept(F->fd, addr, addrlen);
+}
+
+/*
+ * rb_close_iouring
+ *
+ * Drops everything we were tracking for F before its fd number is
+ * reused.  Anything still in flight is cancelled and its completion
+ * thrown away when it turns up.
+ */
+void
+rb_close_iouring(rb_fde_t *F)
+{
+	struct uring_fd *slot = uring_slot(F);
+
+	if(slot == NULL)
+		return;
+
+	if(slot->rd != NULL)
+		uring_cancel(slot->rd);
+	if(slot->wr != NULL)
+		uring_cancel(slot->wr);
+	if(slot->pending && slot->res > 0)
+		uring_recycle_buf(slot->bid);
+	while(slot->acclen > 0)
+	{
+		close(slot->accq[slot->acchead]);
+		slot->acchead = (slot->acchead + 1) % slot->accmax;
+		slot->acclen--;
+	}
+	uring_unmark_ready(slot);
+	rb_free(slot->accq);
+	memset(slot, 0, sizeof(*slot));
+}
+
+#else /* io_uring not supported here */
+int
+rb_init_netio_iouring(void)
+{
+	return ENOSYS;
+}
+
+void
+rb_setselect_iouring(rb_fde_t *F __attribute__((unused)), unsigned int type __attribute__((unused)), PF * handler __attribute__((unused)), void *client_data __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return;
+}
+
+int
+rb_select_iouring(long delay __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int
+rb_setup_fd_iouring(rb_fde_t *F __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+ssize_t
+rb_read_iouring(rb_fde_t *F __attribute__((unused)), void *buf __attribute__((unused)), int count __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int
+rb_accept_iouring(rb_fde_t *F __attribute__((unused)), struct sockaddr *addr __attribute__((unused)), rb_socklen_t *addrlen __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+void
+rb_close_iouring(rb_fde_t *F __attribute__((unused)))
+{
+}
+#endif
@@ -27,27 +27,144 @@
 #include <rb_lib.h>
 #include <commio-int.h>
 
-static rb_bh *rb_linebuf_heap;
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LINEBUF_SCAN_AVX2
+#endif
+
+static rb_bh *rb_linebuf_heap[LINEBUF_CLASSES];
+
+/* usable bytes in each size class, the last one must fit a whole line */
+static const int rb_linebuf_class_size[LINEBUF_CLASSES] = {
+	64, 128, 256, 512, LINEBUF_SIZE + CRLF_LEN + 1
+};
 
 static int bufline_count = 0;
 
+/*
+ * Line terminator scanners.  Each returns the offset of the first CR or
+ * LF in ch[0..len), or len if there is none.  The widest one the CPU
+ * supports is picked in rb_linebuf_init().
+ */
+static size_t
+rb_linebuf_scan_scalar(const char *ch, size_t len)
+{
+	size_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		if(ch[i] == '\r' || ch[i] == '\n')
+			break;
+	}
+	return i;
+}
+
+#if defined(__SSE2__)
+static size_t
+rb_linebuf_scan_sse2(const char *ch, size_t len)
+{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	size_t i;
+
+	for(i = 0; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(ch + i));
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+
+		if(mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+	return i + rb_linebuf_scan_scalar(ch + i, len - i);
+}
+#endif
+
+#if defined(LINEBUF_SCAN_AVX2)
+__attribute__((target("avx2")))
+static size_t
+rb_linebuf_scan_avx2(const char *ch, size_t len)
+{
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	size_t i;
+
+	for(i = 0; i + 32 <= len; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(ch + i));
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+
+		if(mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+	return i + rb_linebuf_scan_scalar(ch + i, len - i);
+}
+#endif
+
+static size_t (*rb_linebuf_scan)(const char *, size_t) = rb_linebuf_scan_scalar;
+
 /*
  * rb_linebuf_init
  *
  * Initialise the linebuf mechanism
+ *
+ * LIBRB_LINEBUF_SCAN=scalar|sse2|avx2 forces a particular scanner.
  */
 
 void
 rb_linebuf_init(size_t heap_size)
 {
-	rb_linebuf_heap = rb_bh_create(sizeof(buf_line_t), heap_size, "librb_linebuf_heap");
+	const char *scan = getenv("LIBRB_LINEBUF_SCAN");
+	char desc[32];
+	int i;
+
+	if(scan == NULL || strcmp(scan, "scalar"))
+	{
+#if defined(__SSE2__)
+		rb_linebuf_scan = rb_linebuf_scan_sse2;
+#endif
+#if defined(LINEBUF_SCAN_AVX2)
+		__builtin_cpu_init();
+		if((scan == NULL || !strcmp(scan, "avx2")) && __builtin_cpu_supports("avx2"))
+			rb_linebuf_scan = rb_linebuf_scan_avx2;
+#endif
+	}
+
+	for(i = 0; i < LINEBUF_CLASSES; i++)
+	{
+		snprintf(desc, sizeof(desc), "librb_linebuf_heap_%d", rb_linebuf_class_size[i]);
+		rb_linebuf_heap[i] = rb_bh_create(sizeof(buf_line_t) + rb_linebuf_class_size[i],
+						  heap_size, desc);
+	}
+}
+
+/*
+ * rb_linebuf_class
+ *
+ * Find the smallest size class that holds size bytes (including the
+ * terminating NUL)
+ */
+static inline int
+rb_linebuf_class(int size)
+{
+	int i;
+
+	for(i = 0; i < LINEBUF_MAXCLASS; i++)
+	{
+		if(size <= rb_linebuf_class_size[i])
+			return i;
+	}
+	return LINEBUF_MAXCLASS;
 }
 
 static buf_line_t *
-rb_linebuf_allocate(void)
+rb_linebuf_allocate(int sizeclass)
 {
 	buf_line_t *t;
-	t = rb_bh_alloc(rb_linebuf_heap);
+	t = rb_bh_alloc(rb_linebuf_heap[sizeclass]);
+	t->sizeclass = sizeclass;
 	return (t);
 
 }
@@ -55,21 +172,21 @@ rb_linebuf_allocate(void)
 static void
 rb_linebuf_free(buf_line_t * p)
 {
-	rb_bh_free(rb_linebuf_heap, p);
+	rb_bh_free(rb_linebuf_heap[p->sizeclass], p);
 }
 
 /*
  * rb_linebuf_new_line
  *
- * Create a new line, and link it to the given linebuf.
- * It will be initially empty.
+ * Create a new line with room for size bytes, and link it to the given
+ * linebuf.  It will be initially empty.
  */
 static buf_line_t *
-rb_linebuf_new_line(buf_head_t * bufhead)
+rb_linebuf_new_line(buf_head_t * bufhead, int size)
 {
 	buf_line_t *bufline;
 
-	bufline = rb_linebuf_allocate();
+	bufline = rb_linebuf_allocate(rb_linebuf_class(size));
 	if(bufline == NULL)
 		return NULL;
 	++bufline_count;
@@ -123,15 +240,12 @@ static inline int
 rb_linebuf_skip_crlf(char *ch, int len)
 {
 	int orig_len = len;
+	size_t eol;
 
-	/* First, skip until the first non-CRLF */
-	for(; len; len--, ch++)
-	{
-		if(*ch == '\r')
-			break;
-		else if(*ch == '\n')
-			break;
-	}
+	/* First, skip until the first CRLF */
+	eol = rb_linebuf_scan(ch, len);
+	ch += eol;
+	len -= eol;
 
 	/* Then, skip until the last CRLF */
 	for(; len; len--, ch++)
@@ -145,6 +259,25 @@ rb_linebuf_skip_crlf(char *ch, int len)
 
 
 
+/*
+ * rb_linebuf_line_size
+ *
+ * work out how much room the next line in data needs.  A line that is
+ * already complete only gets what it uses, anything that may still have
+ * data appended to it gets a full sized buffer.  cpylen is the result of
+ * rb_linebuf_skip_crlf() for data.
+ */
+static inline int
+rb_linebuf_line_size(char *data, int cpylen)
+{
+	if(data[cpylen - 1] != '\r' && data[cpylen - 1] != '\n')
+		return LINEBUF_SIZE + CRLF_LEN + 1;
+
+	if(cpylen > LINEBUF_SIZE)
+		cpylen = LINEBUF_SIZE;
+	return cpylen + 1;
+}
+
 /*
  * rb_linebuf_newbuf
  *
@@ -188,12 +321,15 @@ rb_linebuf_donebuf(buf_head_t * bufhead)
  * be different than the size of the linebuffer, as when we discard
  * the overflow, we don't want to process it again.
  *
+ * skip is rb_linebuf_skip_crlf() of data, so each line is only scanned
+ * once.
+ *
  * This still sucks in my opinion, but it seems to work.
  *
  * -Aaron
  */
 static int
-rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int len)
+rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int skip)
 {
 	int cpylen = 0;		/* how many bytes we've copied */
 	char *ch = data;	/* Pointer to where we are in the read data */
@@ -208,9 +344,7 @@ rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 	if(bufline->terminated == 1)
 		return 0;
 
-	clen = cpylen = rb_linebuf_skip_crlf(ch, len);
-	if(clen == -1)
-		return -1;
+	clen = cpylen = skip;
 
 	/* This is the ~overflow case..This doesn't happen often.. */
 	if(cpylen > (LINEBUF_SIZE - bufline->len))
@@ -267,7 +401,7 @@ rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
  *
  */
 static int
-rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int len)
+rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int skip)
 {
 	int cpylen = 0;		/* how many bytes we've copied */
 	char *ch = data;	/* Pointer to where we are in the read data */
@@ -282,9 +416,7 @@ rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 	if(bufline->terminated == 1)
 		return 0;
 
-	clen = cpylen = rb_linebuf_skip_crlf(ch, len);
-	if(clen == -1)
-		return -1;
+	clen = cpylen = skip;
 
 	/* This is the overflow case..This doesn't happen often.. */
 	if(cpylen > (LINEBUF_SIZE - bufline->len))
@@ -329,9 +461,9 @@ rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
  *
  * A few notes here, which you'll need to understand before continuing.
  *
- * - right now I'm only dealing with single sized buffers. Later on,
- *   I might consider chaining buffers together to get longer "lines"
- *   but seriously, I don't see the advantage right now.
+ * - lines that are complete in data are allocated from the smallest
+ *   size class that fits them, a trailing partial line always gets a
+ *   full sized buffer so it can be appended to on the next read.
  *
  * - This *is* designed to turn into a reference-counter-protected setup
  *   to dodge copious copies.
@@ -340,7 +472,7 @@ int
 rb_linebuf_parse(buf_head_t * bufhead, char *data, int len, int raw)
 {
 	buf_line_t *bufline;
-	int cpylen;
+	int cpylen, skip;
 	int linecnt = 0;
 
 	/* First, if we have a partial buffer, try to squeze data into it */
@@ -349,13 +481,18 @@ rb_linebuf_parse(buf_head_t * bufhead, char *data, int len, int raw)
 		/* Check we're doing the partial buffer thing */
 		bufline = bufhead->list.tail->data;
 		/* just try, the worst it could do is *reject* us .. */
-		if(!raw)
-			cpylen = rb_linebuf_copy_line(bufhead, bufline, data, len);
+		if(!bufline->terminated)
+		{
+			/* only a full sized tail has room for the rest of the line */
+			lrb_assert(bufline->sizeclass == LINEBUF_MAXCLASS);
+			skip = rb_linebuf_skip_crlf(data, len);
+			if(!raw)
+				cpylen = rb_linebuf_copy_line(bufhead, bufline, data, skip);
+			else
+				cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, skip);
+		}
 		else
-			cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, len);
-
-		if(cpylen == -1)
-			return -1;
+			cpylen = 0;
 
 		linecnt++;
 		/* If we've copied the same as what we've got, quit now */
@@ -371,17 +508,16 @@ rb_linebuf_parse(buf_head_t * bufhead, char *data, int len, int raw)
 	/* Next, the loop */
 	while(len > 0)
 	{
+		skip = rb_linebuf_skip_crlf(data, len);
+
 		/* We obviously need a new buffer, so .. */
-		bufline = rb_linebuf_new_line(bufhead);
+		bufline = rb_linebuf_new_line(bufhead, rb_linebuf_line_size(data, skip));
 
 		/* And parse */
 		if(!raw)
-			cpylen = rb_linebuf_copy_line(bufhead, bufline, data, len);
+			cpylen = rb_linebuf_copy_line(bufhead, bufline, data, skip);
 		else
-			cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, len);
-
-		if(cpylen == -1)
-			return -1;
+			cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, skip);
 
 		len -= cpylen;
 		lrb_assert(len >= 0);
@@ -493,6 +629,7 @@ void
 rb_linebuf_put(buf_head_t *bufhead, const rb_strf_t *strings)
 {
 	buf_line_t *bufline;
+	char buf[LINEBUF_SIZE + CRLF_LEN + 1];
 	size_t len = 0;
 	int ret;
 
@@ -502,16 +639,18 @@ rb_linebuf_put(buf_head_t *bufhead, const rb_strf_t *strings)
 		lrb_assert(bufline->terminated);
 	}
 
-	/* create a new line */
-	bufline = rb_linebuf_new_line(bufhead);
-
-	ret = rb_fsnprint(bufline->buf, LINEBUF_SIZE + 1, strings);
+	ret = rb_fsnprint(buf, LINEBUF_SIZE + 1, strings);
 	if (ret > 0)
 		len += ret;
 
 	if (len > LINEBUF_SIZE)
 		len = LINEBUF_SIZE;
 
+	/* create a new line just big enough for the data and the trailing CRLF */
+	bufline = rb_linebuf_new_line(bufhead, len + CRLF_LEN + 1);
+
+	memcpy(bufline->buf, buf, len);
+
 	/* add trailing CRLF */
 	bufline->buf[len++] = '\r';
 	bufline->buf[len++] = '\n';
@@ -523,6 +662,38 @@ rb_linebuf_put(buf_head_t *bufhead, const rb_strf_t *strings)
 	bufhead->len += len;
 }
 
+/*
+ * rb_linebuf_putbuf
+ *
+ * append a line that the caller has already formatted, without going
+ * through rb_fsnprint().  The CRLF is added here.
+ */
+void
+rb_linebuf_putbuf(buf_head_t *bufhead, const char *data, size_t len)
+{
+	buf_line_t *bufline;
+
+	if (bufhead->list.tail) {
+		bufline = bufhead->list.tail->data;
+		lrb_assert(bufline->terminated);
+	}
+
+	if (len > LINEBUF_SIZE)
+		len = LINEBUF_SIZE;
+
+	bufline = rb_linebuf_new_line(bufhead, len + CRLF_LEN + 1);
+
+	memcpy(bufline->buf, data, len);
+	bufline->buf[len++] = '\r';
+	bufline->buf[len++] = '\n';
+	bufline->buf[len] = '\0';
+
+	bufline->terminated = 1;
+
+	bufline->len = len;
+	bufhead->len += len;
+}
+
 /*
  * rb_linebuf_flush
  *
@@ -676,5 +847,32 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 void
 rb_count_rb_linebuf_memory(size_t *count, size_t *rb_linebuf_memory_used)
 {
-	rb_bh_usage(rb_linebuf_heap, count, NULL, rb_linebuf_memory_used, NULL);
+	size_t c, m, total_count = 0, total_memory = 0;
+	int i;
+
+	for(i = 0; i < LINEBUF_CLASSES; i++)
+	{
+		rb_bh_usage(rb_linebuf_heap[i], &c, NULL, &m, NULL);
+		total_count += c;
+		total_memory += m;
+	}
+
+	if(count != NULL)
+		*count = total_count;
+	if(rb_linebuf_memory_used != NULL)
+		*rb_linebuf_memory_used = total_memory;
+}
+
+/*
+ * same as above, but for a single size class.  Returns the usable
+ * buffer size of the class in bufsize.
+ */
+void
+rb_count_rb_linebuf_class_memory(int sizeclass, size_t *bufsize, size_t *count, size_t *rb_linebuf_memory_used)
+{
+	lrb_assert(sizeclass >= 0 && sizeclass < LINEBUF_CLASSES);
+
+	if(bufsize != NULL)
+		*bufsize = rb_linebuf_class_size[sizeclass];
+	rb_bh_usage(rb_linebuf_heap[sizeclass], count, NULL, rb_linebuf_memory_used, NULL);
 }
@@ -822,6 +822,33 @@ rb_ssl_clear_handshake_count(rb_fde_t *const F)
 	F->handshake_count = 0;
 }
 
+void
+rb_ssl_set_ktls(const int enable __attribute__((unused)))
+{
+	return;
+}
+
+int
+rb_ssl_ktls_detach(rb_fde_t *const F __attribute__((unused)))
+{
+	/* not supported by this backend, the connection stays in ssld */
+	return 0;
+}
+
+int
+rb_ssl_set_ticket_keys(const uint8_t *const keys __attribute__((unused)), const int count __attribute__((unused)))
+{
+	/* mbedtls_ssl_ticket generates its own keys, so tickets could not be
+	 * shared between processes anyway; sessions are not resumed */
+	return 0;
+}
+
+int
+rb_ssl_session_resumed(rb_fde_t *const F __attribute__((unused)))
+{
+	return 0;
+}
+
 void
 rb_ssl_start_accepted(rb_fde_t *const F, ACCB *const cb, void *const data, const int timeout)
 {
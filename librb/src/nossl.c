@@ -180,4 +180,28 @@ rb_ssl_get_cipher(rb_fde_t *F __attribute__((unused)))
 	return NULL;
 }
 
+void
+rb_ssl_set_ktls(int enable __attribute__((unused)))
+{
+	return;
+}
+
+int
+rb_ssl_ktls_detach(rb_fde_t *F __attribute__((unused)))
+{
+	return 0;
+}
+
+int
+rb_ssl_set_ticket_keys(const uint8_t *keys __attribute__((unused)), int count __attribute__((unused)))
+{
+	return 0;
+}
+
+int
+rb_ssl_session_resumed(rb_fde_t *F __attribute__((unused)))
+{
+	return 0;
+}
+
 #endif /* !HAVE_OPENSSL */
@@ -44,6 +44,15 @@ typedef enum
 
 
 static SSL_CTX *ssl_ctx = NULL;
+static int ssl_ktls = 0;
+
+static uint8_t ticket_keys[RB_SSL_TICKET_KEYS_MAX][RB_SSL_TICKET_KEY_LEN];
+static int ticket_key_count = 0;
+
+/* key name, AES-256-CBC key, HMAC-SHA256 key */
+#define TICKET_NAME(k)	(k)
+#define TICKET_AES(k)	((k) + 16)
+#define TICKET_HMAC(k)	((k) + 48)
 
 struct ssl_connect
 {
@@ -97,6 +106,11 @@ rb_ssl_init_fd(rb_fde_t *const F, const rb_fd_tls_direction dir)
 	}
 
 	SSL_set_fd(SSL_P(F), rb_get_fd(F));
+
+	#ifdef LRB_HAVE_TLS_KTLS
+	if(ssl_ktls)
+		(void) SSL_set_options(SSL_P(F), SSL_OP_ENABLE_KTLS);
+	#endif
 }
 
 static void
@@ -196,6 +210,75 @@ verify_accept_all_cb(const int preverify_ok __attribute__((unused)), X509_STORE_
 	return 1;
 }
 
+/*
+ * Session tickets are encrypted with the keys the caller gives us, rather
+ * than the random ones OpenSSL would pick, so that any process sharing them
+ * can resume a session.  A ticket under the older key is accepted and
+ * replaced with a new one.
+ */
+#ifdef LRB_HAVE_TLS_TICKET_EVP_CB
+static int
+rb_ssl_ticket_key_cb(SSL *const ssl __attribute__((unused)), unsigned char *const key_name,
+                     unsigned char *const iv, EVP_CIPHER_CTX *const ctx, EVP_MAC_CTX *const hctx, const int enc)
+#else
+static int
+rb_ssl_ticket_key_cb(SSL *const ssl __attribute__((unused)), unsigned char *const key_name,
+                     unsigned char *const iv, EVP_CIPHER_CTX *const ctx, HMAC_CTX *const hctx, const int enc)
+#endif
+{
+	const uint8_t *key = NULL;
+	int ret = 1;
+
+	if(enc)
+	{
+		if(ticket_key_count == 0)
+			return 0;
+
+		key = ticket_keys[0];
+		(void) memcpy(key_name, TICKET_NAME(key), 16);
+
+		if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+			return -1;
+
+		if(EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, TICKET_AES(key), iv) != 1)
+			return -1;
+	}
+	else
+	{
+		for(int i = 0; i < ticket_key_count; i++)
+		{
+			if(memcmp(key_name, TICKET_NAME(ticket_keys[i]), 16) == 0)
+			{
+				key = ticket_keys[i];
+				ret = (i == 0) ? 1 : 2;
+				break;
+			}
+		}
+
+		if(key == NULL)
+			return 0;
+
+		if(EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, TICKET_AES(key), iv) != 1)
+			return -1;
+	}
+
+	#ifdef LRB_HAVE_TLS_TICKET_EVP_CB
+	OSSL_PARAM params[] = {
+		OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, (void *) TICKET_HMAC(key), 32),
+		OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0),
+		OSSL_PARAM_construct_end(),
+	};
+
+	if(EVP_MAC_CTX_set_params(hctx, params) != 1)
+		return -1;
+	#else
+	if(HMAC_Init_ex(hctx, TICKET_HMAC(key), 32, EVP_sha256(), NULL) != 1)
+		return -1;
+	#endif
+
+	return ret;
+}
+
 static ssize_t
 rb_ssl_read_or_write(const int r_or_w, rb_fde_t *const F, void *const rbuf, const void *const wbuf, const size_t count)
 {
@@ -420,7 +503,17 @@ rb_setup_ssl_server(const char *const certfile, const char *keyfile,
 		return 0;
 	}
 
-	SSL_CTX_set_session_cache_mode(ssl_ctx_new, SSL_SESS_CACHE_OFF);
+	/* session IDs can only be resumed by the same process, tickets by any of
+	 * them once rb_ssl_set_ticket_keys() has been called */
+	SSL_CTX_set_session_cache_mode(ssl_ctx_new, SSL_SESS_CACHE_SERVER);
+	(void) SSL_CTX_set_session_id_context(ssl_ctx_new, (const unsigned char *) "librb", 5);
+	(void) SSL_CTX_set_timeout(ssl_ctx_new, RB_SSL_TICKET_LIFETIME);
+
+	#ifdef LRB_HAVE_TLS_TICKET_EVP_CB
+	(void) SSL_CTX_set_tlsext_ticket_key_evp_cb(ssl_ctx_new, rb_ssl_ticket_key_cb);
+	#else
+	(void) SSL_CTX_set_tlsext_ticket_key_cb(ssl_ctx_new, rb_ssl_ticket_key_cb);
+	#endif
 	SSL_CTX_set_verify(ssl_ctx_new, SSL_VERIFY_PEER | SSL_VERIFY_CLIENT_ONCE, verify_accept_all_cb);
 
 	#ifdef SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS
@@ -435,10 +528,6 @@ rb_setup_ssl_server(const char *const certfile, const char *keyfile,
 	(void) SSL_CTX_set_options(ssl_ctx_new, SSL_OP_NO_TLSv1);
 	#endif
 
-	#ifdef SSL_OP_NO_TICKET
-	(void) SSL_CTX_set_options(ssl_ctx_new, SSL_OP_NO_TICKET);
-	#endif
-
 	#ifdef SSL_OP_CIPHER_SERVER_PREFERENCE
 	(void) SSL_CTX_set_options(ssl_ctx_new, SSL_OP_CIPHER_SERVER_PREFERENCE);
 	#endif
@@ -604,6 +693,61 @@ rb_ssl_get_cipher(rb_fde_t *const F)
 	return buf;
 }
 
+void
+rb_ssl_set_ktls(const int enable)
+{
+	ssl_ktls = enable;
+}
+
+int
+rb_ssl_set_ticket_keys(const uint8_t *const keys, const int count)
+{
+	if(count < 0 || count > RB_SSL_TICKET_KEYS_MAX)
+		return 0;
+
+	(void) memcpy(ticket_keys, keys, (size_t) count * RB_SSL_TICKET_KEY_LEN);
+	ticket_key_count = count;
+
+	return 1;
+}
+
+int
+rb_ssl_session_resumed(rb_fde_t *const F)
+{
+	if(F == NULL || F->ssl == NULL)
+		return 0;
+
+	return SSL_session_reused(SSL_P(F)) ? 1 : 0;
+}
+
+/*
+ * Once OpenSSL has handed both directions of a session to the kernel TLS ULP,
+ * the socket reads and writes plaintext and the SSL object is not needed any
+ * more, unless it has already read records that the kernel will not see again.
+ */
+int
+rb_ssl_ktls_detach(rb_fde_t *const F)
+{
+	if(F == NULL || F->ssl == NULL)
+		return 0;
+
+	#ifdef LRB_HAVE_TLS_KTLS
+	if(!BIO_get_ktls_send(SSL_get_wbio(SSL_P(F))) || !BIO_get_ktls_recv(SSL_get_rbio(SSL_P(F))))
+		return 0;
+
+	if(SSL_has_pending(SSL_P(F)))
+		return 0;
+
+	SSL_free(SSL_P(F));
+	F->ssl = NULL;
+	F->type &= ~RB_FD_SSL;
+
+	return 1;
+	#else
+	return 0;
+	#endif
+}
+
 ssize_t
 rb_ssl_read(rb_fde_t *const F, void *const buf, const size_t count)
 {
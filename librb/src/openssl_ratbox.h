@@ -28,6 +28,7 @@
 #include <openssl/ec.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 
@@ -71,6 +72,15 @@
 #  endif
 #endif
 
+#if !defined(LIBRESSL_VERSION_NUMBER) && (OPENSSL_VERSION_NUMBER >= 0x30000000L) && defined(SSL_OP_ENABLE_KTLS)
+#  define LRB_HAVE_TLS_KTLS             1
+#endif
+
+#if !defined(LIBRESSL_VERSION_NUMBER) && (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+#  include <openssl/core_names.h>
+#  define LRB_HAVE_TLS_TICKET_EVP_CB    1
+#endif
+
 #if !defined(LIBRESSL_VERSION_NUMBER) && (OPENSSL_VERSION_NUMBER >= 0x10100000L)
 #  define LRB_SSL_VTEXT_COMPILETIME     OPENSSL_VERSION_TEXT
 #  define LRB_SSL_VTEXT_RUNTIME         OpenSSL_version(OPENSSL_VERSION)
@@ -529,6 +529,98 @@ rb_patricia_search_best(rb_patricia_tree_t *patricia, rb_prefix_t *prefix)
 	return (rb_patricia_search_best2(patricia, prefix, 1));
 }
 
+/*
+ * rb_patricia_search_all - find every node whose prefix covers prefix
+ *
+ * nodes must have room for RB_PATRICIA_MAXBITS + 1 entries; they are
+ * stored most specific first.  Returns the number of nodes found.
+ */
+int
+rb_patricia_search_all(rb_patricia_tree_t *patricia, rb_prefix_t *prefix,
+		       rb_patricia_node_t **nodes)
+{
+	rb_patricia_node_t *node;
+	rb_patricia_node_t *stack[RB_PATRICIA_MAXBITS + 1];
+	uint8_t *addr;
+	unsigned int bitlen;
+	int cnt = 0, found = 0;
+
+	assert(patricia);
+	assert(prefix);
+	assert(prefix->bitlen <= patricia->maxbits);
+
+	node = patricia->head;
+	addr = rb_prefix_touchar(prefix);
+	bitlen = prefix->bitlen;
+
+	while(node != NULL && node->bit < bitlen)
+	{
+		if(node->prefix)
+			stack[cnt++] = node;
+
+		if(BIT_TEST(addr[node->bit >> 3], 0x80 >> (node->bit & 0x07)))
+			node = node->r;
+		else
+			node = node->l;
+	}
+
+	if(node && node->prefix)
+		stack[cnt++] = node;
+
+	while(--cnt >= 0)
+	{
+		node = stack[cnt];
+		if(comp_with_mask(prefix_tochar(node->prefix),
+				  prefix_tochar(prefix), node->prefix->bitlen))
+			nodes[found++] = node;
+	}
+	return found;
+}
+
+
+/*
+ * rb_patricia_search_within - find the subtree of nodes inside prefix
+ *
+ * The reverse of rb_patricia_search_all(): every node with a prefix in
+ * the returned subtree is covered by prefix.  Walk it with
+ * RB_PATRICIA_WALK().  Returns NULL if no node lies inside prefix.
+ */
+rb_patricia_node_t *
+rb_patricia_search_within(rb_patricia_tree_t *patricia, rb_prefix_t *prefix)
+{
+	rb_patricia_node_t *node, *leaf;
+	uint8_t *addr;
+	unsigned int bitlen;
+
+	assert(patricia);
+	assert(prefix);
+	assert(prefix->bitlen <= patricia->maxbits);
+
+	node = patricia->head;
+	addr = rb_prefix_touchar(prefix);
+	bitlen = prefix->bitlen;
+
+	while(node != NULL && node->bit < bitlen)
+	{
+		if(BIT_TEST(addr[node->bit >> 3], 0x80 >> (node->bit & 0x07)))
+			node = node->r;
+		else
+			node = node->l;
+	}
+
+	if(node == NULL)
+		return NULL;
+
+	/* everything below node agrees on the first node->bit bits, so
+	 * checking any one prefix there tells whether they all match */
+	for(leaf = node; leaf->prefix == NULL; leaf = leaf->l != NULL ? leaf->l : leaf->r)
+		;
+
+	if(!comp_with_mask(prefix_tochar(leaf->prefix), prefix_tochar(prefix), bitlen))
+		return NULL;
+
+	return node;
+}
 
 rb_patricia_node_t *
 rb_patricia_lookup(rb_patricia_tree_t *patricia, rb_prefix_t *prefix)
@@ -1004,6 +1096,74 @@ rb_match_ip(rb_patricia_tree_t *tree, struct sockaddr *ip)
 	return NULL;
 }
 
+/*
+ * rb_match_ip_all - find every node covering ip, most specific first
+ *
+ * Like rb_match_ip(), but returns all matching prefixes instead of just
+ * the longest one, see rb_patricia_search_all().
+ */
+int
+rb_match_ip_all(rb_patricia_tree_t *tree, struct sockaddr *ip, rb_patricia_node_t **nodes)
+{
+	rb_prefix_t prefix;
+	void *ipptr;
+	unsigned int len;
+	int family;
+
+	if(ip->sa_family == AF_INET6)
+	{
+		len = 128;
+		family = AF_INET6;
+		ipptr = &((struct sockaddr_in6 *)ip)->sin6_addr;
+	}
+	else
+	{
+		len = 32;
+		family = AF_INET;
+		ipptr = &((struct sockaddr_in *)ip)->sin_addr;
+	}
+
+	if(len > tree->maxbits)
+		return 0;
+
+	New_Prefix2(family, ipptr, len, &prefix);
+	return rb_patricia_search_all(tree, &prefix, nodes);
+}
+
+/*
+ * rb_match_ip_within - find the subtree of nodes inside ip/len
+ *
+ * See rb_patricia_search_within().
+ */
+rb_patricia_node_t *
+rb_match_ip_within(rb_patricia_tree_t *tree, struct sockaddr *ip, unsigned int len)
+{
+	rb_prefix_t prefix;
+	void *ipptr;
+	int family;
+
+	if(ip->sa_family == AF_INET6)
+	{
+		if(len > 128)
+			len = 128;
+		family = AF_INET6;
+		ipptr = &((struct sockaddr_in6 *)ip)->sin6_addr;
+	}
+	else
+	{
+		if(len > 32)
+			len = 32;
+		family = AF_INET;
+		ipptr = &((struct sockaddr_in *)ip)->sin_addr;
+	}
+
+	if(len > tree->maxbits)
+		return NULL;
+
+	New_Prefix2(family, ipptr, len, &prefix);
+	return rb_patricia_search_within(tree, &prefix);
+}
+
 rb_patricia_node_t *
 rb_match_ip_exact(rb_patricia_tree_t *tree, struct sockaddr *ip, unsigned int len)
 {
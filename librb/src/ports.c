@@ -28,7 +28,6 @@
 #include <librb_config.h>
 #include <rb_lib.h>
 #include <commio-int.h>
-#include <event-int.h>
 #if defined(HAVE_PORT_H) && (HAVE_PORT_CREATE)
 
 #include <port.h>
@@ -126,7 +125,6 @@ rb_select_ports(long delay)
 	unsigned int nget = 1;
 	struct timespec poll_time;
 	struct timespec *p = NULL;
-	struct ev_entry *ev;
 
 	if(delay >= 0)
 	{
@@ -159,101 +157,13 @@ rb_select_ports(long delay)
 				F->write_handler = NULL;
 				hdl(F, F->write_data);
 			}
-		} else if(pelst[i].portev_source == PORT_SOURCE_TIMER)
-		{
-			ev = (struct ev_entry *)pelst[i].portev_user;
-			rb_run_one_event(ev);
 		}
 	}
 	return RB_OK;
 }
 
-int
-rb_ports_supports_event(void)
-{
-	return 1;
-};
-
-void
-rb_ports_init_event(void)
-{
-	return;
-}
-
-int
-rb_ports_sched_event(struct ev_entry *event, int when)
-{
-	timer_t *id;
-	struct sigevent ev;
-	port_notify_t not;
-	struct itimerspec ts;
-
-	event->comm_ptr = rb_malloc(sizeof(timer_t));
-	id = event->comm_ptr;
-
-	memset(&ev, 0, sizeof(ev));
-	ev.sigev_notify = SIGEV_PORT;
-	ev.sigev_value.sival_ptr = &not;
-
-	memset(&not, 0, sizeof(not));
-	not.portnfy_port = pe;
-	not.portnfy_user = event;
-
-	if(timer_create(CLOCK_REALTIME, &ev, id) < 0)
-	{
-		rb_lib_log("timer_create: %s\n", strerror(errno));
-		return 0;
-	}
-
-	memset(&ts, 0, sizeof(ts));
-	ts.it_value.tv_sec = when;
-	ts.it_value.tv_nsec = 0;
-	if(event->frequency != 0)
-		ts.it_interval = ts.it_value;
-
-	if(timer_settime(*id, 0, &ts, NULL) < 0)
-	{
-		rb_lib_log("timer_settime: %s\n", strerror(errno));
-		return 0;
-	}
-	return 1;
-}
-
-void
-rb_ports_unsched_event(struct ev_entry *event)
-{
-	timer_delete(*((timer_t *) event->comm_ptr));
-	rb_free(event->comm_ptr);
-	event->comm_ptr = NULL;
-}
 #else /* ports not supported */
 
-int
-rb_ports_supports_event(void)
-{
-	errno = ENOSYS;
-	return 0;
-}
-
-void
-rb_ports_init_event(void)
-{
-	return;
-}
-
-int
-rb_ports_sched_event(struct ev_entry *event __attribute__((unused)), int when __attribute__((unused)))
-{
-	errno = ENOSYS;
-	return -1;
-}
-
-void
-rb_ports_unsched_event(struct ev_entry *event __attribute__((unused)))
-{
-	return;
-}
-
 int
 rb_init_netio_ports(void)
 {
@@ -208,44 +208,21 @@ rb_lib_init(log_cb * ilog, restart_cb * irestart, die_cb * idie, int closeall, i
 	rb_fdlist_init(closeall, maxcon, fd_heap_size);
 	rb_init_netio();
 	rb_init_rb_dlink_nodes(dh_size);
-	if(rb_io_supports_event())
-	{
-		rb_io_init_event();
-	}
 }
 
 void
 rb_lib_loop(long delay)
 {
-	time_t next;
 	rb_set_time();
 
-	if(rb_io_supports_event())
-	{
-		while(1)
-			rb_select(-1);
-	}
-
-
 	while(1)
 	{
 		if(delay == 0)
-		{
-			if((next = rb_event_next()) > 0)
-			{
-				next -= rb_current_time();
-				if(next <= 0)
-					next = 1000;
-				else
-					next *= 1000;
-			}
-			else
-				next = -1;
-			rb_select(next);
-		}
+			rb_select(rb_event_next_msec());
 		else
 			rb_select(delay);
 		rb_event_run();
+		rb_run_select_hook();
 	}
 }
 
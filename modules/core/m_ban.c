@@ -295,6 +295,7 @@ ms_ban(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 			else
 			{
 				rb_dlinkAddAlloc(aconf, &xline_conf_list);
+				xline_conf_changed();
 				check_xlines();
 			}
 			break;
@@ -307,7 +308,10 @@ ms_ban(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 			break;
 		case CONF_RESV_NICK:
 			if (!(aconf->status & CONF_ILLEGAL))
+			{
 				rb_dlinkAddAlloc(aconf, &resv_conf_list);
+				resv_conf_changed();
+			}
 			break;
 	}
 	sendto_server(client_p, NULL, CAP_BAN|CAP_TS6, NOCAPS,
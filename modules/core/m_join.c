@@ -738,7 +738,7 @@ ms_sjoin(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source
 		if(rb_dlink_list_length(&chptr->quietlist) > 0)
 			remove_ban_list(chptr, fakesource_p, &chptr->quietlist,
 					'q', ALL_MEMBERS);
-		chptr->bants++;
+		invalidate_bancache_channel(chptr);
 
 		sendto_channel_local(&me, ALL_MEMBERS, chptr,
 				     ":%s NOTICE %s :*** Notice -- TS for %s changed from %ld to %ld",
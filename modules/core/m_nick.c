@@ -45,6 +45,7 @@
 #include "s_newconf.h"
 #include "monitor.h"
 #include "s_assert.h"
+#include "userindex.h"
 
 /* Give all UID nicks the same TS. This ensures nick TS is always the same on
  * all servers for each nick-user pair, also if a user with a UID nick changes
@@ -697,6 +698,8 @@ change_local_nick(struct Client *client_p, struct Client *source_p,
 	del_from_client_hash(source_p->name, source_p);
 	rb_strlcpy(source_p->name, nick, sizeof(source_p->name));
 	add_to_client_hash(nick, source_p);
+	invalidate_client_matchset(source_p);
+	user_index_update(source_p);
 
 	if(!samenick)
 		monitor_signon(source_p);
@@ -766,6 +769,7 @@ change_remote_nick(struct Client *client_p, struct Client *source_p,
 
 	rb_strlcpy(source_p->name, nick, sizeof(source_p->name));
 	add_to_client_hash(nick, source_p);
+	user_index_update(source_p);
 
 	if(!samenick)
 		monitor_signon(source_p);
@@ -1039,6 +1043,7 @@ register_client(struct Client *client_p, struct Client *server,
 
 	source_p = make_client(client_p);
 	user = make_user(source_p);
+	source_p->list_order = ++global_client_order;
 	rb_dlinkAddTail(source_p, &source_p->node, &global_client_list);
 
 	source_p->hopcount = atoi(parv[2]);
@@ -1133,6 +1138,7 @@ register_client(struct Client *client_p, struct Client *server,
 	source_p->servptr = server;
 
 	rb_dlinkAdd(source_p, &source_p->lnode, &source_p->servptr->serv->users);
+	user_index_add(source_p);
 
 	call_hook(h_new_remote_user, source_p);
 
@@ -26,6 +26,7 @@
 #include "modules.h"
 #include "whowas.h"
 #include "monitor.h"
+#include "userindex.h"
 
 static const char chghost_desc[] = "Provides commands used to change and retrieve client hostnames";
 
@@ -105,6 +106,8 @@ me_realhost(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 	else
 		ClearDynSpoof(source_p);
 	add_to_hostname_hash(source_p->orighost, source_p);
+	invalidate_client_matchset(source_p);
+	user_index_update(source_p);
 }
 
 static bool
@@ -136,6 +139,7 @@ do_chghost(struct Client *source_p, struct Client *target_p,
 		if (MyClient(target_p))
 			sendto_one_numeric(target_p, RPL_HOSTHIDDEN, "%s :hostname reset by %s", target_p->host, source_p->name);
 	}
+	invalidate_client_matchset(target_p);
 	if (MyClient(source_p))
 		sendto_one_notice(source_p, ":Changed hostname for %s to %s", target_p->name, target_p->host);
 	if (!IsServer(source_p) && !IsService(source_p))
@@ -48,6 +48,7 @@
 #include "modules.h"
 #include "logger.h"
 #include "supported.h"
+#include "userindex.h"
 
 static const char etrace_desc[] =
     "Provides enhanced tracing facilities to opers (ETRACE, CHANTRACE, and MASKTRACE)";
@@ -294,9 +295,42 @@ match_masktrace(struct Client *source_p, rb_dlink_list *list,
 	const char *gecos)
 {
 	struct Client *target_p;
-	rb_dlink_node *ptr;
+	struct match_pattern *upat, *hpat, *npat = NULL, *gpat = NULL;
+	struct UserIndexMask masks[4];
+	rb_dlink_list candidates = { NULL, NULL, 0 };
+	rb_dlink_node *ptr, *nptr;
 	const char *sockhost;
 
+	upat = match_compile(username, MATCH_GLOB);
+	hpat = match_compile(hostname, MATCH_GLOB);
+	if(name != NULL)
+		npat = match_compile(name, MATCH_GLOB);
+	if(gecos != NULL)
+		gpat = match_compile(gecos, MATCH_ESC);
+
+	/* a global trace only has to look at the users the index gives,
+	 * name and gecos are skipped when NULL
+	 */
+	if(list == &global_client_list)
+	{
+		masks[0].mask = username;
+		masks[0].syntax = MATCH_GLOB;
+		masks[1].mask = name;
+		masks[1].syntax = MATCH_GLOB;
+		masks[2].mask = gecos;
+		masks[2].syntax = MATCH_ESC;
+		masks[3].mask = NULL;
+		masks[3].syntax = MATCH_GLOB;
+
+		/* the host may match a CIDR or the placeholder sockhosts instead */
+		if(strchr(hostname, '/') == NULL && !match_compiled(hpat, empty_sockhost) &&
+		   !match_compiled(hpat, spoofed_sockhost))
+			masks[3].mask = hostname;
+
+		if(user_index_find(masks, 4, &candidates))
+			list = &candidates;
+	}
+
 	RB_DLINK_FOREACH(ptr, list->head)
 	{
 		target_p = ptr->data;
@@ -310,15 +344,15 @@ match_masktrace(struct Client *source_p, rb_dlink_list *list,
 		else
 			sockhost = target_p->sockhost;
 
-		if(match(username, target_p->username) &&
-		   (match(hostname, target_p->host) ||
-		    match(hostname, target_p->orighost) ||
-		    match(hostname, sockhost) || match_ips(hostname, sockhost)))
+		if(match_compiled(upat, target_p->username) &&
+		   (match_compiled(hpat, target_p->host) ||
+		    match_compiled(hpat, target_p->orighost) ||
+		    match_compiled(hpat, sockhost) || match_ips(hostname, sockhost)))
 		{
-			if(name != NULL && !match(name, target_p->name))
+			if(npat != NULL && !match_compiled(npat, target_p->name))
 				continue;
 
-			if(gecos != NULL && !match_esc(gecos, target_p->info))
+			if(gpat != NULL && !match_compiled(gpat, target_p->info))
 				continue;
 
 			sendto_one(source_p, form_str(RPL_ETRACE),
@@ -330,6 +364,14 @@ match_masktrace(struct Client *source_p, rb_dlink_list *list,
 				sockhost, target_p->info);
 		}
 	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, candidates.head)
+		rb_dlinkDestroy(ptr, &candidates);
+
+	match_free(upat);
+	match_free(hpat);
+	match_free(npat);
+	match_free(gpat);
 }
 
 static void
@@ -531,6 +531,12 @@ static struct InfoStruct info_table[] = {
 		&ConfigFileEntry.tls_ciphers_oper_only,
 		"TLS cipher strings are hidden in whois for non-opers",
 	},
+	{
+		"deferred_flush",
+		OUTPUT_BOOLEAN_YN,
+		&ConfigFileEntry.deferred_flush,
+		"Sendqs are written once per event loop pass",
+	},
 	{
 		"default_split_server_count",
 		OUTPUT_DECIMAL,
@@ -645,6 +651,12 @@ static struct InfoStruct info_table[] = {
 		&ConfigChannel.opmod_send_statusmsg,
 		"Send messages to @#channel if affected by +z"
 	},
+	{
+		"ban_refresh",
+		OUTPUT_BOOLEAN_YN,
+		&ConfigChannel.ban_refresh,
+		"Recheck local members in the background after ban changes"
+	},
 	{
 		"disable_hidden",
 		OUTPUT_BOOLEAN_YN,
@@ -50,13 +50,10 @@
 #include "s_assert.h"
 #include "logger.h"
 #include "rb_radixtree.h"
+#include "safelist.h"
 
 static const char list_desc[] = "Provides the LIST command to clients to view non-hidden channels";
 
-static rb_dlink_list safelisting_clients = { NULL, NULL, 0 };
-
-static struct ev_entry *iterate_clients_ev = NULL;
-
 static int _modinit(void);
 static void _moddeinit(void);
 
@@ -66,11 +63,9 @@ static void mo_list(struct MsgBuf *, struct Client *, struct Client *, int, cons
 static void list_one_channel(struct Client *source_p, struct Channel *chptr, int visible);
 
 static void safelist_one_channel(struct Client *source_p, struct Channel *chptr, struct ListClient *params);
-static void safelist_check_cliexit(hook_data_client_exit * hdata);
 static void safelist_client_instantiate(struct Client *, struct ListClient *);
-static void safelist_client_release(struct Client *);
-static void safelist_iterate_client(struct Client *source_p);
-static void safelist_iterate_clients(void *unused);
+static void safelist_client_release(struct Client *, void *, bool);
+static bool safelist_iterate_client(struct Client *source_p, void *data);
 static void safelist_channel_named(struct Client *source_p, const char *name, int operspy);
 
 struct Message list_msgtab = {
@@ -80,17 +75,10 @@ struct Message list_msgtab = {
 
 mapi_clist_av1 list_clist[] = { &list_msgtab, NULL };
 
-mapi_hfn_list_av1 list_hfnlist[] = {
-	{"client_exit", (hookfn) safelist_check_cliexit},
-	{NULL, NULL}
-};
-
-DECLARE_MODULE_AV2(list, _modinit, _moddeinit, list_clist, NULL, list_hfnlist, NULL, NULL, list_desc);
+DECLARE_MODULE_AV2(list, _modinit, _moddeinit, list_clist, NULL, NULL, NULL, NULL, list_desc);
 
 static int _modinit(void)
 {
-	iterate_clients_ev = rb_event_add("safelist_iterate_clients", safelist_iterate_clients, NULL, 3);
-
 	/* ELIST=[tokens]:
 	 *
 	 * M = mask search
@@ -107,23 +95,12 @@ static int _modinit(void)
 
 static void _moddeinit(void)
 {
-	rb_event_delete(iterate_clients_ev);
+	safelist_cancel_all(safelist_iterate_client);
 
 	delete_isupport("SAFELIST");
 	delete_isupport("ELIST");
 }
 
-static void safelist_check_cliexit(hook_data_client_exit * hdata)
-{
-	/* Cancel the safelist request if we are disconnecting
-	 * from the server. That way it doesn't core. :P --nenolod
-	 */
-	if (MyClient(hdata->target) && hdata->target->localClient->safelist_data != NULL)
-	{
-		safelist_client_release(hdata->target);
-	}
-}
-
 /* m_list()
  *      parv[1] = channel
  *
@@ -135,10 +112,10 @@ m_list(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 {
 	static time_t last_used = 0L;
 
-	if (source_p->localClient->safelist_data != NULL)
+	if (safelist_pending(source_p, safelist_iterate_client))
 	{
 		sendto_one_notice(source_p, ":/LIST aborted");
-		safelist_client_release(source_p);
+		safelist_cancel(source_p, safelist_iterate_client);
 		return;
 	}
 
@@ -170,10 +147,10 @@ mo_list(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_
 	int i;
 	int operspy = 0;
 
-	if (source_p->localClient->safelist_data != NULL)
+	if (safelist_pending(source_p, safelist_iterate_client))
 	{
 		sendto_one_notice(source_p, ":/LIST aborted");
-		safelist_client_release(source_p);
+		safelist_cancel(source_p, safelist_iterate_client);
 		return;
 	}
 
@@ -313,22 +290,6 @@ static void list_one_channel(struct Client *source_p, struct Channel *chptr,
 		   topic);
 }
 
-/*
- * safelist_sendq_exceeded()
- *
- * inputs       - pointer to client that needs checking
- * outputs      - true if a client has exceeded the reserved
- *                sendq limit, false if not
- * side effects - none
- *
- * When safelisting, we only use half of the SendQ at any
- * given time.
- */
-static bool safelist_sendq_exceeded(struct Client *client_p)
-{
-	return rb_linebuf_len(&client_p->localClient->buf_sendq) > (get_sendq(client_p) / 2);
-}
-
 /*
  * safelist_client_instantiate()
  *
@@ -346,40 +307,32 @@ static void safelist_client_instantiate(struct Client *client_p, struct ListClie
 	s_assert(MyClient(client_p));
 	s_assert(params != NULL);
 
-	client_p->localClient->safelist_data = params;
-
 	sendto_one(client_p, form_str(RPL_LISTSTART), me.name, client_p->name);
 
-	/* pop the client onto the queue for processing */
-	rb_dlinkAddAlloc(client_p, &safelisting_clients);
-
-	/* give the user some initial data to work with */
-	safelist_iterate_client(client_p);
+	/* the rest is sent as the sendq drains, other commands
+	 * are still processed meanwhile
+	 */
+	safelist_start(client_p, safelist_iterate_client, safelist_client_release, params, false);
 }
 
 /*
  * safelist_client_release()
  *
- * inputs       - pointer to Client being listed on
+ * inputs       - pointer to Client being listed on,
+ *                its ListClient, whether it is going away
  * outputs      - none
  * side effects - the client is no longer being
  *                listed
  */
-static void safelist_client_release(struct Client *client_p)
+static void safelist_client_release(struct Client *client_p, void *data, bool aborted)
 {
-	if(!MyClient(client_p))
-		return;
-
-	s_assert(MyClient(client_p));
+	struct ListClient *params = data;
 
-	rb_dlinkFindDestroy(client_p, &safelisting_clients);
+	rb_free(params->chname);
+	rb_free(params);
 
-	rb_free(client_p->localClient->safelist_data->chname);
-	rb_free(client_p->localClient->safelist_data);
-
-	client_p->localClient->safelist_data = NULL;
-
-	sendto_one(client_p, form_str(RPL_LISTEND), me.name, client_p->name);
+	if (!aborted)
+		sendto_one(client_p, form_str(RPL_LISTEND), me.name, client_p->name);
 }
 
 /*
@@ -464,35 +417,28 @@ static void safelist_one_channel(struct Client *source_p, struct Channel *chptr,
 /*
  * safelist_iterate_client()
  *
- * inputs       - client pointer
- * outputs      - none
+ * inputs       - client pointer, its ListClient
+ * outputs      - true once every channel has been looked at
  * side effects - the client's sendq is filled up again
  */
-static void safelist_iterate_client(struct Client *source_p)
+static bool safelist_iterate_client(struct Client *source_p, void *data)
 {
+	struct ListClient *params = data;
 	struct Channel *chptr;
 	rb_radixtree_iteration_state iter;
 
-	RB_RADIXTREE_FOREACH_FROM(chptr, &iter, channel_tree, source_p->localClient->safelist_data->chname)
+	RB_RADIXTREE_FOREACH_FROM(chptr, &iter, channel_tree, params->chname)
 	{
-		if (safelist_sendq_exceeded(source_p->from))
+		if (safelist_sendq_exceeded(source_p))
 		{
-			rb_free(source_p->localClient->safelist_data->chname);
-			source_p->localClient->safelist_data->chname = rb_strdup(chptr->chname);
+			rb_free(params->chname);
+			params->chname = rb_strdup(chptr->chname);
 
-			return;
+			return false;
 		}
 
-		safelist_one_channel(source_p, chptr, source_p->localClient->safelist_data);
+		safelist_one_channel(source_p, chptr, params);
 	}
 
-	safelist_client_release(source_p);
-}
-
-static void safelist_iterate_clients(void *unused)
-{
-	rb_dlink_node *n, *n2;
-
-	RB_DLINK_FOREACH_SAFE(n, n2, safelisting_clients.head)
-		safelist_iterate_client((struct Client *)n->data);
+	return true;
 }
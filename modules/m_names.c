@@ -82,7 +82,7 @@ m_names(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_
 		}
 
 		if((chptr = find_channel(p)) != NULL)
-			channel_member_names(chptr, source_p, 1);
+			stream_channel_member_names(chptr, source_p);
 		else
 			sendto_one(source_p, form_str(RPL_ENDOFNAMES),
 				   me.name, source_p->name, p);
@@ -47,6 +47,7 @@
 #include "parse.h"
 #include "modules.h"
 #include "logger.h"
+#include "userindex.h"
 
 static const char scan_desc[] =
 	"Provides the SCAN command to show users that have a mode set or cleared";
@@ -118,7 +119,8 @@ scan_umodes(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 	const char *c;
 	struct Client *target_p;
 	rb_dlink_list *target_list = &lclient_list;	/* local clients only by default */
-	rb_dlink_node *tn;
+	rb_dlink_list candidates = { NULL, NULL, 0 };
+	rb_dlink_node *tn, *tnext;
 	int i;
 	const char *sockhost;
 	char buf[512];
@@ -208,6 +210,15 @@ scan_umodes(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 		}
 	}
 
+	/* a nick!user@host mask can be looked up in the user index */
+	if (target_list == &global_client_list && mask != NULL)
+	{
+		struct UserIndexMask um = { mask, MATCH_GLOB };
+
+		if (user_index_find(&um, 1, &candidates))
+			target_list = &candidates;
+	}
+
 	RB_DLINK_FOREACH(tn, target_list->head)
 	{
 		unsigned int working_umodes = 0;
@@ -271,6 +282,9 @@ scan_umodes(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 		count++;
 	}
 
+	RB_DLINK_FOREACH_SAFE(tn, tnext, candidates.head)
+		rb_dlinkDestroy(tn, &candidates);
+
 	sendto_one_numeric(source_p, RPL_SCANMATCHED,
 			form_str(RPL_SCANMATCHED), count);
 }
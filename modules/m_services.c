@@ -45,6 +45,7 @@
 #include "whowas.h"
 #include "monitor.h"
 #include "supported.h"
+#include "userindex.h"
 
 static const char services_desc[] = "Provides support for running a services daemon";
 
@@ -247,6 +248,8 @@ doit:
 	del_from_client_hash(target_p->name, target_p);
 	rb_strlcpy(target_p->name, parv[2], NICKLEN);
 	add_to_client_hash(target_p->name, target_p);
+	invalidate_client_matchset(target_p);
+	user_index_update(target_p);
 
 	monitor_signon(target_p);
 
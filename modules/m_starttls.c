@@ -90,7 +90,7 @@ mr_starttls(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 
 	/* TODO: set localClient->ssl_callback and handle success/failure */
 
-	ctl = start_ssld_accept(client_p->localClient->F, F[1], connid_get(client_p));
+	ctl = start_ssld_accept(client_p->localClient->F, F[1], connid_get(client_p), false);
 	if (ctl != NULL)
 	{
 		client_p->localClient->F = F[0];
@@ -387,27 +387,26 @@ stats_tdeny (struct Client *source_p)
 	char *host, *pass, *user, *oper_reason;
 	struct AddressRec *arec;
 	struct ConfItem *aconf;
-	int i;
+	rb_dlink_node *ptr;
 
-	for (i = 0; i < ATABLE_SIZE; i++)
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
 	{
-		for (arec = atable[i]; arec; arec = arec->next)
+		arec = ptr->data;
+
+		if(arec->type == CONF_DLINE)
 		{
-			if(arec->type == CONF_DLINE)
-			{
-				aconf = arec->aconf;
+			aconf = arec->aconf;
 
-				if(!(aconf->flags & CONF_FLAGS_TEMPORARY))
-					continue;
+			if(!(aconf->flags & CONF_FLAGS_TEMPORARY))
+				continue;
 
-				get_printable_kline(source_p, aconf, &host, &pass, &user, &oper_reason);
+			get_printable_kline(source_p, aconf, &host, &pass, &user, &oper_reason);
 
-				sendto_one_numeric(source_p, RPL_STATSDLINE,
-						   form_str (RPL_STATSDLINE),
-						   'd', host, pass,
-						   oper_reason ? "|" : "",
-						   oper_reason ? oper_reason : "");
-			}
+			sendto_one_numeric(source_p, RPL_STATSDLINE,
+					   form_str (RPL_STATSDLINE),
+					   'd', host, pass,
+					   oper_reason ? "|" : "",
+					   oper_reason ? oper_reason : "");
 		}
 	}
 }
@@ -424,27 +423,26 @@ stats_deny (struct Client *source_p)
 	char *host, *pass, *user, *oper_reason;
 	struct AddressRec *arec;
 	struct ConfItem *aconf;
-	int i;
+	rb_dlink_node *ptr;
 
-	for (i = 0; i < ATABLE_SIZE; i++)
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
 	{
-		for (arec = atable[i]; arec; arec = arec->next)
+		arec = ptr->data;
+
+		if(arec->type == CONF_DLINE)
 		{
-			if(arec->type == CONF_DLINE)
-			{
-				aconf = arec->aconf;
+			aconf = arec->aconf;
 
-				if(aconf->flags & CONF_FLAGS_TEMPORARY)
-					continue;
+			if(aconf->flags & CONF_FLAGS_TEMPORARY)
+				continue;
 
-				get_printable_kline(source_p, aconf, &host, &pass, &user, &oper_reason);
+			get_printable_kline(source_p, aconf, &host, &pass, &user, &oper_reason);
 
-				sendto_one_numeric(source_p, RPL_STATSDLINE,
-						   form_str (RPL_STATSDLINE),
-						   'D', host, pass,
-						   oper_reason ? "|" : "",
-						   oper_reason ? oper_reason : "");
-			}
+			sendto_one_numeric(source_p, RPL_STATSDLINE,
+					   form_str (RPL_STATSDLINE),
+					   'D', host, pass,
+					   oper_reason ? "|" : "",
+					   oper_reason ? oper_reason : "");
 		}
 	}
 }
@@ -463,7 +461,8 @@ stats_exempt(struct Client *source_p)
 	const char *pass;
 	struct AddressRec *arec;
 	struct ConfItem *aconf;
-	int i, port;
+	rb_dlink_node *ptr;
+	int port;
 
 	if(ConfigFileEntry.stats_e_disabled)
 	{
@@ -472,22 +471,22 @@ stats_exempt(struct Client *source_p)
 		return;
 	}
 
-	for (i = 0; i < ATABLE_SIZE; i++)
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
 	{
-		for (arec = atable[i]; arec; arec = arec->next)
+		arec = ptr->data;
+
+		if(arec->type == CONF_EXEMPTDLINE)
 		{
-			if(arec->type == CONF_EXEMPTDLINE)
-			{
-				aconf = arec->aconf;
-				get_printable_conf (aconf, &name, &host, &pass,
-						    &user, &port, &classname);
+			aconf = arec->aconf;
+			get_printable_conf (aconf, &name, &host, &pass,
+					    &user, &port, &classname);
 
-				sendto_one_numeric(source_p, RPL_STATSDLINE,
-						   form_str(RPL_STATSDLINE),
-						   'e', host, pass, "", "");
-			}
+			sendto_one_numeric(source_p, RPL_STATSDLINE,
+					   form_str(RPL_STATSDLINE),
+					   'e', host, pass, "", "");
 		}
-	}}
+	}
+}
 
 
 static void
@@ -680,27 +679,26 @@ report_Klines(struct Client *source_p)
 	char *host, *pass, *user, *oper_reason;
 	struct AddressRec *arec;
 	struct ConfItem *aconf = NULL;
-	int i;
+	rb_dlink_node *ptr;
 
-	for (i = 0; i < ATABLE_SIZE; i++)
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
 	{
-		for (arec = atable[i]; arec; arec = arec->next)
-		{
-			if(arec->type == CONF_KILL)
-			{
-				aconf = arec->aconf;
+		arec = ptr->data;
 
-				/* its a tempkline, theyre reported elsewhere */
-				if(aconf->flags & CONF_FLAGS_TEMPORARY)
-					continue;
-
-				get_printable_kline(source_p, aconf, &host, &pass, &user, &oper_reason);
-				sendto_one_numeric(source_p, RPL_STATSKLINE,
-						   form_str(RPL_STATSKLINE),
-						   'K', host, user, pass,
-						   oper_reason ? "|" : "",
-						   oper_reason ? oper_reason : "");
-			}
+		if(arec->type == CONF_KILL)
+		{
+			aconf = arec->aconf;
+
+			/* its a tempkline, theyre reported elsewhere */
+			if(aconf->flags & CONF_FLAGS_TEMPORARY)
+				continue;
+
+			get_printable_kline(source_p, aconf, &host, &pass, &user, &oper_reason);
+			sendto_one_numeric(source_p, RPL_STATSKLINE,
+					   form_str(RPL_STATSKLINE),
+					   'K', host, user, pass,
+					   oper_reason ? "|" : "",
+					   oper_reason ? oper_reason : "");
 		}
 	}
 }
@@ -921,15 +919,19 @@ stats_resv(struct Client *source_p)
 }
 
 static void
-stats_ssld_foreach(void *data, pid_t pid, int cli_count, enum ssld_status status, const char *version)
+stats_ssld_foreach(void *data, pid_t pid, int cli_count, int handshakes, unsigned long handshakes_total,
+		unsigned long resumed_total, enum ssld_status status, const char *version)
 {
 	struct Client *source_p = data;
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
-			"S :%u %c %u :%s",
+			"S :%u %c %u %d %lu %lu :%s",
 			pid,
 			status == SSLD_DEAD ? 'D' : (status == SSLD_SHUTDOWN ? 'S' : 'A'),
 			cli_count,
+			handshakes,
+			handshakes_total,
+			resumed_total,
 			version);
 }
 
@@ -1077,6 +1079,20 @@ stats_tstats (struct Client *source_p)
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 				"T :time connected %llu %llu",
 				sp.is_cti, sp.is_sti);
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				"T :sendq writes %llu bytes %lluK (%llu bytes/write)",
+				sp.is_sqw, sp.is_sqwb / 1024,
+				sp.is_sqw ? sp.is_sqwb / sp.is_sqw : 0);
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				"T :sendq deferred flushes %llu writes saved %llu",
+				sp.is_sqdf, sp.is_sqco);
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				"T :netbursts %llu lines %llu bytes %lluK time %llums (%lluK/s)",
+				sp.is_bst, sp.is_bstl, sp.is_bstb / 1024, sp.is_bstt,
+				sp.is_bstt ? sp.is_bstb * 1000 / 1024 / sp.is_bstt : sp.is_bstb / 1024);
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				"T :ban cache hits %llu misses %llu refreshed %llu",
+				sp.is_bch, sp.is_bcm, sp.is_bcr);
 }
 
 static void
@@ -1273,6 +1289,18 @@ stats_class(struct Client *source_p)
 		report_classes(source_p);
 }
 
+static void
+stats_memory_heap(size_t used, size_t freem, size_t memusage, size_t heapalloc,
+		const char *desc, void *data)
+{
+	struct Client *source_p = data;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :heap %s used %lu(%lu) free %lu allocated %lu",
+			   desc, (unsigned long)used, (unsigned long)memusage,
+			   (unsigned long)freem, (unsigned long)heapalloc);
+}
+
 static void
 stats_memory (struct Client *source_p)
 {
@@ -1280,6 +1308,7 @@ stats_memory (struct Client *source_p)
 	struct Channel *chptr;
 	rb_dlink_node *rb_dlink;
 	rb_dlink_node *ptr;
+	int i;
 	int channel_count = 0;
 	int local_client_conf_count = 0;	/* local client conf links */
 	int users_counted = 0;	/* user structs */
@@ -1324,6 +1353,9 @@ stats_memory (struct Client *source_p)
 
 	size_t total_memory = 0;
 
+	size_t heap_alloc = 0;
+	size_t heap_used = 0;
+
 	whowas_memory_usage(&ww, &wwm);
 
 	RB_DLINK_FOREACH(ptr, global_client_list.head)
@@ -1455,6 +1487,16 @@ stats_memory (struct Client *source_p)
 			   "z :linebuf %ld(%ld)",
 			   (long)linebuf_count, (long)linebuf_memory_used);
 
+	for(i = 0; i < LINEBUF_CLASSES; i++)
+	{
+		size_t class_size, class_count, class_memory;
+
+		rb_count_rb_linebuf_class_memory(i, &class_size, &class_count, &class_memory);
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				   "z :linebuf class %ld: %ld(%ld)",
+				   (long)class_size, (long)class_count, (long)class_memory);
+	}
+
 	count_scache(&number_servers_cached, &mem_servers_cached);
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
@@ -1489,6 +1531,13 @@ stats_memory (struct Client *source_p)
 			   "z :Remote client Memory in use: %ld(%ld)",
 			   (long)remote_client_count,
 			   (long)remote_client_memory_used);
+
+	rb_bh_usage_all(stats_memory_heap, source_p);
+	rb_bh_total_usage(&heap_alloc, &heap_used);
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :Block heaps in use: %lu allocated: %lu",
+			   (unsigned long)heap_used, (unsigned long)heap_alloc);
 }
 
 static void
@@ -1563,6 +1612,17 @@ stats_servlinks (struct Client *source_p)
 			(rb_current_time() > target_p->localClient->lasttime) ?
 			 (rb_current_time() - target_p->localClient->lasttime) : 0,
 			IsOperGeneral (source_p) ? show_capabilities (target_p) : "TS");
+
+		if(target_p->localClient->burst != NULL && IsOperGeneral (source_p))
+		{
+			struct ServerBurst *burst = target_p->localClient->burst;
+
+			sendto_one_numeric(source_p, RPL_STATSDEBUG,
+					   "? :%s bursting: users %zu/%zu channels %zu/%zu held %u",
+					   target_p->name, burst->upos, burst->nuids,
+					   burst->cpos, burst->nchans,
+					   rb_linebuf_len(&burst->holdq));
+		}
 	}
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
@@ -44,6 +44,7 @@
 #include "msg.h"
 #include "parse.h"
 #include "modules.h"
+#include "userindex.h"
 
 static const char testmask_desc[] =
 	"Provides the TESTMASK command to show the number of clients matching a hostmask or GECOS";
@@ -72,7 +73,11 @@ mo_testmask(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 	char *name, *username, *hostname;
 	const char *sockhost;
 	char *gecos = NULL;
-	rb_dlink_node *ptr;
+	struct match_pattern *upat, *hpat, *npat = NULL, *gpat = NULL;
+	struct UserIndexMask masks[4];
+	rb_dlink_list candidates = { NULL, NULL, 0 };
+	bool indexed;
+	rb_dlink_node *ptr, *nptr;
 
 	name = LOCAL_COPY(parv[1]);
 	collapse(name);
@@ -107,7 +112,31 @@ mo_testmask(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 		collapse_esc(gecos);
 	}
 
-	RB_DLINK_FOREACH(ptr, global_client_list.head)
+	upat = match_compile(username, MATCH_GLOB);
+	hpat = match_compile(hostname, MATCH_GLOB);
+	if(name != NULL)
+		npat = match_compile(name, MATCH_GLOB);
+	if(gecos != NULL)
+		gpat = match_compile(gecos, MATCH_ESC);
+
+	/* name and gecos are skipped when NULL */
+	masks[0].mask = username;
+	masks[0].syntax = MATCH_GLOB;
+	masks[1].mask = name;
+	masks[1].syntax = MATCH_GLOB;
+	masks[2].mask = gecos;
+	masks[2].syntax = MATCH_ESC;
+	masks[3].mask = NULL;
+	masks[3].syntax = MATCH_GLOB;
+
+	/* the host may match a CIDR or the placeholder sockhosts instead */
+	if(strchr(hostname, '/') == NULL && !match_compiled(hpat, empty_sockhost) &&
+	   !match_compiled(hpat, spoofed_sockhost))
+		masks[3].mask = hostname;
+
+	indexed = user_index_find(masks, 4, &candidates);
+
+	RB_DLINK_FOREACH(ptr, indexed ? candidates.head : global_client_list.head)
 	{
 		target_p = ptr->data;
 
@@ -121,15 +150,15 @@ mo_testmask(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 		else
 			sockhost = target_p->sockhost;
 
-		if(match(username, target_p->username) &&
-		   (match(hostname, target_p->host) ||
-		    match(hostname, target_p->orighost) ||
-		    match(hostname, sockhost) || match_ips(hostname, sockhost)))
+		if(match_compiled(upat, target_p->username) &&
+		   (match_compiled(hpat, target_p->host) ||
+		    match_compiled(hpat, target_p->orighost) ||
+		    match_compiled(hpat, sockhost) || match_ips(hostname, sockhost)))
 		{
-			if(name && !match(name, target_p->name))
+			if(npat && !match_compiled(npat, target_p->name))
 				continue;
 
-			if(gecos && !match_esc(gecos, target_p->info))
+			if(gpat && !match_compiled(gpat, target_p->info))
 				continue;
 
 			if(MyClient(target_p))
@@ -139,6 +168,14 @@ mo_testmask(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 		}
 	}
 
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, candidates.head)
+		rb_dlinkDestroy(ptr, &candidates);
+
+	match_free(upat);
+	match_free(hpat);
+	match_free(npat);
+	match_free(gpat);
+
 	sendto_one(source_p, form_str(RPL_TESTMASKGECOS),
 			me.name, source_p->name,
 			lcount, gcount, name ? name : "*",
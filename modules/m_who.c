@@ -39,6 +39,8 @@
 #include "s_newconf.h"
 #include "ratelimit.h"
 #include "supported.h"
+#include "userindex.h"
+#include "safelist.h"
 
 #define FIELD_CHANNEL    0x0001
 #define FIELD_HOP        0x0002
@@ -67,7 +69,8 @@ static void m_who(struct MsgBuf *, struct Client *, struct Client *, int, const
 
 static void do_who_on_channel(struct Client *source_p, struct Channel *chptr,
 			      int server_oper, int member,
-			      struct who_format *fmt);
+			      struct who_format *fmt, const char *endmask);
+static bool who_stream_step(struct Client *source_p, void *data);
 static void who_global(struct Client *source_p, const char *mask, int server_oper, int operspy, struct who_format *fmt);
 static void do_who(struct Client *source_p,
 		   struct Client *target_p, struct membership *msptr,
@@ -88,6 +91,7 @@ _modinit(void)
 static void
 _moddeinit(void)
 {
+	safelist_cancel_all(who_stream_step);
 	delete_isupport("WHOX");
 }
 
@@ -163,11 +167,11 @@ m_who(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p,
 		if((lp = source_p->user->channel.head) != NULL)
 		{
 			msptr = lp->data;
-			do_who_on_channel(source_p, msptr->chptr, server_oper, true, &fmt);
+			do_who_on_channel(source_p, msptr->chptr, server_oper, true, &fmt, "*");
 		}
-
-		sendto_one(source_p, form_str(RPL_ENDOFWHO),
-			   me.name, source_p->name, "*");
+		else
+			sendto_one(source_p, form_str(RPL_ENDOFWHO),
+				   me.name, source_p->name, "*");
 		return;
 	}
 
@@ -205,9 +209,15 @@ m_who(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p,
 				report_operspy(source_p, "WHO", chptr->chname);
 
 			if(IsMember(source_p, chptr) || operspy)
-				do_who_on_channel(source_p, chptr, server_oper, true, &fmt);
+			{
+				do_who_on_channel(source_p, chptr, server_oper, true, &fmt, parv[1] + operspy);
+				return;
+			}
 			else if(!SecretChannel(chptr))
-				do_who_on_channel(source_p, chptr, server_oper, false, &fmt);
+			{
+				do_who_on_channel(source_p, chptr, server_oper, false, &fmt, parv[1] + operspy);
+				return;
+			}
 		}
 
 		sendto_one(source_p, form_str(RPL_ENDOFWHO),
@@ -286,10 +296,26 @@ m_who(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p,
 		   me.name, source_p->name, mask);
 }
 
+/* who_matches
+ * inputs	- pointer to client requesting who
+ *		- pointer to client to check
+ *		- compiled mask to match
+ * output	- 1 if the mask matches any of the client's names
+ * side effects - NONE
+ */
+static int
+who_matches(struct Client *source_p, struct Client *target_p, const struct match_pattern *pat)
+{
+	return match_compiled(pat, target_p->name) || match_compiled(pat, target_p->username) ||
+		match_compiled(pat, target_p->host) || match_compiled(pat, target_p->servptr->name) ||
+		(IsOperGeneral(source_p) && match_compiled(pat, target_p->orighost)) ||
+		match_compiled(pat, target_p->info);
+}
+
 /* who_common_channel
  * inputs	- pointer to client requesting who
  * 		- pointer to channel member chain.
- *		- char * mask to match
+ *		- compiled mask to match
  *		- int if oper on a server or not
  *		- pointer to int maxmatches
  *		- format options
@@ -299,7 +325,7 @@ m_who(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p,
  */
 static void
 who_common_channel(struct Client *source_p, struct Channel *chptr,
-		   const char *mask, int server_oper, int *maxmatches,
+		   const struct match_pattern *pat, int server_oper, int *maxmatches,
 		   struct who_format *fmt)
 {
 	struct membership *msptr;
@@ -321,11 +347,7 @@ who_common_channel(struct Client *source_p, struct Channel *chptr,
 
 		if(*maxmatches > 0)
 		{
-			if((mask == NULL) ||
-					match(mask, target_p->name) || match(mask, target_p->username) ||
-					match(mask, target_p->host) || match(mask, target_p->servptr->name) ||
-					(IsOperGeneral(source_p) && match(mask, target_p->orighost)) ||
-					match(mask, target_p->info))
+			if(pat == NULL || who_matches(source_p, target_p, pat))
 			{
 				do_who(source_p, target_p, NULL, fmt);
 				--(*maxmatches);
@@ -334,6 +356,27 @@ who_common_channel(struct Client *source_p, struct Channel *chptr,
 	}
 }
 
+/* match_server_name
+ * inputs	- compiled mask to match
+ * output	- true if the mask matches the name of a server
+ * side effects - NONE
+ */
+static bool
+match_server_name(const struct match_pattern *pat)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, global_serv_list.head)
+	{
+		struct Client *server_p = ptr->data;
+
+		if(match_compiled(pat, server_p->name))
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * who_global
  *
@@ -353,9 +396,15 @@ who_global(struct Client *source_p, const char *mask, int server_oper, int opers
 {
 	struct membership *msptr;
 	struct Client *target_p;
-	rb_dlink_node *lp, *ptr;
+	struct match_pattern *pat = NULL;
+	rb_dlink_node *lp, *ptr, *nptr;
+	rb_dlink_list candidates = { NULL, NULL, 0 };
+	bool indexed = false;
 	int maxmatches = 500;
 
+	if(mask != NULL)
+		pat = match_compile(mask, MATCH_GLOB);
+
 	/* first, list all matching INvisible clients on common channels
 	 * if this is not an operspy who
 	 */
@@ -364,7 +413,7 @@ who_global(struct Client *source_p, const char *mask, int server_oper, int opers
 		RB_DLINK_FOREACH(lp, source_p->user->channel.head)
 		{
 			msptr = lp->data;
-			who_common_channel(source_p, msptr->chptr, mask, server_oper, &maxmatches, fmt);
+			who_common_channel(source_p, msptr->chptr, pat, server_oper, &maxmatches, fmt);
 		}
 	}
 	else if (!ConfigFileEntry.operspy_dont_care_user_info)
@@ -374,8 +423,20 @@ who_global(struct Client *source_p, const char *mask, int server_oper, int opers
 	 * on invisible clients
 	 * if this is an operspy who, list all matching clients, no need
 	 * to clear marks
+	 *
+	 * the users the index gives us come in the same order, the marks
+	 * of any it leaves out are cleared from the channels they were set
+	 * on.  the index has no server names, so a mask that matches a
+	 * server has to check everyone.
 	 */
-	RB_DLINK_FOREACH(ptr, global_client_list.head)
+	if(pat != NULL && !match_server_name(pat))
+	{
+		struct UserIndexMask um = { mask, MATCH_GLOB };
+
+		indexed = user_index_find(&um, 1, &candidates);
+	}
+
+	RB_DLINK_FOREACH(ptr, indexed ? candidates.head : global_client_list.head)
 	{
 		target_p = ptr->data;
 		if(!IsPerson(target_p))
@@ -392,11 +453,7 @@ who_global(struct Client *source_p, const char *mask, int server_oper, int opers
 
 		if(maxmatches > 0)
 		{
-			if(!mask ||
-					match(mask, target_p->name) || match(mask, target_p->username) ||
-					match(mask, target_p->host) || match(mask, target_p->servptr->name) ||
-					(IsOperGeneral(source_p) && match(mask, target_p->orighost)) ||
-					match(mask, target_p->info))
+			if(pat == NULL || who_matches(source_p, target_p, pat))
 			{
 				do_who(source_p, target_p, NULL, fmt);
 				--maxmatches;
@@ -404,43 +461,134 @@ who_global(struct Client *source_p, const char *mask, int server_oper, int opers
 		}
 	}
 
+	if(indexed)
+	{
+		RB_DLINK_FOREACH_SAFE(ptr, nptr, candidates.head)
+			rb_dlinkDestroy(ptr, &candidates);
+
+		if(!operspy)
+		{
+			RB_DLINK_FOREACH(lp, source_p->user->channel.head)
+			{
+				msptr = lp->data;
+				RB_DLINK_FOREACH(ptr, msptr->chptr->members.head)
+					ClearMark(((struct membership *)ptr->data)->client_p);
+			}
+		}
+	}
+
+	match_free(pat);
+
 	if (maxmatches <= 0)
 		sendto_one(source_p,
 			form_str(ERR_TOOMANYMATCHES),
 			me.name, source_p->name, "WHO");
 }
 
+struct who_stream
+{
+	struct MemberSnapshot snap;
+	int server_oper;
+	int member;
+	struct who_format fmt;
+	char querytype[4];
+	char *endmask;
+};
+
+static void
+who_channel_member(struct Client *source_p, struct membership *msptr,
+		   int server_oper, int member, struct who_format *fmt)
+{
+	struct Client *target_p = msptr->client_p;
+
+	if(server_oper && !SeesOper(target_p, source_p))
+		return;
+
+	if(member || !IsInvisible(target_p))
+		do_who(source_p, target_p, msptr, fmt);
+}
+
+static bool
+who_stream_step(struct Client *source_p, void *data)
+{
+	struct who_stream *ws = data;
+	struct membership *msptr;
+
+	while(!safelist_sendq_exceeded(source_p))
+	{
+		if((msptr = next_snapshot_member(&ws->snap)) == NULL)
+			return true;
+
+		who_channel_member(source_p, msptr, ws->server_oper, ws->member, &ws->fmt);
+	}
+
+	return false;
+}
+
+static void
+who_stream_done(struct Client *source_p, void *data, bool aborted)
+{
+	struct who_stream *ws = data;
+
+	if(!aborted)
+		sendto_one(source_p, form_str(RPL_ENDOFWHO),
+			   me.name, source_p->name, ws->endmask);
+
+	free_member_snapshot(&ws->snap);
+	rb_free(ws->endmask);
+	rb_free(ws);
+}
+
 /*
  * do_who_on_channel
  *
  * inputs	- pointer to client requesting who
  *		- pointer to channel to do who on
- *		- The "real name" of this channel
  *		- int if source_p is a server oper or not
  *		- int if client is member or not
  *		- format options
+ *		- mask to end the reply with
  * output	- NONE
- * side effects - do a who on given channel
+ * side effects - do a who on given channel, followed by RPL_ENDOFWHO.
+ *		  whatever doesnt fit in half the sendq is sent as it
+ *		  drains, and the client's next command waits for it.
  */
 static void
 do_who_on_channel(struct Client *source_p, struct Channel *chptr,
-		  int server_oper, int member, struct who_format *fmt)
+		  int server_oper, int member, struct who_format *fmt,
+		  const char *endmask)
 {
-	struct Client *target_p;
-	struct membership *msptr;
+	struct who_stream *ws;
 	rb_dlink_node *ptr;
 
-	RB_DLINK_FOREACH(ptr, chptr->members.head)
+	ws = rb_malloc(sizeof(struct who_stream));
+	ws->server_oper = server_oper;
+	ws->member = member;
+	ws->fmt = *fmt;
+	if(fmt->querytype != NULL)
 	{
-		msptr = ptr->data;
-		target_p = msptr->client_p;
+		rb_strlcpy(ws->querytype, fmt->querytype, sizeof ws->querytype);
+		ws->fmt.querytype = ws->querytype;
+	}
+	ws->endmask = rb_strdup(endmask);
 
-		if(server_oper && !SeesOper(target_p, source_p))
-			continue;
+	/* send what fits straight from the member list, unless another
+	 * reply is still going
+	 */
+	ptr = chptr->members.head;
+	if(!safelist_busy(source_p))
+	{
+		for(; ptr != NULL; ptr = ptr->next)
+		{
+			if(safelist_sendq_exceeded(source_p))
+				break;
 
-		if(member || !IsInvisible(target_p))
-			do_who(source_p, target_p, msptr, fmt);
+			who_channel_member(source_p, ptr->data, server_oper, member, fmt);
+		}
 	}
+
+	snapshot_channel_members(&ws->snap, chptr, ptr);
+	safelist_start(source_p, who_stream_step, who_stream_done, ws, true);
 }
 
 /*
@@ -105,6 +105,7 @@ typedef struct _conn
 #define FLAG_SSL_W_WANTS_R 0x10	/* output needs to wait until input possible */
 #define FLAG_SSL_R_WANTS_W 0x20	/* input needs to wait until output possible */
 #define FLAG_ZIPSSL	0x40
+#define FLAG_KTLS	0x80	/* may be handed back to the ircd after the handshake */
 
 #define IsSSL(x) ((x)->flags & FLAG_SSL)
 #define IsZip(x) ((x)->flags & FLAG_ZIP)
@@ -113,6 +114,7 @@ typedef struct _conn
 #define IsSSLWWantsR(x) ((x)->flags & FLAG_SSL_W_WANTS_R)
 #define IsSSLRWantsW(x) ((x)->flags & FLAG_SSL_R_WANTS_W)
 #define IsZipSSL(x)	((x)->flags & FLAG_ZIPSSL)
+#define IsKTLS(x)	((x)->flags & FLAG_KTLS)
 
 #define SetSSL(x) ((x)->flags |= FLAG_SSL)
 #define SetZip(x) ((x)->flags |= FLAG_ZIP)
@@ -120,6 +122,7 @@ typedef struct _conn
 #define SetDead(x) ((x)->flags |= FLAG_DEAD)
 #define SetSSLWWantsR(x) ((x)->flags |= FLAG_SSL_W_WANTS_R)
 #define SetSSLRWantsW(x) ((x)->flags |= FLAG_SSL_R_WANTS_W)
+#define SetKTLS(x) ((x)->flags |= FLAG_KTLS)
 
 #define ClearCork(x) ((x)->flags &= ~FLAG_CORK)
 #define ClearSSLWWantsR(x) ((x)->flags &= ~FLAG_SSL_W_WANTS_R)
@@ -696,13 +699,43 @@ ssl_send_certfp(conn_t *conn)
 }
 
 static void
-ssl_send_open(conn_t *conn)
+ssl_send_open(conn_t *conn, int resumed)
 {
-	uint8_t buf[5];
+	uint8_t buf[6];
 
 	buf[0] = 'O';
 	uint32_to_buf(&buf[1], conn->id);
-	mod_cmd_write_queue(conn->ctl, buf, 5);
+	buf[5] = resumed;
+	mod_cmd_write_queue(conn->ctl, buf, 6);
+}
+
+/*
+ * The kernel does the record layer for this session now, so the socket
+ * goes back to the ircd, which reads and writes the plaintext itself.
+ * Our end of the socketpair is closed and the connection forgotten.
+ */
+static void
+ssl_send_handoff(conn_t *conn, int resumed)
+{
+	mod_ctl_buf_t *ctl_buf;
+
+	ctl_buf = rb_malloc(sizeof(mod_ctl_buf_t));
+	ctl_buf->buf = rb_malloc(6);
+	ctl_buf->buflen = 6;
+	ctl_buf->buf[0] = 'H';
+	uint32_to_buf(&ctl_buf->buf[1], conn->id);
+	ctl_buf->buf[5] = resumed;
+	ctl_buf->F[0] = conn->mod_fd;
+	ctl_buf->nfds = 1;
+	rb_dlinkAddTail(ctl_buf, &ctl_buf->node, &conn->ctl->writeq);
+
+	/* mod_write_ctl closes mod_fd once it has been passed */
+	SetDead(conn);
+	rb_dlinkDelete(&conn->node, connid_hash(conn->id));
+	rb_close(conn->plain_fd);
+	rb_dlinkAdd(conn, &conn->node, &dead_list);
+
+	mod_write_ctl(conn->ctl->F, conn->ctl);
 }
 
 static void
@@ -712,9 +745,17 @@ ssl_process_accept_cb(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen
 
 	if(status == RB_OK)
 	{
+		/* the session is gone once it has been detached */
+		int resumed = rb_ssl_session_resumed(conn->mod_fd);
+
 		ssl_send_cipher(conn);
 		ssl_send_certfp(conn);
-		ssl_send_open(conn);
+		if(IsKTLS(conn) && rb_ssl_ktls_detach(conn->mod_fd))
+		{
+			ssl_send_handoff(conn, resumed);
+			return;
+		}
+		ssl_send_open(conn, resumed);
 		conn_mod_read_cb(conn->mod_fd, conn);
 		conn_plain_read_cb(conn->plain_fd, conn);
 		return;
@@ -733,7 +774,7 @@ ssl_process_connect_cb(rb_fde_t *F, int status, void *data)
 	{
 		ssl_send_cipher(conn);
 		ssl_send_certfp(conn);
-		ssl_send_open(conn);
+		ssl_send_open(conn, rb_ssl_session_resumed(conn->mod_fd));
 		conn_mod_read_cb(conn->mod_fd, conn);
 		conn_plain_read_cb(conn->plain_fd, conn);
 	}
@@ -768,6 +809,9 @@ ssl_process_accept(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 	conn_add_id_hash(conn, id);
 	SetSSL(conn);
 
+	if(ctlb->buflen > 5 && ctlb->buf[5])
+		SetKTLS(conn);
+
 	if(rb_get_type(conn->mod_fd) & RB_FD_UNKNOWN)
 		rb_set_type(conn->mod_fd, RB_FD_SOCKET);
 
@@ -783,6 +827,18 @@ ssl_change_certfp_method(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 	certfp_method = buf_to_uint32(&ctlb->buf[1]);
 }
 
+static void
+ssl_change_ktls(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
+{
+	rb_ssl_set_ktls(ctlb->buf[1]);
+}
+
+static void
+ssl_change_ticket_keys(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
+{
+	rb_ssl_set_ticket_keys(&ctlb->buf[2], ctlb->buf[1]);
+}
+
 static void
 ssl_process_connect(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
@@ -982,7 +1038,7 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 		{
 		case 'A':
 			{
-				if (ctl_buf->nfds != 2 || ctl_buf->buflen != 5)
+				if (ctl_buf->nfds != 2 || (ctl_buf->buflen != 5 && ctl_buf->buflen != 6))
 				{
 					cleanup_bad_message(ctl, ctl_buf);
 					break;
@@ -1037,6 +1093,27 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 				process_stats(ctl, ctl_buf);
 				break;
 			}
+		case 'T':
+			{
+				if (ctl_buf->buflen != 2)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+				ssl_change_ktls(ctl, ctl_buf);
+				break;
+			}
+		case 'R':
+			{
+				if (ctl_buf->buflen < 2 || ctl_buf->buf[1] > RB_SSL_TICKET_KEYS_MAX ||
+						ctl_buf->buflen != 2 + (size_t) ctl_buf->buf[1] * RB_SSL_TICKET_KEY_LEN)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+				ssl_change_ticket_keys(ctl, ctl_buf);
+				break;
+			}
 
 #ifdef HAVE_LIBZ
 		case 'Z':
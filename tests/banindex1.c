@@ -0,0 +1,457 @@
+/*
+ *  banindex1.c: Check compiled channel ban lists against a linear scan
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "banindex.h"
+#include "channel.h"
+#include "chmode.h"
+#include "hash.h"
+#include "ircd.h"
+#include "match.h"
+#include "s_conf.h"
+#include "s_stats.h"
+#include "s_user.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NCLIENTS 300
+#define NBANS 400
+#define NEXCEPTS 60
+#define NQUIETS 5
+#define NBENCH 1000
+#define ROUNDS 20
+
+static struct Client *clients[NCLIENTS];
+static struct Channel *chptr;
+
+static int
+extb_test(const char *data, struct Client *client_p, struct Channel *chptr, long mode_type)
+{
+	if(data == NULL)
+		return EXTBAN_INVALID;
+	return atoi(client_p->name + 1) % 50 == atoi(data) ? EXTBAN_MATCH : EXTBAN_NOMATCH;
+}
+
+static void
+make_clients(void)
+{
+	int i;
+
+	for(i = 0; i < NCLIENTS; i++)
+		clients[i] = make_local_person_random(i);
+}
+
+static void
+random_ban(char *buf, size_t len, int i)
+{
+	unsigned int r = ircd_util_rand();
+
+	/* rare, they match almost everyone */
+	if(i % 97 == 96)
+	{
+		snprintf(buf, len, "$~z:%u", r % 50);
+		return;
+	}
+
+	switch(r % 14)
+	{
+	case 0:
+		snprintf(buf, len, "*!*@h%u.pool%u.isp%u.example.net", r % NCLIENTS, (r >> 9) % 20,
+				(r >> 5) % 5);
+		break;
+	case 1:
+		snprintf(buf, len, "*!*@*.pool%u.ISP%u.example.net", r % 40, (r >> 6) % 5);
+		break;
+	case 2:
+		snprintf(buf, len, "C%uNICK%u!*@*", r % (NCLIENTS * 2), (r >> 9) % 50);
+		break;
+	case 3:
+		snprintf(buf, len, "*!u%u@*", r % 60);
+		break;
+	case 4:
+		snprintf(buf, len, "*!*@10.%u.%u.0/24", r % 4, (r >> 4) % 16);
+		break;
+	case 5:
+		snprintf(buf, len, "*!*@10.%u.0.0/%u", r % 8, 12 + (r >> 4) % 8);
+		break;
+	case 6:
+		snprintf(buf, len, "*!*@2001:db8:%x::%x/%u", r % 8, ((r >> 4) % 4096) & ~0xff,
+				116 + (r >> 12) % 8);
+		break;
+	case 7:
+		snprintf(buf, len, "*!*@10.%u.%u.%u", r % 4, (r >> 4) % 16, (r >> 8) % 256);
+		break;
+	case 8:
+		snprintf(buf, len, "$z:%u", r % 200);
+		break;
+	case 9:
+		snprintf(buf, len, "c%u*!u%u@*/%u", r % NCLIENTS, (r >> 9) % 30, r % 33);
+		break;
+	case 10:
+		snprintf(buf, len, "c%uNick%u", r % NCLIENTS, (r >> 9) % 50);
+		break;
+	case 11:
+		snprintf(buf, len, "*!*@10.%u.*", r % 8);
+		break;
+	case 12:
+		snprintf(buf, len, "c%u*!u%u@h%u.pool%u.isp*.example.net", r % NCLIENTS, (r >> 9) % 30,
+				r % NCLIENTS, (r >> 4) % 20);
+		break;
+	default:
+		snprintf(buf, len, "*!*@2002:a0%u:*", r % 4);
+		break;
+	}
+}
+
+/* bans on other people, as most of a big channel's list is */
+static void
+bench_ban(char *buf, size_t len)
+{
+	unsigned int r = ircd_util_rand();
+
+	switch(r % 6)
+	{
+	case 0:
+		snprintf(buf, len, "*!*@h%u.pool%u.example.org", r % 100000, (r >> 17) % 20);
+		break;
+	case 1:
+		snprintf(buf, len, "*!*@*.isp%u.example.com", r % 100000);
+		break;
+	case 2:
+		snprintf(buf, len, "*!*@192.0.%u.%u", r % 256, (r >> 8) % 256);
+		break;
+	case 3:
+		snprintf(buf, len, "*!*@198.%u.%u.0/24", 18 + r % 2, (r >> 8) % 256);
+		break;
+	case 4:
+		snprintf(buf, len, "*!id%u@*", r % 100000);
+		break;
+	default:
+		snprintf(buf, len, "spam%u*!*@*", r % 100000);
+		break;
+	}
+}
+
+static void
+add_bans(rb_dlink_list *list, long mode_type, int count)
+{
+	char mask[BANLEN];
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		random_ban(mask, sizeof mask, i);
+		add_id(&me, chptr, mask, NULL, list, mode_type);
+	}
+}
+
+static struct Ban *
+brute_find(rb_dlink_list *list, struct Client *who, const struct matchset *ms)
+{
+	rb_dlink_node *ptr;
+	struct Ban *banptr;
+
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		banptr = ptr->data;
+		if(matches_mask(ms, banptr->banstr))
+			return banptr;
+		if(match_extban(banptr->banstr, who, chptr, CHFL_BAN))
+			return banptr;
+	}
+	return NULL;
+}
+
+static void
+compare(rb_dlink_list *list, int min_hits)
+{
+	struct matchset ms;
+	int i, wrong = 0, hits = 0;
+	struct Ban *a, *b;
+
+	for(i = 0; i < NCLIENTS; i++)
+	{
+		matchset_for_client(clients[i], &ms);
+		a = banindex_find(chptr, list, clients[i], &ms, CHFL_BAN);
+		b = brute_find(list, clients[i], &ms);
+		if(a != b)
+			wrong++;
+		if(b != NULL)
+			hits++;
+	}
+
+	is_int(0, wrong, MSG);
+	ok(hits >= min_hits, MSG);
+}
+
+static void
+compare1(void)
+{
+	compare(&chptr->banlist, NCLIENTS / 4);
+	compare(&chptr->exceptlist, 1);
+	compare(&chptr->quietlist, 0);
+}
+
+static void
+is_banned1(void)
+{
+	struct matchset ms;
+	int i, wrong = 0, excepted = 0, expect, result;
+
+	ConfigChannel.use_except = true;
+
+	for(i = 0; i < NCLIENTS; i++)
+	{
+		matchset_for_client(clients[i], &ms);
+
+		expect = 0;
+		if(brute_find(&chptr->banlist, clients[i], &ms) != NULL)
+		{
+			expect = CHFL_BAN;
+			if(brute_find(&chptr->exceptlist, clients[i], &ms) != NULL)
+			{
+				expect = CHFL_EXCEPTION;
+				excepted++;
+			}
+		}
+
+		result = is_banned(chptr, clients[i], NULL, NULL, NULL);
+		if(result != expect)
+			wrong++;
+	}
+
+	is_int(0, wrong, MSG);
+	ok(excepted > 0, MSG);
+}
+
+/* the cached matchset follows nick and host changes */
+static void
+matchset1(void)
+{
+	struct Client *client = make_local_person_full("cached", "ident", "old.host.test", "192.0.2.77", "Cached");
+	const struct matchset *ms;
+
+	ms = client_matchset(client);
+	is_string("cached!ident@old.host.test", ms->host[0], MSG);
+	is_string("cached!ident@192.0.2.77", ms->ip[0], MSG);
+	ok(ms == client_matchset(client), MSG);
+	ok(client_matches_mask(client, "*!*@old.host.test"), MSG);
+
+	change_nick_user_host(client, "renamed", "ident", "new.host.test", 0, "test");
+	ms = client_matchset(client);
+	is_string("renamed!ident@new.host.test", ms->host[0], MSG);
+	ok(!client_matches_mask(client, "*!*@old.host.test"), MSG);
+	ok(client_matches_mask(client, "renamed!*@new.host.test"), MSG);
+	ok(client_matches_mask(client, "*!*@192.0.2.0/24"), MSG);
+
+	remove_local_person(client);
+}
+
+/* lists changing within the same second still invalidate */
+static void
+change1(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+	struct Ban *banptr;
+	int i = 0;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->banlist.head)
+	{
+		banptr = ptr->data;
+		if(i++ % 3 == 0 && del_id(chptr, banptr->banstr, &chptr->banlist, CHFL_BAN) == banptr)
+			free_ban(banptr);
+	}
+	compare(&chptr->banlist, NCLIENTS / 8);
+
+	add_bans(&chptr->banlist, CHFL_BAN, NBANS / 4);
+	compare(&chptr->banlist, NCLIENTS / 8);
+
+	/* matches everyone, but comes last in the list */
+	banptr = allocate_ban("*", "me.test", NULL);
+	rb_dlinkAddTail(banptr, &banptr->node, &chptr->banlist);
+	invalidate_bancache_channel(chptr);
+	compare1();
+}
+
+static double
+time_lookups(struct Ban *(*find)(rb_dlink_list *, struct Client *, const struct matchset *))
+{
+	struct timespec start;
+	struct matchset ms[NCLIENTS];
+	int i, j, hits = 0;
+
+	for(i = 0; i < NCLIENTS; i++)
+		matchset_for_client(clients[i], &ms[i]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(j = 0; j < ROUNDS; j++)
+		for(i = 0; i < NCLIENTS; i++)
+			if(find(&chptr->banlist, clients[i], &ms[i]) != NULL)
+				hits++;
+	/* none of the bans are on them */
+	is_int(0, hits, MSG);
+
+	return ircd_util_elapsed_ns(&start) / (ROUNDS * NCLIENTS);
+}
+
+static struct Ban *
+index_find(rb_dlink_list *list, struct Client *who, const struct matchset *ms)
+{
+	return banindex_find(chptr, list, who, ms, CHFL_BAN);
+}
+
+static void
+bench1(void)
+{
+	struct Channel *saved = chptr;
+	char mask[BANLEN];
+	double tindex, tlist;
+	int i;
+
+	chptr = allocate_channel("#bench");
+	for(i = 0; i < NBENCH; i++)
+	{
+		bench_ban(mask, sizeof mask);
+		add_id(&me, chptr, mask, NULL, &chptr->banlist, CHFL_BAN);
+	}
+
+	tindex = time_lookups(index_find);
+	tlist = time_lookups(brute_find);
+	diag("ban lookup with %lu bans: index %.1f ns/op, list %.1f ns/op",
+		rb_dlink_list_length(&chptr->banlist), tindex, tlist);
+
+	free_channel_list(&chptr->banlist);
+	banindex_free(chptr);
+	free_channel(chptr);
+	chptr = saved;
+}
+
+/* channel::ban_refresh rechecks members after a ban change */
+static void
+refresh1(void)
+{
+	struct Channel *saved = chptr;
+	struct membership *msptr;
+	struct matchset ms;
+	unsigned long long refreshed = ServerStats.is_bcr;
+	int i, stale = 0, wrong = 0, banned = 0, tries;
+
+	ConfigChannel.ban_refresh = true;
+
+	chptr = get_or_create_channel(clients[0], "#refresh", NULL);
+	for(i = 0; i < NCLIENTS; i++)
+		add_user_to_channel(chptr, clients[i], CHFL_PEON);
+
+	add_id(&me, chptr, "*!u1*@*", NULL, &chptr->banlist, CHFL_BAN);
+	ok(chptr->refresh_node.data != NULL, MSG);
+
+	/* the member due next leaves, and one is checked on send */
+	msptr = chptr->refresh_next->data;
+	remove_user_from_channel(msptr);
+	msptr = find_channel_membership(chptr, clients[NCLIENTS / 2]);
+	can_send(chptr, clients[NCLIENTS / 2], msptr);
+	is_int(chptr->bants, msptr->bants, MSG);
+
+	for(tries = 0; tries < 1000 && chptr->refresh_node.data != NULL; tries++)
+	{
+		usleep(1000);
+		rb_set_time();
+		rb_event_run();
+	}
+	ok(chptr->refresh_node.data == NULL, MSG);
+
+	for(i = 0; i < NCLIENTS; i++)
+	{
+		msptr = find_channel_membership(chptr, clients[i]);
+		if(msptr == NULL)
+			continue;
+
+		if(msptr->bants != chptr->bants)
+			stale++;
+
+		matchset_for_client(clients[i], &ms);
+		if(brute_find(&chptr->banlist, clients[i], &ms) != NULL)
+		{
+			banned++;
+			if(!(msptr->flags & CHFL_BANNED))
+				wrong++;
+		}
+		else if(msptr->flags & CHFL_BANNED)
+			wrong++;
+	}
+
+	is_int(0, stale, MSG);
+	is_int(0, wrong, MSG);
+	ok(banned > 0, MSG);
+	is_int(NCLIENTS - 2, ServerStats.is_bcr - refreshed, MSG);
+
+	/* the last one out destroys the channel */
+	for(i = 0; i < NCLIENTS; i++)
+		if((msptr = find_channel_membership(chptr, clients[i])) != NULL)
+			remove_user_from_channel(msptr);
+
+	ConfigChannel.ban_refresh = false;
+	chptr = saved;
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	extban_table['z'] = extb_test;
+
+	chptr = allocate_channel("#bans");
+	make_clients();
+	add_bans(&chptr->banlist, CHFL_BAN, NBANS);
+	add_bans(&chptr->exceptlist, CHFL_EXCEPTION, NEXCEPTS);
+	add_bans(&chptr->quietlist, CHFL_QUIET, NQUIETS);
+
+	compare1();
+	is_banned1();
+	matchset1();
+	bench1();
+	change1();
+	refresh1();
+
+	free_channel_list(&chptr->banlist);
+	free_channel_list(&chptr->exceptlist);
+	free_channel_list(&chptr->quietlist);
+	banindex_free(chptr);
+	free_channel(chptr);
+
+	for(i = 0; i < NCLIENTS; i++)
+		remove_local_person(clients[i]);
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
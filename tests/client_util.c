@@ -107,6 +107,46 @@ void remove_local_person(struct Client *client)
 	exit_client(NULL, client, &me, "Test client removed");
 }
 
+/*
+ * A client for the index and ban tests: nick c<i>Nick<0-49>, user
+ * u<0-29>, and a mix of 10.0.0.0/12, 2001:db8::/45 and 6to4 addresses
+ * of 10.0.0.0/14.  A third of them have no hostname, the rest are
+ * h<i>.Pool<0-19>.isp<0-4>.example.net.
+ */
+struct Client *make_local_person_random(int i)
+{
+	char nick[NICKLEN], user[USERLEN + 1], ip[HOSTIPLEN], host[HOSTLEN], info[REALLEN];
+	struct Client *client;
+	unsigned int r = ircd_util_rand();
+
+	switch (i % 4) {
+	case 0:
+	case 1:
+		snprintf(ip, sizeof(ip), "10.%u.%u.%u", r % 4, (r >> 4) % 16, (r >> 8) % 256);
+		break;
+	case 2:
+		snprintf(ip, sizeof(ip), "2001:db8:%x::%x", r % 8, (r >> 4) % 4096);
+		break;
+	default:
+		snprintf(ip, sizeof(ip), "2002:a%02x:%x::1", r % 4, (r >> 4) % 4096);
+		break;
+	}
+
+	if (r % 3 == 0)
+		rb_strlcpy(host, ip, sizeof(host));
+	else
+		snprintf(host, sizeof(host), "h%d.Pool%u.isp%u.example.net", i, r % 20, (r >> 5) % 5);
+
+	snprintf(nick, sizeof(nick), "c%dNick%u", i, (r >> 12) % 50);
+	snprintf(user, sizeof(user), "u%u", (r >> 6) % 30);
+	snprintf(info, sizeof(info), "Test user %u of %s", (r >> 10) % 30, r % 2 ? "Mars" : "Venus");
+
+	client = make_local_person_full(nick, user, host, ip, info);
+	rb_strlcpy(client->orighost, host, sizeof(client->orighost));
+
+	return client;
+}
+
 struct Client *make_remote_server(struct Client *uplink)
 {
 	return make_remote_server_name(uplink, TEST_SERVER_NAME);
@@ -69,6 +69,7 @@ struct Client *make_local_person_nick(const char *nick);
 struct Client *make_local_person_full(const char *nick, const char *username, const char *hostname, const char *ip, const char *realname);
 void make_local_person_oper(struct Client *client);
 void remove_local_person(struct Client *client);
+struct Client *make_local_person_random(int i);
 
 struct Client *make_remote_server(struct Client *uplink);
 struct Client *make_remote_server_name(struct Client *uplink, const char *name);
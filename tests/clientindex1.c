@@ -0,0 +1,211 @@
+/*
+ *  clientindex1.c: Check the local client index against a linear scan
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "clientindex.h"
+#include "hostmask.h"
+#include "match.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NCLIENTS 3000
+#define NPROBES 500
+
+static struct Client *clients[NCLIENTS];
+static bool candidate[NCLIENTS];
+
+static void
+make_clients(void)
+{
+	int i;
+
+	for(i = 0; i < NCLIENTS; i++)
+	{
+		clients[i] = make_local_person_random(i);
+		client_index_add(clients[i]);
+	}
+}
+
+static void
+random_mask(char *buf, size_t len)
+{
+	unsigned int r = ircd_util_rand();
+
+	switch(r % 8)
+	{
+	case 0:
+		snprintf(buf, len, "10.%u.%u.0/%u", r % 4, (r >> 4) % 16, 16 + (r >> 8) % 17);
+		break;
+	case 1:
+		snprintf(buf, len, "10.%u.0.0/%u", r % 4, 8 + (r >> 8) % 9);
+		break;
+	case 2:
+		snprintf(buf, len, "2001:db8:%x::/%u", r % 8, 40 + (r >> 8) % 89);
+		break;
+	case 3:
+		snprintf(buf, len, "*.pool%u.isp%u.EXAMPLE.net", r % 20, (r >> 5) % 5);
+		break;
+	case 4:
+		snprintf(buf, len, "h%u*.isp%u.example.net", r % 100, (r >> 5) % 5);
+		break;
+	case 5:
+		snprintf(buf, len, "h%u.pool%u.isp%u.example.net", r % NCLIENTS, r % 20, (r >> 5) % 5);
+		break;
+	case 6:
+		snprintf(buf, len, "*.net");
+		break;
+	default:
+		snprintf(buf, len, "2001:db8:*");
+		break;
+	}
+}
+
+static bool
+mask_matches(const char *mask, struct Client *client_p)
+{
+	struct rb_sockaddr_storage addr;
+	struct sockaddr_in ip4;
+	int bits;
+
+	switch(parse_netmask(mask, &addr, &bits))
+	{
+	case HM_IPV4:
+		if(GET_SS_FAMILY(&client_p->localClient->ip) == AF_INET6 &&
+				rb_ipv4_from_ipv6((struct sockaddr_in6 *)&client_p->localClient->ip, &ip4))
+			return comp_with_mask_sock((struct sockaddr *)&ip4, (struct sockaddr *)&addr, bits);
+		/* FALLTHROUGH */
+	case HM_IPV6:
+		return GET_SS_FAMILY(&client_p->localClient->ip) == GET_SS_FAMILY(&addr) &&
+			comp_with_mask_sock((struct sockaddr *)&client_p->localClient->ip,
+					(struct sockaddr *)&addr, bits);
+	default:
+		return match(mask, client_p->orighost) || match(mask, client_p->sockhost);
+	}
+}
+
+static void
+compare1(void)
+{
+	rb_dlink_list list = { NULL, NULL, 0 };
+	rb_dlink_node *ptr, *next_ptr;
+	char mask[HOSTLEN];
+	int i, j, missed = 0, extra = 0, found = 0, scanned = 0;
+
+	for(i = 0; i < NPROBES; i++)
+	{
+		random_mask(mask, sizeof mask);
+
+		memset(candidate, 0, sizeof candidate);
+		if(!client_index_find(mask, &list))
+		{
+			scanned++;
+			continue;
+		}
+
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list.head)
+		{
+			struct Client *client_p = ptr->data;
+
+			j = atoi(client_p->name + 1);
+			if(candidate[j])
+				extra++;	/* listed twice */
+			candidate[j] = true;
+			rb_dlinkDestroy(ptr, &list);
+		}
+
+		for(j = 0; j < NCLIENTS; j++)
+		{
+			if(clients[j] == NULL)
+			{
+				if(candidate[j])
+					extra++;
+				continue;
+			}
+
+			if(mask_matches(mask, clients[j]))
+			{
+				found++;
+				if(!candidate[j])
+					missed++;
+			}
+			else if(candidate[j] && parse_netmask(mask, NULL, NULL) != HM_HOST)
+			{
+				/* address lookups are exact */
+				extra++;
+			}
+		}
+	}
+
+	is_int(0, missed, MSG);
+	is_int(0, extra, MSG);
+	ok(found > NPROBES, MSG);
+	ok(scanned > 0, MSG);
+	ok(scanned < NPROBES / 4, MSG);
+}
+
+static void
+delete1(void)
+{
+	rb_dlink_list list = { NULL, NULL, 0 };
+	int i;
+
+	for(i = 0; i < NCLIENTS; i += 3)
+	{
+		remove_local_person(clients[i]);
+		clients[i] = NULL;
+	}
+
+	compare1();
+
+	for(i = 0; i < NCLIENTS; i++)
+	{
+		if(clients[i] == NULL)
+			continue;
+		remove_local_person(clients[i]);
+		clients[i] = NULL;
+	}
+
+	ok(client_index_find("0.0.0.0/0", &list), MSG);
+	ok(client_index_find("::/0", &list), MSG);
+	ok(client_index_find("*.net", &list), MSG);
+	is_int(0, rb_dlink_list_length(&list), MSG);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	make_clients();
+	compare1();
+	delete1();
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
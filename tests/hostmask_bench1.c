@@ -0,0 +1,432 @@
+/*
+ *  hostmask_bench1.c: Check and time address conf lookups with many masks
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+
+#include "client.h"
+#include "hostmask.h"
+#include "match.h"
+#include "operhash.h"
+#include "s_conf.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NMASKS4 70000
+#define NMASKS6 20000
+#define NDLINES 10000
+#define NHOSTS 20000
+#define NPROBES 1000
+#define LOOKUPS 200000
+
+static const char *usernames[] = { "*", "*", "*", "bad*", "user" };
+static const char *probe_users[] = { "user", "baduser", "other" };
+
+static struct ConfItem *
+add_mask(const char *host, const char *user, int type)
+{
+	struct ConfItem *aconf = make_conf();
+
+	aconf->status = type;
+	aconf->host = rb_strdup(host);
+	aconf->user = user != NULL ? rb_strdup(user) : NULL;
+	aconf->passwd = rb_strdup("test");
+	aconf->info.oper = operhash_add("tester");
+	add_conf_by_address(aconf->host, type, aconf->user, NULL, aconf);
+	return aconf;
+}
+
+/* everything is kept in 10/8 and 2001:db8::/48 so the masks overlap */
+static void
+random_v4(char *buf, size_t len, int bits)
+{
+	snprintf(buf, len, "10.%u.%u.%u/%d", ircd_util_rand() % 8, ircd_util_rand() % 256,
+			ircd_util_rand() % 256, bits);
+}
+
+static void
+random_v6(char *buf, size_t len, int bits)
+{
+	snprintf(buf, len, "2001:db8:0:%x:%x::%x/%d", ircd_util_rand() % 4,
+			ircd_util_rand() % 0x10000, ircd_util_rand() % 0x10000, bits);
+}
+
+static void
+random_host_mask(char *buf, size_t len)
+{
+	unsigned int n = ircd_util_rand() % 2000, isp = ircd_util_rand() % 50;
+
+	/* no literal suffix, these are tried against every host */
+	if(ircd_util_rand() % 200 == 0)
+	{
+		snprintf(buf, len, "*bad%u*", n);
+		return;
+	}
+
+	switch(ircd_util_rand() % 20)
+	{
+	case 0: case 1: case 2: case 3: case 4: case 5:
+		snprintf(buf, len, "user%u.isp%u.net", n, isp);
+		break;
+	case 6: case 7: case 8: case 9: case 10:
+		snprintf(buf, len, "ip-%u-*.isp%u.net", n % 256, isp);
+		break;
+	default:
+		snprintf(buf, len, "*.h%u.Example.ORG", n);
+		break;
+	}
+}
+
+static void
+random_host(char *buf, size_t len)
+{
+	unsigned int n = ircd_util_rand() % 2000, isp = ircd_util_rand() % 50;
+
+	switch(ircd_util_rand() % 5)
+	{
+	case 0:
+		snprintf(buf, len, "user%u.isp%u.net", n, isp);
+		break;
+	case 1:
+		snprintf(buf, len, "ip-%u-%u-1-2.isp%u.net", n % 256, n % 100, isp);
+		break;
+	case 2:
+		snprintf(buf, len, "a.b.h%u.example.org", n);
+		break;
+	case 3:
+		snprintf(buf, len, "bad%u.other.com", n);
+		break;
+	default:
+		snprintf(buf, len, "nothing.example.com");
+		break;
+	}
+}
+
+static void
+load_masks(void)
+{
+	char buf[64];
+	int i;
+
+	for(i = 0; i < NMASKS4; i++)
+	{
+		random_v4(buf, sizeof buf, 8 + ircd_util_rand() % 25);
+		add_mask(buf, usernames[ircd_util_rand() % 5], CONF_KILL);
+	}
+
+	for(i = 0; i < NMASKS6; i++)
+	{
+		random_v6(buf, sizeof buf, 48 + ircd_util_rand() % 81);
+		add_mask(buf, usernames[ircd_util_rand() % 5], CONF_KILL);
+	}
+
+	for(i = 0; i < NDLINES; i++)
+	{
+		random_v4(buf, sizeof buf, 12 + ircd_util_rand() % 21);
+		add_mask(buf, NULL, CONF_DLINE);
+	}
+
+	for(i = 0; i < NHOSTS; i++)
+	{
+		random_host_mask(buf, sizeof buf);
+		add_mask(buf, usernames[ircd_util_rand() % 5], CONF_KILL);
+	}
+
+	is_int(NMASKS4 + NMASKS6 + NDLINES + NHOSTS, rb_dlink_list_length(&address_conf_list), MSG);
+}
+
+/* the old way: look at every mask, the first one added wins */
+static struct ConfItem *
+brute_find_host(const char *host, int type, const char *username)
+{
+	rb_dlink_node *ptr;
+	struct AddressRec *arec;
+
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
+	{
+		arec = ptr->data;
+
+		if(arec->type != type || arec->masktype != HM_HOST)
+			continue;
+		if(!match(arec->Mask.hostname, host) || !match(arec->username, username))
+			continue;
+		return arec->aconf;
+	}
+	return NULL;
+}
+
+
+static struct ConfItem *
+brute_find(struct sockaddr *addr, int type, const char *username)
+{
+	rb_dlink_node *ptr;
+	struct AddressRec *arec;
+
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
+	{
+		arec = ptr->data;
+
+		if(arec->type != type || arec->masktype == HM_HOST)
+			continue;
+		if(GET_SS_FAMILY(&arec->Mask.ipa.addr) != addr->sa_family)
+			continue;
+		if(!comp_with_mask_sock(addr, (struct sockaddr *)&arec->Mask.ipa.addr, arec->Mask.ipa.bits))
+			continue;
+		if(username != NULL && !match(arec->username, username))
+			continue;
+		return arec->aconf;
+	}
+	return NULL;
+}
+
+static void
+probe_addr(struct rb_sockaddr_storage *addr, bool v6)
+{
+	char buf[64];
+
+	if(v6)
+		random_v6(buf, sizeof buf, 128);
+	else
+		random_v4(buf, sizeof buf, 32);
+
+	/* parse_netmask() strips the bit length for us */
+	parse_netmask(buf, addr, NULL);
+}
+
+static void
+compare1(void)
+{
+	struct rb_sockaddr_storage addr;
+	struct ConfItem *aconf, *expect;
+	const char *user;
+	char host[HOSTLEN + 1];
+	int i, mismatch = 0, found = 0;
+
+	for(i = 0; i < NPROBES; i++)
+	{
+		probe_addr(&addr, i & 1);
+		user = probe_users[ircd_util_rand() % 3];
+
+		aconf = find_conf_by_address(NULL, NULL, NULL, (struct sockaddr *)&addr,
+				CONF_KILL, GET_SS_FAMILY(&addr), user, NULL);
+		expect = brute_find((struct sockaddr *)&addr, CONF_KILL, user);
+		if(aconf != expect)
+			mismatch++;
+		if(aconf != NULL)
+			found++;
+
+		if(!(i & 1))
+		{
+			aconf = find_dline((struct sockaddr *)&addr, AF_INET);
+			if(aconf != brute_find((struct sockaddr *)&addr, CONF_DLINE, NULL))
+				mismatch++;
+		}
+	}
+
+	is_int(0, mismatch, MSG);
+	ok(found > NPROBES / 4, MSG);
+
+	mismatch = found = 0;
+	for(i = 0; i < NPROBES; i++)
+	{
+		random_host(host, sizeof host);
+		user = probe_users[ircd_util_rand() % 3];
+
+		aconf = find_conf_by_address(host, NULL, NULL, NULL, CONF_KILL, AF_INET, user, NULL);
+		if(aconf != brute_find_host(host, CONF_KILL, user))
+			mismatch++;
+		if(aconf != NULL)
+			found++;
+	}
+
+	is_int(0, mismatch, MSG);
+	ok(found > NPROBES / 10, MSG);
+}
+
+static void
+cidr1(void)
+{
+	struct rb_sockaddr_storage addr;
+	struct ConfItem *aconf, *found;
+
+	/* prefix lengths that are not a multiple of 8 */
+	aconf = add_mask("192.0.2.0/23", "*", CONF_KILL);
+
+	parse_netmask("192.0.3.200", &addr, NULL);
+	found = find_conf_by_address(NULL, NULL, NULL, (struct sockaddr *)&addr,
+			CONF_KILL, AF_INET, "someone", NULL);
+	ok(found == aconf, MSG);
+
+	parse_netmask("192.0.4.1", &addr, NULL);
+	found = find_conf_by_address(NULL, NULL, NULL, (struct sockaddr *)&addr,
+			CONF_KILL, AF_INET, "someone", NULL);
+	ok(found == NULL, MSG);
+
+	ok(find_exact_conf_by_address("192.0.2.0/23", CONF_KILL, "*") == aconf, MSG);
+	ok(find_exact_conf_by_address("192.0.2.0/24", CONF_KILL, "*") == NULL, MSG);
+	ok(find_exact_conf_by_address("192.0.2.0/23", CONF_DLINE, "*") == NULL, MSG);
+
+	/* IPv4 K-lines apply to 6to4 addresses as well */
+	parse_netmask("2002:c000:0201::1", &addr, NULL);
+	found = find_conf_by_address(NULL, NULL, NULL, (struct sockaddr *)&addr,
+			CONF_KILL, AF_INET6, "someone", NULL);
+	ok(found == aconf, MSG);
+
+	delete_one_address_conf("192.0.2.0/23", aconf);
+	parse_netmask("192.0.3.200", &addr, NULL);
+	found = find_conf_by_address(NULL, NULL, NULL, (struct sockaddr *)&addr,
+			CONF_KILL, AF_INET, "someone", NULL);
+	ok(found == NULL, MSG);
+
+	/* hostname masks still work next to the trees */
+	aconf = add_mask("*.example.com", "*", CONF_KILL);
+	found = find_conf_by_address("foo.example.com", NULL, NULL, NULL,
+			CONF_KILL, AF_INET, "someone", NULL);
+	ok(found == aconf, MSG);
+	ok(find_exact_conf_by_address("*.example.com", CONF_KILL, "*") == aconf, MSG);
+	ok(find_exact_conf_by_address("*.EXAMPLE.com", CONF_KILL, "*") == aconf, MSG);
+	ok(find_exact_conf_by_address("*.example.com", CONF_CLIENT, "*") == NULL, MSG);
+	delete_one_address_conf("*.example.com", aconf);
+	found = find_conf_by_address("foo.example.com", NULL, NULL, NULL,
+			CONF_KILL, AF_INET, "someone", NULL);
+	ok(found == NULL, MSG);
+
+	/* unanchored masks are also tried against the IP */
+	aconf = add_mask("198.51.100.*", "*", CONF_KILL);
+	parse_netmask("198.51.100.7", &addr, NULL);
+	found = find_conf_by_address("host.example.net", "198.51.100.7", NULL,
+			(struct sockaddr *)&addr, CONF_KILL, AF_INET, "someone", NULL);
+	ok(found == aconf, MSG);
+	delete_one_address_conf("198.51.100.*", aconf);
+}
+
+static void
+delete1(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+	struct AddressRec *arec;
+	int i = 0;
+
+	/* drop every third mask, lookups must still agree */
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, address_conf_list.head)
+	{
+		arec = ptr->data;
+		if(arec->type == CONF_CLIENT)
+			continue;
+		if(i++ % 3 == 0)
+			delete_one_address_conf(arec->aconf->host, arec->aconf);
+	}
+
+	compare1();
+}
+
+static double
+time_lookups(void)
+{
+	struct rb_sockaddr_storage addrs[256];
+	struct timespec start;
+	unsigned int hits = 0;
+	int i;
+
+	for(i = 0; i < 256; i++)
+		probe_addr(&addrs[i], i & 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < LOOKUPS; i++)
+	{
+		if(find_conf_by_address(NULL, NULL, NULL, (struct sockaddr *)&addrs[i & 255],
+				CONF_KILL, GET_SS_FAMILY(&addrs[i & 255]), "user", NULL) != NULL)
+			hits++;
+	}
+	ok(hits > 0, MSG);
+
+	return ircd_util_elapsed_ns(&start);
+}
+
+static double
+time_host_lookups(void)
+{
+	char hosts[256][HOSTLEN + 1];
+	struct timespec start;
+	unsigned int hits = 0;
+	int i;
+
+	for(i = 0; i < 256; i++)
+		random_host(hosts[i], sizeof hosts[i]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < LOOKUPS; i++)
+	{
+		if(find_conf_by_address(hosts[i & 255], "192.0.2.1", NULL, NULL,
+				CONF_KILL, AF_INET, "user", NULL) != NULL)
+			hits++;
+	}
+	ok(hits > 0, MSG);
+
+	return ircd_util_elapsed_ns(&start);
+}
+
+static void
+bench1(void)
+{
+	diag("K-line lookup with %lu masks: %.1f ns/op",
+		rb_dlink_list_length(&address_conf_list), time_lookups() / LOOKUPS);
+	diag("hostname K-line lookup with %d hostname masks: %.1f ns/op",
+		NHOSTS, time_host_lookups() / LOOKUPS);
+}
+
+static void
+clear1(void)
+{
+	rb_dlink_node *ptr;
+	struct AddressRec *arec;
+	int bans = 0;
+
+	clear_out_address_conf_bans();
+
+	RB_DLINK_FOREACH(ptr, address_conf_list.head)
+	{
+		arec = ptr->data;
+		if(arec->type != CONF_CLIENT && arec->type != CONF_EXEMPTDLINE)
+			bans++;
+	}
+	is_int(0, bans, MSG);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+
+	load_masks();
+	compare1();
+	cidr1();
+	bench1();
+	delete1();
+	clear1();
+
+	ircd_util_free();
+	return 0;
+}
@@ -114,3 +114,20 @@ void ircd_util_reload_module(const char *name)
 void ircd_util_free(void)
 {
 }
+
+/* the same sequence every run, so failures can be reproduced */
+unsigned int ircd_util_rand(void)
+{
+	static unsigned int seed = 1;
+
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+double ircd_util_elapsed_ns(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "stdinc.h"
 #include "ircd_defs.h"
@@ -31,3 +32,6 @@
 void ircd_util_init(const char *name);
 void ircd_util_reload_module(const char *name);
 void ircd_util_free(void);
+
+unsigned int ircd_util_rand(void);
+double ircd_util_elapsed_ns(const struct timespec *start);
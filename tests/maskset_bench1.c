@@ -0,0 +1,354 @@
+/*
+ *  maskset_bench1.c: Check and time X-line and RESV lookups with many masks
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+
+#include "client.h"
+#include "maskset.h"
+#include "match.h"
+#include "operhash.h"
+#include "s_conf.h"
+#include "s_newconf.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NXLINES 30000
+#define NRESVS 20000
+#define NPROBES 2000
+#define LOOKUPS 20000
+
+static const char *words[] = {
+	"bot", "spam", "free", "porn", "warez", "casino", "crypto", "Drone",
+	"proxy", "flood", "clone", "abuse", "troll", "john", "smith", "irc",
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+static struct ConfItem *
+add_conf(const char *mask, int status, rb_dlink_list *list)
+{
+	struct ConfItem *aconf = make_conf();
+
+	aconf->status = status;
+	aconf->host = rb_strdup(mask);
+	aconf->passwd = rb_strdup("test");
+	aconf->info.oper = operhash_add("tester");
+	rb_dlinkAddTailAlloc(aconf, list);
+	return aconf;
+}
+
+static void
+random_gecos_mask(char *buf, size_t len)
+{
+	unsigned int n = ircd_util_rand() % 5000;
+	const char *w = words[ircd_util_rand() % NWORDS];
+
+	switch(ircd_util_rand() % 10)
+	{
+	case 0:
+		snprintf(buf, len, "*%s*%u*", w, n);
+		break;
+	case 1:
+		snprintf(buf, len, "%s?%u", w, n);
+		break;
+	case 2:
+		snprintf(buf, len, "*\\s%s%u\\s*", w, n);
+		break;
+	case 3:
+		snprintf(buf, len, "%s###%u*", w, n % 10);
+		break;
+	case 4:
+		snprintf(buf, len, "*\\*%s%u*", w, n);
+		break;
+	default:
+		snprintf(buf, len, "*%s%u*", w, n);
+		break;
+	}
+}
+
+static void
+random_gecos(char *buf, size_t len)
+{
+	unsigned int n = ircd_util_rand() % 5000;
+	const char *w = words[ircd_util_rand() % NWORDS];
+
+	switch(ircd_util_rand() % 6)
+	{
+	case 0:
+		snprintf(buf, len, "I am a %s%u bot", w, n);
+		break;
+	case 1:
+		snprintf(buf, len, "%sx%u", w, n);
+		break;
+	case 2:
+		snprintf(buf, len, "%s123%u", w, n % 10);
+		break;
+	case 3:
+		snprintf(buf, len, "a *%s%u b", w, n);
+		break;
+	case 4:
+		snprintf(buf, len, "%s", w);
+		break;
+	default:
+		snprintf(buf, len, "Just a regular user %u", n);
+		break;
+	}
+}
+
+static void
+random_nick_mask(char *buf, size_t len)
+{
+	unsigned int n = ircd_util_rand() % 5000;
+	const char *w = words[ircd_util_rand() % NWORDS];
+
+	switch(ircd_util_rand() % 4)
+	{
+	case 0:
+		snprintf(buf, len, "%s%u*", w, n);
+		break;
+	case 1:
+		snprintf(buf, len, "*%s%u", w, n);
+		break;
+	case 2:
+		snprintf(buf, len, "%s?%u", w, n);
+		break;
+	default:
+		snprintf(buf, len, "%s%u", w, n);
+		break;
+	}
+}
+
+static void
+random_nick(char *buf, size_t len)
+{
+	snprintf(buf, len, "%s%s%u", ircd_util_rand() % 2 ? "" : "x",
+			words[ircd_util_rand() % NWORDS], ircd_util_rand() % 5000);
+}
+
+static void
+load_masks(void)
+{
+	char buf[BUFSIZE];
+	int i;
+
+	for(i = 0; i < NXLINES; i++)
+	{
+		random_gecos_mask(buf, sizeof buf);
+		add_conf(buf, CONF_XLINE, &xline_conf_list);
+	}
+	/* these match everything, but only after all of the above */
+	add_conf("*", CONF_XLINE, &xline_conf_list);
+	xline_conf_changed();
+
+	for(i = 0; i < NRESVS; i++)
+	{
+		random_nick_mask(buf, sizeof buf);
+		add_conf(buf, CONF_RESV_NICK, &resv_conf_list);
+	}
+	resv_conf_changed();
+}
+
+/* the old way: look at every mask, the first one wins */
+static struct ConfItem *
+brute_find(rb_dlink_list *list, const char *name)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		struct ConfItem *aconf = ptr->data;
+
+		if(match_esc(aconf->host, name))
+			return aconf;
+	}
+	return NULL;
+}
+
+static void
+compare1(void)
+{
+	char buf[BUFSIZE];
+	struct ConfItem *aconf, *expect;
+	int i, mismatch = 0, found = 0, catchall = 0;
+
+	for(i = 0; i < NPROBES; i++)
+	{
+		random_gecos(buf, sizeof buf);
+		aconf = find_xline(buf, 0);
+		expect = brute_find(&xline_conf_list, buf);
+		if(aconf != expect)
+			mismatch++;
+		if(aconf != NULL && strcmp(aconf->host, "*"))
+			found++;
+		else
+			catchall++;
+	}
+	is_int(0, mismatch, MSG);
+	ok(found > NPROBES / 4, MSG);
+	ok(catchall > 0, MSG);
+
+	mismatch = found = 0;
+	for(i = 0; i < NPROBES; i++)
+	{
+		random_nick(buf, sizeof buf);
+		aconf = find_nick_resv(buf);
+		expect = brute_find(&resv_conf_list, buf);
+		if(aconf != expect)
+			mismatch++;
+		if(aconf != NULL)
+			found++;
+	}
+	is_int(0, mismatch, MSG);
+	ok(found > NPROBES / 10, MSG);
+}
+
+static void
+counter1(void)
+{
+	struct ConfItem *aconf;
+	int port;
+
+	aconf = find_xline("I am a bot4242 bot", 0);
+	ok(aconf != NULL, MSG);
+	port = aconf->port;
+	ok(find_xline("I am a bot4242 bot", 0) == aconf, MSG);
+	is_int(port, aconf->port, MSG);
+	ok(find_xline("I am a bot4242 bot", 1) == aconf, MSG);
+	is_int(port + 1, aconf->port, MSG);
+
+	aconf = add_conf("counter1", CONF_RESV_NICK, &resv_conf_list);
+	resv_conf_changed();
+	ok(find_nick_resv("COUNTER1") == aconf, MSG);
+	ok(find_nick_resv("counter1") == aconf, MSG);
+	is_int(2, aconf->port, MSG);
+
+	/* removing it rebuilds the set */
+	rb_dlinkFindDestroy(aconf, &resv_conf_list);
+	resv_conf_changed();
+	free_conf(aconf);
+	ok(find_nick_resv("counter1") == NULL, MSG);
+}
+
+static void
+syntax1(void)
+{
+	struct MaskSet *set = maskset_create(MASKSET_MATCH);
+	char a, b, c, d, e;
+
+	maskset_add(set, "*!*@*.example.com", &a);
+	maskset_add(set, "nick!*@*", &b);
+	maskset_add(set, "*!~*@*", &c);
+	maskset_add(set, "*@#*", &d);
+	maskset_add(set, "*", &e);
+
+	ok(maskset_find(set, "foo!bar@host.EXAMPLE.com") == &a, MSG);
+	ok(maskset_find(set, "NICK!bar@host.example.org") == &b, MSG);
+	ok(maskset_find(set, "x!~bar@host.example.org") == &c, MSG);
+	/* '#' is a literal here */
+	ok(maskset_find(set, "x!y@#z") == &d, MSG);
+	ok(maskset_find(set, "x!y@1z") == &e, MSG);
+	is_int(5, maskset_size(set), MSG);
+
+	maskset_clear(set);
+	ok(maskset_find(set, "x!y@1z") == NULL, MSG);
+	maskset_add(set, "x!y@?z", &a);
+	ok(maskset_find(set, "x!y@1z") == &a, MSG);
+
+	maskset_destroy(set);
+
+	set = maskset_create(MASKSET_MATCH_ESC);
+	maskset_add(set, "a\\*b", &a);
+	maskset_add(set, "*\\sc", &b);
+	maskset_add(set, "@#", &c);
+	ok(maskset_find(set, "a*b") == &a, MSG);
+	ok(maskset_find(set, "axb") == NULL, MSG);
+	ok(maskset_find(set, "x c") == &b, MSG);
+	ok(maskset_find(set, "z9") == &c, MSG);
+	ok(maskset_find(set, "99") == NULL, MSG);
+	maskset_destroy(set);
+}
+
+static double
+time_lookups(struct ConfItem *(*find)(rb_dlink_list *, const char *), rb_dlink_list *list,
+		char (*names)[BUFSIZE], int count)
+{
+	struct timespec start;
+	unsigned int hits = 0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < count; i++)
+	{
+		if(find(list, names[i & 255]) != NULL)
+			hits++;
+	}
+	ok(hits > 0, MSG);
+
+	return ircd_util_elapsed_ns(&start) / count;
+}
+
+static struct ConfItem *
+set_find(rb_dlink_list *list, const char *name)
+{
+	return list == &xline_conf_list ? find_xline(name, 0) : find_nick_resv(name);
+}
+
+static void
+bench1(void)
+{
+	static char names[256][BUFSIZE];
+	double tset, tlist;
+	int i;
+
+	/* the list is slow enough to only need a few rounds */
+	for(i = 0; i < 256; i++)
+		random_gecos(names[i], sizeof names[i]);
+	tset = time_lookups(set_find, &xline_conf_list, names, LOOKUPS);
+	tlist = time_lookups(brute_find, &xline_conf_list, names, 256);
+	diag("X-line lookup with %d masks: mask set %.1f ns/op, list %.1f ns/op",
+		NXLINES + 1, tset, tlist);
+
+	for(i = 0; i < 256; i++)
+		random_nick(names[i], sizeof names[i]);
+	tset = time_lookups(set_find, &resv_conf_list, names, LOOKUPS);
+	tlist = time_lookups(brute_find, &resv_conf_list, names, 256);
+	diag("RESV lookup with %d masks: mask set %.1f ns/op, list %.1f ns/op",
+		NRESVS, tset, tlist);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+
+	syntax1();
+	load_masks();
+	compare1();
+	counter1();
+	bench1();
+
+	ircd_util_free();
+	return 0;
+}
@@ -0,0 +1,508 @@
+/*
+ *  match_bench1.c: Check and time the wildcard matchers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+
+#include "match.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NRANDOM 200000
+#define NNAMES 256
+#define ROUNDS 200
+
+/* the backtracking matchers match.c used to have, for comparison */
+static int
+old_match(const char *mask, const char *name)
+{
+	const char *m = mask, *n = name;
+	const char *m_tmp = mask, *n_tmp = name;
+	int star_p;
+
+	for (;;)
+	{
+		switch (*m)
+		{
+		  case '\0':
+			  if (!*n)
+				  return 1;
+		  backtrack:
+			  if (m_tmp == mask)
+				  return 0;
+			  m = m_tmp;
+			  n = ++n_tmp;
+			  break;
+		  case '*':
+		  case '?':
+			  for (star_p = 0;; m++)
+			  {
+				  if (*m == '*')
+					  star_p = 1;
+				  else if (*m == '?')
+				  {
+					  if (!*n++)
+						  goto backtrack;
+				  }
+				  else
+					  break;
+			  }
+			  if (star_p)
+			  {
+				  if (!*m)
+					  return 1;
+				  else
+				  {
+					  m_tmp = m;
+					  for (n_tmp = n; *n && irctolower(*n) != irctolower(*m); n++);
+				  }
+			  }
+			  /* FALLTHROUGH */
+		  default:
+			  if (!*n)
+				  return (*m != '\0' ? 0 : 1);
+			  if (irctolower(*m) != irctolower(*n))
+				  goto backtrack;
+			  m++;
+			  n++;
+			  break;
+		}
+	}
+}
+
+static int
+old_match_esc(const char *mask, const char *name)
+{
+	const unsigned char *m = (const unsigned char *)mask;
+	const unsigned char *n = (const unsigned char *)name;
+	const unsigned char *ma = (const unsigned char *)mask;
+	const unsigned char *na = (const unsigned char *)name;
+	int wild = 0;
+	int calls = 0;
+	int quote = 0;
+	int match1 = 0;
+
+	if((*m == '*') && (*(m + 1) == '\0'))
+		return 1;
+
+	while(calls++ < 512)
+	{
+		if(quote)
+			quote++;
+		if(quote == 3)
+			quote = 0;
+		if(*m == '\\' && !quote)
+		{
+			m++;
+			quote = 1;
+			continue;
+		}
+		if(!quote && *m == '*')
+		{
+			while(*m == '*')
+				m++;
+
+			wild = 1;
+			ma = m;
+			na = n;
+
+			if(*m == '\\')
+			{
+				m++;
+				if(!*m)
+					return 0;
+				quote++;
+				continue;
+			}
+		}
+
+		if(!*m)
+		{
+			if(!*n)
+				return 1;
+			if(quote)
+				return 0;
+			for(m--; (m > (const unsigned char *)mask) && (*m == '?'); m--)
+				;
+
+			if(*m == '*' && (m > (const unsigned char *)mask))
+				return 1;
+			if(!wild)
+				return 0;
+			m = ma;
+			n = ++na;
+		}
+		else if(!*n)
+		{
+			if(quote)
+				return 0;
+			while(*m == '*')
+				m++;
+			return (*m == 0);
+		}
+
+		if(quote)
+			match1 = *m == 's' ? *n == ' ' : irctolower(*m) == irctolower(*n);
+		else if(*m == '?')
+			match1 = 1;
+		else if(*m == '@')
+			match1 = IsLetter(*n);
+		else if(*m == '#')
+			match1 = IsDigit(*n);
+		else
+			match1 = irctolower(*m) == irctolower(*n);
+		if(match1)
+		{
+			if(*m)
+				m++;
+			if(*n)
+				n++;
+		}
+		else
+		{
+			if(!wild)
+				return 0;
+			m = ma;
+			n = ++na;
+		}
+	}
+	return 0;
+}
+
+/* what the masks mean, slowly */
+static int
+ref_match(const char *m, const char *n, int syntax)
+{
+	int len = 1, ret;
+
+	if(*m == '\0')
+		return *n == '\0';
+
+	if(*m == '*')
+	{
+		for(;; n++)
+		{
+			if(ref_match(m + 1, n, syntax))
+				return 1;
+			if(*n == '\0')
+				return 0;
+		}
+	}
+
+	if(*n == '\0')
+		return 0;
+
+	if(*m == '?')
+		ret = syntax != MATCH_MASK || *n != '*';
+	else if(syntax == MATCH_ESC && *m == '@')
+		ret = IsLetter(*n);
+	else if(syntax == MATCH_ESC && *m == '#')
+		ret = IsDigit(*n);
+	else if(syntax == MATCH_ESC && *m == '\\')
+	{
+		if(m[1] == '\0')
+			return 0;
+		ret = m[1] == 's' ? *n == ' ' : irctolower(m[1]) == irctolower(*n);
+		len = 2;
+	}
+	else
+		ret = irctolower(*m) == irctolower(*n);
+
+	return ret && ref_match(m + len, n + 1, syntax);
+}
+
+/* every pair of bytes folds the same way as before */
+static void
+fold1(void)
+{
+	char mask[4], name[4];
+	int a, b, bad = 0, bad_compiled = 0;
+	struct match_pattern *pat;
+
+	for(a = 1; a < 256; a++)
+	{
+		snprintf(mask, sizeof mask, "*%c*", a);
+		pat = match_compile(mask, MATCH_GLOB);
+
+		for(b = 1; b < 256; b++)
+		{
+			snprintf(name, sizeof name, "%c", b);
+			if(match(mask + 1, name) != old_match(mask + 1, name))
+				bad++;
+			if(match_compiled(pat, name) != old_match(mask, name))
+				bad_compiled++;
+		}
+
+		match_free(pat);
+	}
+	is_int(0, bad, MSG);
+	is_int(0, bad_compiled, MSG);
+}
+
+static void
+random_string(char *buf, int maxlen, const char *chars)
+{
+	int len = ircd_util_rand() % (maxlen + 1), i;
+	size_t nchars = strlen(chars);
+
+	for(i = 0; i < len; i++)
+		buf[i] = chars[ircd_util_rand() % nchars];
+	buf[i] = '\0';
+}
+
+/* match() does what it did, mask_match() and match_esc() had some
+ * mistakes when backtracking, so they are checked against what the
+ * masks mean */
+static void
+compare1(void)
+{
+	static const char mask_chars[] = "aAbB[{*?*?.";
+	static const char esc_chars[] = "aAbsS 1*?@#\\.";
+	static const char name_chars[] = "aAbB[{*.";
+	static const char esc_name_chars[] = "aAbsS 1*.";
+	struct match_pattern *pat;
+	char mask[16], name[16];
+	int i, bad_glob = 0, bad_mask = 0, bad_esc = 0, bad_compiled = 0, matched = 0;
+
+	for(i = 0; i < NRANDOM; i++)
+	{
+		random_string(mask, 10, mask_chars);
+		random_string(name, 10, name_chars);
+
+		if(match(mask, name) != old_match(mask, name))
+		{
+			if(bad_glob++ == 0)
+				diag("match(\"%s\", \"%s\")", mask, name);
+		}
+		if(old_match(mask, name) != ref_match(mask, name, MATCH_GLOB))
+			bad_glob++;
+		if(mask_match(mask, name) != ref_match(mask, name, MATCH_MASK))
+		{
+			if(bad_mask++ == 0)
+				diag("mask_match(\"%s\", \"%s\")", mask, name);
+		}
+		if(old_match(mask, name))
+			matched++;
+
+		pat = match_compile(mask, MATCH_GLOB);
+		if(match_compiled(pat, name) != old_match(mask, name))
+			bad_compiled++;
+		match_free(pat);
+
+		random_string(mask, 10, esc_chars);
+		random_string(name, 10, esc_name_chars);
+		if(match_esc(mask, name) != ref_match(mask, name, MATCH_ESC))
+		{
+			if(bad_esc++ == 0)
+				diag("match_esc(\"%s\", \"%s\")", mask, name);
+		}
+
+		pat = match_compile(mask, MATCH_ESC);
+		if(match_compiled(pat, name) != ref_match(mask, name, MATCH_ESC))
+			bad_compiled++;
+		match_free(pat);
+	}
+	is_int(0, bad_glob, MSG);
+	is_int(0, bad_mask, MSG);
+	is_int(0, bad_esc, MSG);
+	is_int(0, bad_compiled, MSG);
+	ok(matched > NRANDOM / 100, MSG);
+}
+
+static void
+syntax1(void)
+{
+	ok(match("*", ""), MSG);
+	ok(!match("", "a"), MSG);
+	ok(match("", ""), MSG);
+	ok(match("*!*@*.Example.COM", "nick!user@host.example.com"), MSG);
+	ok(!match("*!*@*.example.com", "nick!user@example.com"), MSG);
+	ok(match("nick*", "NICKNAME"), MSG);
+	ok(match("a*b*c", "abc"), MSG);
+	ok(!match("a*b*c", "acb"), MSG);
+	ok(match("?*?", "ab"), MSG);
+	ok(!match("?*?", "a"), MSG);
+	ok(match("[foo]*", "{FOO}bar"), MSG);
+
+	ok(mask_match("*!*@*", "*!*@*"), MSG);
+	ok(!mask_match("?!*@*", "*!*@*"), MSG);
+	ok(mask_match("*!*@*", "nick!*@?.com"), MSG);
+
+	ok(match_esc("*", "anything"), MSG);
+	ok(match_esc("a\\sb", "a b"), MSG);
+	ok(!match_esc("a\\sb", "asb"), MSG);
+	ok(match_esc("a\\*b", "a*b"), MSG);
+	ok(!match_esc("a\\*b", "axb"), MSG);
+	ok(match_esc("@#", "x9"), MSG);
+	ok(!match_esc("@#", "99"), MSG);
+	ok(match_esc("\\@\\#", "@#"), MSG);
+	ok(!match_esc("a\\", "a"), MSG);
+
+	/* masks longer than the stack buffer */
+	{
+		char mask[300], name[300];
+
+		memset(mask, 'x', sizeof mask - 1);
+		mask[sizeof mask - 1] = '\0';
+		mask[100] = '*';
+		mask[200] = '?';
+		strcpy(name, mask);
+		name[100] = 'y';
+		name[200] = 'z';
+		ok(match(mask, name), MSG);
+		name[150] = 'y';
+		ok(!match(mask, name), MSG);
+	}
+}
+
+/* the old matchers used to give up on long strings */
+static void
+long1(void)
+{
+	char name[1200];
+
+	memset(name, 'a', sizeof name - 1);
+	name[sizeof name - 1] = '\0';
+	name[sizeof name - 2] = 'b';
+
+	ok(match_esc("*a*a*a*b", name), MSG);
+	ok(!old_match_esc("*a*a*a*b", name), MSG);
+}
+
+struct shape
+{
+	const char *desc;
+	const char *mask;
+	int syntax;
+};
+
+static const struct shape shapes[] = {
+	{ "*!*@host suffix", "*!*@*.users.example.net", MATCH_GLOB },
+	{ "nick prefix", "guest*", MATCH_GLOB },
+	{ "ident", "*!~*@*", MATCH_GLOB },
+	{ "IP prefix", "*@192.168.*", MATCH_GLOB },
+	{ "substring", "*spam*", MATCH_GLOB },
+	{ "'?' nick", "guest???" "?!*@*", MATCH_GLOB },
+	{ "several runs", "*!*bot*@*.ip*.example.*", MATCH_GLOB },
+	{ "gecos", "*\\sfree\\s*", MATCH_ESC },
+	{ "gecos digits", "*bot###*", MATCH_ESC },
+};
+#define NSHAPES (sizeof(shapes) / sizeof(shapes[0]))
+
+static void
+random_name(char *buf, size_t len, int gecos)
+{
+	static const char *nicks[] = { "Guest", "alice", "bob", "SpamBot", "jilles", "Drone" };
+	static const char *hosts[] = {
+		"%u.users.example.net", "cpe-%u.ip42.EXAMPLE.com", "192.168.%u.7",
+		"2001:db8::%x", "gateway/web/irccloud.com/x-%u",
+	};
+	unsigned int n = ircd_util_rand() % 100000;
+	const char *nick = nicks[ircd_util_rand() % 6];
+	char host[64];
+
+	if(gecos)
+	{
+		switch(ircd_util_rand() % 4)
+		{
+		case 0:
+			snprintf(buf, len, "%s the free bot%u", nick, n);
+			break;
+		case 1:
+			snprintf(buf, len, "%s", nick);
+			break;
+		default:
+			snprintf(buf, len, "Just some user from the free world %u", n);
+			break;
+		}
+		return;
+	}
+
+	snprintf(host, sizeof host, hosts[ircd_util_rand() % 5], n);
+	snprintf(buf, len, "%s%u!%s%s@%s", nick, n % 10000,
+		ircd_util_rand() % 2 ? "~" : "", nick, host);
+}
+
+static void
+bench1(void)
+{
+	static char names[NNAMES][BUFSIZE];
+	struct match_pattern *pat;
+	struct timespec start;
+	double told, tnew, tcompiled;
+	unsigned int i, r, n, hits_old, hits_new, hits_compiled;
+	int (*oldfn)(const char *, const char *);
+	int (*newfn)(const char *, const char *);
+
+	for(i = 0; i < NSHAPES; i++)
+	{
+		const struct shape *s = &shapes[i];
+
+		oldfn = s->syntax == MATCH_ESC ? old_match_esc : old_match;
+		newfn = s->syntax == MATCH_ESC ? match_esc : match;
+
+		for(n = 0; n < NNAMES; n++)
+			random_name(names[n], sizeof names[n], s->syntax == MATCH_ESC);
+
+		hits_old = hits_new = hits_compiled = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(r = 0; r < ROUNDS; r++)
+			for(n = 0; n < NNAMES; n++)
+				hits_old += oldfn(s->mask, names[n]);
+		told = ircd_util_elapsed_ns(&start) / (NNAMES * ROUNDS);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(r = 0; r < ROUNDS; r++)
+			for(n = 0; n < NNAMES; n++)
+				hits_new += newfn(s->mask, names[n]);
+		tnew = ircd_util_elapsed_ns(&start) / (NNAMES * ROUNDS);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		pat = match_compile(s->mask, s->syntax);
+		for(r = 0; r < ROUNDS; r++)
+			for(n = 0; n < NNAMES; n++)
+				hits_compiled += match_compiled(pat, names[n]);
+		match_free(pat);
+		tcompiled = ircd_util_elapsed_ns(&start) / (NNAMES * ROUNDS);
+
+		is_int(hits_old, hits_new, MSG);
+		is_int(hits_old, hits_compiled, MSG);
+		diag("%-16s %-26s old %5.1f ns, match %5.1f ns, compiled %5.1f ns (%u%% hit)",
+			s->desc, s->mask, told, tnew, tcompiled, hits_old * 100 / (NNAMES * ROUNDS));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	fold1();
+	syntax1();
+	compare1();
+	long1();
+	bench1();
+
+	return 0;
+}
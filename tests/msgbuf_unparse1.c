@@ -2799,11 +2799,50 @@ static void para_no_origin_no_cmd_no_target(void)
 	}
 }
 
+static void cache_shared_capsets(void)
+{
+	const struct MsgBuf msgbuf = {
+		.n_tags = 2,
+		.tags = {
+			{ .key = "tag1", .value = "value1", .capmask = 1 },
+			{ .key = "tag2", .value = "value2", .capmask = 2 },
+		},
+	};
+	const rb_strf_t message = { .format = ":origin PRIVMSG #test :test", .format_args = NULL, .next = NULL };
+	struct MsgBuf_cache cache;
+	buf_head_t *linebuf1, *linebuf2;
+	char output[OUTPUT_BUFSIZE];
+
+	msgbuf_cache_init(&cache, &msgbuf, &message);
+
+	/* caps that don't select any tag produce the same line */
+	linebuf1 = msgbuf_cache_get(&cache, 1);
+	linebuf2 = msgbuf_cache_get(&cache, 1 | 4 | 8);
+	ok(linebuf1 == linebuf2, MSG);
+
+	linebuf1 = msgbuf_cache_get(&cache, 0);
+	linebuf2 = msgbuf_cache_get(&cache, 16);
+	ok(linebuf1 == linebuf2, MSG);
+
+	linebuf2 = msgbuf_cache_get(&cache, 1 | 2 | 32);
+	ok(linebuf1 != linebuf2, MSG);
+
+	if (is_int(54, rb_linebuf_get(linebuf2, output, sizeof(output), 0, 1), MSG)) {
+		output[54] = '\0';
+		is_string("@tag1=value1;tag2=value2 :origin PRIVMSG #test :test\r\n", output, MSG);
+	}
+
+	msgbuf_cache_free(&cache);
+}
+
 int main(int argc, char *argv[])
 {
 	memset(&me, 0, sizeof(me));
 	strcpy(me.name, "me.name.");
 
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
 	plan_lazy();
 
 	is_int(512, TAGSLEN, MSG);
@@ -2943,6 +2982,8 @@ int main(int argc, char *argv[])
 	para_no_cmd_no_target();
 	para_no_origin_no_cmd_no_target();
 
+	cache_shared_capsets();
+
 	// TODO msgbuf_vunparse_fmt
 
 	return 0;
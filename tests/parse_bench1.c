@@ -0,0 +1,200 @@
+/*
+ *  parse_bench1.c: Test and time command dispatch in parse()
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "msg.h"
+#include "parse.h"
+#include "modules.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define LOOKUPS 2000000
+#define PARSES 200000
+
+/* a typical mix of verbs, core ones first */
+static const char *verbs[] = {
+	"PRIVMSG", "PRIVMSG", "PRIVMSG", "PRIVMSG", "NOTICE", "PING", "PONG",
+	"JOIN", "PART", "MODE", "WHO", "NICK", "QUIT", "privmsg", "MOTD",
+};
+
+static double
+elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* parse() wants a connected client, replies come out at *peer */
+static struct Client *
+make_connected_person(rb_fde_t **peer)
+{
+	struct Client *user = make_local_person();
+	rb_fde_t *F;
+
+	if (!ok(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &F, peer, "parse_bench1") == 0, MSG))
+		exit(1);
+
+	user->localClient->F = F;
+	return user;
+}
+
+static const char *
+get_peer_reply(rb_fde_t *peer)
+{
+	static char buf[BUFSIZE];
+	ssize_t len;
+
+	len = rb_read(peer, buf, sizeof(buf) - 1);
+	buf[len > 0 ? len : 0] = '\0';
+	return buf;
+}
+
+static void
+lookup1(void)
+{
+	struct Message *mptr = find_command("PRIVMSG");
+
+	ok(mptr != NULL, MSG);
+	ok(mptr == rb_dictionary_retrieve(cmd_dict, "PRIVMSG"), MSG);
+	ok(mptr == find_command("privmsg"), MSG);
+	ok(mptr == find_command("PrivMsg"), MSG);
+
+	/* not a core verb, served from cmd_dict */
+	ok(find_command("MOTD") != NULL, MSG);
+	ok(find_command("MOTD") == rb_dictionary_retrieve(cmd_dict, "MOTD"), MSG);
+
+	/* close to core verbs but unknown */
+	ok(find_command("PRIVMSGX") == NULL, MSG);
+	ok(find_command("PIN") == NULL, MSG);
+	ok(find_command("P") == NULL, MSG);
+	ok(find_command("") == NULL, MSG);
+}
+
+static void
+reload1(void)
+{
+	rb_fde_t *peer;
+	struct Client *user = make_connected_person(&peer);
+	struct Message *before = find_command("PING");
+
+	ok(before != NULL, MSG);
+
+	if (ok(unload_one_module("m_ping", false), MSG))
+	{
+		ok(find_command("PING") == NULL, MSG);
+		ok(load_one_module("m_ping", MAPI_ORIGIN_CORE, false), MSG);
+	}
+
+	ok(find_command("PING") != NULL, MSG);
+	ok(find_command("PING") == rb_dictionary_retrieve(cmd_dict, "PING"), MSG);
+
+	client_util_parse(user, "PING :test" CRLF);
+	is_string(":me.test PONG me.test :test" CRLF, get_peer_reply(peer), MSG);
+
+	remove_local_person(user);
+	rb_close(peer);
+}
+
+static void
+bench1(void)
+{
+	struct timespec start, end;
+	const size_t nverbs = ARRAY_SIZE(verbs);
+	unsigned int seed = 1, hits = 0;
+	double tdict, tfast;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < LOOKUPS; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		if (rb_dictionary_retrieve(cmd_dict, verbs[(seed >> 16) % nverbs]) != NULL)
+			hits++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	tdict = elapsed_ns(&start, &end);
+	is_int(LOOKUPS, hits, MSG);
+
+	seed = 1;
+	hits = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < LOOKUPS; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		if (find_command(verbs[(seed >> 16) % nverbs]) != NULL)
+			hits++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	tfast = elapsed_ns(&start, &end);
+	is_int(LOOKUPS, hits, MSG);
+
+	diag("command lookup: cmd_dict %.1f ns/op, find_command %.1f ns/op",
+		tdict / LOOKUPS, tfast / LOOKUPS);
+}
+
+static void
+bench2(void)
+{
+	rb_fde_t *peer;
+	struct Client *user = make_connected_person(&peer);
+	struct timespec start, end;
+	char line[64];
+	int i;
+
+	/* PONG from a registered client is dispatched and then ignored */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < PARSES; i++)
+	{
+		strcpy(line, "PONG :me.test");
+		parse(user, line, line + strlen(line));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	is_string("", get_client_sendq(user), MSG);
+	is_string("", get_peer_reply(peer), MSG);
+	diag("parse: %.1f ns/line", elapsed_ns(&start, &end) / PARSES);
+
+	remove_local_person(user);
+	rb_close(peer);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	lookup1();
+	reload1();
+	bench1();
+	bench2();
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
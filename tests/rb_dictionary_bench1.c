@@ -0,0 +1,222 @@
+/*
+ *  rb_dictionary_bench1.c: Compare the splay and hashed rb_dictionary backends
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "rb_dictionary.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NKEYS 5000
+#define LOOKUPS 2000000
+
+/* a typical mix of client commands, as parse() sees them */
+static const char *commands[] = {
+	"PRIVMSG", "NOTICE", "PING", "PONG", "JOIN", "PART", "MODE", "WHO",
+	"WHOIS", "NICK", "QUIT", "TOPIC", "AWAY", "CAP", "USER", "NAMES",
+	"KICK", "INVITE", "LIST", "ISON", "USERHOST", "MONITOR", "AUTHENTICATE",
+	"OPER", "KILL", "STATS", "LINKS", "MOTD", "LUSERS", "VERSION", "ADMIN",
+	"INFO", "TIME", "TRACE", "HELP", "KLINE", "UNKLINE", "DLINE", "UNDLINE",
+	"XLINE", "UNXLINE", "RESV", "UNRESV", "WALLOPS", "OPERWALL", "REHASH",
+	"CONNECT", "SQUIT", "MAP", "TESTLINE", "TESTMASK", "ETRACE", "CHANTRACE",
+	"MASKTRACE", "SCAN", "KNOCK", "ACCEPT", "HELP", "CHALLENGE", "SASL",
+};
+
+static char keys[NKEYS][16];
+
+static void
+check_same(rb_dictionary *splay, rb_dictionary *hashed)
+{
+	rb_dictionary_iter a, b;
+	void *da, *db;
+	int i, found = 0, mismatch = 0;
+
+	for(i = 0; i < NKEYS; i++)
+	{
+		da = rb_dictionary_retrieve(splay, keys[i]);
+		db = rb_dictionary_retrieve(hashed, keys[i]);
+		if(da != db)
+			mismatch++;
+		if(da != NULL)
+			found++;
+	}
+	is_int(0, mismatch, MSG);
+	is_int(rb_dictionary_size(splay), found, MSG);
+	is_int(rb_dictionary_size(splay), rb_dictionary_size(hashed), MSG);
+
+	/* both iterate in comparator order */
+	mismatch = 0;
+	rb_dictionary_foreach_start(splay, &a);
+	rb_dictionary_foreach_start(hashed, &b);
+	while(1)
+	{
+		da = rb_dictionary_foreach_cur(splay, &a);
+		db = rb_dictionary_foreach_cur(hashed, &b);
+		if(da != db)
+			mismatch++;
+		if(da == NULL || db == NULL)
+			break;
+		rb_dictionary_foreach_next(splay, &a);
+		rb_dictionary_foreach_next(hashed, &b);
+	}
+	is_int(0, mismatch, MSG);
+}
+
+static void
+same1(void)
+{
+	rb_dictionary *splay = rb_dictionary_create("same1 splay", rb_strcasecmp);
+	rb_dictionary *hashed = rb_dictionary_create_hashed("same1 hash", rb_strcasecmp, rb_dictionary_strcase_hash);
+	char upper[16];
+	int i;
+
+	for(i = 0; i < NKEYS; i++)
+		snprintf(keys[i], sizeof(keys[i]), "Key%d", i * 7919);
+
+	for(i = 0; i < NKEYS; i++)
+	{
+		rb_dictionary_add(splay, keys[i], keys[i]);
+		rb_dictionary_add(hashed, keys[i], keys[i]);
+	}
+	check_same(splay, hashed);
+
+	/* case insensitive lookups must hit the same entry */
+	snprintf(upper, sizeof(upper), "KEY%d", 42 * 7919);
+	is_string(keys[42], rb_dictionary_retrieve(hashed, upper), MSG);
+
+	for(i = 0; i < NKEYS; i += 3)
+	{
+		ok(rb_dictionary_delete(splay, keys[i]) == rb_dictionary_delete(hashed, keys[i]), MSG);
+	}
+	check_same(splay, hashed);
+
+	ok(rb_dictionary_delete(hashed, keys[0]) == NULL, MSG);
+
+	for(i = 0; i < NKEYS; i += 3)
+	{
+		rb_dictionary_add(splay, keys[i], keys[i]);
+		rb_dictionary_add(hashed, keys[i], keys[i]);
+	}
+	check_same(splay, hashed);
+
+	rb_dictionary_destroy(splay, NULL, NULL);
+	rb_dictionary_destroy(hashed, NULL, NULL);
+}
+
+static void
+uint1(void)
+{
+	rb_dictionary *hashed = rb_dictionary_create_hashed("uint1", rb_uint32cmp, rb_dictionary_uint32_hash);
+	rb_dictionary_iter iter;
+	char buf[64];
+	const char *data;
+	uint32_t i;
+
+	for(i = 1; i <= 1000; i++)
+		rb_dictionary_add(hashed, RB_UINT_TO_POINTER(i), "x");
+
+	is_int(1000, rb_dictionary_size(hashed), MSG);
+	ok(rb_dictionary_retrieve(hashed, RB_UINT_TO_POINTER(500)) != NULL, MSG);
+	ok(rb_dictionary_retrieve(hashed, RB_UINT_TO_POINTER(1001)) == NULL, MSG);
+
+	for(i = 1; i <= 1000; i++)
+		rb_dictionary_delete(hashed, RB_UINT_TO_POINTER(i));
+	is_int(0, rb_dictionary_size(hashed), MSG);
+
+	rb_dictionary_destroy(hashed, NULL, NULL);
+
+	/* ordered iteration over string keys */
+	hashed = rb_dictionary_create_hashed("uint1 order", strcmp, rb_dictionary_str_hash);
+	rb_dictionary_add(hashed, "c", "c");
+	rb_dictionary_add(hashed, "a", "a");
+	rb_dictionary_add(hashed, "b", "b");
+	buf[0] = '\0';
+	RB_DICTIONARY_FOREACH(data, &iter, hashed)
+		rb_strlcat(buf, data, sizeof(buf));
+	is_string("abc", buf, MSG);
+	rb_dictionary_destroy(hashed, NULL, NULL);
+}
+
+static double
+time_lookups(rb_dictionary *dict)
+{
+	struct timespec start, end;
+	const size_t ncommands = sizeof(commands) / sizeof(commands[0]);
+	unsigned int seed = 1, hits = 0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < LOOKUPS; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		if(rb_dictionary_retrieve(dict, commands[(seed >> 16) % ncommands]) != NULL)
+			hits++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ok(hits == LOOKUPS, MSG);
+
+	return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+static void
+bench1(void)
+{
+	rb_dictionary *splay = rb_dictionary_create("bench1 splay", rb_strcasecmp);
+	rb_dictionary *hashed = rb_dictionary_create_hashed("bench1 hash", rb_strcasecmp, rb_dictionary_strcase_hash);
+	double tsplay, thash;
+	size_t i;
+
+	for(i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+	{
+		if(rb_dictionary_find(splay, commands[i]) != NULL)
+			continue;
+		rb_dictionary_add(splay, commands[i], (void *)commands[i]);
+		rb_dictionary_add(hashed, commands[i], (void *)commands[i]);
+	}
+
+	tsplay = time_lookups(splay);
+	thash = time_lookups(hashed);
+
+	diag("command lookup: splay %.1f ns/op, hash %.1f ns/op",
+		tsplay / LOOKUPS, thash / LOOKUPS);
+
+	rb_dictionary_destroy(splay, NULL, NULL);
+	rb_dictionary_destroy(hashed, NULL, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	plan_lazy();
+
+	same1();
+	uint1();
+	bench1();
+
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ *  rb_event1.c: Test rb_event scheduling
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static char order[16];
+static int fired;
+
+static void
+record_cb(void *arg)
+{
+	size_t len = strlen(order);
+
+	if(len < sizeof(order) - 1)
+		order[len] = *(const char *)arg;
+	fired++;
+}
+
+static struct ev_entry *self_ev;
+
+static void
+delete_self_cb(void *arg)
+{
+	fired++;
+	rb_event_delete(self_ev);
+}
+
+/* run the loop for roughly msec milliseconds */
+static void
+spin(long msec)
+{
+	struct timeval start;
+
+	rb_set_time();
+	start = *rb_current_time_tv();
+	while(1)
+	{
+		const struct timeval *now = rb_current_time_tv();
+		long elapsed = (now->tv_sec - start.tv_sec) * 1000 + (now->tv_usec - start.tv_usec) / 1000;
+
+		rb_event_run();
+		if(elapsed >= msec)
+			break;
+		usleep(1000);
+		rb_set_time();
+	}
+}
+
+static void
+ordering1(void)
+{
+	memset(order, 0, sizeof(order));
+	fired = 0;
+
+	/* librb keeps a few slow housekeeping events of its own */
+	ok(rb_event_next_msec() > 1000, MSG);
+
+	rb_event_addonce_msec("c", record_cb, "c", 30);
+	rb_event_addonce_msec("a", record_cb, "a", 10);
+	rb_event_addonce_msec("b", record_cb, "b", 20);
+
+	ok(rb_event_next_msec() >= 0 && rb_event_next_msec() <= 10, MSG);
+
+	spin(60);
+
+	is_string("abc", order, MSG);
+	is_int(3, fired, MSG);
+	ok(rb_event_next_msec() > 1000, MSG);
+}
+
+static void
+delete1(void)
+{
+	struct ev_entry *ev;
+
+	memset(order, 0, sizeof(order));
+	fired = 0;
+
+	rb_event_addonce_msec("x", record_cb, "x", 10);
+	ev = rb_event_addonce_msec("y", record_cb, "y", 15);
+	rb_event_addonce_msec("z", record_cb, "z", 20);
+	rb_event_delete(ev);
+
+	spin(40);
+
+	is_string("xz", order, MSG);
+	is_int(2, fired, MSG);
+}
+
+static void
+find_delete1(void)
+{
+	memset(order, 0, sizeof(order));
+	fired = 0;
+
+	rb_event_add_msec("r", record_cb, "r", 5);
+	spin(30);
+	ok(fired >= 2, MSG);
+
+	rb_event_find_delete(record_cb, "r");
+	fired = 0;
+	spin(20);
+	is_int(0, fired, MSG);
+	ok(rb_event_next_msec() > 1000, MSG);
+}
+
+static void
+delete_self1(void)
+{
+	fired = 0;
+
+	self_ev = rb_event_add_msec("self", delete_self_cb, NULL, 5);
+	spin(40);
+
+	is_int(1, fired, MSG);
+	ok(rb_event_next_msec() > 1000, MSG);
+}
+
+static void
+many1(void)
+{
+	static struct ev_entry *evs[10000];
+	char ids[10000];
+	int i, live = 0;
+
+	fired = 0;
+
+	for(i = 0; i < 10000; i++)
+	{
+		ids[i] = 'm';
+		evs[i] = rb_event_addonce_msec("many", record_cb, &ids[i], 1 + (rand() % 20));
+	}
+	for(i = 0; i < 10000; i += 3)
+		rb_event_delete(evs[i]);
+	for(i = 0; i < 10000; i++)
+		if(i % 3 != 0)
+			live++;
+
+	spin(50);
+
+	is_int(live, fired, MSG);
+	ok(rb_event_next_msec() > 1000, MSG);
+}
+
+static int readd_stop;
+
+static void
+readd_cb(void *arg)
+{
+	fired++;
+	/* bounded so a regression shows up as a count rather than a hang */
+	if(!readd_stop && fired < 50)
+		rb_event_addonce_msec("readd", readd_cb, NULL, 0);
+}
+
+/* an event scheduled from a callback waits for the next pass */
+static void
+readd1(void)
+{
+	fired = 0;
+	readd_stop = 0;
+
+	rb_event_addonce_msec("readd", readd_cb, NULL, 0);
+	usleep(5000);
+	rb_set_time();
+	rb_event_run();
+	is_int(1, fired, MSG);
+	is_int(1, rb_event_next_msec(), MSG);
+
+	usleep(5000);
+	rb_set_time();
+	rb_event_run();
+	is_int(2, fired, MSG);
+
+	readd_stop = 1;
+	spin(10);
+	ok(rb_event_next_msec() > 1000, MSG);
+}
+
+/* a tiny addish period must not come out as 0 and rearm for now */
+static void
+addish1(void)
+{
+	memset(order, 0, sizeof(order));
+	fired = 0;
+
+	rb_event_addish_msec("ish", record_cb, "i", 1);
+	usleep(5000);
+	rb_set_time();
+	rb_event_run();
+	is_int(1, fired, MSG);
+	is_int(1, rb_event_next_msec(), MSG);
+
+	rb_event_find_delete(record_cb, "i");
+	ok(rb_event_next_msec() > 1000, MSG);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	plan_lazy();
+
+	ordering1();
+	delete1();
+	find_delete1();
+	delete_self1();
+	many1();
+	readd1();
+	addish1();
+
+	return 0;
+}
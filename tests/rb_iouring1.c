@@ -0,0 +1,247 @@
+/*
+ *  rb_iouring1.c: Test the io_uring commio backend
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static char readbuf[64];
+static ssize_t readlen;
+static int fired;
+
+static void run_until_fired(void)
+{
+	int i;
+
+	for (i = 0; i < 50 && !fired; i++)
+		rb_select(100);
+}
+
+static void stream_read_cb(rb_fde_t *F, void *data)
+{
+	readlen = rb_read(F, readbuf, sizeof(readbuf));
+	fired++;
+}
+
+static void stream1(void)
+{
+	rb_fde_t *F1, *F2;
+
+	if (!ok(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &F1, &F2, "stream1") == 0, MSG))
+		return;
+
+	fired = 0;
+	readlen = -1;
+	rb_setselect(F1, RB_SELECT_READ, stream_read_cb, NULL);
+	is_int(7, rb_write(F2, "hello\r\n", 7), MSG);
+	run_until_fired();
+
+	is_int(1, fired, MSG);
+	is_int(7, readlen, MSG);
+	ok(readlen == 7 && !memcmp(readbuf, "hello\r\n", 7), MSG);
+
+	/* nothing more queued, and the stream must not be reordered */
+	is_int(-1, rb_read(F1, readbuf, sizeof(readbuf)), MSG);
+
+	rb_close(F1);
+	rb_close(F2);
+}
+
+static rb_fde_t *passed_F;
+static int passed_count;
+
+static void fdpass_read_cb(rb_fde_t *F, void *data)
+{
+	rb_fde_t *xF[1] = { NULL };
+
+	passed_count = rb_recv_fd_buf(F, readbuf, sizeof(readbuf), xF, 1);
+	passed_F = xF[0];
+	fired++;
+}
+
+/* the read is armed before the message turns up, like ssld's control socket */
+static void fdpass1(void)
+{
+	rb_fde_t *ctl1, *ctl2, *rF, *wF;
+	char buf[8];
+
+	if (!ok(rb_socketpair(AF_UNIX, SOCK_DGRAM, 0, &ctl1, &ctl2, "fdpass1") == 0, MSG))
+		return;
+	if (!ok(rb_pipe(&rF, &wF, "fdpass1 pipe") == 0, MSG))
+		return;
+
+	fired = 0;
+	passed_F = NULL;
+	rb_setselect(ctl2, RB_SELECT_READ, fdpass_read_cb, NULL);
+	rb_select(0);
+
+	ok(rb_send_fd_buf(ctl1, &rF, 1, "P", 1, getpid()) > 0, MSG);
+	run_until_fired();
+
+	is_int(1, fired, MSG);
+	is_int(1, passed_count, MSG);
+	is_int('P', readbuf[0], MSG);
+	if (ok(passed_F != NULL, MSG)) {
+		is_int(2, rb_write(wF, "ok", 2), MSG);
+		is_int(2, read(rb_get_fd(passed_F), buf, sizeof(buf)), MSG);
+		rb_close(passed_F);
+	}
+
+	rb_close(rF);
+	rb_close(wF);
+	rb_close(ctl1);
+	rb_close(ctl2);
+}
+
+static rb_fde_t *accepted_F;
+
+static void accept_cb(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen_t len, void *data)
+{
+	if (status == RB_OK)
+		accepted_F = F;
+	fired++;
+}
+
+static void accept1(void)
+{
+	struct sockaddr_in sin;
+	socklen_t sinlen = sizeof(sin);
+	rb_fde_t *listen_F;
+	int cfd;
+
+	listen_F = rb_socket(AF_INET, SOCK_STREAM, 0, "accept1");
+	if (!ok(listen_F != NULL, MSG))
+		return;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	SET_SS_LEN((struct rb_sockaddr_storage *)&sin, sizeof(sin));
+	ok(rb_bind(listen_F, (struct sockaddr *)&sin) == 0, MSG);
+	ok(rb_listen(listen_F, 8, 0) == 0, MSG);
+	getsockname(rb_get_fd(listen_F), (struct sockaddr *)&sin, &sinlen);
+
+	fired = 0;
+	accepted_F = NULL;
+	rb_accept_tcp(listen_F, NULL, accept_cb, NULL);
+
+	cfd = socket(AF_INET, SOCK_STREAM, 0);
+	ok(connect(cfd, (struct sockaddr *)&sin, sizeof(sin)) == 0, MSG);
+	run_until_fired();
+
+	is_int(1, fired, MSG);
+	if (ok(accepted_F != NULL, MSG))
+		rb_close(accepted_F);
+
+	close(cfd);
+	rb_close(listen_F);
+}
+
+static char dgram[9000];
+static ssize_t dgramlen;
+static int dgrams;
+
+/* like authd's resolver: read with recvfrom() and ask for the next one */
+static void udp_read_cb(rb_fde_t *F, void *data)
+{
+	struct sockaddr_in from;
+	socklen_t fromlen = sizeof(from);
+	ssize_t len;
+
+	fired++;
+	while ((len = recvfrom(rb_get_fd(F), dgram, sizeof(dgram), 0,
+			(struct sockaddr *)&from, &fromlen)) >= 0)
+	{
+		dgramlen = len;
+		dgrams++;
+	}
+	rb_setselect(F, RB_SELECT_READ, udp_read_cb, NULL);
+}
+
+/* datagrams are left for their owner to read, whole */
+static void udp1(void)
+{
+	struct sockaddr_in sin;
+	socklen_t sinlen = sizeof(sin);
+	rb_fde_t *F;
+	int sfd, i;
+
+	F = rb_socket(AF_INET, SOCK_DGRAM, 0, "udp1");
+	if (!ok(F != NULL, MSG))
+		return;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	SET_SS_LEN((struct rb_sockaddr_storage *)&sin, sizeof(sin));
+	ok(rb_bind(F, (struct sockaddr *)&sin) == 0, MSG);
+	getsockname(rb_get_fd(F), (struct sockaddr *)&sin, &sinlen);
+
+	fired = 0;
+	dgrams = 0;
+	dgramlen = -1;
+	rb_setselect(F, RB_SELECT_READ, udp_read_cb, NULL);
+	rb_select(0);
+
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(dgram, 'u', sizeof(dgram));
+	is_int(sizeof(dgram), sendto(sfd, dgram, sizeof(dgram), 0, (struct sockaddr *)&sin, sizeof(sin)), MSG);
+	run_until_fired();
+
+	/* and nothing more after it */
+	for (i = 0; i < 10; i++)
+		rb_select(10);
+
+	is_int(1, fired, MSG);
+	is_int(1, dgrams, MSG);
+	is_int(sizeof(dgram), dgramlen, MSG);
+
+	close(sfd);
+	rb_close(F);
+}
+
+int main(int argc, char *argv[])
+{
+	setenv("LIBRB_USE_IOTYPE", "iouring", 1);
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	if (strcmp(rb_get_iotype(), "iouring"))
+		skip_all("io_uring is not available (using %s)", rb_get_iotype());
+
+	plan_lazy();
+
+	stream1();
+	fdpass1();
+	accept1();
+	udp1();
+
+	return 0;
+}
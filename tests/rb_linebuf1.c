@@ -0,0 +1,171 @@
+/*
+ *  rb_linebuf1.c: Test rb_linebuf line splitting
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static char line[LINEBUF_SIZE * 2];
+static char expect[LINEBUF_SIZE * 2];
+static char got[LINEBUF_SIZE * 2];
+
+static void
+basic1(void)
+{
+	buf_head_t buf;
+	char data[] = "abc\r\ndef\nghi\r\r\n\njkl";
+
+	rb_linebuf_newbuf(&buf);
+
+	is_int(4, rb_linebuf_parse(&buf, data, strlen(data), 0), MSG);
+
+	is_int(3, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+	is_string("abc", got, MSG);
+	is_int(3, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+	is_string("def", got, MSG);
+	is_int(3, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+	is_string("ghi", got, MSG);
+
+	/* jkl is not terminated yet */
+	is_int(0, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+
+	rb_linebuf_parse(&buf, "mno\r\n", 5, 0);
+	is_int(6, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+	is_string("jklmno", got, MSG);
+
+	rb_linebuf_donebuf(&buf);
+}
+
+/* every line length around the 16 and 32 byte scan blocks, at every
+ * offset into the read buffer */
+static void
+boundary1(void)
+{
+	buf_head_t buf;
+	int n, off, bad = 0;
+
+	for (off = 0; off < 40; off++)
+	{
+		for (n = 0; n < 100; n++)
+		{
+			memset(line, 'y', off);
+			memset(line + off, 'x', n);
+			memcpy(line + off + n, "\r\n", 2);
+			memset(expect, 'x', n);
+			expect[n] = '\0';
+
+			rb_linebuf_newbuf(&buf);
+			rb_linebuf_parse(&buf, line, off, 0);
+			rb_linebuf_parse(&buf, line + off, n + 2, 0);
+
+			/* the leading y's and the x's join into one line */
+			if (rb_linebuf_get(&buf, got, sizeof(got), 0, 0) != off + n ||
+			    strspn(got, "y") != (size_t)off || strcmp(got + off, expect))
+				bad++;
+			rb_linebuf_donebuf(&buf);
+		}
+	}
+	is_int(0, bad, MSG);
+}
+
+static void
+bytewise1(void)
+{
+	buf_head_t buf;
+	const char *data = "PRIVMSG #chan :hello world, this line is longer than thirty two bytes\r\nPING :x\n";
+	size_t i;
+
+	rb_linebuf_newbuf(&buf);
+	for (i = 0; i < strlen(data); i++)
+		rb_linebuf_parse(&buf, (char *)&data[i], 1, 0);
+
+	rb_linebuf_get(&buf, got, sizeof(got), 0, 0);
+	is_string("PRIVMSG #chan :hello world, this line is longer than thirty two bytes", got, MSG);
+
+	/* a CR and LF split over two reads leave an empty line behind */
+	is_int(0, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+	is_int(1, buf.numlines, MSG);
+
+	rb_linebuf_get(&buf, got, sizeof(got), 0, 0);
+	is_string("PING :x", got, MSG);
+	is_int(0, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+
+	rb_linebuf_donebuf(&buf);
+}
+
+static void
+overflow1(void)
+{
+	buf_head_t buf;
+
+	memset(line, 'x', LINEBUF_SIZE + 100);
+	memcpy(line + LINEBUF_SIZE + 100, "\r\nnext\r\n", 8);
+
+	rb_linebuf_newbuf(&buf);
+	rb_linebuf_parse(&buf, line, LINEBUF_SIZE + 108, 0);
+
+	is_int(LINEBUF_SIZE, rb_linebuf_get(&buf, got, sizeof(got), 0, 0), MSG);
+	is_int(LINEBUF_SIZE, strspn(got, "x"), MSG);
+	rb_linebuf_get(&buf, got, sizeof(got), 0, 0);
+	is_string("next", got, MSG);
+
+	rb_linebuf_donebuf(&buf);
+}
+
+static void
+raw1(void)
+{
+	buf_head_t buf;
+	char data[] = "abc\r\ndefghijklmnopqrstuvwxyz0123456789\n";
+
+	rb_linebuf_newbuf(&buf);
+	rb_linebuf_parse(&buf, data, strlen(data), 1);
+
+	/* raw lines are not NUL terminated */
+	memset(got, 0, sizeof(got));
+	is_int(5, rb_linebuf_get(&buf, got, sizeof(got), 0, 1), MSG);
+	is_string("abc\r\n", got, MSG);
+	memset(got, 0, sizeof(got));
+	rb_linebuf_get(&buf, got, sizeof(got), 0, 1);
+	is_string("defghijklmnopqrstuvwxyz0123456789\n", got, MSG);
+
+	rb_linebuf_donebuf(&buf);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	plan_lazy();
+
+	basic1();
+	boundary1();
+	bytewise1();
+	overflow1();
+	raw1();
+
+	return 0;
+}
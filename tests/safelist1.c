@@ -0,0 +1,257 @@
+/*
+ *  safelist1.c: Check that long replies sent as the sendq drains are
+ *  the same as when sent in one go
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "channel.h"
+#include "class.h"
+#include "hash.h"
+#include "msg.h"
+#include "msgbuf.h"
+#include "parse.h"
+#include "s_conf.h"
+#include "safelist.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NMEMBERS 2000
+#define SMALL_SENDQ 8192
+#define OUTLEN (1024 * 1024)
+
+static struct Client *members[NMEMBERS];
+static struct Client *lister;
+static struct Channel *channel;
+static struct ConfItem *small_conf;
+
+static char expected[OUTLEN], output[OUTLEN];
+
+static void
+make_members(void)
+{
+	char nick[NICKLEN];
+	int i;
+
+	lister = make_local_person();
+	rb_strlcpy(lister->id, generate_uid(), sizeof lister->id);
+	add_to_id_hash(lister->id, lister);
+
+	/* replies that resume look the channel up again */
+	channel = get_or_create_channel(lister, TEST_CHANNEL, NULL);
+
+	for(i = 0; i < NMEMBERS; i++)
+	{
+		snprintf(nick, sizeof nick, "member%d", i);
+		members[i] = make_local_person_nick(nick);
+		rb_strlcpy(members[i]->id, generate_uid(), sizeof members[i]->id);
+		add_to_id_hash(members[i]->id, members[i]);
+		if(i % 3 == 0)
+			SetInvisible(members[i]);
+		add_user_to_channel(channel, members[i], i % 10 ? CHFL_PEON : CHFL_CHANOP);
+	}
+
+	small_conf = make_conf();
+	small_conf->status = CONF_CLIENT;
+	ClassPtr(small_conf) = make_class();
+	MaxSendq(ClassPtr(small_conf)) = SMALL_SENDQ;
+}
+
+/* take everything out of the sendq */
+static size_t
+drain(char *out, size_t len, size_t *max_queued)
+{
+	buf_head_t *sendq = &lister->localClient->buf_sendq;
+	size_t used = strlen(out);
+	int ret;
+
+	if(max_queued != NULL && (size_t)rb_linebuf_len(sendq) > *max_queued)
+		*max_queued = rb_linebuf_len(sendq);
+
+	while(rb_linebuf_len(sendq) > 0 && used < len - 1)
+	{
+		ret = rb_linebuf_get(sendq, out + used, len - used - 1, 0, 1);
+		if(ret <= 0)
+			break;
+		used += ret;
+		out[used] = '\0';
+	}
+
+	return used;
+}
+
+/* run the reply with a small sendq, draining it whenever it stops */
+static void
+stream(void (*start)(void), char *out, size_t len)
+{
+	size_t max_queued = 0;
+	int rounds = 0;
+
+	out[0] = '\0';
+	lister->localClient->att_conf = small_conf;
+
+	start();
+	while(safelist_busy(lister) && rounds < 100000)
+	{
+		ok(safelist_holds_input(lister), MSG);
+		drain(out, len, &max_queued);
+		safelist_continue(lister);
+		rounds++;
+	}
+	drain(out, len, &max_queued);
+
+	lister->localClient->att_conf = NULL;
+
+	ok(rounds > 1, MSG);
+	ok(max_queued <= SMALL_SENDQ / 2 + BUFSIZE, MSG);
+}
+
+static void
+start_names(void)
+{
+	stream_channel_member_names(channel, lister);
+}
+
+static void
+start_who(void)
+{
+	char line[] = "WHO " TEST_CHANNEL;
+	struct Message *mptr = find_command("WHO");
+	struct MsgBuf msgbuf;
+
+	/* straight to the handler: parse() wants a connected client, and
+	 * with a socket behind it the sendq would be written out rather
+	 * than fill up
+	 */
+	lister->localClient->join_who_credits = 1;
+	msgbuf_parse(&msgbuf, line);
+	mptr->handlers[lister->handler].handler(&msgbuf, lister, lister, msgbuf.n_para, msgbuf.para);
+}
+
+static void
+names1(void)
+{
+	expected[0] = '\0';
+	channel_member_names(channel, lister, 1);
+	drain(expected, sizeof expected, NULL);
+	ok(strstr(expected, " 366 ") != NULL, MSG);
+
+	stream(start_names, output, sizeof output);
+	is_string(expected, output, MSG);
+
+	/* as a member, invisible users are shown too */
+	add_user_to_channel(channel, lister, CHFL_PEON);
+
+	expected[0] = '\0';
+	channel_member_names(channel, lister, 1);
+	drain(expected, sizeof expected, NULL);
+
+	stream(start_names, output, sizeof output);
+	is_string(expected, output, MSG);
+}
+
+static void
+who1(void)
+{
+	/* the same reply with the default sendq fits in one go */
+	expected[0] = '\0';
+	start_who();
+	ok(!safelist_busy(lister), MSG);
+	drain(expected, sizeof expected, NULL);
+	ok(strstr(expected, " 315 ") != NULL, MSG);
+
+	stream(start_who, output, sizeof output);
+	is_string(expected, output, MSG);
+}
+
+static void
+parted1(void)
+{
+	int i;
+
+	output[0] = '\0';
+	lister->localClient->att_conf = small_conf;
+	stream_channel_member_names(channel, lister);
+	ok(safelist_busy(lister), MSG);
+	drain(output, sizeof output, NULL);
+
+	/* members that leave before their turn are left out, the
+	 * sendq has to take their quits
+	 */
+	lister->localClient->att_conf = NULL;
+	for(i = NMEMBERS / 2; i < NMEMBERS; i++)
+	{
+		remove_local_person(members[i]);
+		members[i] = NULL;
+	}
+
+	for(i = 0; safelist_busy(lister) && i < 100000; i++)
+	{
+		drain(output, sizeof output, NULL);
+		safelist_continue(lister);
+	}
+	drain(output, sizeof output, NULL);
+
+	ok(!IsAnyDead(lister), MSG);
+	ok(strstr(output, " member2 ") != NULL, MSG);
+	ok(strstr(output, "member1000 ") == NULL, MSG);
+	ok(strstr(output, " 366 ") != NULL, MSG);
+}
+
+static void
+exit1(void)
+{
+	lister->localClient->att_conf = small_conf;
+	stream_channel_member_names(channel, lister);
+	ok(safelist_busy(lister), MSG);
+
+	/* the rest of the reply is dropped */
+	lister->localClient->att_conf = NULL;
+	remove_local_person(lister);
+	lister = NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	make_members();
+	names1();
+	who1();
+	parted1();
+	exit1();
+
+	for(i = 0; i < NMEMBERS; i++)
+		if(members[i] != NULL)
+			remove_local_person(members[i]);
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ *  userindex1.c: Check the user index against a linear scan
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "userindex.h"
+#include "ircd.h"
+#include "match.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NCLIENTS 3000
+#define NPROBES 500
+
+static struct Client *clients[NCLIENTS];
+static bool candidate[NCLIENTS];
+
+static void
+make_clients(void)
+{
+	int i;
+
+	for(i = 0; i < NCLIENTS; i++)
+	{
+		clients[i] = make_local_person_random(i);
+		if(i % 7 == 0)
+			rb_strlcpy(clients[i]->host, "cloaked/user", sizeof clients[i]->host);
+		clients[i]->list_order = ++global_client_order;
+		user_index_add(clients[i]);
+	}
+}
+
+static void
+random_masks(struct UserIndexMask *masks, char buf[][BUFSIZE])
+{
+	unsigned int r = ircd_util_rand();
+
+	masks[0].syntax = masks[1].syntax = MATCH_GLOB;
+	masks[1].mask = NULL;
+
+	switch(r % 8)
+	{
+	case 0:
+		snprintf(buf[0], BUFSIZE, "c%u*", r % NCLIENTS);
+		break;
+	case 1:
+		snprintf(buf[0], BUFSIZE, "*NICK%u", r % 50);
+		break;
+	case 2:
+		snprintf(buf[0], BUFSIZE, "*!u%u@*.ISP%u.example.net", r % 30, (r >> 5) % 5);
+		break;
+	case 3:
+		snprintf(buf[0], BUFSIZE, "h%u.pool?.*", r % NCLIENTS);
+		break;
+	case 4:
+		snprintf(buf[0], BUFSIZE, "10.%u.%u.*", r % 4, (r >> 4) % 16);
+		break;
+	case 5:
+		/* a TESTMASK with a gecos */
+		snprintf(buf[0], BUFSIZE, "u%u", r % 30);
+		snprintf(buf[1], BUFSIZE, "test\\suser\\s%u\\sof*", (r >> 4) % 30);
+		masks[1].mask = buf[1];
+		masks[1].syntax = MATCH_ESC;
+		break;
+	case 6:
+		snprintf(buf[0], BUFSIZE, "*user*");
+		break;
+	default:
+		/* no three literal characters in a row */
+		snprintf(buf[0], BUFSIZE, "c1?*");
+		break;
+	}
+
+	masks[0].mask = buf[0];
+}
+
+static bool
+field_matches(const struct UserIndexMask *m, struct Client *client_p)
+{
+	char nuh[BUFSIZE];
+	int (*fn)(const char *, const char *) = m->syntax == MATCH_ESC ? match_esc : match;
+
+	snprintf(nuh, sizeof nuh, "%s!%s@%s", client_p->name, client_p->username, client_p->host);
+
+	return fn(m->mask, client_p->name) || fn(m->mask, client_p->username) ||
+		fn(m->mask, client_p->host) || fn(m->mask, client_p->orighost) ||
+		fn(m->mask, client_p->sockhost) || fn(m->mask, client_p->info) ||
+		fn(m->mask, nuh);
+}
+
+static void
+compare1(void)
+{
+	rb_dlink_list list = { NULL, NULL, 0 };
+	rb_dlink_node *ptr, *next_ptr;
+	struct UserIndexMask masks[2];
+	char buf[2][BUFSIZE];
+	uint64_t last;
+	int i, j, missed = 0, extra = 0, unordered = 0, found = 0, listed = 0, scanned = 0;
+
+	for(i = 0; i < NPROBES; i++)
+	{
+		random_masks(masks, buf);
+
+		memset(candidate, 0, sizeof candidate);
+		if(!user_index_find(masks, 2, &list))
+		{
+			scanned++;
+			continue;
+		}
+
+		last = 0;
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list.head)
+		{
+			struct Client *client_p = ptr->data;
+
+			if(client_p->list_order <= last)
+				unordered++;
+			last = client_p->list_order;
+
+			j = atoi(client_p->name + 1);
+			if(candidate[j])
+				extra++;	/* listed twice */
+			candidate[j] = true;
+			listed++;
+			rb_dlinkDestroy(ptr, &list);
+		}
+
+		for(j = 0; j < NCLIENTS; j++)
+		{
+			if(clients[j] == NULL)
+			{
+				if(candidate[j])
+					extra++;
+				continue;
+			}
+
+			if(field_matches(&masks[0], clients[j]) &&
+					(masks[1].mask == NULL || field_matches(&masks[1], clients[j])))
+			{
+				found++;
+				if(!candidate[j])
+					missed++;
+			}
+		}
+	}
+
+	is_int(0, missed, MSG);
+	is_int(0, extra, MSG);
+	is_int(0, unordered, MSG);
+	ok(found > NPROBES, MSG);
+	ok(scanned > 0, MSG);
+	ok(scanned < NPROBES / 4, MSG);
+	/* the index should narrow most lookups down a lot */
+	ok(listed < (NPROBES - scanned) * NCLIENTS / 4, MSG);
+}
+
+static void
+update1(void)
+{
+	char nick[NICKLEN];
+	int i;
+
+	for(i = 1; i < NCLIENTS; i += 5)
+	{
+		snprintf(nick, sizeof nick, "c%dRenamed", i);
+		rb_strlcpy(clients[i]->name, nick, sizeof clients[i]->name);
+		rb_strlcpy(clients[i]->host, "changed.example.org", sizeof clients[i]->host);
+		user_index_update(clients[i]);
+	}
+
+	compare1();
+}
+
+static void
+delete1(void)
+{
+	rb_dlink_list list = { NULL, NULL, 0 };
+	struct UserIndexMask m = { "*.example.net", MATCH_GLOB };
+	int i;
+
+	for(i = 0; i < NCLIENTS; i += 3)
+	{
+		remove_local_person(clients[i]);
+		clients[i] = NULL;
+	}
+
+	compare1();
+
+	for(i = 0; i < NCLIENTS; i++)
+	{
+		if(clients[i] == NULL)
+			continue;
+		remove_local_person(clients[i]);
+		clients[i] = NULL;
+	}
+
+	ok(user_index_find(&m, 1, &list), MSG);
+	is_int(0, rb_dlink_list_length(&list), MSG);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	make_clients();
+	compare1();
+	update1();
+	delete1();
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
@@ -0,0 +1,253 @@
+/*
+ *  wsockd_deflate1.c: Check wsockd's permessage-deflate
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "wsockd/deflate.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static const char *
+response(const ws_deflate_params_t *params)
+{
+	static char buf[BUFSIZE];
+
+	ws_deflate_response(params, buf, sizeof buf);
+	return buf;
+}
+
+static void
+negotiate1(void)
+{
+	ws_deflate_params_t params;
+
+	ok(ws_deflate_negotiate("permessage-deflate", true, 1024 * 1024, &params), MSG);
+	is_int(15, params.server_max_window_bits, MSG);
+	is_int(15, params.client_max_window_bits, MSG);
+	is_int(8, params.mem_level, MSG);
+	is_string("permessage-deflate", response(&params), MSG);
+
+	ok(ws_deflate_negotiate("permessage-deflate; client_max_window_bits", true, 1024 * 1024, &params), MSG);
+	is_int(15, params.client_max_window_bits, MSG);
+	is_string("permessage-deflate", response(&params), MSG);
+
+	ok(ws_deflate_negotiate("PerMessage-Deflate ;client_no_context_takeover", true, 1024 * 1024, &params), MSG);
+	is_string("permessage-deflate; client_no_context_takeover", response(&params), MSG);
+
+	ok(ws_deflate_negotiate("permessage-deflate", false, 1024 * 1024, &params), MSG);
+	is_string("permessage-deflate; server_no_context_takeover; client_no_context_takeover", response(&params), MSG);
+
+	ok(ws_deflate_negotiate("x-webkit-deflate-frame, permessage-deflate; server_max_window_bits=10", true, 1024 * 1024, &params), MSG);
+	is_int(10, params.server_max_window_bits, MSG);
+	is_string("permessage-deflate; server_max_window_bits=10", response(&params), MSG);
+
+	ok(ws_deflate_negotiate("permessage-deflate; client_max_window_bits=\"12\"", true, 1024 * 1024, &params), MSG);
+	is_int(12, params.client_max_window_bits, MSG);
+	is_string("permessage-deflate; client_max_window_bits=12", response(&params), MSG);
+
+	/* the first offer we can take wins */
+	ok(ws_deflate_negotiate("permessage-deflate; server_max_window_bits=8, permessage-deflate; server_no_context_takeover",
+		true, 1024 * 1024, &params), MSG);
+	is_string("permessage-deflate; server_no_context_takeover", response(&params), MSG);
+
+	ok(!ws_deflate_negotiate("", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("x-webkit-deflate-frame", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; server_max_window_bits=8", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; server_max_window_bits", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; client_max_window_bits=16", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; client_max_window_bits=010", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; server_no_context_takeover; server_no_context_takeover", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; server_no_context_takeover=1", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; mystery", true, 1024 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate=1", true, 1024 * 1024, &params), MSG);
+}
+
+static void
+memory1(void)
+{
+	ws_deflate_params_t params;
+
+	/* our side shrinks, theirs stays as big as it may be */
+	ok(ws_deflate_negotiate("permessage-deflate", true, 64 * 1024, &params), MSG);
+	ok(ws_deflate_memory(&params) <= 64 * 1024, MSG);
+	ok(params.server_max_window_bits < 15, MSG);
+	is_int(15, params.client_max_window_bits, MSG);
+	is_string("permessage-deflate", response(&params), MSG);
+
+	/* theirs too, if they let us */
+	ok(ws_deflate_negotiate("permessage-deflate; client_max_window_bits", true, 64 * 1024, &params), MSG);
+	ok(ws_deflate_memory(&params) <= 64 * 1024, MSG);
+	ok(params.client_max_window_bits < 15, MSG);
+	ok(strstr(response(&params), "; client_max_window_bits=") != NULL, MSG);
+
+	ok(!ws_deflate_negotiate("permessage-deflate", true, 16 * 1024, &params), MSG);
+	ok(!ws_deflate_negotiate("permessage-deflate; client_max_window_bits", true, 1024, &params), MSG);
+}
+
+#ifdef HAVE_LIBZ
+struct sink
+{
+	char buf[WS_INFLATE_MAX * 2];
+	size_t len;
+};
+
+static void
+sink_cb(void *data, const void *buf, size_t len)
+{
+	struct sink *sink = data;
+
+	if (sink->len + len <= sizeof sink->buf)
+		memcpy(sink->buf + sink->len, buf, len);
+	sink->len += len;
+}
+
+/* the other end's view of the same agreement */
+static ws_deflate_t *
+make_client(const ws_deflate_params_t *params)
+{
+	ws_deflate_params_t mirror = *params;
+
+	mirror.server_no_context_takeover = params->client_no_context_takeover;
+	mirror.client_no_context_takeover = params->server_no_context_takeover;
+	mirror.server_max_window_bits = params->client_max_window_bits;
+	mirror.client_max_window_bits = params->server_max_window_bits;
+	return ws_deflate_new(&mirror);
+}
+
+static void
+roundtrip(bool context_takeover)
+{
+	static const char line[] = ":nick!user@host PRIVMSG #channel :hello there, how is everyone doing today?\r\n";
+	static struct sink sink;
+	ws_deflate_params_t params;
+	ws_deflate_t *server, *client;
+	uint8_t out[1024];
+	int len[3];
+	int i;
+
+	ok(ws_deflate_negotiate("permessage-deflate", context_takeover, 64 * 1024, &params), MSG);
+	server = ws_deflate_new(&params);
+	client = make_client(&params);
+	ok(server != NULL && client != NULL, MSG);
+
+	for (i = 0; i < 3; i++)
+	{
+		len[i] = ws_deflate_message(server, line, strlen(line), out, sizeof out);
+		ok(len[i] > 0, MSG);
+
+		sink.len = 0;
+		is_int(0, ws_inflate_message(client, out, len[i], true, sink_cb, &sink), MSG);
+		ok(sink.len == strlen(line) && !memcmp(sink.buf, line, sink.len), MSG);
+	}
+
+	/* the same line again refers back to the first one, unless the
+	 * window is thrown away after every message */
+	if (context_takeover)
+	{
+		ok(len[1] < len[0] / 2, MSG);
+		ok(len[2] < len[0] / 2, MSG);
+	}
+	else
+	{
+		is_int(len[0], len[1], MSG);
+		is_int(len[0], len[2], MSG);
+	}
+
+	/* and the other way, split over two frames */
+	len[0] = ws_deflate_message(client, line, strlen(line), out, sizeof out);
+	ok(len[0] > 2, MSG);
+	sink.len = 0;
+	is_int(0, ws_inflate_message(server, out, 2, false, sink_cb, &sink), MSG);
+	is_int(0, ws_inflate_message(server, out + 2, len[0] - 2, true, sink_cb, &sink), MSG);
+	ok(sink.len == strlen(line) && !memcmp(sink.buf, line, sink.len), MSG);
+
+	ws_deflate_free(server);
+	ws_deflate_free(client);
+}
+
+static void
+roundtrip1(void)
+{
+	roundtrip(true);
+	roundtrip(false);
+}
+
+static void
+inflate_limit1(void)
+{
+	static char big[WS_INFLATE_MAX + 1];
+	static struct sink sink;
+	static const uint8_t garbage[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	ws_deflate_params_t params;
+	ws_deflate_t *server, *client;
+	uint8_t out[1024];
+	int len;
+
+	ok(ws_deflate_negotiate("permessage-deflate", true, 1024 * 1024, &params), MSG);
+	server = ws_deflate_new(&params);
+	client = make_client(&params);
+
+	memset(big, 'a', sizeof big);
+
+	/* exactly as much as we take */
+	len = ws_deflate_message(client, big, WS_INFLATE_MAX, out, sizeof out);
+	ok(len > 0, MSG);
+	sink.len = 0;
+	is_int(0, ws_inflate_message(server, out, len, true, sink_cb, &sink), MSG);
+	is_int(WS_INFLATE_MAX, sink.len, MSG);
+
+	/* a byte more isn't */
+	len = ws_deflate_message(client, big, sizeof big, out, sizeof out);
+	ok(len > 0, MSG);
+	sink.len = 0;
+	is_int(-1, ws_inflate_message(server, out, len, true, sink_cb, &sink), MSG);
+	ok(sink.len <= WS_INFLATE_MAX, MSG);
+
+	ws_deflate_free(server);
+	server = ws_deflate_new(&params);
+	sink.len = 0;
+	is_int(-1, ws_inflate_message(server, garbage, sizeof garbage, true, sink_cb, &sink), MSG);
+
+	/* what doesn't fit in the frame fails instead of being cut short */
+	is_int(-1, ws_deflate_message(server, big, sizeof big, out, 8), MSG);
+
+	ws_deflate_free(server);
+	ws_deflate_free(client);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, 1024, 4096);
+
+	plan_lazy();
+
+	negotiate1();
+	memory1();
+#ifdef HAVE_LIBZ
+	roundtrip1();
+	inflate_limit1();
+#endif
+
+	return 0;
+}
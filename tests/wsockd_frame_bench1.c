@@ -0,0 +1,455 @@
+/*
+ *  wsockd_frame_bench1.c: Check and time wsockd's websocket framing
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+
+#include "wsockd/frame.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define NLINES 4096
+#define ROUNDS 50
+#define UNMASK_LEN 65536
+#define UNMASK_ROUNDS 2000
+
+/* what ws_frame_unmask() used to do */
+static void
+old_unmask(char *msg, int length, uint8_t maskval[WEBSOCKET_MASK_LENGTH])
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		msg[i] = msg[i] ^ maskval[i % 4];
+}
+
+/* every length around the vector and word sizes, at every alignment */
+static void
+unmask1(void)
+{
+	static uint8_t buf[512 + 16], expect[512 + 16];
+	uint8_t mask[WEBSOCKET_MASK_LENGTH];
+	size_t len, off, i;
+	int bad = 0;
+
+	for (len = 0; len < 300; len++)
+	{
+		for (off = 0; off < 16; off++)
+		{
+			for (i = 0; i < WEBSOCKET_MASK_LENGTH; i++)
+				mask[i] = ircd_util_rand();
+			for (i = 0; i < sizeof buf; i++)
+				buf[i] = expect[i] = ircd_util_rand();
+
+			old_unmask((char *) expect + off, len, mask);
+			ws_frame_unmask(buf + off, len, mask);
+
+			if (memcmp(buf, expect, sizeof buf) != 0 && bad++ == 0)
+				diag("length %zu offset %zu", len, off);
+		}
+	}
+	is_int(0, bad, MSG);
+}
+
+/* add a line the way wsockd does, refusing it if it doesn't fit */
+static bool
+add_line(ws_frame_buf_t *fb, const void *line, size_t len)
+{
+	size_t room;
+	char *tail = ws_frame_buf_tail(fb, &room);
+
+	if (len > room)
+		return false;
+
+	memcpy(tail, line, len);
+	ws_frame_buf_commit_line(fb, len);
+	return true;
+}
+
+/* pull one frame off the front of buf, returns its length or 0 */
+static size_t
+parse_frame(const uint8_t *buf, size_t len, const uint8_t **payload, size_t *payload_len)
+{
+	size_t hdrlen = 2;
+
+	if (len < 2)
+		return 0;
+
+	/* fin, text, not masked */
+	if (buf[0] != 0x81 || (buf[1] & 0x80))
+		return 0;
+
+	*payload_len = buf[1] & 0x7f;
+	if (*payload_len == 126)
+	{
+		if (len < 4)
+			return 0;
+		*payload_len = (buf[2] << 8) | buf[3];
+		if (*payload_len <= WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH)
+			return 0;	/* not the shortest encoding */
+		hdrlen = 4;
+	}
+	else if (*payload_len == 127)
+		return 0;
+
+	if (len < hdrlen + *payload_len)
+		return 0;
+
+	*payload = buf + hdrlen;
+	return hdrlen + *payload_len;
+}
+
+static void
+frame1(void)
+{
+	static uint8_t out[WEBSOCKET_FRAME_PAYLOAD_MAX * 4];
+	static char expect[WEBSOCKET_FRAME_PAYLOAD_MAX * 4], got[WEBSOCKET_FRAME_PAYLOAD_MAX * 4];
+	ws_frame_buf_t fb;
+	char line[600];
+	uint8_t *frame;
+	const uint8_t *payload;
+	size_t framelen, payload_len, outlen = 0, explen = 0, gotlen = 0, n;
+	int frames = 0, bad = 0, i;
+
+	/* every payload length either side of the extended length */
+	for (i = 0; i < 200; i++)
+	{
+		ws_frame_buf_reset(&fb);
+		memset(line, 'a' + i % 26, i);
+		ok(add_line(&fb, line, i), MSG);
+		frame = ws_frame_buf_finish(&fb, &framelen);
+
+		n = parse_frame(frame, framelen, &payload, &payload_len);
+		if (n != framelen || payload_len != (size_t) i + 2 || memcmp(payload, line, i) != 0 ||
+				memcmp(payload + i, "\r\n", 2) != 0)
+		{
+			if (bad++ == 0)
+				diag("line length %d", i);
+		}
+	}
+	is_int(0, bad, MSG);
+
+	/* lines packed until the frame is full, each ending in CRLF */
+	ws_frame_buf_reset(&fb);
+	for (i = 0; explen + sizeof line < sizeof expect - WEBSOCKET_FRAME_PAYLOAD_MAX; i++)
+	{
+		int len = 10 + ircd_util_rand() % 500;
+
+		memset(line, 'A' + i % 26, len);
+
+		if (!add_line(&fb, line, len))
+		{
+			frame = ws_frame_buf_finish(&fb, &framelen);
+			memcpy(out + outlen, frame, framelen);
+			outlen += framelen;
+			ws_frame_buf_reset(&fb);
+			ok(add_line(&fb, line, len), MSG);
+		}
+
+		memcpy(expect + explen, line, len);
+		explen += len;
+		memcpy(expect + explen, "\r\n", 2);
+		explen += 2;
+	}
+	frame = ws_frame_buf_finish(&fb, &framelen);
+	memcpy(out + outlen, frame, framelen);
+	outlen += framelen;
+
+	for (n = 0; n < outlen; n += framelen, frames++)
+	{
+		framelen = parse_frame(out + n, outlen - n, &payload, &payload_len);
+		if (framelen == 0)
+			break;
+		ok(payload_len <= WEBSOCKET_FRAME_PAYLOAD_MAX, MSG);
+		ok(memcmp(payload + payload_len - 2, "\r\n", 2) == 0, MSG);
+		memcpy(got + gotlen, payload, payload_len);
+		gotlen += payload_len;
+	}
+
+	is_int(outlen, n, MSG);
+	ok(frames > 1, MSG);
+	is_int(explen, gotlen, MSG);
+	ok(memcmp(expect, got, explen) == 0, MSG);
+
+	/* a line that can never fit is refused, its CRLF counts */
+	ws_frame_buf_reset(&fb);
+	ok(!add_line(&fb, out, WEBSOCKET_FRAME_PAYLOAD_MAX - 1), MSG);
+	ok(add_line(&fb, out, WEBSOCKET_FRAME_PAYLOAD_MAX - 2), MSG);
+	is_int(WEBSOCKET_FRAME_PAYLOAD_MAX, fb.len, MSG);
+
+	ws_frame_buf_reset(&fb);
+	ok(add_line(&fb, out, 1), MSG);
+	ok(!add_line(&fb, out, WEBSOCKET_FRAME_PAYLOAD_MAX - 4), MSG);
+	ok(add_line(&fb, out, WEBSOCKET_FRAME_PAYLOAD_MAX - 5), MSG);
+	is_int(WEBSOCKET_FRAME_PAYLOAD_MAX, fb.len, MSG);
+}
+
+static void
+bench_unmask1(void)
+{
+	static uint8_t buf[UNMASK_LEN];
+	uint8_t mask[WEBSOCKET_MASK_LENGTH] = { 0x12, 0x34, 0x56, 0x78 };
+	struct timespec start;
+	double told, tnew;
+	int r;
+
+	memset(buf, 'x', sizeof buf);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < UNMASK_ROUNDS; r++)
+		old_unmask((char *) buf, sizeof buf, mask);
+	told = ircd_util_elapsed_ns(&start) / 1e9;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < UNMASK_ROUNDS; r++)
+		ws_frame_unmask(buf, sizeof buf, mask);
+	tnew = ircd_util_elapsed_ns(&start) / 1e9;
+
+	/* an even number of rounds each */
+	ok(buf[0] == 'x' && buf[sizeof buf - 1] == 'x', MSG);
+	diag("unmask: bytewise %.0f MB/s, ws_frame_unmask %.0f MB/s",
+		UNMASK_LEN * (double) UNMASK_ROUNDS / told / 1e6,
+		UNMASK_LEN * (double) UNMASK_ROUNDS / tnew / 1e6);
+}
+
+/* the old way: a frame per line, copied out of the linebuf and queued
+ * as header, line and CRLF */
+static void
+old_write_frames(rawbuf_head_t *out, buf_head_t *in)
+{
+	char inbuf[16384];
+	ws_frame_hdr_t hdr;
+	uint16_t extlen;
+	int len;
+
+	memset(inbuf, 0, sizeof inbuf);
+
+	while ((len = rb_linebuf_get(in, inbuf, sizeof inbuf, LINEBUF_COMPLETE, LINEBUF_PARSED)) > 0)
+	{
+		hdr = WEBSOCKET_FRAME_HDR_INIT;
+		ws_frame_set_opcode(&hdr, WEBSOCKET_OPCODE_TEXT_FRAME);
+		ws_frame_set_fin(&hdr, 1);
+		if (len < 123)
+		{
+			hdr.payload_length_mask = (len + 2) & 0x7f;
+			rb_rawbuf_append(out, &hdr, sizeof(hdr));
+		}
+		else
+		{
+			hdr.payload_length_mask = 126;
+			extlen = htons(len + 2);
+			rb_rawbuf_append(out, &hdr, sizeof(hdr));
+			rb_rawbuf_append(out, &extlen, sizeof(extlen));
+		}
+		rb_rawbuf_append(out, inbuf, len);
+		rb_rawbuf_append(out, "\r\n", 2);
+	}
+}
+
+/* what conn_plain_process_recvq() does now, packing as with
+ * wsock_pack_lines */
+static void
+write_frames(rawbuf_head_t *out, buf_head_t *in, bool pack)
+{
+	ws_frame_buf_t fb;
+	uint8_t *frame;
+	size_t framelen, room;
+	char *tail;
+	int len;
+
+	ws_frame_buf_reset(&fb);
+
+	while (1)
+	{
+		tail = ws_frame_buf_tail(&fb, &room);
+		if (room < LINEBUF_SIZE + CRLF_LEN)
+		{
+			frame = ws_frame_buf_finish(&fb, &framelen);
+			rb_rawbuf_append(out, frame, framelen);
+			ws_frame_buf_reset(&fb);
+			tail = ws_frame_buf_tail(&fb, &room);
+		}
+
+		len = rb_linebuf_get(in, tail, room, LINEBUF_COMPLETE, LINEBUF_PARSED);
+		if (len <= 0)
+			break;
+
+		ws_frame_buf_commit_line(&fb, len);
+
+		if (!pack)
+		{
+			frame = ws_frame_buf_finish(&fb, &framelen);
+			rb_rawbuf_append(out, frame, framelen);
+			ws_frame_buf_reset(&fb);
+		}
+	}
+
+	if (fb.len > 0)
+	{
+		frame = ws_frame_buf_finish(&fb, &framelen);
+		rb_rawbuf_append(out, frame, framelen);
+	}
+}
+
+static size_t
+drain(rawbuf_head_t *out, char *sink, size_t len)
+{
+	size_t total = 0;
+	int n;
+
+	while ((n = rb_rawbuf_get(out, sink + total, len - total)) > 0)
+		total += n;
+	return total;
+}
+
+/* do the frames in buf hold exactly the lines in text, each frame ending
+ * in the CRLF of a line? */
+static bool
+same_payload(const char *buf, size_t len, const char *text, size_t textlen)
+{
+	const uint8_t *payload;
+	size_t n, framelen, payload_len, pos = 0;
+
+	for (n = 0; n < len; n += framelen)
+	{
+		framelen = parse_frame((const uint8_t *) buf + n, len - n, &payload, &payload_len);
+		if (framelen == 0 || payload_len < 2 || pos + payload_len > textlen ||
+				memcmp(text + pos, payload, payload_len) != 0 ||
+				memcmp(payload + payload_len - 2, "\r\n", 2) != 0)
+			return false;
+		pos += payload_len;
+	}
+
+	return pos == textlen;
+}
+
+/* lines of 123 and 124 bytes, which used to get an extended length */
+static size_t
+count_short_ext(const char *text, size_t textlen)
+{
+	const char *p = text, *eol;
+	size_t count = 0, len;
+
+	while (p < text + textlen && (eol = memchr(p, '\r', text + textlen - p)) != NULL)
+	{
+		len = eol - p;
+		if (len == 123 || len == 124)
+			count++;
+		p = eol + 2;
+	}
+
+	return count;
+}
+
+/* the lines an ircd would send, mostly PRIVMSGs of a few dozen bytes */
+static size_t
+make_lines(char *text, size_t len)
+{
+	static const char lorem[] =
+		"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+		"tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, "
+		"quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. "
+		"Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu "
+		"fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in "
+		"culpa qui officia deserunt mollit anim id est laborum.";
+	size_t used = 0;
+	int i;
+
+	for (i = 0; i < NLINES; i++)
+	{
+		int textlen = ircd_util_rand() % 8 ? 10 + ircd_util_rand() % 60 : 200 + ircd_util_rand() % 200;
+
+		used += snprintf(text + used, len - used,
+			":nick%u!~user@host%u.example.net PRIVMSG #channel :%.*s\r\n",
+			ircd_util_rand() % 1000, ircd_util_rand() % 1000, textlen, lorem);
+	}
+
+	return used;
+}
+
+static void
+bench_frame1(void)
+{
+	static char text[NLINES * 512], sink[3][NLINES * 520];
+	rawbuf_head_t *out = rb_new_rawbuffer();
+	buf_head_t in;
+	struct timespec start;
+	size_t textlen, wire[3];
+	double t[3];
+	int r, way;
+
+	textlen = make_lines(text, sizeof text);
+	rb_linebuf_newbuf(&in);
+
+	for (way = 0; way < 3; way++)
+	{
+		t[way] = 0;
+		for (r = 0; r < ROUNDS; r++)
+		{
+			rb_linebuf_parse(&in, text, textlen, 0);
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (way == 0)
+				old_write_frames(out, &in);
+			else
+				write_frames(out, &in, way == 2);
+			t[way] += ircd_util_elapsed_ns(&start) / 1e9;
+
+			wire[way] = drain(out, sink[way], sizeof sink[way]);
+		}
+	}
+
+	for (way = 1; way < 3; way++)
+		ok(same_payload(sink[way], wire[way], text, textlen), MSG);
+
+	/* a frame per line is what it was, except that lines of 123 and 124
+	 * bytes no longer get an extended length they don't need */
+	is_int(wire[0] - 2 * count_short_ext(text, textlen), wire[1], MSG);
+	ok(wire[2] < wire[1], MSG);
+	diag("framing %zu bytes in %d lines: old %.0f MB/s, per line %.0f MB/s, packed %.0f MB/s (%zu header bytes saved)",
+		textlen, NLINES,
+		textlen * (double) ROUNDS / t[0] / 1e6,
+		textlen * (double) ROUNDS / t[1] / 1e6,
+		textlen * (double) ROUNDS / t[2] / 1e6,
+		wire[1] - wire[2]);
+
+	rb_linebuf_donebuf(&in);
+	rb_free_rawbuffer(out);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, 1024, 4096);
+	rb_linebuf_init(4096);
+	rb_init_rawbuffers(4096);
+
+	plan_lazy();
+
+	unmask1();
+	frame1();
+	bench_unmask1();
+	bench_frame1();
+
+	return 0;
+}
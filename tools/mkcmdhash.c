@@ -0,0 +1,104 @@
+/*
+ *  mkcmdhash.c: Find a multiplier for the core command perfect hash
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmdhash.h"
+
+/*
+ * Checks that CMD_FAST_MULT still gives every verb in CMD_FAST_VERBS a
+ * slot of its own.  If it doesn't, or with -n, tries multipliers from a
+ * fixed sequence and prints the first that does, to be pasted into
+ * include/cmdhash.h.
+ */
+
+#define MAX_TRIES	100000000UL
+
+static const char *verbs[] = { CMD_FAST_VERBS };
+#define NVERBS	(sizeof(verbs) / sizeof(verbs[0]))
+
+/* returns the first verb that shares a slot with an earlier one, or NULL */
+static const char *
+collision(uint32_t mult, const char **other)
+{
+	const char *slots[1 << CMD_FAST_BITS];
+	unsigned int slot;
+	size_t i;
+
+	memset(slots, 0, sizeof(slots));
+
+	for(i = 0; i < NVERBS; i++)
+	{
+		slot = cmd_fast_hash_mult(verbs[i], strlen(verbs[i]), mult);
+		if(slots[slot] != NULL)
+		{
+			*other = slots[slot];
+			return verbs[i];
+		}
+		slots[slot] = verbs[i];
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *verb, *other;
+	uint32_t mult, state = 1;
+	unsigned long tries;
+
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-n")))
+	{
+		fprintf(stderr, "usage: %s [-n]\n", argv[0]);
+		return 2;
+	}
+
+	if(argc == 1)
+	{
+		if((verb = collision(CMD_FAST_MULT, &other)) == NULL)
+		{
+			printf("CMD_FAST_MULT 0x%08xU gives each of the %zu verbs its own slot\n",
+			       (unsigned int)CMD_FAST_MULT, NVERBS);
+			return 0;
+		}
+
+		printf("CMD_FAST_MULT 0x%08xU puts %s and %s in the same slot\n",
+		       (unsigned int)CMD_FAST_MULT, verb, other);
+	}
+
+	for(tries = 0; tries < MAX_TRIES; tries++)
+	{
+		/* xorshift32, odd multipliers only */
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		mult = state | 1;
+
+		if(collision(mult, &other) == NULL)
+		{
+			printf("#define CMD_FAST_MULT\t0x%08xU\n", (unsigned int)mult);
+			return 0;
+		}
+	}
+
+	fprintf(stderr, "no multiplier found after %lu tries, raise CMD_FAST_BITS\n", tries);
+	return 1;
+}
@@ -0,0 +1,346 @@
+/*
+ *  deflate.c: permessage-deflate (RFC 7692) for wsockd
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stdinc.h"
+#include "deflate.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+/* roughly what zlib needs besides the window and hash tables */
+#define DEFLATE_STATE_SIZE	(6 * 1024)
+#define INFLATE_STATE_SIZE	(7 * 1024)
+
+/* zlib can't make raw deflate streams with a smaller window */
+#define MIN_SERVER_WINDOW_BITS	9
+
+/* the parameters of one offer, a window size of -1 if it wasn't given
+ * and 0 if it was without a value */
+struct offer
+{
+	bool server_no_context_takeover;
+	bool client_no_context_takeover;
+	int server_max_window_bits;
+	int client_max_window_bits;
+};
+
+static char *
+trim(char *s)
+{
+	char *end;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+
+	end = s + strlen(s);
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t'))
+		*--end = '\0';
+
+	return s;
+}
+
+static int
+parse_window_bits(char *value)
+{
+	size_t len = strlen(value);
+	int bits;
+
+	if (len >= 2 && value[0] == '"' && value[len - 1] == '"')
+	{
+		value[len - 1] = '\0';
+		value++;
+	}
+
+	if (!strcmp(value, "8") || !strcmp(value, "9"))
+		bits = value[0] - '0';
+	else if (value[0] == '1' && value[1] >= '0' && value[1] <= '5' && value[2] == '\0')
+		bits = 10 + value[1] - '0';
+	else
+		return -1;
+
+	return bits;
+}
+
+/* an offer we don't understand all of is declined */
+static bool
+parse_offer(char *offer, struct offer *o)
+{
+	char *tok, *save = NULL, *name, *value;
+	bool first = true;
+
+	memset(o, 0, sizeof(*o));
+	o->server_max_window_bits = o->client_max_window_bits = -1;
+
+	for (tok = strtok_r(offer, ";", &save); tok != NULL; tok = strtok_r(NULL, ";", &save))
+	{
+		name = tok;
+		if ((value = strchr(name, '=')) != NULL)
+		{
+			*value++ = '\0';
+			value = trim(value);
+		}
+		name = trim(name);
+
+		if (first)
+		{
+			if (value != NULL || rb_strcasecmp(name, "permessage-deflate"))
+				return false;
+			first = false;
+		}
+		else if (!rb_strcasecmp(name, "server_no_context_takeover") && value == NULL &&
+				!o->server_no_context_takeover)
+			o->server_no_context_takeover = true;
+		else if (!rb_strcasecmp(name, "client_no_context_takeover") && value == NULL &&
+				!o->client_no_context_takeover)
+			o->client_no_context_takeover = true;
+		else if (!rb_strcasecmp(name, "server_max_window_bits") && value != NULL &&
+				o->server_max_window_bits < 0)
+		{
+			if ((o->server_max_window_bits = parse_window_bits(value)) < 0)
+				return false;
+		}
+		else if (!rb_strcasecmp(name, "client_max_window_bits") && o->client_max_window_bits < 0)
+		{
+			if (value == NULL)
+				o->client_max_window_bits = 0;
+			else if ((o->client_max_window_bits = parse_window_bits(value)) < 0)
+				return false;
+		}
+		else
+			return false;
+	}
+
+	return !first;
+}
+
+/* zlib's memory use for these parameters, as documented in zconf.h */
+size_t
+ws_deflate_memory(const ws_deflate_params_t *params)
+{
+	return DEFLATE_STATE_SIZE + (1 << (params->server_max_window_bits + 2)) +
+		(1 << (params->mem_level + 9)) +
+		INFLATE_STATE_SIZE + (1 << params->client_max_window_bits);
+}
+
+/*
+ * ws_deflate_negotiate - pick the first offer in a Sec-WebSocket-Extensions
+ * header we can take, with windows small enough for both streams to fit in
+ * memory bytes.  The client's window can only be limited if it said so.
+ */
+bool
+ws_deflate_negotiate(const char *offers, bool context_takeover, size_t memory, ws_deflate_params_t *params)
+{
+	char buf[BUFSIZE], *offer, *save = NULL;
+	struct offer o;
+	int k;
+
+	rb_strlcpy(buf, offers, sizeof buf);
+
+	for (offer = strtok_r(buf, ",", &save); offer != NULL; offer = strtok_r(NULL, ",", &save))
+	{
+		if (!parse_offer(offer, &o))
+			continue;
+
+		if (o.server_max_window_bits >= 0 && o.server_max_window_bits < MIN_SERVER_WINDOW_BITS)
+			continue;
+
+		for (k = 0; 15 - k >= MIN_SERVER_WINDOW_BITS; k++)
+		{
+			params->server_max_window_bits = 15 - k;
+			params->mem_level = 8 - k > 1 ? 8 - k : 1;
+			params->client_max_window_bits = o.client_max_window_bits >= 0 ? 15 - k : 15;
+
+			if (o.server_max_window_bits > 0 && params->server_max_window_bits > o.server_max_window_bits)
+				params->server_max_window_bits = o.server_max_window_bits;
+			if (o.client_max_window_bits > 0 && params->client_max_window_bits > o.client_max_window_bits)
+				params->client_max_window_bits = o.client_max_window_bits;
+
+			if (ws_deflate_memory(params) > memory)
+				continue;
+
+			params->server_no_context_takeover = o.server_no_context_takeover || !context_takeover;
+			params->client_no_context_takeover = o.client_no_context_takeover || !context_takeover;
+			/* a smaller window of ours needs no mention unless asked */
+			params->send_server_max_window_bits = o.server_max_window_bits > 0;
+			params->send_client_max_window_bits = params->client_max_window_bits < 15;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* the Sec-WebSocket-Extensions value accepting it */
+size_t
+ws_deflate_response(const ws_deflate_params_t *params, char *buf, size_t len)
+{
+	size_t used = rb_strlcpy(buf, "permessage-deflate", len);
+
+	if (params->server_no_context_takeover)
+		used = rb_strlcat(buf, "; server_no_context_takeover", len);
+	if (params->client_no_context_takeover)
+		used = rb_strlcat(buf, "; client_no_context_takeover", len);
+	if (params->send_server_max_window_bits)
+		used += snprintf(buf + used, len > used ? len - used : 0,
+			"; server_max_window_bits=%d", params->server_max_window_bits);
+	if (params->send_client_max_window_bits)
+		used += snprintf(buf + used, len > used ? len - used : 0,
+			"; client_max_window_bits=%d", params->client_max_window_bits);
+
+	return used;
+}
+
+#ifdef HAVE_LIBZ
+struct ws_deflate
+{
+	z_stream outstream;
+	z_stream instream;
+	bool reset_out;
+	size_t inflated;		/* so far of the message coming in */
+};
+
+ws_deflate_t *
+ws_deflate_new(const ws_deflate_params_t *params)
+{
+	ws_deflate_t *z = rb_malloc(sizeof(ws_deflate_t));
+
+	/* negative window sizes give raw deflate streams, no zlib header */
+	if (deflateInit2(&z->outstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+			-params->server_max_window_bits, params->mem_level, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		rb_free(z);
+		return NULL;
+	}
+
+	if (inflateInit2(&z->instream, -params->client_max_window_bits) != Z_OK)
+	{
+		deflateEnd(&z->outstream);
+		rb_free(z);
+		return NULL;
+	}
+
+	z->reset_out = params->server_no_context_takeover;
+	return z;
+}
+
+void
+ws_deflate_free(ws_deflate_t *z)
+{
+	if (z == NULL)
+		return;
+
+	deflateEnd(&z->outstream);
+	inflateEnd(&z->instream);
+	rb_free(z);
+}
+
+/*
+ * ws_deflate_message - compress a whole message into out, returns its
+ * length or -1 if it doesn't fit or zlib fails.
+ */
+int
+ws_deflate_message(ws_deflate_t *z, const void *in, size_t len, void *out, size_t outlen)
+{
+	static const uint8_t sync_tail[4] = { 0x00, 0x00, 0xff, 0xff };
+	size_t have;
+	int ret;
+
+	z->outstream.next_in = (Bytef *) in;
+	z->outstream.avail_in = len;
+	z->outstream.next_out = out;
+	z->outstream.avail_out = outlen;
+
+	ret = deflate(&z->outstream, Z_SYNC_FLUSH);
+	if (ret != Z_OK || z->outstream.avail_in != 0 || z->outstream.avail_out == 0)
+		return -1;
+
+	/* the empty block Z_SYNC_FLUSH ends with is left off, the client
+	 * puts it back */
+	have = outlen - z->outstream.avail_out;
+	if (have < sizeof sync_tail || memcmp((uint8_t *) out + have - sizeof sync_tail, sync_tail, sizeof sync_tail))
+		return -1;
+	have -= sizeof sync_tail;
+
+	if (z->reset_out)
+		deflateReset(&z->outstream);
+
+	return have;
+}
+
+static int
+inflate_some(ws_deflate_t *z, const void *in, size_t len, ws_inflate_cb *cb, void *data)
+{
+	uint8_t outbuf[16384];
+	size_t have;
+	int ret;
+
+	z->instream.next_in = (Bytef *) in;
+	z->instream.avail_in = len;
+
+	do
+	{
+		z->instream.next_out = outbuf;
+		z->instream.avail_out = sizeof outbuf;
+
+		ret = inflate(&z->instream, Z_SYNC_FLUSH);
+		if (ret == Z_STREAM_END)
+			/* the client may end its stream, the next message starts a new one */
+			inflateReset(&z->instream);
+		else if (ret != Z_OK && ret != Z_BUF_ERROR)
+			return -1;
+
+		have = sizeof outbuf - z->instream.avail_out;
+		z->inflated += have;
+		if (z->inflated > WS_INFLATE_MAX)
+			return -1;
+
+		if (have > 0)
+			cb(data, outbuf, have);
+		else if (ret == Z_BUF_ERROR)
+			break;
+	}
+	while (z->instream.avail_in > 0 || z->instream.avail_out == 0);
+
+	return 0;
+}
+
+/*
+ * ws_inflate_message - decompress a frame of a message from the client,
+ * passing what comes out to cb; last is set for its final frame.  Returns
+ * -1 if the data is bad or the message inflates to more than
+ * WS_INFLATE_MAX bytes.
+ */
+int
+ws_inflate_message(ws_deflate_t *z, const void *in, size_t len, bool last, ws_inflate_cb *cb, void *data)
+{
+	static const uint8_t sync_tail[4] = { 0x00, 0x00, 0xff, 0xff };
+	int ret;
+
+	if (len > 0 && inflate_some(z, in, len, cb, data) < 0)
+		return -1;
+
+	if (!last)
+		return 0;
+
+	ret = inflate_some(z, sync_tail, sizeof sync_tail, cb, data);
+	z->inflated = 0;
+	return ret;
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+ *  deflate.h: permessage-deflate (RFC 7692) for wsockd
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef WS_DEFLATE_H
+#define WS_DEFLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* most a compressed message from a client may inflate to */
+#define WS_INFLATE_MAX 65536
+
+/* what we agreed on with the client */
+typedef struct {
+	bool server_no_context_takeover;
+	bool client_no_context_takeover;
+	int server_max_window_bits;	/* our deflate window */
+	int client_max_window_bits;	/* theirs, and our inflate window */
+	int mem_level;
+	bool send_server_max_window_bits;
+	bool send_client_max_window_bits;
+} ws_deflate_params_t;
+
+bool ws_deflate_negotiate(const char *offers, bool context_takeover, size_t memory, ws_deflate_params_t *params);
+size_t ws_deflate_response(const ws_deflate_params_t *params, char *buf, size_t len);
+size_t ws_deflate_memory(const ws_deflate_params_t *params);
+
+#ifdef HAVE_LIBZ
+typedef struct ws_deflate ws_deflate_t;
+typedef void ws_inflate_cb(void *data, const void *buf, size_t len);
+
+ws_deflate_t *ws_deflate_new(const ws_deflate_params_t *params);
+void ws_deflate_free(ws_deflate_t *z);
+int ws_deflate_message(ws_deflate_t *z, const void *in, size_t len, void *out, size_t outlen);
+int ws_inflate_message(ws_deflate_t *z, const void *in, size_t len, bool last, ws_inflate_cb *cb, void *data);
+#endif
+
+#endif
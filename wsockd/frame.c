@@ -0,0 +1,144 @@
+/*
+ *  frame.c: websocket framing for wsockd
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "frame.h"
+
+/*
+ * ws_frame_unmask - XOR a frame's payload with its masking key in place.
+ * The key is repeated over a 16 byte block, which is applied a vector
+ * (or two words) at a time; since the block length is a multiple of the
+ * key length, the bytes left over start at key offset 0 again.
+ */
+void
+ws_frame_unmask(void *msg, size_t length, const uint8_t maskval[WEBSOCKET_MASK_LENGTH])
+{
+	uint8_t *p = msg;
+	uint8_t pattern[16];
+	size_t i = 0;
+
+	for (i = 0; i < sizeof pattern; i++)
+		pattern[i] = maskval[i % WEBSOCKET_MASK_LENGTH];
+	i = 0;
+
+#if defined(__SSE2__)
+	{
+		const __m128i mask = _mm_loadu_si128((const __m128i *) pattern);
+
+		for (; i + 16 <= length; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+			_mm_storeu_si128((__m128i *) (p + i), _mm_xor_si128(v, mask));
+		}
+	}
+#endif
+
+	{
+		uint64_t mask, v;
+
+		memcpy(&mask, pattern, sizeof mask);
+		for (; i + 8 <= length; i += 8)
+		{
+			memcpy(&v, p + i, sizeof v);
+			v ^= mask;
+			memcpy(p + i, &v, sizeof v);
+		}
+	}
+
+	for (; i < length; i++)
+		p[i] ^= maskval[i % WEBSOCKET_MASK_LENGTH];
+}
+
+void
+ws_frame_buf_reset(ws_frame_buf_t *fb)
+{
+	fb->len = 0;
+	fb->compressed = false;
+}
+
+/* ws_frame_buf_payload - where the payload starts, for filling it whole */
+uint8_t *
+ws_frame_buf_payload(ws_frame_buf_t *fb)
+{
+	return fb->buf + WEBSOCKET_FRAME_HDR_MAX;
+}
+
+/*
+ * ws_frame_buf_tail - where the next line goes, *room is how long it may
+ * be, leaving space for the CRLF after it; one more byte (for a
+ * terminating nul) may be written after that.
+ */
+char *
+ws_frame_buf_tail(ws_frame_buf_t *fb, size_t *room)
+{
+	*room = WEBSOCKET_FRAME_PAYLOAD_MAX - fb->len - 2;
+	return (char *) fb->buf + WEBSOCKET_FRAME_HDR_MAX + fb->len;
+}
+
+/*
+ * ws_frame_buf_commit_line - the line of len bytes at the tail is part
+ * of the frame now, followed by a CRLF.
+ */
+void
+ws_frame_buf_commit_line(ws_frame_buf_t *fb, size_t len)
+{
+	uint8_t *end = fb->buf + WEBSOCKET_FRAME_HDR_MAX + fb->len + len;
+
+	end[0] = '\r';
+	end[1] = '\n';
+	fb->len += len + 2;
+}
+
+/*
+ * ws_frame_buf_finish - put the header in front of the payload, returns
+ * where the frame starts and its length in *framelen.
+ */
+uint8_t *
+ws_frame_buf_finish(ws_frame_buf_t *fb, size_t *framelen)
+{
+	ws_frame_hdr_t hdr = WEBSOCKET_FRAME_HDR_INIT;
+	uint8_t *start;
+
+	ws_frame_set_opcode(&hdr, WEBSOCKET_OPCODE_TEXT_FRAME);
+	ws_frame_set_fin(&hdr, 1);
+	if (fb->compressed)
+		hdr.opcode_rsv_fin |= 0x1 << 6;
+
+	if (fb->len <= WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH)
+	{
+		start = fb->buf + WEBSOCKET_FRAME_HDR_MAX - sizeof(hdr);
+		hdr.payload_length_mask = fb->len;
+	}
+	else
+	{
+		start = fb->buf;
+		hdr.payload_length_mask = 126;
+		start[2] = (fb->len >> 8) & 0xff;
+		start[3] = fb->len & 0xff;
+	}
+
+	memcpy(start, &hdr, sizeof(hdr));
+	*framelen = fb->buf + WEBSOCKET_FRAME_HDR_MAX + fb->len - start;
+	return start;
+}
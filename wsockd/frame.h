@@ -0,0 +1,104 @@
+/*
+ *  frame.h: websocket framing for wsockd
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef WS_FRAME_H
+#define WS_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WEBSOCKET_OPCODE_TEXT_FRAME          1
+
+#define WEBSOCKET_MASK_LENGTH 4
+
+#define WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH 125
+
+/* largest header of the frames we send, they never need a 64-bit length */
+#define WEBSOCKET_FRAME_HDR_MAX 4
+
+/* payload of a frame holding lines packed together */
+#define WEBSOCKET_FRAME_PAYLOAD_MAX 8192
+
+/* what deflate may add to a payload it can't shrink */
+#define WEBSOCKET_FRAME_SLACK 64
+
+typedef struct {
+	uint8_t opcode_rsv_fin; // opcode: 4, rsv1: 1, rsv2: 1, rsv3: 1, fin: 1
+	uint8_t payload_length_mask; // payload_length: 7, mask: 1
+} ws_frame_hdr_t;
+
+#define WEBSOCKET_FRAME_HDR_INIT ((ws_frame_hdr_t) { 0, 0 })
+
+static inline void
+ws_frame_set_opcode(ws_frame_hdr_t *header, int opcode)
+{
+	header->opcode_rsv_fin &= ~0xF;
+	header->opcode_rsv_fin |= opcode & 0xF;
+}
+
+static inline void
+ws_frame_set_fin(ws_frame_hdr_t *header, int fin)
+{
+	header->opcode_rsv_fin &= ~(0x1 << 7);
+	header->opcode_rsv_fin |= (fin << 7) & (0x1 << 7);
+}
+
+static inline int
+ws_frame_get_opcode(const ws_frame_hdr_t *header)
+{
+	return header->opcode_rsv_fin & 0xF;
+}
+
+static inline int
+ws_frame_get_rsv1(const ws_frame_hdr_t *header)
+{
+	return (header->opcode_rsv_fin >> 6) & 0x1;
+}
+
+static inline int
+ws_frame_get_fin(const ws_frame_hdr_t *header)
+{
+	return (header->opcode_rsv_fin >> 7) & 0x1;
+}
+
+/*
+ * A text frame being filled with IRC lines.  The lines are read straight
+ * into the payload, after room for the header, which is put in front of
+ * it once the length is known, so the whole frame can be queued with one
+ * copy.
+ *
+ * Every line in the frame ends in CRLF, whether it holds one line or
+ * several packed together.
+ */
+typedef struct {
+	uint8_t buf[WEBSOCKET_FRAME_HDR_MAX + WEBSOCKET_FRAME_PAYLOAD_MAX + WEBSOCKET_FRAME_SLACK];
+	size_t len;		/* payload bytes so far */
+	bool compressed;	/* payload is deflated, sets RSV1 */
+} ws_frame_buf_t;
+
+void ws_frame_unmask(void *msg, size_t length, const uint8_t maskval[WEBSOCKET_MASK_LENGTH]);
+
+void ws_frame_buf_reset(ws_frame_buf_t *fb);
+uint8_t *ws_frame_buf_payload(ws_frame_buf_t *fb);
+char *ws_frame_buf_tail(ws_frame_buf_t *fb, size_t *room);
+void ws_frame_buf_commit_line(ws_frame_buf_t *fb, size_t len);
+uint8_t *ws_frame_buf_finish(ws_frame_buf_t *fb, size_t *framelen);
+
+#endif
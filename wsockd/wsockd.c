@@ -22,6 +22,8 @@
 
 #include "stdinc.h"
 #include "sha1.h"
+#include "frame.h"
+#include "deflate.h"
 
 #define MAXPASSFD 4
 #ifndef READBUF_SIZE
@@ -31,6 +33,10 @@
 #define WEBSOCKET_SERVER_KEY "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 #define WEBSOCKET_ANSWER_STRING_1 "HTTP/1.1 101 Switching Protocols\r\nAccess-Control-Allow-Origin: *\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
 #define WEBSOCKET_ANSWER_STRING_2 "\r\n\r\n"
+#define WEBSOCKET_ANSWER_EXTENSIONS "\r\nSec-WebSocket-Extensions: "
+
+/* how often the compression counters are sent to the ircd */
+#define STATS_INTERVAL 30
 
 static void setup_signals(void);
 static pid_t ppid;
@@ -50,6 +56,13 @@ uint32_to_buf(uint8_t *buf, uint32_t x)
 	return;
 }
 
+static inline void
+uint64_to_buf(uint8_t *buf, uint64_t x)
+{
+	memcpy(buf, &x, sizeof(x));
+	return;
+}
+
 typedef struct _mod_ctl_buf
 {
 	rb_dlink_node node;
@@ -71,6 +84,24 @@ typedef struct _mod_ctl
 
 static mod_ctl_t *mod_ctl;
 
+/* set by the ircd with 'C' */
+static bool deflate_enabled;
+static bool deflate_context_takeover = true;
+static uint32_t deflate_memory = 64 * 1024;
+static bool pack_lines;
+
+/* compression counters of a listener, shared by its connections */
+typedef struct _listener_stats
+{
+	rb_dlink_node node;
+	uint32_t id;
+	int refcount;
+	uint64_t plain;		/* bytes before deflate and after inflate */
+	uint64_t wire;		/* and as they went over the socket */
+} listener_stats_t;
+
+static rb_dlink_list listener_stats_list;
+
 typedef struct _conn
 {
 	rb_dlink_node node;
@@ -93,20 +124,13 @@ typedef struct _conn
 	uint8_t flags;
 
 	char client_key[37];		/* maximum 36 bytes + nul */
-} conn_t;
-
-#define WEBSOCKET_OPCODE_TEXT_FRAME          1
-
-#define WEBSOCKET_MASK_LENGTH 4
-
-#define WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH 125
-
-typedef struct {
-	uint8_t opcode_rsv_fin; // opcode: 4, rsv1: 1, rsv2: 1, rsv3: 1, fin: 1
-	uint8_t payload_length_mask; // payload_length: 7, mask: 1
-} ws_frame_hdr_t;
+	char extensions[BUFSIZE];	/* Sec-WebSocket-Extensions offered */
 
-#define WEBSOCKET_FRAME_HDR_INIT ((ws_frame_hdr_t) { 0, 0 })
+#ifdef HAVE_LIBZ
+	ws_deflate_t *deflate;		/* permessage-deflate, if agreed on */
+#endif
+	listener_stats_t *stats;
+} conn_t;
 
 typedef struct {
 	ws_frame_hdr_t header;
@@ -129,40 +153,31 @@ typedef struct {
 	uint64_t payload_length_extended;
 } ws_frame_ext2_t;
 
-static inline void
-ws_frame_set_opcode(ws_frame_hdr_t *header, int opcode)
-{
-	header->opcode_rsv_fin &= ~0xF;
-	header->opcode_rsv_fin |= opcode & 0xF;
-}
-
-static inline void
-ws_frame_set_fin(ws_frame_hdr_t *header, int fin)
-{
-	header->opcode_rsv_fin &= ~(0x1 << 7);
-	header->opcode_rsv_fin |= (fin << 7) & (0x1 << 7);
-}
-
 static void close_conn(conn_t * conn, int wait_plain, const char *fmt, ...);
 static void conn_mod_read_cb(rb_fde_t *fd, void *data);
 static void conn_plain_read_cb(rb_fde_t *fd, void *data);
 static void conn_plain_process_recvq(conn_t *conn);
+static void mod_cmd_write_queue(mod_ctl_t * ctl, const void *data, size_t len);
 
 #define FLAG_CORK	0x01
 #define FLAG_DEAD	0x02
 #define FLAG_WSOCK	0x04
 #define FLAG_KEYED	0x08
+#define FLAG_INFLATING	0x10
 
 #define IsCork(x) ((x)->flags & FLAG_CORK)
 #define IsDead(x) ((x)->flags & FLAG_DEAD)
 #define IsKeyed(x) ((x)->flags & FLAG_KEYED)
+#define IsInflating(x) ((x)->flags & FLAG_INFLATING)
 
 #define SetCork(x) ((x)->flags |= FLAG_CORK)
 #define SetDead(x) ((x)->flags |= FLAG_DEAD)
 #define SetWS(x)   ((x)->flags |= FLAG_WSOCK)
 #define SetKeyed(x) ((x)->flags |= FLAG_KEYED)
+#define SetInflating(x) ((x)->flags |= FLAG_INFLATING)
 
 #define ClearCork(x) ((x)->flags &= ~FLAG_CORK)
+#define ClearInflating(x) ((x)->flags &= ~FLAG_INFLATING)
 
 #define NO_WAIT 0x0
 #define WAIT_PLAIN 0x1
@@ -235,9 +250,69 @@ conn_add_id_hash(conn_t * conn, uint32_t id)
 	rb_dlinkAdd(conn, &conn->node, connid_hash(id));
 }
 
+static listener_stats_t *
+listener_stats_get(uint32_t id)
+{
+	listener_stats_t *stats;
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, listener_stats_list.head)
+	{
+		stats = ptr->data;
+		if (stats->id == id)
+		{
+			stats->refcount++;
+			return stats;
+		}
+	}
+
+	stats = rb_malloc(sizeof(listener_stats_t));
+	stats->id = id;
+	stats->refcount = 1;
+	rb_dlinkAdd(stats, &stats->node, &listener_stats_list);
+	return stats;
+}
+
+/* send the counters that moved since last time, and forget listeners
+ * nobody is connected through any more */
+static void
+send_listener_stats(void *unused)
+{
+	listener_stats_t *stats;
+	rb_dlink_node *ptr, *next;
+	uint8_t buf[21];
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, listener_stats_list.head)
+	{
+		stats = ptr->data;
+
+		if (stats->plain > 0 || stats->wire > 0)
+		{
+			buf[0] = 'S';
+			uint32_to_buf(&buf[1], stats->id);
+			uint64_to_buf(&buf[5], stats->plain);
+			uint64_to_buf(&buf[13], stats->wire);
+			mod_cmd_write_queue(mod_ctl, buf, sizeof(buf));
+			stats->plain = stats->wire = 0;
+		}
+
+		if (stats->refcount == 0)
+		{
+			rb_dlinkDelete(ptr, &listener_stats_list);
+			rb_free(stats);
+		}
+	}
+}
+
 static void
 free_conn(conn_t * conn)
 {
+#ifdef HAVE_LIBZ
+	ws_deflate_free(conn->deflate);
+#endif
+	if (conn->stats != NULL)
+		conn->stats->refcount--;
+
 	rb_linebuf_donebuf(&conn->plainbuf_in);
 	rb_linebuf_donebuf(&conn->plainbuf_out);
 
@@ -328,48 +403,53 @@ conn_mod_write(conn_t * conn, void *data, size_t len)
 	rb_rawbuf_append(conn->modbuf_out, data, len);
 }
 
+/* queue the frame and start a new one */
 static void
-conn_mod_write_short_frame(conn_t * conn, void *data, int len)
+conn_mod_write_frame(conn_t *conn, ws_frame_buf_t *fb)
 {
-	ws_frame_hdr_t hdr = WEBSOCKET_FRAME_HDR_INIT;
-
-	ws_frame_set_opcode(&hdr, WEBSOCKET_OPCODE_TEXT_FRAME);
-	ws_frame_set_fin(&hdr, 1);
-	hdr.payload_length_mask = (len + 2) & 0x7f;
-
-	conn_mod_write(conn, &hdr, sizeof(hdr));
-	conn_mod_write(conn, data, len);
-	conn_mod_write(conn, "\r\n", 2);
-}
+	uint8_t *frame;
+	size_t framelen;
 
-static void
-conn_mod_write_long_frame(conn_t * conn, void *data, int len)
-{
-	ws_frame_ext_t hdr = WEBSOCKET_FRAME_EXT_INIT;
+	if(IsDead(conn) || fb->len == 0)
+		return;
 
-	ws_frame_set_opcode(&hdr.header, WEBSOCKET_OPCODE_TEXT_FRAME);
-	ws_frame_set_fin(&hdr.header, 1);
-	hdr.header.payload_length_mask = 126;
-	hdr.payload_length_extended = htons(len + 2);
+#ifdef HAVE_LIBZ
+	if (conn->deflate != NULL)
+	{
+		ws_frame_buf_t zfb;
+		int zlen;
 
-	conn_mod_write(conn, &hdr, sizeof(hdr));
-	conn_mod_write(conn, data, len);
-	conn_mod_write(conn, "\r\n", 2);
-}
+		ws_frame_buf_reset(&zfb);
+		zlen = ws_deflate_message(conn->deflate, ws_frame_buf_payload(fb), fb->len,
+				ws_frame_buf_payload(&zfb), WEBSOCKET_FRAME_PAYLOAD_MAX + WEBSOCKET_FRAME_SLACK);
+		if (zlen < 0)
+		{
+			/* the stream is no good now, so the connection is closed.
+			 * close_conn() first sends what is left of the recvq,
+			 * which comes back through here: without the stream
+			 * those lines go out uncompressed, which the extension
+			 * allows, rather than failing again */
+			ws_deflate_free(conn->deflate);
+			conn->deflate = NULL;
+			close_conn(conn, WAIT_PLAIN, "websocket error: compression failed");
+			return;
+		}
 
-static void
-conn_mod_write_frame(conn_t *conn, void *data, int len)
-{
-	if(IsDead(conn))	/* no point in queueing to a dead man */
-		return;
+		conn->stats->plain += fb->len;
+		conn->stats->wire += zlen;
 
-	if (len < 123)
-	{
-		conn_mod_write_short_frame(conn, data, len);
+		zfb.len = zlen;
+		zfb.compressed = true;
+		frame = ws_frame_buf_finish(&zfb, &framelen);
+		conn_mod_write(conn, frame, framelen);
+		ws_frame_buf_reset(fb);
 		return;
 	}
+#endif
 
-	conn_mod_write_long_frame(conn, data, len);
+	frame = ws_frame_buf_finish(fb, &framelen);
+	conn_mod_write(conn, frame, framelen);
+	ws_frame_buf_reset(fb);
 }
 
 static void
@@ -486,13 +566,49 @@ cleanup_bad_message(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 		rb_close(ctlb->F[i]);
 }
 
+#ifdef HAVE_LIBZ
 static void
-ws_frame_unmask(char *msg, int length, uint8_t maskval[WEBSOCKET_MASK_LENGTH])
+conn_mod_inflate_cb(void *data, const void *buf, size_t len)
 {
-	int i;
+	conn_t *conn = data;
+
+	conn->stats->plain += len;
+	rb_linebuf_parse(&conn->plainbuf_out, (char *) buf, len, 1);
+}
+#endif
+
+/* hand a frame's payload on to the ircd, inflating it first if it is
+ * part of a compressed message */
+static void
+conn_mod_deliver(conn_t *conn, ws_frame_hdr_t *hdr, char *msg, int len)
+{
+	bool compressed = ws_frame_get_rsv1(hdr) ||
+		(ws_frame_get_opcode(hdr) == 0 && IsInflating(conn));
+
+	if (!compressed)
+	{
+		rb_linebuf_parse(&conn->plainbuf_out, msg, len, 1);
+		return;
+	}
+
+#ifdef HAVE_LIBZ
+	if (conn->deflate != NULL)
+	{
+		bool fin = ws_frame_get_fin(hdr);
 
-	for (i = 0; i < length; i++)
-		msg[i] = msg[i] ^ maskval[i % 4];
+		if (fin)
+			ClearInflating(conn);
+		else
+			SetInflating(conn);
+
+		conn->stats->wire += len;
+		if (ws_inflate_message(conn->deflate, msg, len, fin, conn_mod_inflate_cb, conn) < 0)
+			close_conn(conn, WAIT_PLAIN, "websocket error: bad compressed message");
+		return;
+	}
+#endif
+
+	close_conn(conn, WAIT_PLAIN, "websocket error: compressed frame without permessage-deflate");
 }
 
 static void
@@ -523,7 +639,7 @@ conn_mod_process_frame(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
 	if (masked)
 		ws_frame_unmask(msg, dolen, maskval);
 
-	rb_linebuf_parse(&conn->plainbuf_out, msg, dolen, 1);
+	conn_mod_deliver(conn, hdr, msg, dolen);
 }
 
 static void
@@ -534,8 +650,6 @@ conn_mod_process_large(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
 	uint8_t maskval[WEBSOCKET_MASK_LENGTH];
 	int dolen;
 
-	memset(msg, 0, sizeof msg);
-
 	dolen = rb_rawbuf_get(conn->modbuf_in, &msglen, sizeof(msglen));
 	if (!dolen)
 	{
@@ -544,6 +658,11 @@ conn_mod_process_large(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
 	}
 
 	msglen = ntohs(msglen);
+	if (msglen > sizeof msg)
+	{
+		close_conn(conn, WAIT_PLAIN, "websocket error: message too large");
+		return;
+	}
 
 	if (masked)
 	{
@@ -565,7 +684,7 @@ conn_mod_process_large(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
 	if (masked)
 		ws_frame_unmask(msg, dolen, maskval);
 
-	rb_linebuf_parse(&conn->plainbuf_out, msg, dolen, 1);
+	conn_mod_deliver(conn, hdr, msg, dolen);
 }
 
 static void
@@ -606,6 +725,53 @@ conn_mod_process(conn_t *conn)
 	conn_plain_write_sendq(conn->plain_fd, conn);
 }
 
+/* copy out a header's value, start is just past its name */
+static void
+handshake_header_value(char *inbuf, char *start, char *value, size_t len)
+{
+	char *end;
+
+	for (; start < (inbuf + READBUF_SIZE) && *start; start++)
+	{
+		if (*start != ' ' && *start != '\t')
+			break;
+	}
+
+	for (end = start; end < (inbuf + READBUF_SIZE) && *end; end++)
+	{
+		if (*end == '\r' || *end == '\n')
+		{
+			*end = '\0';
+			break;
+		}
+	}
+
+	rb_strlcpy(value, start, len);
+}
+
+/* agree on permessage-deflate if the client offered it and we may */
+static bool
+conn_deflate_negotiate(conn_t *conn, char *response, size_t len)
+{
+#ifdef HAVE_LIBZ
+	ws_deflate_params_t params;
+
+	if (!deflate_enabled || conn->extensions[0] == '\0')
+		return false;
+
+	if (!ws_deflate_negotiate(conn->extensions, deflate_context_takeover, deflate_memory, &params))
+		return false;
+
+	if ((conn->deflate = ws_deflate_new(&params)) == NULL)
+		return false;
+
+	ws_deflate_response(&params, response, len);
+	return true;
+#else
+	return false;
+#endif
+}
+
 static void
 conn_mod_handshake_process(conn_t *conn)
 {
@@ -621,28 +787,14 @@ conn_mod_handshake_process(conn_t *conn)
 		if (!dolen)
 			break;
 
+		if ((p = rb_strcasestr(inbuf, "Sec-WebSocket-Extensions:")) != NULL)
+			handshake_header_value(inbuf, p + strlen("Sec-WebSocket-Extensions:"),
+				conn->extensions, sizeof(conn->extensions));
+
 		if ((p = rb_strcasestr(inbuf, "Sec-WebSocket-Key:")) != NULL)
 		{
-			char *start, *end;
-
-			start = p + strlen("Sec-WebSocket-Key:");
-
-			for (; start < (inbuf + READBUF_SIZE) && *start; start++)
-			{
-				if (*start != ' ' && *start != '\t')
-					break;
-			}
-
-			for (end = start; end < (inbuf + READBUF_SIZE) && *end; end++)
-			{
-				if (*end == '\r' || *end == '\n')
-				{
-					*end = '\0';
-					break;
-				}
-			}
-
-			rb_strlcpy(conn->client_key, start, sizeof(conn->client_key));
+			handshake_header_value(inbuf, p + strlen("Sec-WebSocket-Key:"),
+				conn->client_key, sizeof(conn->client_key));
 			SetKeyed(conn);
 		}
 	}
@@ -651,6 +803,7 @@ conn_mod_handshake_process(conn_t *conn)
 	{
 		SHA1 sha1;
 		uint8_t digest[SHA1_DIGEST_LENGTH];
+		char extensions[BUFSIZE];
 		char *resp;
 
 		sha1_init(&sha1);
@@ -662,6 +815,11 @@ conn_mod_handshake_process(conn_t *conn)
 
 		conn_mod_write(conn, WEBSOCKET_ANSWER_STRING_1, strlen(WEBSOCKET_ANSWER_STRING_1));
 		conn_mod_write(conn, resp, strlen(resp));
+		if (conn_deflate_negotiate(conn, extensions, sizeof(extensions)))
+		{
+			conn_mod_write(conn, WEBSOCKET_ANSWER_EXTENSIONS, strlen(WEBSOCKET_ANSWER_EXTENSIONS));
+			conn_mod_write(conn, extensions, strlen(extensions));
+		}
 		conn_mod_write(conn, WEBSOCKET_ANSWER_STRING_2, strlen(WEBSOCKET_ANSWER_STRING_2));
 
 		rb_free(resp);
@@ -742,22 +900,41 @@ plain_check_cork(conn_t * conn)
 	return false;
 }
 
+/* room needed to be sure the next line isn't cut short */
+#define WEBSOCKET_LINE_ROOM (LINEBUF_SIZE + CRLF_LEN)
+
 static void
 conn_plain_process_recvq(conn_t *conn)
 {
-	char inbuf[READBUF_SIZE];
+	ws_frame_buf_t fb;
+	char *tail;
+	size_t room;
 
-	memset(inbuf, 0, sizeof inbuf);
+	ws_frame_buf_reset(&fb);
 
 	while (1)
 	{
-		int dolen = rb_linebuf_get(&conn->plainbuf_in, inbuf, sizeof inbuf, LINEBUF_COMPLETE, LINEBUF_PARSED);
+		tail = ws_frame_buf_tail(&fb, &room);
+		if (room < WEBSOCKET_LINE_ROOM)
+		{
+			conn_mod_write_frame(conn, &fb);
+			tail = ws_frame_buf_tail(&fb, &room);
+		}
+
+		int dolen = rb_linebuf_get(&conn->plainbuf_in, tail, room, LINEBUF_COMPLETE, LINEBUF_PARSED);
 		if (!dolen)
 			break;
 
-		conn_mod_write_frame(conn, inbuf, dolen);
+		ws_frame_buf_commit_line(&fb, dolen);
+
+		/* with wsock_pack_lines, the lines are packed into as few
+		 * frames as they fit in, for clients that split frames on CRLF */
+		if (!pack_lines)
+			conn_mod_write_frame(conn, &fb);
 	}
 
+	conn_mod_write_frame(conn, &fb);
+
 	if (IsKeyed(conn))
 		conn_mod_write_sendq(conn->mod_fd, conn);
 }
@@ -850,6 +1027,7 @@ wsock_process(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 
 	id = buf_to_uint32(&ctlb->buf[1]);
 	conn_add_id_hash(conn, id);
+	conn->stats = listener_stats_get(buf_to_uint32(&ctlb->buf[5]));
 	SetWS(conn);
 
 	if(rb_get_type(conn->mod_fd) & RB_FD_UNKNOWN)
@@ -876,7 +1054,7 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 		{
 		case 'A':
 			{
-				if (ctl_buf->nfds != 2 || ctl_buf->buflen != 5)
+				if (ctl_buf->nfds != 2 || ctl_buf->buflen != 9)
 				{
 					cleanup_bad_message(ctl, ctl_buf);
 					break;
@@ -884,6 +1062,19 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 				wsock_process(ctl, ctl_buf);
 				break;
 			}
+		case 'C':
+			{
+				if (ctl_buf->buflen != 8)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+				deflate_enabled = ctl_buf->buf[1];
+				deflate_context_takeover = ctl_buf->buf[2];
+				deflate_memory = buf_to_uint32(&ctl_buf->buf[3]);
+				pack_lines = ctl_buf->buf[7];
+				break;
+			}
 		default:
 			break;
 			/* Log unknown commands */
@@ -1003,6 +1194,7 @@ main(int argc, char **argv)
 	rb_set_nb(mod_ctl->F);
 	rb_set_nb(mod_ctl->F_pipe);
 	rb_event_addish("clean_dead_conns", clean_dead_conns, NULL, 10);
+	rb_event_addish("send_listener_stats", send_listener_stats, NULL, STATS_INTERVAL);
 	read_pipe_ctl(mod_ctl->F_pipe, NULL);
 	mod_read_ctl(mod_ctl->F, mod_ctl);
 